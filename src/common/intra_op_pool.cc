@@ -0,0 +1,165 @@
+#include "common/intra_op_pool.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace my_ai_training {
+
+namespace {
+
+// loops of any IntraOpPool the calling thread is running a range of
+thread_local int loop_depth = 0;
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// best effort: a CPU outside the process' affinity mask is ignored
+void PinThread(std::thread& thread, int cpu) {
+#if defined(__linux__)
+  if (cpu < 0 || cpu >= CPU_SETSIZE) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+  (void)thread;
+  (void)cpu;
+#endif
+}
+
+}  // namespace
+
+IntraOpPool::IntraOpPool(IntraOpPoolOptions options)
+    : spin_rounds_(std::max(0, options.spin_rounds)) {
+  int num_threads = options.num_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  workers_.reserve(num_threads - 1);
+  for (int i = 0; i + 1 < num_threads; i++) {
+    workers_.emplace_back([this, i]() { workerLoop(i); });
+    if (!options.cpus.empty()) {
+      PinThread(workers_.back(), options.cpus[i % options.cpus.size()]);
+    }
+  }
+}
+
+IntraOpPool::~IntraOpPool() {
+  stop_.store(true, std::memory_order_relaxed);
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  {
+    std::lock_guard<std::mutex> guard(park_mutex_);
+    park_cv_.notify_all();
+  }
+  for (auto& worker : workers_) worker.join();
+}
+
+void IntraOpPool::run(size_t n, Schedule schedule, size_t grain,
+                      int max_threads, Body body, void* fn) {
+  if (n == 0) return;
+  grain = std::max<size_t>(grain, 1);
+  if (workers_.empty() || n <= grain || max_threads == 1 || loop_depth > 0) {
+    body(fn, 0, n);
+    return;
+  }
+  std::unique_lock<std::mutex> loop(loop_mutex_, std::try_to_lock);
+  if (!loop.owns_lock()) {
+    body(fn, 0, n);
+    return;
+  }
+  body_ = body;
+  fn_ = fn;
+  n_ = n;
+  grain_ = grain;
+  schedule_ = schedule;
+  threads_ = workers_.size() + 1;
+  if (max_threads > 0) {
+    threads_ = std::min(threads_, static_cast<size_t>(max_threads));
+  }
+  next_.store(0, std::memory_order_relaxed);
+  active_.store(static_cast<int>(workers_.size()), std::memory_order_relaxed);
+  // publishes the loop; pairs with the increment of num_parked_ before a
+  // worker's last look at epoch_, so either it sees this loop or this sees
+  // it parked
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  if (num_parked_.load(std::memory_order_seq_cst) > 0) {
+    std::lock_guard<std::mutex> guard(park_mutex_);
+    park_cv_.notify_all();
+  }
+  runShare(0);
+  for (int round = 0; active_.load(std::memory_order_acquire) != 0;
+       round++) {
+    if (round < spin_rounds_) {
+      CpuRelax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  std::exception_ptr error = std::move(error_);
+  error_ = nullptr;
+  if (error) std::rethrow_exception(error);
+}
+
+void IntraOpPool::runShare(int index) {
+  // the workers past the cap only report back
+  if (static_cast<size_t>(index) >= threads_) return;
+  loop_depth++;
+  try {
+    if (schedule_ == Schedule::kStatic) {
+      // whole grains per thread, so no range is cut below 'grain'
+      size_t grains = (n_ + grain_ - 1) / grain_;
+      size_t threads = threads_;
+      size_t begin = grains * index / threads * grain_;
+      size_t end = std::min(n_, grains * (index + 1) / threads * grain_);
+      if (begin < end) body_(fn_, begin, end);
+    } else {
+      for (;;) {
+        size_t begin = next_.fetch_add(grain_, std::memory_order_relaxed);
+        if (begin >= n_) break;
+        body_(fn_, begin, std::min(n_, begin + grain_));
+      }
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> guard(error_mutex_);
+    if (!error_) error_ = std::current_exception();
+  }
+  loop_depth--;
+}
+
+void IntraOpPool::workerLoop(int index) {
+  uint64_t seen = 0;
+  for (;;) {
+    uint64_t epoch = epoch_.load(std::memory_order_acquire);
+    for (int round = 0; epoch == seen; round++) {
+      if (round < spin_rounds_) {
+        CpuRelax();
+      } else {
+        std::unique_lock<std::mutex> lock(park_mutex_);
+        num_parked_.fetch_add(1, std::memory_order_seq_cst);
+        park_cv_.wait(lock, [this, seen]() {
+          return epoch_.load(std::memory_order_seq_cst) != seen;
+        });
+        num_parked_.fetch_sub(1, std::memory_order_relaxed);
+        round = 0;
+      }
+      epoch = epoch_.load(std::memory_order_acquire);
+    }
+    seen = epoch;
+    if (stop_.load(std::memory_order_relaxed)) return;
+    runShare(index + 1);
+    active_.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+}  // namespace my_ai_training
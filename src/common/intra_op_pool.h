@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace my_ai_training {
+
+struct IntraOpPoolOptions {
+  // threads running a loop, the caller included; <= 0 uses
+  // std::thread::hardware_concurrency()
+  int num_threads = 0;
+  // CPUs to pin worker i to, cpus[i % cpus.size()]; the caller's thread is
+  // left as it is. Empty leaves placement to the OS. Ignored on platforms
+  // without thread affinity.
+  std::vector<int> cpus;
+  // rounds a worker polls for the next loop before it parks
+  int spin_rounds = 4096;
+};
+
+// Persistent threads for the loops inside one kernel, e.g. over the
+// channels of a Mat, without an OpenMP runtime. A loop wakes the workers
+// by bumping a counter they poll for a while after the last loop, so back
+// to back loops of one kernel cost no syscalls; then they park on a
+// condition variable until the next one.
+//
+// One loop runs at a time. A loop started while another one runs, from a
+// worker of the pool or from another thread, e.g. a kernel running in
+// parallel on a WorkStealingPool, runs on its calling thread alone, so the
+// pools never oversubscribe the cores.
+class IntraOpPool {
+ public:
+  enum class Schedule {
+    // the range split in one block per thread
+    kStatic,
+    // chunks of 'grain' indices handed out in order, for uneven work
+    kDynamic,
+  };
+
+  explicit IntraOpPool(IntraOpPoolOptions options = IntraOpPoolOptions());
+  ~IntraOpPool();
+
+  IntraOpPool(const IntraOpPool&) = delete;
+  IntraOpPool& operator=(const IntraOpPool&) = delete;
+
+  int numThreads() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // Calls fn(begin, end) on disjoint ranges covering [0, n), of at least
+  // 'grain' indices each but the last, and returns once all calls
+  // finished. The first exception fn throws is rethrown here after the
+  // others finished. 'max_threads' > 0 caps the threads the ranges run on,
+  // for loops too small to pay for all of them.
+  template <typename F>
+  void parallelFor(size_t n, F&& fn, Schedule schedule = Schedule::kStatic,
+                   size_t grain = 1, int max_threads = 0) {
+    using Fn = std::remove_reference_t<F>;
+    run(n, schedule, grain, max_threads,
+        [](void* f, size_t begin, size_t end) {
+          (*static_cast<Fn*>(f))(begin, end);
+        },
+        const_cast<void*>(static_cast<const void*>(&fn)));
+  }
+
+ private:
+  using Body = void (*)(void* fn, size_t begin, size_t end);
+
+  void run(size_t n, Schedule schedule, size_t grain, int max_threads,
+           Body body, void* fn);
+  void workerLoop(int index);
+  // runs the ranges of thread 'index' of the current loop
+  void runShare(int index);
+
+  std::vector<std::thread> workers_;
+  int spin_rounds_;
+
+  // held by the caller of the running loop
+  std::mutex loop_mutex_;
+  // the running loop
+  Body body_ = nullptr;
+  void* fn_ = nullptr;
+  size_t n_ = 0;
+  size_t grain_ = 1;
+  Schedule schedule_ = Schedule::kStatic;
+  // threads taking part, the caller and workers 1 to threads_ - 1
+  size_t threads_ = 1;
+  std::atomic<size_t> next_{0};
+  // bumped to start a loop, and to stop
+  std::atomic<uint64_t> epoch_{0};
+  // workers still in the current loop
+  std::atomic<int> active_{0};
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+
+  std::mutex park_mutex_;
+  std::condition_variable park_cv_;
+  std::atomic<int> num_parked_{0};
+  std::atomic<bool> stop_{false};
+};
+
+}  // namespace my_ai_training
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace my_ai_training {
+
+// Fixed-size pool of worker threads.
+class ThreadPool {
+ public:
+  // num_threads <= 0 uses std::thread::hardware_concurrency()
+  explicit ThreadPool(int num_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int numThreads() const { return static_cast<int>(workers_.size()); }
+
+  // Run 'task' on some worker, tasks must not throw.
+  void schedule(std::function<void()> task);
+
+  // Call fn(i) for every i in [0, n) on the workers and the calling thread,
+  // and return once all calls have finished. Indices are handed out one at
+  // a time, so callers should pass chunks rather than single elements.
+  //
+  // Nesting is safe: the calling thread keeps claiming indices itself, so it
+  // never waits for an index that no thread is working on. The first
+  // exception thrown by fn is rethrown here after all calls finished.
+  void parallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+ private:
+  void workerLoop();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> tasks_;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace my_ai_training
@@ -0,0 +1,128 @@
+#include "common/work_stealing_pool.h"
+
+#include <algorithm>
+
+namespace my_ai_training {
+
+namespace {
+
+// the pool and index of the worker running on this thread
+thread_local const WorkStealingPool* current_pool = nullptr;
+thread_local int current_index = -1;
+
+// rounds of looking for a task before an idle worker goes to sleep
+constexpr int kSpinRounds = 64;
+
+}  // namespace
+
+WorkStealingPool::WorkStealingPool(int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  workers_.reserve(num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  // every deque exists before a worker may steal from it
+  for (int i = 0; i < num_threads; i++) {
+    workers_[i]->thread = std::thread([this, i]() { workerLoop(i); });
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& worker : workers_) worker->thread.join();
+}
+
+int WorkStealingPool::currentWorker() const {
+  return current_pool == this ? current_index : -1;
+}
+
+void WorkStealingPool::spawn(Task* task) {
+  int index = currentWorker();
+  if (index >= 0) {
+    workers_[index]->deque.push(task);
+  } else {
+    std::lock_guard<std::mutex> guard(mutex_);
+    injected_.push_back(task);
+    num_injected_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // pairs with the increment of num_sleeping_ before a worker's last look
+  // for tasks: either it sees this task, or this sees it sleeping
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (num_sleeping_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    cv_.notify_one();
+  }
+}
+
+bool WorkStealingPool::tryRunOne() {
+  Task* task = findTask(currentWorker());
+  if (task == nullptr) return false;
+  task->run();
+  return true;
+}
+
+WorkStealingPool::Task* WorkStealingPool::findTask(int index) {
+  Task* task = nullptr;
+  if (index >= 0 && workers_[index]->deque.pop(&task)) return task;
+  if (num_injected_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!injected_.empty()) {
+      task = injected_.front();
+      injected_.pop_front();
+      num_injected_.fetch_sub(1, std::memory_order_relaxed);
+      return task;
+    }
+  }
+  // start with the next worker, so thieves spread over the victims
+  size_t n = workers_.size();
+  size_t start = index >= 0 ? index + 1 : 0;
+  for (size_t k = 0; k < n; k++) {
+    size_t victim = (start + k) % n;
+    if (static_cast<int>(victim) == index) continue;
+    if (workers_[victim]->deque.steal(&task)) return task;
+  }
+  return nullptr;
+}
+
+// called with mutex_ held
+bool WorkStealingPool::hasQueuedTasks() {
+  if (!injected_.empty()) return true;
+  return std::any_of(workers_.begin(), workers_.end(),
+                     [](const auto& w) { return !w->deque.empty(); });
+}
+
+void WorkStealingPool::workerLoop(int index) {
+  current_pool = this;
+  current_index = index;
+  for (;;) {
+    Task* task = nullptr;
+    for (int round = 0; round < kSpinRounds && task == nullptr; round++) {
+      task = findTask(index);
+      if (task == nullptr) std::this_thread::yield();
+    }
+    if (task != nullptr) {
+      task->run();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_sleeping_.fetch_add(1, std::memory_order_seq_cst);
+    bool stop = false;
+    if (!hasQueuedTasks()) {
+      if (stop_) {
+        stop = true;
+      } else {
+        cv_.wait(lock);
+      }
+    }
+    num_sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    if (stop) return;
+  }
+}
+
+}  // namespace my_ai_training
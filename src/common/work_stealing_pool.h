@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace my_ai_training {
+
+// The work-stealing deque of Chase and Lev, with the memory orders of Lê et
+// al., "Correct and Efficient Work-Stealing for Weak Memory Models". Its
+// owner pushes and pops at the bottom without contention; other threads
+// steal from the top, and only a steal racing for the last item costs a
+// compare-and-swap. T must be trivially copyable, e.g. a pointer.
+template <typename T>
+class ChaseLevDeque {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "ChaseLevDeque holds trivially copyable items");
+
+ public:
+  // 'capacity' is rounded up to a power of two; the deque grows as needed
+  explicit ChaseLevDeque(size_t capacity = 64) {
+    size_t n = 1;
+    while (n < capacity) n *= 2;
+    arrays_.push_back(std::make_unique<Array>(n));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+
+  ChaseLevDeque(const ChaseLevDeque&) = delete;
+  ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+  // owner only
+  void push(T item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    Array* a = array_.load(std::memory_order_relaxed);
+    if (b - t > static_cast<int64_t>(a->mask)) a = grow(a, t, b);
+    a->put(b, item);
+    // publishes the item like the paper's release fence does, in a way
+    // ThreadSanitizer understands
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  // owner only; the item pushed last, false if empty
+  bool pop(T* item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    *item = a->get(b);
+    if (t == b) {
+      // the last item: race the thieves for it
+      bool won = top_.compare_exchange_strong(t, t + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed);
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // any thread; the oldest item, false if empty or another thread took it
+  bool steal(T* item) {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return false;
+    // consume in the paper; acquire is what compilers implement it as
+    Array* a = array_.load(std::memory_order_acquire);
+    T x = a->get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return false;
+    }
+    *item = x;
+    return true;
+  }
+
+  // may be stale by the time it returns
+  bool empty() const {
+    return bottom_.load(std::memory_order_relaxed) <=
+           top_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Array {
+    explicit Array(size_t capacity)
+        : mask(capacity - 1), items(new std::atomic<T>[capacity]) {}
+
+    T get(int64_t i) const {
+      return items[static_cast<size_t>(i) & mask].load(
+          std::memory_order_relaxed);
+    }
+    void put(int64_t i, T x) {
+      items[static_cast<size_t>(i) & mask].store(x,
+                                                 std::memory_order_relaxed);
+    }
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<T>[]> items;
+  };
+
+  Array* grow(Array* a, int64_t t, int64_t b) {
+    auto bigger = std::make_unique<Array>(2 * (a->mask + 1));
+    for (int64_t i = t; i < b; i++) bigger->put(i, a->get(i));
+    Array* result = bigger.get();
+    // thieves may still read the old array, so it lives as long as the deque
+    arrays_.push_back(std::move(bigger));
+    array_.store(result, std::memory_order_release);
+    return result;
+  }
+
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Array*> array_;
+  // owner only
+  std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+// Worker threads that each run tasks from a deque of their own and steal
+// from the others when it runs dry. A task spawning more work pushes it on
+// its worker's deque, where the worker picks it up next, with its inputs
+// still in cache, unless an idle worker steals it first. Idle workers spin
+// briefly, then sleep until a task is spawned.
+//
+// Tasks are not owned by the pool; dataflow executors keep one per node.
+class WorkStealingPool {
+ public:
+  class Task {
+   public:
+    virtual void run() = 0;
+
+   protected:
+    ~Task() = default;
+  };
+
+  // num_threads <= 0 uses std::thread::hardware_concurrency()
+  explicit WorkStealingPool(int num_threads = 0);
+  // runs the tasks still queued, then joins the workers
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  int numThreads() const { return static_cast<int>(workers_.size()); }
+
+  // Queues 'task', which must stay alive until it ran and must not throw:
+  // on the deque of the calling worker, or from any other thread on a
+  // queue shared by all workers.
+  void spawn(Task* task);
+
+  // Runs one queued task on the calling thread, false if there was none,
+  // so a worker waiting for other tasks can help instead of blocking.
+  bool tryRunOne();
+
+  // the index of the calling thread among this pool's workers, or -1
+  int currentWorker() const;
+
+ private:
+  struct Worker {
+    ChaseLevDeque<Task*> deque;
+    std::thread thread;
+  };
+
+  void workerLoop(int index);
+  // the worker's own deque, then the shared queue, then the other workers
+  Task* findTask(int index);
+  bool hasQueuedTasks();
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  // tasks spawned by other threads
+  std::deque<Task*> injected_;
+  std::atomic<size_t> num_injected_{0};
+  std::atomic<int> num_sleeping_{0};
+  bool stop_ = false;
+};
+
+}  // namespace my_ai_training
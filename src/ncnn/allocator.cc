@@ -0,0 +1,186 @@
+#include "ncnn/allocator.h"
+
+#include <stdio.h>
+
+#include <list>
+#include <mutex>
+#include <utility>
+
+namespace ncnn {
+
+Allocator::~Allocator() {}
+
+namespace {
+
+// The buffers of a pool allocator: budgets are free for reuse, payouts are
+// handed out. Not locked; PoolAllocator locks around it.
+class PoolBuffers {
+ public:
+  ~PoolBuffers() {
+    clear();
+    if (!payouts_.empty()) {
+      fprintf(stderr, "FATAL ERROR! pool allocator destroyed too early\n");
+      for (const auto& payout : payouts_) {
+        fprintf(stderr, "%p still in use\n", payout.second);
+      }
+    }
+  }
+
+  // ratio range 0 ~ 1
+  void set_size_compare_ratio(float scr) {
+    if (scr < 0.f || scr > 1.f) {
+      fprintf(stderr, "invalid size compare ratio %f\n", scr);
+      return;
+    }
+    size_compare_ratio_ = (unsigned int)(scr * 256);
+  }
+
+  void set_size_drop_threshold(size_t threshold) {
+    size_drop_threshold_ = threshold;
+  }
+
+  void clear() {
+    for (const auto& budget : budgets_) ncnn::fastFree(budget.second);
+    budgets_.clear();
+  }
+
+  // a budget of at least 'size' bytes and not much more, or null after
+  // dropping a budget unlikely to fit later queries once the pool is full
+  void* take(size_t size) {
+    auto it_max = budgets_.begin();
+    auto it_min = budgets_.begin();
+    for (auto it = budgets_.begin(); it != budgets_.end(); ++it) {
+      size_t bs = it->first;
+      if (bs >= size && ((bs * size_compare_ratio_) >> 8) <= size) {
+        void* ptr = it->second;
+        payouts_.push_back(*it);
+        budgets_.erase(it);
+        return ptr;
+      }
+      if (bs < it_min->first) it_min = it;
+      if (bs > it_max->first) it_max = it;
+    }
+    if (!budgets_.empty() && budgets_.size() >= size_drop_threshold_) {
+      if (it_max->first < size) {
+        // larger than any budget: drop the smallest
+        ncnn::fastFree(it_min->second);
+        budgets_.erase(it_min);
+      } else if (it_min->first > size) {
+        // smaller than any budget: drop the largest
+        ncnn::fastFree(it_max->second);
+        budgets_.erase(it_max);
+      }
+    }
+    return 0;
+  }
+
+  void pay(size_t size, void* ptr) { payouts_.emplace_back(size, ptr); }
+
+  // false if 'ptr' was not handed out by this pool
+  bool giveBack(void* ptr) {
+    for (auto it = payouts_.begin(); it != payouts_.end(); ++it) {
+      if (it->second == ptr) {
+        budgets_.push_back(*it);
+        payouts_.erase(it);
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  // 0 ~ 256
+  unsigned int size_compare_ratio_ = 0;
+  size_t size_drop_threshold_ = 10;
+  std::list<std::pair<size_t, void*>> budgets_;
+  std::list<std::pair<size_t, void*>> payouts_;
+};
+
+void* poolMalloc(PoolBuffers& buffers, size_t size) {
+  void* ptr = buffers.take(size);
+  if (ptr) return ptr;
+  ptr = ncnn::fastMalloc(size);
+  buffers.pay(size, ptr);
+  return ptr;
+}
+
+void poolFree(PoolBuffers& buffers, void* ptr) {
+  if (!buffers.giveBack(ptr)) {
+    fprintf(stderr, "FATAL ERROR! pool allocator get wild %p\n", ptr);
+    ncnn::fastFree(ptr);
+  }
+}
+
+}  // namespace
+
+class PoolAllocatorPrivate {
+ public:
+  std::mutex lock;
+  PoolBuffers buffers;
+};
+
+PoolAllocator::PoolAllocator() : Allocator(), d(new PoolAllocatorPrivate) {}
+
+PoolAllocator::~PoolAllocator() { delete d; }
+
+void PoolAllocator::set_size_compare_ratio(float scr) {
+  std::lock_guard<std::mutex> guard(d->lock);
+  d->buffers.set_size_compare_ratio(scr);
+}
+
+void PoolAllocator::set_size_drop_threshold(size_t threshold) {
+  std::lock_guard<std::mutex> guard(d->lock);
+  d->buffers.set_size_drop_threshold(threshold);
+}
+
+void PoolAllocator::clear() {
+  std::lock_guard<std::mutex> guard(d->lock);
+  d->buffers.clear();
+}
+
+void* PoolAllocator::fastMalloc(size_t size) {
+  {
+    std::lock_guard<std::mutex> guard(d->lock);
+    if (void* ptr = d->buffers.take(size)) return ptr;
+  }
+  // allocate without holding the lock
+  void* ptr = ncnn::fastMalloc(size);
+  std::lock_guard<std::mutex> guard(d->lock);
+  d->buffers.pay(size, ptr);
+  return ptr;
+}
+
+void PoolAllocator::fastFree(void* ptr) {
+  std::lock_guard<std::mutex> guard(d->lock);
+  poolFree(d->buffers, ptr);
+}
+
+class UnlockedPoolAllocatorPrivate {
+ public:
+  PoolBuffers buffers;
+};
+
+UnlockedPoolAllocator::UnlockedPoolAllocator()
+    : Allocator(), d(new UnlockedPoolAllocatorPrivate) {}
+
+UnlockedPoolAllocator::~UnlockedPoolAllocator() { delete d; }
+
+void UnlockedPoolAllocator::set_size_compare_ratio(float scr) {
+  d->buffers.set_size_compare_ratio(scr);
+}
+
+void UnlockedPoolAllocator::set_size_drop_threshold(size_t threshold) {
+  d->buffers.set_size_drop_threshold(threshold);
+}
+
+void UnlockedPoolAllocator::clear() { d->buffers.clear(); }
+
+void* UnlockedPoolAllocator::fastMalloc(size_t size) {
+  return poolMalloc(d->buffers, size);
+}
+
+void UnlockedPoolAllocator::fastFree(void* ptr) {
+  poolFree(d->buffers, ptr);
+}
+
+}  // namespace ncnn
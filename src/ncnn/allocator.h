@@ -76,6 +76,18 @@ static NCNN_FORCEINLINE void fastFree(void* ptr) {
   }
 }
 
+// atomic fetch and add on a reference count
+#if defined(__GNUC__) || defined(__clang__)
+#define NCNN_XADD(addr, delta) \
+  __atomic_fetch_add((addr), (delta), __ATOMIC_ACQ_REL)
+#else
+static NCNN_FORCEINLINE int NCNN_XADD(int* addr, int delta) {
+  int tmp = *addr;
+  *addr += delta;
+  return tmp;
+}
+#endif
+
 class NCNN_EXPORT Allocator {
  public:
   virtual ~Allocator();
@@ -0,0 +1,94 @@
+#include "ncnn/cpu.h"
+
+#include <string.h>
+
+#include <fstream>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+namespace ncnn {
+
+namespace {
+
+std::string trim(const std::string& s) {
+  size_t begin = s.find_first_not_of(" \t");
+  if (begin == std::string::npos) return std::string();
+  return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+}
+
+// the first "model name" or "Hardware" line of /proc/cpuinfo
+std::string procCpuModel() {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    std::string key = trim(line.substr(0, colon));
+    if (key == "model name" || key == "Hardware") {
+      return trim(line.substr(colon + 1));
+    }
+  }
+  return std::string();
+}
+
+std::string cpuModel() {
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+  unsigned int regs[12];
+  if (__get_cpuid_max(0x80000000u, nullptr) >= 0x80000004u) {
+    for (unsigned int i = 0; i < 3; i++) {
+      __get_cpuid(0x80000002u + i, &regs[i * 4], &regs[i * 4 + 1],
+                  &regs[i * 4 + 2], &regs[i * 4 + 3]);
+    }
+    char brand[sizeof(regs) + 1];
+    memcpy(brand, regs, sizeof(regs));
+    brand[sizeof(regs)] = '\0';
+    std::string model = trim(brand);
+    if (!model.empty()) return model;
+  }
+#endif
+  std::string model = procCpuModel();
+  return model.empty() ? "unknown" : model;
+}
+
+}  // namespace
+
+const char* cpu_model_name() {
+  static const std::string model = cpuModel();
+  return model.c_str();
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+
+int cpu_support_x86_avx2() { return __builtin_cpu_supports("avx2") ? 1 : 0; }
+
+int cpu_support_x86_fma() { return __builtin_cpu_supports("fma") ? 1 : 0; }
+
+int cpu_support_x86_avx512() {
+  return __builtin_cpu_supports("avx512f") &&
+                 __builtin_cpu_supports("avx512cd") &&
+                 __builtin_cpu_supports("avx512bw") &&
+                 __builtin_cpu_supports("avx512dq") &&
+                 __builtin_cpu_supports("avx512vl")
+             ? 1
+             : 0;
+}
+
+int cpu_support_x86_avx512_vnni() {
+  return cpu_support_x86_avx512() && __builtin_cpu_supports("avx512vnni")
+             ? 1
+             : 0;
+}
+
+#else
+
+int cpu_support_x86_avx2() { return 0; }
+int cpu_support_x86_fma() { return 0; }
+int cpu_support_x86_avx512() { return 0; }
+int cpu_support_x86_avx512_vnni() { return 0; }
+
+#endif
+
+}  // namespace ncnn
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ncnn/platform.h"
+
+namespace ncnn {
+
+// Whether the CPU running the process has these x86 extensions: 1 or 0,
+// always 0 on other architectures. Kernels compiled for them with target
+// attributes check these before they are called.
+NCNN_EXPORT int cpu_support_x86_avx2();
+NCNN_EXPORT int cpu_support_x86_fma();
+// AVX-512 F, CD, BW, DQ and VL, as on Skylake-X and later
+NCNN_EXPORT int cpu_support_x86_avx512();
+NCNN_EXPORT int cpu_support_x86_avx512_vnni();
+
+// The model of the CPU, e.g. its x86 brand string or the "model name" of
+// /proc/cpuinfo, or "unknown".
+NCNN_EXPORT const char* cpu_model_name();
+
+}  // namespace ncnn
@@ -0,0 +1,473 @@
+#include "ncnn/mat.h"
+
+#include <string.h>
+
+namespace ncnn {
+
+Mat::Mat()
+    : data(0),
+      refcount(0),
+      elemsize(0),
+      elempack(0),
+      allocator(0),
+      dims(0),
+      w(0),
+      h(0),
+      d(0),
+      c(0),
+      cstep(0) {}
+
+Mat::Mat(int _w, size_t _elemsize, Allocator* _allocator) : Mat() {
+  create(_w, _elemsize, _allocator);
+}
+
+Mat::Mat(int _w, int _h, size_t _elemsize, Allocator* _allocator) : Mat() {
+  create(_w, _h, _elemsize, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _c, size_t _elemsize, Allocator* _allocator)
+    : Mat() {
+  create(_w, _h, _c, _elemsize, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _d, int _c, size_t _elemsize,
+         Allocator* _allocator)
+    : Mat() {
+  create(_w, _h, _d, _c, _elemsize, _allocator);
+}
+
+Mat::Mat(int _w, size_t _elemsize, int _elempack, Allocator* _allocator)
+    : Mat() {
+  create(_w, _elemsize, _elempack, _allocator);
+}
+
+Mat::Mat(int _w, int _h, size_t _elemsize, int _elempack,
+         Allocator* _allocator)
+    : Mat() {
+  create(_w, _h, _elemsize, _elempack, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _c, size_t _elemsize, int _elempack,
+         Allocator* _allocator)
+    : Mat() {
+  create(_w, _h, _c, _elemsize, _elempack, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _d, int _c, size_t _elemsize, int _elempack,
+         Allocator* _allocator)
+    : Mat() {
+  create(_w, _h, _d, _c, _elemsize, _elempack, _allocator);
+}
+
+Mat::Mat(const Mat& m)
+    : data(m.data),
+      refcount(m.refcount),
+      elemsize(m.elemsize),
+      elempack(m.elempack),
+      allocator(m.allocator),
+      dims(m.dims),
+      w(m.w),
+      h(m.h),
+      d(m.d),
+      c(m.c),
+      cstep(m.cstep) {
+  addref();
+}
+
+Mat::Mat(int _w, void* _data, size_t _elemsize, Allocator* _allocator)
+    : Mat() {
+  wrap(1, _w, 1, 1, 1, _data, _elemsize, 1, _allocator);
+}
+
+Mat::Mat(int _w, int _h, void* _data, size_t _elemsize, Allocator* _allocator)
+    : Mat() {
+  wrap(2, _w, _h, 1, 1, _data, _elemsize, 1, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _c, void* _data, size_t _elemsize,
+         Allocator* _allocator)
+    : Mat() {
+  wrap(3, _w, _h, 1, _c, _data, _elemsize, 1, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _d, int _c, void* _data, size_t _elemsize,
+         Allocator* _allocator)
+    : Mat() {
+  wrap(4, _w, _h, _d, _c, _data, _elemsize, 1, _allocator);
+}
+
+Mat::Mat(int _w, void* _data, size_t _elemsize, int _elempack,
+         Allocator* _allocator)
+    : Mat() {
+  wrap(1, _w, 1, 1, 1, _data, _elemsize, _elempack, _allocator);
+}
+
+Mat::Mat(int _w, int _h, void* _data, size_t _elemsize, int _elempack,
+         Allocator* _allocator)
+    : Mat() {
+  wrap(2, _w, _h, 1, 1, _data, _elemsize, _elempack, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _c, void* _data, size_t _elemsize,
+         int _elempack, Allocator* _allocator)
+    : Mat() {
+  wrap(3, _w, _h, 1, _c, _data, _elemsize, _elempack, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _d, int _c, void* _data, size_t _elemsize,
+         int _elempack, Allocator* _allocator)
+    : Mat() {
+  wrap(4, _w, _h, _d, _c, _data, _elemsize, _elempack, _allocator);
+}
+
+Mat::~Mat() { release(); }
+
+Mat& Mat::operator=(const Mat& m) {
+  if (this == &m) return *this;
+  if (m.refcount) NCNN_XADD(m.refcount, 1);
+  release();
+  data = m.data;
+  refcount = m.refcount;
+  elemsize = m.elemsize;
+  elempack = m.elempack;
+  allocator = m.allocator;
+  dims = m.dims;
+  w = m.w;
+  h = m.h;
+  d = m.d;
+  c = m.c;
+  cstep = m.cstep;
+  return *this;
+}
+
+void Mat::fill(float v) {
+  float* ptr = (float*)data;
+  size_t size = total() * elemsize / sizeof(float);
+  for (size_t i = 0; i < size; i++) ptr[i] = v;
+}
+
+void Mat::fill(int v) {
+  int* ptr = (int*)data;
+  size_t size = total() * elemsize / sizeof(int);
+  for (size_t i = 0; i < size; i++) ptr[i] = v;
+}
+
+Mat Mat::clone(Allocator* _allocator) const {
+  if (empty()) return Mat();
+  Mat m;
+  m.allocate(dims, w, h, d, c, elemsize, elempack, _allocator);
+  if (m.empty()) return m;
+  if (total() > 0) {
+    if (cstep == m.cstep) {
+      memcpy(m.data, data, total() * elemsize);
+    } else {
+      // copy one channel at a time, the allocator may align differently
+      size_t size = (size_t)w * h * d * elemsize;
+      for (int i = 0; i < c; i++) {
+        memcpy((unsigned char*)m.data + m.cstep * i * m.elemsize,
+               (const unsigned char*)data + cstep * i * elemsize, size);
+      }
+    }
+  }
+  return m;
+}
+
+Mat Mat::reshape(int _w, Allocator* _allocator) const {
+  if ((size_t)w * h * d * c != (size_t)_w) return Mat();
+  if (dims >= 3 && cstep != (size_t)w * h * d) {
+    // gather the channels
+    Mat m;
+    m.create(_w, elemsize, elempack, _allocator);
+    if (m.empty()) return m;
+    size_t size = (size_t)w * h * d * elemsize;
+    for (int i = 0; i < c; i++) {
+      memcpy((unsigned char*)m.data + size * i,
+             (const unsigned char*)data + cstep * i * elemsize, size);
+    }
+    return m;
+  }
+  Mat m = *this;
+  m.dims = 1;
+  m.w = _w;
+  m.h = 1;
+  m.d = 1;
+  m.c = 1;
+  m.cstep = _w;
+  return m;
+}
+
+Mat Mat::reshape(int _w, int _h, Allocator* _allocator) const {
+  if ((size_t)w * h * d * c != (size_t)_w * _h) return Mat();
+  if (dims >= 3 && cstep != (size_t)w * h * d) {
+    Mat m;
+    m.create(_w, _h, elemsize, elempack, _allocator);
+    if (m.empty()) return m;
+    size_t size = (size_t)w * h * d * elemsize;
+    for (int i = 0; i < c; i++) {
+      memcpy((unsigned char*)m.data + size * i,
+             (const unsigned char*)data + cstep * i * elemsize, size);
+    }
+    return m;
+  }
+  Mat m = *this;
+  m.dims = 2;
+  m.w = _w;
+  m.h = _h;
+  m.d = 1;
+  m.c = 1;
+  m.cstep = (size_t)_w * _h;
+  return m;
+}
+
+Mat Mat::reshape(int _w, int _h, int _c, Allocator* _allocator) const {
+  return reshape(_w, _h, 1, _c, _allocator);
+}
+
+Mat Mat::reshape(int _w, int _h, int _d, int _c, Allocator* _allocator) const {
+  if ((size_t)w * h * d * c != (size_t)_w * _h * _d * _c) return Mat();
+  int _dims = _d == 1 ? 3 : 4;
+  size_t size = (size_t)_w * _h * _d;
+  bool gaps = dims >= 3 && cstep != (size_t)w * h * d;
+  // the channels of the result start aligned like those of create()
+  bool aligned = _c == 1 || size * elemsize % 16 == 0;
+  if (!gaps && aligned) {
+    Mat m = *this;
+    m.dims = _dims;
+    m.w = _w;
+    m.h = _h;
+    m.d = _d;
+    m.c = _c;
+    m.cstep = size;
+    return m;
+  }
+  Mat flat = reshape(w * h * d * c, _allocator);
+  Mat m;
+  m.allocate(_dims, _w, _h, _d, _c, elemsize, elempack, _allocator);
+  if (flat.empty() || m.empty()) return m;
+  for (int i = 0; i < _c; i++) {
+    memcpy((unsigned char*)m.data + m.cstep * i * elemsize,
+           (const unsigned char*)flat.data + size * i * elemsize,
+           size * elemsize);
+  }
+  return m;
+}
+
+void Mat::create(int _w, size_t _elemsize, Allocator* _allocator) {
+  allocate(1, _w, 1, 1, 1, _elemsize, 1, _allocator);
+}
+
+void Mat::create(int _w, int _h, size_t _elemsize, Allocator* _allocator) {
+  allocate(2, _w, _h, 1, 1, _elemsize, 1, _allocator);
+}
+
+void Mat::create(int _w, int _h, int _c, size_t _elemsize,
+                 Allocator* _allocator) {
+  allocate(3, _w, _h, 1, _c, _elemsize, 1, _allocator);
+}
+
+void Mat::create(int _w, int _h, int _d, int _c, size_t _elemsize,
+                 Allocator* _allocator) {
+  allocate(4, _w, _h, _d, _c, _elemsize, 1, _allocator);
+}
+
+void Mat::create(int _w, size_t _elemsize, int _elempack,
+                 Allocator* _allocator) {
+  allocate(1, _w, 1, 1, 1, _elemsize, _elempack, _allocator);
+}
+
+void Mat::create(int _w, int _h, size_t _elemsize, int _elempack,
+                 Allocator* _allocator) {
+  allocate(2, _w, _h, 1, 1, _elemsize, _elempack, _allocator);
+}
+
+void Mat::create(int _w, int _h, int _c, size_t _elemsize, int _elempack,
+                 Allocator* _allocator) {
+  allocate(3, _w, _h, 1, _c, _elemsize, _elempack, _allocator);
+}
+
+void Mat::create(int _w, int _h, int _d, int _c, size_t _elemsize,
+                 int _elempack, Allocator* _allocator) {
+  allocate(4, _w, _h, _d, _c, _elemsize, _elempack, _allocator);
+}
+
+void Mat::create_like(const Mat& m, Allocator* _allocator) {
+  allocate(m.dims, m.w, m.h, m.d, m.c, m.elemsize, m.elempack, _allocator);
+}
+
+void Mat::addref() {
+  if (refcount) NCNN_XADD(refcount, 1);
+}
+
+void Mat::release() {
+  if (refcount && NCNN_XADD(refcount, -1) == 1) {
+    if (allocator) {
+      allocator->fastFree(data);
+    } else {
+      fastFree(data);
+    }
+  }
+  data = 0;
+  elemsize = 0;
+  elempack = 0;
+  dims = 0;
+  w = 0;
+  h = 0;
+  d = 0;
+  c = 0;
+  cstep = 0;
+  refcount = 0;
+}
+
+Mat Mat::channel(int _c) {
+  // a channel of a cube is a 3 dim Mat with its depth as channels
+  Mat m(w, h, d, (unsigned char*)data + cstep * _c * elemsize, elemsize,
+        elempack, allocator);
+  m.dims = dims - 1;
+  m.cstep = (size_t)w * h;
+  return m;
+}
+
+const Mat Mat::channel(int _c) const {
+  return const_cast<Mat*>(this)->channel(_c);
+}
+
+Mat Mat::channel_range(int _c, int channels) {
+  Mat m(w, h, d, channels, (unsigned char*)data + cstep * _c * elemsize,
+        elemsize, elempack, allocator);
+  m.dims = dims;
+  m.cstep = cstep;
+  return m;
+}
+
+const Mat Mat::channel_range(int _c, int channels) const {
+  return const_cast<Mat*>(this)->channel_range(_c, channels);
+}
+
+Mat Mat::row_range(int y, int rows) {
+  return Mat(w, rows, (unsigned char*)data + (size_t)w * y * elemsize,
+             elemsize, elempack, allocator);
+}
+
+const Mat Mat::row_range(int y, int rows) const {
+  return const_cast<Mat*>(this)->row_range(y, rows);
+}
+
+Mat Mat::range(int x, int n) {
+  return Mat(n, (unsigned char*)data + x * elemsize, elemsize, elempack,
+             allocator);
+}
+
+const Mat Mat::range(int x, int n) const {
+  return const_cast<Mat*>(this)->range(x, n);
+}
+
+void Mat::allocate(int _dims, int _w, int _h, int _d, int _c,
+                   size_t _elemsize, int _elempack, Allocator* _allocator) {
+  if (dims == _dims && w == _w && h == _h && d == _d && c == _c &&
+      elemsize == _elemsize && elempack == _elempack &&
+      allocator == _allocator && refcount) {
+    return;
+  }
+  release();
+  elemsize = _elemsize;
+  elempack = _elempack;
+  allocator = _allocator;
+  dims = _dims;
+  w = _w;
+  h = _h;
+  d = _d;
+  c = _c;
+  // channels of 3 and 4 dim Mats start 16 byte aligned
+  cstep = (size_t)w * h * d;
+  if (dims >= 3 && elemsize > 0) {
+    cstep = alignSize(cstep * elemsize, 16) / elemsize;
+  }
+  size_t totalsize = alignSize(total() * elemsize, 4);
+  if (totalsize > 0) {
+    if (allocator) {
+      data = allocator->fastMalloc(totalsize + sizeof(*refcount));
+    } else {
+      data = fastMalloc(totalsize + sizeof(*refcount));
+    }
+    if (!data) {
+      // out of memory leaves an empty Mat
+      dims = w = h = d = c = 0;
+      cstep = 0;
+      return;
+    }
+    refcount = (int*)((unsigned char*)data + totalsize);
+    *refcount = 1;
+  }
+}
+
+void Mat::wrap(int _dims, int _w, int _h, int _d, int _c, void* _data,
+               size_t _elemsize, int _elempack, Allocator* _allocator) {
+  data = _data;
+  refcount = 0;
+  elemsize = _elemsize;
+  elempack = _elempack;
+  allocator = _allocator;
+  dims = _dims;
+  w = _w;
+  h = _h;
+  d = _d;
+  c = _c;
+  cstep = (size_t)w * h * d;
+  if (dims >= 3 && elemsize > 0) {
+    cstep = alignSize(cstep * elemsize, 16) / elemsize;
+  }
+}
+
+void convert_packing(const Mat& src, Mat& dst, int _elempack,
+                     Allocator* allocator) {
+  if (src.elempack == _elempack || src.empty() || _elempack <= 0) {
+    dst = src;
+    return;
+  }
+  // extent of the packed axis in groups, and the groups' stride and size
+  // in elements of 'src'
+  int groups = src.dims == 1 ? src.w : src.dims == 2 ? src.h : src.c;
+  size_t plane = src.dims == 1   ? 1
+                 : src.dims == 2 ? (size_t)src.w
+                                 : (size_t)src.w * src.h * src.d;
+  size_t stride = src.dims >= 3 ? src.cstep : plane;
+  int lanes = groups * src.elempack;
+  if (lanes % _elempack != 0) {
+    dst = src;
+    return;
+  }
+  size_t scalar = src.elemsize / src.elempack;
+  size_t out_elemsize = scalar * _elempack;
+  int out_groups = lanes / _elempack;
+  Mat m;
+  if (src.dims == 1) {
+    m.create(out_groups, out_elemsize, _elempack, allocator);
+  } else if (src.dims == 2) {
+    m.create(src.w, out_groups, out_elemsize, _elempack, allocator);
+  } else if (src.dims == 3) {
+    m.create(src.w, src.h, out_groups, out_elemsize, _elempack, allocator);
+  } else {
+    m.create(src.w, src.h, src.d, out_groups, out_elemsize, _elempack,
+             allocator);
+  }
+  if (m.empty()) {
+    dst = m;
+    return;
+  }
+  size_t out_stride = m.dims >= 3 ? m.cstep : plane;
+  for (int q = 0; q < lanes; q++) {
+    const unsigned char* in =
+        (const unsigned char*)src.data +
+        ((q / src.elempack) * stride * src.elempack + q % src.elempack) *
+            scalar;
+    unsigned char* out =
+        (unsigned char*)m.data +
+        ((q / _elempack) * out_stride * _elempack + q % _elempack) * scalar;
+    for (size_t i = 0; i < plane; i++) {
+      memcpy(out + i * out_elemsize, in + i * src.elemsize, scalar);
+    }
+  }
+  dst = m;
+}
+
+}  // namespace ncnn
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <stddef.h>
+
 #include "ncnn/allocator.h"
 
 namespace ncnn {
 
-class Mat {
+// A reference counted tensor of up to 4 dims (w, h, d, c). Channels start
+// at multiples of cstep elements, so each one is aligned. A packed Mat of
+// elempack n interleaves n consecutive channels (rows for 2 dims, elements
+// for 1 dim): c is the number of channel groups and elemsize the size of
+// one group of n scalars.
+class NCNN_EXPORT Mat {
  public:
   // empty
   Mat();
@@ -58,6 +65,130 @@ class Mat {
   // set all
   void fill(float v);
   void fill(int v);
+  // deep copy
+  Mat clone(Allocator* allocator = 0) const;
+  // reshape, sharing the data when the channels have no gaps
+  Mat reshape(int w, Allocator* allocator = 0) const;
+  Mat reshape(int w, int h, Allocator* allocator = 0) const;
+  Mat reshape(int w, int h, int c, Allocator* allocator = 0) const;
+  Mat reshape(int w, int h, int d, int c, Allocator* allocator = 0) const;
+  // allocate vec
+  void create(int w, size_t elemsize = 4u, Allocator* allocator = 0);
+  // allocate image
+  void create(int w, int h, size_t elemsize = 4u, Allocator* allocator = 0);
+  // allocate dim
+  void create(int w, int h, int c, size_t elemsize = 4u,
+              Allocator* allocator = 0);
+  // allocate cube
+  void create(int w, int h, int d, int c, size_t elemsize = 4u,
+              Allocator* allocator = 0);
+  // allocate packed vec
+  void create(int w, size_t elemsize, int elempack, Allocator* allocator = 0);
+  // allocate packed image
+  void create(int w, int h, size_t elemsize, int elempack,
+              Allocator* allocator = 0);
+  // allocate packed dim
+  void create(int w, int h, int c, size_t elemsize, int elempack,
+              Allocator* allocator = 0);
+  // allocate packed cube
+  void create(int w, int h, int d, int c, size_t elemsize, int elempack,
+              Allocator* allocator = 0);
+  // allocate like
+  void create_like(const Mat& m, Allocator* allocator = 0);
+  // refcount++
+  void addref();
+  // refcount--
+  void release();
+
+  bool empty() const { return data == 0 || total() == 0; }
+  size_t total() const { return cstep * c; }
+  // bits of one scalar
+  int elembits() const {
+    return elempack ? static_cast<int>(elemsize * 8) / elempack : 0;
+  }
+
+  // data reference, sharing the data of this Mat
+  Mat channel(int c);
+  const Mat channel(int c) const;
+  Mat channel_range(int c, int channels);
+  const Mat channel_range(int c, int channels) const;
+  Mat row_range(int y, int rows);
+  const Mat row_range(int y, int rows) const;
+  Mat range(int x, int n);
+  const Mat range(int x, int n) const;
+
+  float* row(int y) {
+    return (float*)((unsigned char*)data + w * y * elemsize);
+  }
+  const float* row(int y) const {
+    return (const float*)((unsigned char*)data + w * y * elemsize);
+  }
+  template <typename T>
+  T* row(int y) {
+    return (T*)((unsigned char*)data + w * y * elemsize);
+  }
+  template <typename T>
+  const T* row(int y) const {
+    return (const T*)((unsigned char*)data + w * y * elemsize);
+  }
+
+  template <typename T>
+  operator T*() {
+    return (T*)data;
+  }
+  template <typename T>
+  operator const T*() const {
+    return (const T*)data;
+  }
+
+  float& operator[](size_t i) { return ((float*)data)[i]; }
+  const float& operator[](size_t i) const { return ((const float*)data)[i]; }
+
+  // pointer to the data
+  void* data;
+
+  // pointer to the reference counter, null for external data
+  int* refcount;
+
+  // element size in bytes
+  // 4 = float32/int32
+  // 2 = float16
+  // 1 = int8/uint8
+  // 0 = empty
+  size_t elemsize;
+
+  // packed count inside element
+  // c/1-d-h-w-1  c/1-h-w-1  h/1-w-1  w/1-1  scalar
+  // c/4-d-h-w-4  c/4-h-w-4  h/4-w-4  w/4-4  sse/neon
+  // c/8-d-h-w-8  c/8-h-w-8  h/8-w-8  w/8-8  avx/fp16
+  // c/16-d-h-w-16  c/16-h-w-16  h/16-w-16  w/16-16  avx512
+  int elempack;
+
+  // the allocator
+  Allocator* allocator;
+
+  // the dimension rank
+  int dims;
+
+  int w;
+  int h;
+  int d;
+  int c;
+
+  // elements from one channel to the next
+  size_t cstep;
+
+ private:
+  void allocate(int dims, int w, int h, int d, int c, size_t elemsize,
+                int elempack, Allocator* allocator);
+  void wrap(int dims, int w, int h, int d, int c, void* data,
+            size_t elemsize, int elempack, Allocator* allocator);
 };
 
-}  // namespace ncnn
\ No newline at end of file
+// Repacks 'src' into 'elempack' along its packed axis (c, or h for 2 dims,
+// or w for 1 dim). 'dst' shares 'src' when it already has that elempack or
+// when the axis does not divide into groups of 'elempack'.
+NCNN_EXPORT void convert_packing(const Mat& src, Mat& dst, int elempack,
+                                 Allocator* allocator = 0);
+
+}  // namespace ncnn
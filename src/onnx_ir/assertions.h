@@ -43,7 +43,7 @@ std::string barf(const char* fmt, ...);
     std::string error_msg =                                              \
         ::my_ai_training::ir::barf("%s:%u: %s: Assertion `%s` failed.",  \
                                    __FILE__, __LINE__, __func__, #cond); \
-    throw_assert_error(error_msg);                                       \
+    ::my_ai_training::ir::throw_assert_error(error_msg);                 \
   }
 
 // The following is used to prevent MSVC from passing the whole __VA_ARGS__ list
@@ -56,7 +56,7 @@ std::string barf(const char* fmt, ...);
     std::string error_msg = ::my_ai_training::ir::barf(               \
         "%s:%u: %s: Assertion `%s` failed: " msg, __FILE__, __LINE__, \
         __func__, #cond, __VA_ARGS__);                                \
-    throw_assert_error(error_msg);                                    \
+    ::my_ai_training::ir::throw_assert_error(error_msg);              \
   }
 
 // The trailing ' ' argument is a hack to deal with the extra comma when ... is
@@ -69,7 +69,7 @@ std::string barf(const char* fmt, ...);
     std::string error_msg = ::my_ai_training::ir::barf(               \
         "%s:%u: %s: Assertion `%s` failed: " msg, __FILE__, __LINE__, \
         __func__, #cond, __VA_ARGS__);                                \
-    throw_tensor_error(error_msg);                                    \
+    ::my_ai_training::ir::throw_tensor_error(error_msg);              \
   }
 
 #define TENSOR_ASSERTM(...) ONNX_EXPAND(_TENSOR_ASSERTM(__VA_ARGS__, " "))
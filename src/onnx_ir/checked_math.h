@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <limits>
+
+namespace my_ai_training::ir {
+
+// *r = a + b, a - b or a * b; true if that overflowed, leaving *r alone
+// unless the compiler builtins are used
+#if defined(__GNUC__) || defined(__clang__)
+inline bool addOverflows(int64_t a, int64_t b, int64_t* r) {
+  return __builtin_add_overflow(a, b, r);
+}
+inline bool subOverflows(int64_t a, int64_t b, int64_t* r) {
+  return __builtin_sub_overflow(a, b, r);
+}
+inline bool mulOverflows(int64_t a, int64_t b, int64_t* r) {
+  return __builtin_mul_overflow(a, b, r);
+}
+#else
+inline bool addOverflows(int64_t a, int64_t b, int64_t* r) {
+  constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+  constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+  if (b > 0 ? a > kMax - b : a < kMin - b) return true;
+  *r = a + b;
+  return false;
+}
+inline bool subOverflows(int64_t a, int64_t b, int64_t* r) {
+  constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+  constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+  if (b < 0 ? a > kMax + b : a < kMin + b) return true;
+  *r = a - b;
+  return false;
+}
+inline bool mulOverflows(int64_t a, int64_t b, int64_t* r) {
+  constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+  constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+  if (a != 0 && b != 0) {
+    if (a > 0 ? (b > 0 ? a > kMax / b : b < kMin / a)
+              : (b > 0 ? a < kMin / b : a < kMax / b)) {
+      return true;
+    }
+  }
+  *r = a * b;
+  return false;
+}
+#endif
+
+}  // namespace my_ai_training::ir
@@ -0,0 +1,129 @@
+#include "onnx_ir/external_data.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "onnx_ir/assertions.h"
+
+namespace my_ai_training::ir {
+
+MappedFile::~MappedFile() {
+  if (data_ == nullptr) return;
+#ifndef _WIN32
+  if (mapped_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+    return;
+  }
+#endif
+  delete[] data_;
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+#ifdef _WIN32
+  // no mmap here, fall back to reading the whole file
+  FILE* fp = std::fopen(path.c_str(), "rb");
+  ONNX_ASSERTM(fp != nullptr, "cannot open %s", path.c_str());
+  std::fseek(fp, 0, SEEK_END);
+  size_t size = static_cast<size_t>(std::ftell(fp));
+  std::fseek(fp, 0, SEEK_SET);
+  uint8_t* data = new uint8_t[size ? size : 1];
+  size_t n = std::fread(data, 1, size, fp);
+  std::fclose(fp);
+  if (n != size) {
+    delete[] data;
+    ONNX_ASSERTM(false, "short read on %s", path.c_str());
+  }
+  return std::shared_ptr<MappedFile>(
+      new MappedFile(path, data, size, /*mapped=*/false));
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  ONNX_ASSERTM(fd >= 0, "cannot open %s", path.c_str());
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    ONNX_ASSERTM(false, "cannot stat %s", path.c_str());
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  if (size == 0) {
+    ::close(fd);
+    return std::shared_ptr<MappedFile>(
+        new MappedFile(path, nullptr, 0, /*mapped=*/true));
+  }
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  ::close(fd);
+  ONNX_ASSERTM(addr != MAP_FAILED, "cannot mmap %s", path.c_str());
+  return std::shared_ptr<MappedFile>(new MappedFile(
+      path, static_cast<const uint8_t*>(addr), size, /*mapped=*/true));
+#endif
+}
+
+std::string ExternalDataStore::resolvePath(const std::string& location) const {
+  ONNX_ASSERTM(!location.empty(), "external data without location");
+  // the ONNX spec keeps external data under the model directory, so a
+  // model cannot map arbitrary files of the host
+  bool absolute = location.front() == '/' || location.front() == '\\';
+#ifdef _WIN32
+  absolute |= location.size() > 1 && location[1] == ':';
+#endif
+  ONNX_ASSERTM(!absolute, "external data location %s is absolute",
+               location.c_str());
+  for (size_t begin = 0; begin <= location.size();) {
+    size_t end = location.find_first_of("/\\", begin);
+    if (end == std::string::npos) end = location.size();
+    ONNX_ASSERTM(location.compare(begin, end - begin, "..") != 0,
+                 "external data location %s leaves the model directory",
+                 location.c_str());
+    begin = end + 1;
+  }
+  if (base_dir_.empty()) return location;
+  if (base_dir_.back() == '/') return base_dir_ + location;
+  return base_dir_ + "/" + location;
+}
+
+std::shared_ptr<MappedFile> ExternalDataStore::map(
+    const std::string& location) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = files_.find(location);
+  if (it != files_.end()) return it->second;
+  auto file = MappedFile::open(resolvePath(location));
+  files_.emplace(location, file);
+  return file;
+}
+
+std::shared_ptr<TensorBuffer> ExternalDataStore::load(
+    const ExternalDataInfo& info) {
+  auto file = map(info.location);
+  ONNX_ASSERTM(info.offset >= 0 &&
+                   static_cast<size_t>(info.offset) <= file->size(),
+               "offset %lld is out of range of %s",
+               static_cast<long long>(info.offset), file->path().c_str());
+  size_t offset = static_cast<size_t>(info.offset);
+  size_t length = info.length < 0 ? file->size() - offset
+                                  : static_cast<size_t>(info.length);
+  ONNX_ASSERTM(length <= file->size() - offset,
+               "length %zu at offset %zu is out of range of %s", length, offset,
+               file->path().c_str());
+  return TensorBuffer::borrow(file->data() + offset, length, file);
+}
+
+std::shared_ptr<TensorBuffer> ExternalDataStore::loadLazily(
+    const ExternalDataInfo& info, size_t size) {
+  auto self = shared_from_this();
+  return TensorBuffer::lazy(size, [self, info]() { return self->load(info); });
+}
+
+void ExternalDataStore::clear() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  files_.clear();
+}
+
+}  // namespace my_ai_training::ir
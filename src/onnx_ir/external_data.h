@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "onnx_ir/common.h"
+#include "onnx_ir/tensor.h"
+
+namespace my_ai_training::ir {
+
+// A whole file mapped read-only into memory. The mapping lives as long as
+// the last shared_ptr to it, so tensors borrowing from it stay valid.
+class MappedFile final {
+ public:
+  ONNX_DISALLOW_COPY_ASSIGNMENT_AND_MOVE(MappedFile);
+  ~MappedFile();
+
+  // throws assert_error if the file cannot be opened or mapped
+  static std::shared_ptr<MappedFile> open(const std::string& path);
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  const std::string& path() const { return path_; }
+
+ private:
+  MappedFile(std::string path, const uint8_t* data, size_t size, bool mapped)
+      : path_(std::move(path)), data_(data), size_(size), mapped_(mapped) {}
+
+  std::string path_;
+  const uint8_t* data_;
+  size_t size_;
+  bool mapped_;  // false if the bytes were read into the heap instead
+};
+
+// Where the bytes of a tensor live, following the external_data entries of
+// an ONNX TensorProto: 'location' is relative to the model directory and
+// may not leave it, 'length' < 0 means "up to the end of the file".
+struct ExternalDataInfo final {
+  std::string location;
+  int64_t offset = 0;
+  int64_t length = -1;
+};
+
+// Resolves ExternalDataInfo to tensor buffers that alias mapped files.
+//
+// Each file is mapped at most once and shared by every tensor stored in it,
+// so N workers loading the same model share one copy of the weights in the
+// page cache instead of N copies on their heaps. Thread-safe. Lazy buffers
+// hold a reference to the store, hence it is always owned by a shared_ptr.
+class ExternalDataStore final
+    : public std::enable_shared_from_this<ExternalDataStore> {
+ public:
+  ONNX_DISALLOW_COPY_ASSIGNMENT_AND_MOVE(ExternalDataStore);
+
+  static std::shared_ptr<ExternalDataStore> create(std::string base_dir) {
+    return std::shared_ptr<ExternalDataStore>(
+        new ExternalDataStore(std::move(base_dir)));
+  }
+
+  const std::string& baseDir() const { return base_dir_; }
+
+  // Map (or reuse the mapping of) 'location' now.
+  std::shared_ptr<MappedFile> map(const std::string& location);
+
+  // Buffer aliasing the bytes described by 'info'; maps the file now.
+  std::shared_ptr<TensorBuffer> load(const ExternalDataInfo& info);
+
+  // Buffer of 'size' bytes which maps the file only on first access. 'size'
+  // must match the length that 'info' resolves to.
+  std::shared_ptr<TensorBuffer> loadLazily(const ExternalDataInfo& info,
+                                           size_t size);
+
+  // drop cached mappings; buffers already handed out keep theirs alive
+  void clear();
+
+ private:
+  explicit ExternalDataStore(std::string base_dir)
+      : base_dir_(std::move(base_dir)) {}
+
+  std::string resolvePath(const std::string& location) const;
+
+  std::string base_dir_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<MappedFile>> files_;
+};
+
+}  // namespace my_ai_training::ir
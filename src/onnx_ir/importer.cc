@@ -0,0 +1,920 @@
+#include "onnx_ir/importer.h"
+
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <queue>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "onnx_ir/checked_math.h"
+#include "onnx_ir/proto_reader.h"
+
+namespace my_ai_training::ir {
+
+namespace {
+
+// Field numbers from onnx.proto.
+
+enum ModelProtoField : uint32_t {
+  kModelIrVersion = 1,
+  kModelGraph = 7,
+  kModelOpsetImport = 8,
+};
+
+enum OperatorSetIdProtoField : uint32_t {
+  kOpsetDomain = 1,
+  kOpsetVersion = 2,
+};
+
+enum GraphProtoField : uint32_t {
+  kGraphNode = 1,
+  kGraphName = 2,
+  kGraphInitializer = 5,
+  kGraphDocString = 10,
+  kGraphInput = 11,
+  kGraphOutput = 12,
+  kGraphValueInfo = 13,
+  kGraphSparseInitializer = 15,
+};
+
+enum NodeProtoField : uint32_t {
+  kNodeInput = 1,
+  kNodeOutput = 2,
+  kNodeName = 3,
+  kNodeOpType = 4,
+  kNodeAttribute = 5,
+  kNodeDocString = 6,
+  kNodeDomain = 7,
+  kNodeOverload = 8,
+};
+
+enum AttributeProtoField : uint32_t {
+  kAttrName = 1,
+  kAttrF = 2,
+  kAttrI = 3,
+  kAttrS = 4,
+  kAttrT = 5,
+  kAttrG = 6,
+  kAttrFloats = 7,
+  kAttrInts = 8,
+  kAttrStrings = 9,
+  kAttrTensors = 10,
+  kAttrGraphs = 11,
+  kAttrTp = 14,
+  kAttrTypeProtos = 15,
+  kAttrType = 20,
+  kAttrSparseTensor = 22,
+  kAttrSparseTensors = 23,
+};
+
+// AttributeProto.AttributeType
+enum AttributeType : int32_t {
+  kAttrTypeUndefined = 0,
+  kAttrTypeFloat = 1,
+  kAttrTypeInt = 2,
+  kAttrTypeString = 3,
+  kAttrTypeTensor = 4,
+  kAttrTypeGraph = 5,
+  kAttrTypeFloats = 6,
+  kAttrTypeInts = 7,
+  kAttrTypeStrings = 8,
+  kAttrTypeTensors = 9,
+  kAttrTypeGraphs = 10,
+};
+
+enum TensorProtoField : uint32_t {
+  kTensorDims = 1,
+  kTensorDataType = 2,
+  kTensorFloatData = 4,
+  kTensorInt32Data = 5,
+  kTensorStringData = 6,
+  kTensorInt64Data = 7,
+  kTensorName = 8,
+  kTensorRawData = 9,
+  kTensorDoubleData = 10,
+  kTensorUint64Data = 11,
+  kTensorExternalData = 13,
+  kTensorDataLocation = 14,
+};
+
+enum StringStringEntryProtoField : uint32_t {
+  kEntryKey = 1,
+  kEntryValue = 2,
+};
+
+enum ValueInfoProtoField : uint32_t {
+  kValueInfoName = 1,
+  kValueInfoType = 2,
+};
+
+enum TypeProtoField : uint32_t {
+  kTypeTensorType = 1,
+};
+
+enum TypeProtoTensorField : uint32_t {
+  kTensorTypeElemType = 1,
+  kTensorTypeShape = 2,
+};
+
+enum TensorShapeProtoField : uint32_t {
+  kShapeDim = 1,
+};
+
+enum DimensionField : uint32_t {
+  kDimValue = 1,
+  kDimParam = 2,
+};
+
+constexpr int32_t kDataLocationExternal = 1;
+
+// State shared by the importers of a model and all its subgraphs. It is not
+// modified during the import, so decoding tasks may share it.
+struct ImportContext {
+  // owner of the serialized model, tensors borrow raw_data from it
+  std::shared_ptr<const void> keep_alive;
+  // thread-safe
+  std::shared_ptr<ExternalDataStore> external_data;
+  ThreadPool* pool = nullptr;
+  size_t protos_per_task = 0;
+};
+
+// Op types and attribute names repeat a lot, intern each spelling once
+// without going through the global (locked) symbol table again. Every
+// decoding task owns one.
+class SymbolCache {
+ public:
+  Symbol intern(std::string_view name) {
+    auto it = symbols_.find(name);
+    if (it != symbols_.end()) return it->second;
+    Symbol sym(std::string{name});
+    symbols_.emplace(name, sym);
+    return sym;
+  }
+
+ private:
+  std::unordered_map<std::string_view, Symbol> symbols_;
+};
+
+std::string toString(std::string_view s) { return std::string(s); }
+
+// the value of an external_data offset or length: a decimal integer >= 0
+int64_t externalDataInt(std::string_view key, std::string_view value) {
+  int64_t result = -1;
+  auto [end, error] =
+      std::from_chars(value.data(), value.data() + value.size(), result);
+  ONNX_ASSERTM(error == std::errc() && end == value.data() + value.size() &&
+                   result >= 0,
+               "external_data %s \"%s\" is not a valid byte count",
+               toString(key).c_str(), toString(value).c_str());
+  return result;
+}
+
+template <typename To, typename From>
+void castInto(Tensor* t, const std::vector<From>& values) {
+  TENSOR_ASSERTM(static_cast<int64_t>(values.size()) == t->numel(),
+                 "tensor %s has %zu elements, expected %lld",
+                 t->name().c_str(), values.size(),
+                 static_cast<long long>(t->numel()));
+  To* out = static_cast<To*>(t->allocate());
+  for (size_t i = 0; i < values.size(); i++) {
+    out[i] = static_cast<To>(values[i]);
+  }
+}
+
+// 'name', if given, receives the tensor name as a view into the model bytes
+Tensor decodeTensor(ProtoReader reader, const ImportContext* ctx,
+                    std::string_view* name = nullptr) {
+  Tensor t;
+  std::string_view raw_data;
+  bool has_raw_data = false;
+  bool is_external = false;
+  ExternalDataInfo external;
+  std::vector<float> float_data;
+  std::vector<int32_t> int32_data;
+  std::vector<int64_t> int64_data;
+  std::vector<double> double_data;
+  std::vector<uint64_t> uint64_data;
+
+  while (reader.next()) {
+    switch (reader.field()) {
+      case kTensorDims:
+        reader.readRepeatedVarint(&t.sizes());
+        break;
+      case kTensorDataType:
+        t.elem_type() = reader.readInt32();
+        break;
+      case kTensorFloatData:
+        reader.readRepeatedFixed(&float_data);
+        break;
+      case kTensorInt32Data:
+        reader.readRepeatedVarint(&int32_data);
+        break;
+      case kTensorStringData:
+        t.strings().emplace_back(reader.readBytes());
+        break;
+      case kTensorInt64Data:
+        reader.readRepeatedVarint(&int64_data);
+        break;
+      case kTensorName: {
+        std::string_view bytes = reader.readBytes();
+        if (name) *name = bytes;
+        t.setName(toString(bytes));
+        break;
+      }
+      case kTensorRawData:
+        raw_data = reader.readBytes();
+        has_raw_data = true;
+        break;
+      case kTensorDoubleData:
+        reader.readRepeatedFixed(&double_data);
+        break;
+      case kTensorUint64Data:
+        reader.readRepeatedVarint(&uint64_data);
+        break;
+      case kTensorExternalData: {
+        ProtoReader entry = reader.readMessage();
+        std::string_view key, value;
+        while (entry.next()) {
+          if (entry.field() == kEntryKey) {
+            key = entry.readBytes();
+          } else if (entry.field() == kEntryValue) {
+            value = entry.readBytes();
+          } else {
+            entry.skip();
+          }
+        }
+        if (key == "location") {
+          external.location = toString(value);
+        } else if (key == "offset") {
+          external.offset = externalDataInt(key, value);
+        } else if (key == "length") {
+          external.length = externalDataInt(key, value);
+        }
+        break;
+      }
+      case kTensorDataLocation:
+        is_external = reader.readInt32() == kDataLocationExternal;
+        break;
+      default:
+        reader.skip();
+    }
+  }
+
+  // the element count and byte size fit in int64_t from here on
+  int64_t size = 1;
+  for (int64_t extent : t.sizes()) {
+    TENSOR_ASSERTM(extent >= 0 && !mulOverflows(size, extent, &size),
+                   "tensor %s has bad dim %lld", t.name().c_str(),
+                   static_cast<long long>(extent));
+  }
+  int64_t elem_size = static_cast<int64_t>(elemSizeOf(t.elem_type()));
+  TENSOR_ASSERTM(!mulOverflows(size, elem_size, &size),
+                 "tensor %s is too large", t.name().c_str());
+
+  if (t.elem_type() == TensorProto_DataType_STRING) return t;
+
+  if (is_external) {
+    TENSOR_ASSERTM(ctx->external_data != nullptr,
+                   "tensor %s has external data but no store",
+                   t.name().c_str());
+    size_t size = t.expectedByteSize();
+    if (external.length < 0) external.length = static_cast<int64_t>(size);
+    t.setBuffer(ctx->external_data->loadLazily(external, size));
+    return t;
+  }
+
+  if (has_raw_data) {
+    TENSOR_ASSERTM(raw_data.size() == t.expectedByteSize(),
+                   "tensor %s has %zu bytes of raw_data, expected %zu",
+                   t.name().c_str(), raw_data.size(), t.expectedByteSize());
+    t.setBuffer(TensorBuffer::borrow(raw_data.data(), raw_data.size(),
+                                     ctx->keep_alive));
+    return t;
+  }
+
+  // typed *_data fields, see the comments in onnx.proto for which element
+  // types are stored in which field
+  switch (t.elem_type()) {
+    case TensorProto_DataType_FLOAT:
+      castInto<float>(&t, float_data);
+      break;
+    case TensorProto_DataType_COMPLEX64:
+      t.setRawData(float_data.data(), float_data.size() * sizeof(float));
+      break;
+    case TensorProto_DataType_DOUBLE:
+      castInto<double>(&t, double_data);
+      break;
+    case TensorProto_DataType_COMPLEX128:
+      t.setRawData(double_data.data(), double_data.size() * sizeof(double));
+      break;
+    case TensorProto_DataType_INT32:
+      castInto<int32_t>(&t, int32_data);
+      break;
+    case TensorProto_DataType_INT16:
+    case TensorProto_DataType_UINT16:
+    case TensorProto_DataType_FLOAT16:
+    case TensorProto_DataType_BFLOAT16:
+      // bit patterns are stored in the low 16 bits
+      castInto<uint16_t>(&t, int32_data);
+      break;
+    case TensorProto_DataType_INT8:
+    case TensorProto_DataType_UINT8:
+    case TensorProto_DataType_BOOL:
+      castInto<uint8_t>(&t, int32_data);
+      break;
+    case TensorProto_DataType_INT64:
+      castInto<int64_t>(&t, int64_data);
+      break;
+    case TensorProto_DataType_UINT32:
+      castInto<uint32_t>(&t, uint64_data);
+      break;
+    case TensorProto_DataType_UINT64:
+      castInto<uint64_t>(&t, uint64_data);
+      break;
+    default:
+      TENSOR_ASSERTM(false, "tensor %s has unsupported data type %d",
+                     t.name().c_str(), t.elem_type());
+  }
+  return t;
+}
+
+struct ValueInfo {
+  std::string_view name;
+  int32_t elem_type = TensorProto_DataType_UNDEFINED;
+  bool has_shape = false;
+  std::vector<Dimension> sizes;
+
+  void applyTo(Value* v) const {
+    if (elem_type != TensorProto_DataType_UNDEFINED) v->setElemType(elem_type);
+    if (has_shape) v->setSizes(sizes);
+  }
+};
+
+ValueInfo decodeValueInfo(ProtoReader reader) {
+  ValueInfo info;
+  while (reader.next()) {
+    if (reader.field() == kValueInfoName) {
+      info.name = reader.readBytes();
+      continue;
+    }
+    if (reader.field() != kValueInfoType) {
+      reader.skip();
+      continue;
+    }
+    // only tensor types carry an elem type and shape
+    ProtoReader type = reader.readMessage();
+    while (type.next()) {
+      if (type.field() != kTypeTensorType) {
+        type.skip();
+        continue;
+      }
+      ProtoReader tensor_type = type.readMessage();
+      while (tensor_type.next()) {
+        if (tensor_type.field() == kTensorTypeElemType) {
+          info.elem_type = tensor_type.readInt32();
+        } else if (tensor_type.field() == kTensorTypeShape) {
+          info.has_shape = true;
+          ProtoReader shape = tensor_type.readMessage();
+          while (shape.next()) {
+            if (shape.field() != kShapeDim) {
+              shape.skip();
+              continue;
+            }
+            Dimension dim;
+            ProtoReader dim_proto = shape.readMessage();
+            while (dim_proto.next()) {
+              if (dim_proto.field() == kDimValue) {
+                dim = Dimension(dim_proto.readInt64());
+              } else if (dim_proto.field() == kDimParam) {
+                dim = Dimension(toString(dim_proto.readBytes()));
+              } else {
+                dim_proto.skip();
+              }
+            }
+            info.sizes.push_back(std::move(dim));
+          }
+        } else {
+          tensor_type.skip();
+        }
+      }
+    }
+  }
+  return info;
+}
+
+// Calls fn(begin, end) over [0, n) in chunks of ctx->protos_per_task, on
+// the pool if there is one and more than one chunk.
+void forEachChunk(const ImportContext* ctx, size_t n,
+                  const std::function<void(size_t, size_t)>& fn) {
+  size_t chunk = std::max<size_t>(ctx->protos_per_task, 1);
+  if (ctx->pool == nullptr || n <= chunk) {
+    fn(0, n);
+    return;
+  }
+  size_t num_chunks = (n + chunk - 1) / chunk;
+  ctx->pool->parallelFor(num_chunks, [&](size_t c) {
+    fn(c * chunk, std::min(n, (c + 1) * chunk));
+  });
+}
+
+// Captured nodes of a subgraph whose names the subgraph does not define;
+// the enclosing graph resolves them.
+using CaptureList = std::vector<std::pair<std::string_view, Node*>>;
+
+// An AttributeProto decoded off the graph, applied to its Node when the
+// graph is stitched together.
+struct DecodedAttribute {
+  Symbol name;
+  int32_t type = kAttrTypeUndefined;
+  double f = 0;
+  int64_t i = 0;
+  std::string s;
+  Tensor t;
+  std::shared_ptr<Graph> g;
+  std::vector<double> fs;
+  std::vector<int64_t> is;
+  std::vector<std::string> ss;
+  std::vector<Tensor> ts;
+  std::vector<std::shared_ptr<Graph>> gs;
+
+  void applyTo(Node* n) {
+    switch (type) {
+      case kAttrTypeFloat:
+        n->f_(name, f);
+        break;
+      case kAttrTypeInt:
+        n->i_(name, i);
+        break;
+      case kAttrTypeString:
+        n->s_(name, s);
+        break;
+      case kAttrTypeTensor:
+        n->t_(name, t);
+        break;
+      case kAttrTypeGraph:
+        n->g_(name, g);
+        break;
+      case kAttrTypeFloats:
+        n->fs_(name, std::move(fs));
+        break;
+      case kAttrTypeInts:
+        n->is_(name, std::move(is));
+        break;
+      case kAttrTypeStrings:
+        n->ss_(name, std::move(ss));
+        break;
+      case kAttrTypeTensors:
+        n->ts_(name, std::move(ts));
+        break;
+      case kAttrTypeGraphs:
+        n->gs_(name, std::move(gs));
+        break;
+      default:
+        // an empty list attribute has no field to infer its type from
+        ONNX_ASSERTM(false, "attribute %s of %s has unknown type %d",
+                     name.toString(), n->kind().toString(), type);
+    }
+  }
+};
+
+// A NodeProto decoded off the graph. Names are views into the model bytes.
+struct DecodedNode {
+  Symbol kind;
+  std::vector<std::string_view> inputs;
+  std::vector<std::string_view> outputs;
+  std::string_view name, domain, doc_string, overload;
+  bool has_name = false, has_domain = false, has_doc_string = false,
+       has_overload = false;
+  std::vector<DecodedAttribute> attributes;
+  // outer names used by the subgraphs of this node
+  CaptureList captures;
+};
+
+// Imports one GraphProto in three steps:
+//
+//  1. scan: split the GraphProto into the byte ranges of its fields;
+//  2. decode: turn node and initializer protos into DecodedNode/Tensor.
+//     This is where the time goes (tensor conversion, subgraphs), and it is
+//     independent per proto, so it runs in chunks on ctx->pool. Subgraphs
+//     are imported recursively from within these tasks;
+//  3. stitch: create the Values and Nodes of the Graph, which is not
+//     thread-safe, on the calling thread. Nodes are appended in topological
+//     order, see Note [Topological invariant], even if the model lists them
+//     out of order.
+//
+// A subgraph refers to values of enclosing graphs by name. Such names
+// become Captured nodes at the top of the subgraph and are handed to the
+// enclosing graph through import()'s result, which resolves them during its
+// own stitch.
+class GraphImporter {
+ public:
+  GraphImporter(const ImportContext* ctx, Graph* graph, bool is_subgraph)
+      : ctx_(ctx), graph_(graph), is_subgraph_(is_subgraph) {}
+
+  // Returns the Captured nodes that could not be resolved in this graph.
+  CaptureList import(ProtoReader reader) {
+    std::vector<ProtoReader> nodes, initializers, inputs, outputs, value_infos;
+    while (reader.next()) {
+      switch (reader.field()) {
+        case kGraphNode:
+          nodes.push_back(reader.readMessage());
+          break;
+        case kGraphName:
+          graph_->setName(toString(reader.readBytes()));
+          break;
+        case kGraphInitializer:
+          initializers.push_back(reader.readMessage());
+          break;
+        case kGraphDocString:
+          graph_->setDocString(toString(reader.readBytes()));
+          break;
+        case kGraphInput:
+          inputs.push_back(reader.readMessage());
+          break;
+        case kGraphOutput:
+          outputs.push_back(reader.readMessage());
+          break;
+        case kGraphValueInfo:
+          value_infos.push_back(reader.readMessage());
+          break;
+        case kGraphSparseInitializer:
+          ONNX_ASSERTM(false, "sparse initializers are not supported");
+          break;
+        default:
+          reader.skip();
+      }
+    }
+
+    std::vector<Tensor> tensors(initializers.size());
+    std::vector<std::string_view> tensor_names(initializers.size());
+    std::vector<DecodedNode> decoded(nodes.size());
+    // one index space: initializers first, then nodes
+    forEachChunk(ctx_, initializers.size() + nodes.size(),
+                 [&](size_t begin, size_t end) {
+                   SymbolCache symbols;
+                   for (size_t i = begin; i < end; i++) {
+                     if (i < initializers.size()) {
+                       tensors[i] = decodeTensor(initializers[i], ctx_,
+                                                 &tensor_names[i]);
+                     } else {
+                       size_t n = i - initializers.size();
+                       decodeNode(nodes[n], &symbols, &decoded[n]);
+                     }
+                   }
+                 });
+
+    for (auto& input : inputs) {
+      ValueInfo info = decodeValueInfo(input);
+      Value* v = graph_->addInput();
+      v->setUniqueName(toString(info.name));
+      info.applyTo(v);
+      value_by_name_[info.name] = v;
+    }
+
+    for (size_t i = 0; i < tensors.size(); i++) {
+      if (value_by_name_.count(tensor_names[i])) {
+        // also a graph input, which provides the Value
+        graph_->addInitializer(tensors[i]);
+      } else {
+        value_by_name_[tensor_names[i]] =
+            graph_->addInitializerAndCreateValue(tensors[i]);
+      }
+    }
+
+    for (size_t i : topologicalOrder(decoded)) stitchNode(&decoded[i]);
+
+    for (auto& output : outputs) {
+      ValueInfo info = decodeValueInfo(output);
+      Value* v = lookup(info.name, graph_->return_node());
+      info.applyTo(v);
+      graph_->registerOutput(v);
+    }
+
+    for (auto& value_info : value_infos) {
+      ValueInfo info = decodeValueInfo(value_info);
+      auto it = value_by_name_.find(info.name);
+      if (it != value_by_name_.end()) info.applyTo(it->second);
+    }
+
+    // all values are typed now, resolve what the subgraphs captured
+    for (auto& node : decoded) {
+      for (auto& [name, captured] : node.captures) {
+        auto it = value_by_name_.find(name);
+        if (it != value_by_name_.end() &&
+            it->second->node()->kind() == kCaptured) {
+          // captured here as well, typed once the enclosing graph resolves
+          // it, so let the enclosing graph resolve this one too
+          captures_.emplace_back(name, captured);
+        } else if (it != value_by_name_.end()) {
+          Value* outer = it->second;
+          captured->output()->setElemType(outer->elemType());
+          if (outer->has_sizes()) captured->output()->setSizes(outer->sizes());
+        } else {
+          ONNX_ASSERTM(is_subgraph_, "subgraph uses undefined value %s",
+                       toString(name).c_str());
+          captures_.emplace_back(name, captured);
+        }
+      }
+    }
+    return std::move(captures_);
+  }
+
+ private:
+  void decodeNode(ProtoReader reader, SymbolCache* symbols,
+                  DecodedNode* node) {
+    std::string_view op_type;
+    std::vector<ProtoReader> attributes;
+    while (reader.next()) {
+      switch (reader.field()) {
+        case kNodeInput:
+          node->inputs.push_back(reader.readBytes());
+          break;
+        case kNodeOutput:
+          node->outputs.push_back(reader.readBytes());
+          break;
+        case kNodeName:
+          node->name = reader.readBytes();
+          node->has_name = true;
+          break;
+        case kNodeOpType:
+          op_type = reader.readBytes();
+          break;
+        case kNodeAttribute:
+          attributes.push_back(reader.readMessage());
+          break;
+        case kNodeDocString:
+          node->doc_string = reader.readBytes();
+          node->has_doc_string = true;
+          break;
+        case kNodeDomain:
+          node->domain = reader.readBytes();
+          node->has_domain = true;
+          break;
+        case kNodeOverload:
+          node->overload = reader.readBytes();
+          node->has_overload = true;
+          break;
+        default:
+          reader.skip();
+      }
+    }
+    node->kind = symbols->intern(op_type);
+    node->attributes.resize(attributes.size());
+    for (size_t i = 0; i < attributes.size(); i++) {
+      decodeAttribute(attributes[i], symbols, node, &node->attributes[i]);
+    }
+  }
+
+  void decodeAttribute(ProtoReader reader, SymbolCache* symbols,
+                       DecodedNode* node, DecodedAttribute* attr) {
+    std::vector<float> floats;
+    // old models may omit 'type', then it follows from the field present
+    int32_t inferred_type = kAttrTypeUndefined;
+    while (reader.next()) {
+      switch (reader.field()) {
+        case kAttrName:
+          attr->name = symbols->intern(reader.readBytes());
+          break;
+        case kAttrType:
+          attr->type = reader.readInt32();
+          break;
+        case kAttrF:
+          attr->f = reader.readFloat();
+          inferred_type = kAttrTypeFloat;
+          break;
+        case kAttrI:
+          attr->i = reader.readInt64();
+          inferred_type = kAttrTypeInt;
+          break;
+        case kAttrS:
+          attr->s = toString(reader.readBytes());
+          inferred_type = kAttrTypeString;
+          break;
+        case kAttrT:
+          attr->t = decodeTensor(reader.readMessage(), ctx_);
+          inferred_type = kAttrTypeTensor;
+          break;
+        case kAttrG:
+          attr->g = importSubgraph(reader.readMessage(), node);
+          inferred_type = kAttrTypeGraph;
+          break;
+        case kAttrFloats:
+          reader.readRepeatedFixed(&floats);
+          inferred_type = kAttrTypeFloats;
+          break;
+        case kAttrInts:
+          reader.readRepeatedVarint(&attr->is);
+          inferred_type = kAttrTypeInts;
+          break;
+        case kAttrStrings:
+          attr->ss.emplace_back(reader.readBytes());
+          inferred_type = kAttrTypeStrings;
+          break;
+        case kAttrTensors:
+          attr->ts.push_back(decodeTensor(reader.readMessage(), ctx_));
+          inferred_type = kAttrTypeTensors;
+          break;
+        case kAttrGraphs:
+          attr->gs.push_back(importSubgraph(reader.readMessage(), node));
+          inferred_type = kAttrTypeGraphs;
+          break;
+        case kAttrTp:
+        case kAttrTypeProtos:
+        case kAttrSparseTensor:
+        case kAttrSparseTensors:
+          ONNX_ASSERTM(false, "attribute kind of field %u is not supported",
+                       reader.field());
+          break;
+        default:
+          reader.skip();
+      }
+    }
+    if (attr->type == kAttrTypeUndefined) attr->type = inferred_type;
+    attr->fs.assign(floats.begin(), floats.end());
+  }
+
+  std::shared_ptr<Graph> importSubgraph(ProtoReader reader,
+                                        DecodedNode* node) {
+    auto subgraph = std::make_shared<Graph>();
+    CaptureList captures =
+        GraphImporter(ctx_, subgraph.get(), /*is_subgraph=*/true)
+            .import(reader);
+    node->captures.insert(node->captures.end(), captures.begin(),
+                          captures.end());
+    return subgraph;
+  }
+
+  // Node indices in topological order, keeping the model order where the
+  // model already is topologically sorted (the usual case, checked first).
+  static std::vector<size_t> topologicalOrder(
+      const std::vector<DecodedNode>& nodes) {
+    std::unordered_map<std::string_view, size_t> producer;
+    for (size_t i = 0; i < nodes.size(); i++) {
+      for (std::string_view output : nodes[i].outputs) {
+        if (!output.empty()) producer[output] = i;
+      }
+    }
+    auto forEachDependency = [&](size_t i, auto&& fn) {
+      for (std::string_view input : nodes[i].inputs) {
+        auto it = producer.find(input);
+        if (it != producer.end()) fn(it->second);
+      }
+      // values captured by subgraphs are implicit inputs
+      for (auto& capture : nodes[i].captures) {
+        auto it = producer.find(capture.first);
+        if (it != producer.end()) fn(it->second);
+      }
+    };
+
+    std::vector<size_t> order(nodes.size());
+    bool sorted = true;
+    for (size_t i = 0; i < nodes.size() && sorted; i++) {
+      order[i] = i;
+      forEachDependency(i, [&](size_t p) { sorted = sorted && p < i; });
+    }
+    if (sorted) return order;
+
+    // Kahn's algorithm, always emitting the earliest ready node
+    std::vector<size_t> indegree(nodes.size(), 0);
+    std::vector<std::vector<size_t>> users(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+      forEachDependency(i, [&](size_t p) {
+        users[p].push_back(i);
+        indegree[i]++;
+      });
+    }
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>>
+        ready;
+    for (size_t i = 0; i < nodes.size(); i++) {
+      if (indegree[i] == 0) ready.push(i);
+    }
+    order.clear();
+    while (!ready.empty()) {
+      size_t i = ready.top();
+      ready.pop();
+      order.push_back(i);
+      for (size_t user : users[i]) {
+        if (--indegree[user] == 0) ready.push(user);
+      }
+    }
+    ONNX_ASSERTM(order.size() == nodes.size(), "graph has a cycle");
+    return order;
+  }
+
+  void stitchNode(DecodedNode* decoded) {
+    Node* n = graph_->create(decoded->kind, decoded->outputs.size());
+    for (size_t i = 0; i < decoded->outputs.size(); i++) {
+      // empty names mark optional outputs that are not produced
+      if (decoded->outputs[i].empty()) continue;
+      Value* v = n->outputs()[i];
+      v->setUniqueName(toString(decoded->outputs[i]));
+      value_by_name_[decoded->outputs[i]] = v;
+    }
+    if (decoded->has_name) n->setName(toString(decoded->name));
+    if (decoded->has_domain) n->setDomain(toString(decoded->domain));
+    if (decoded->has_doc_string) {
+      n->setDocString(toString(decoded->doc_string));
+    }
+    if (decoded->has_overload) n->setOverload(toString(decoded->overload));
+    for (auto& attr : decoded->attributes) attr.applyTo(n);
+    graph_->appendNode(n);
+    // producers were stitched before, see topologicalOrder()
+    for (std::string_view name : decoded->inputs) {
+      n->addInput(lookup(name, n));
+    }
+  }
+
+  // Value named 'name' as seen by 'user' (a node or the return node).
+  Value* lookup(std::string_view name, Node* user) {
+    auto it = value_by_name_.find(name);
+    if (it != value_by_name_.end()) return it->second;
+
+    if (name.empty()) {
+      // omitted optional input
+      Node* undef = graph_->create(kUndefined, 1);
+      undef->insertBefore(user);
+      return undef->output();
+    }
+
+    ONNX_ASSERTM(is_subgraph_, "%s uses undefined value %s",
+                 user->kind().toString(), toString(name).c_str());
+    // Captured values are defined before every node of the subgraph.
+    Node* captured = graph_->create(kCaptured, 1);
+    graph_->prependNode(captured);
+    captured->output()->setUniqueName(toString(name));
+    value_by_name_[name] = captured->output();
+    captures_.emplace_back(name, captured);
+    return captured->output();
+  }
+
+  const ImportContext* ctx_;
+  Graph* graph_;
+  bool is_subgraph_;
+  std::unordered_map<std::string_view, Value*> value_by_name_;
+  CaptureList captures_;
+};
+
+}  // namespace
+
+std::unique_ptr<Graph> ImportModelFromBuffer(
+    const void* data, size_t size, std::shared_ptr<const void> keep_alive,
+    const std::string& base_dir, const ImportOptions& options) {
+  ImportContext ctx;
+  ctx.keep_alive = std::move(keep_alive);
+  ctx.external_data = ExternalDataStore::create(base_dir);
+  ctx.pool = options.pool;
+  ctx.protos_per_task = options.protos_per_task;
+
+  ProtoReader reader(static_cast<const uint8_t*>(data), size);
+  ProtoReader graph_proto;
+  bool has_graph = false;
+  std::vector<OpSetID> opset_versions;
+  while (reader.next()) {
+    switch (reader.field()) {
+      case kModelGraph:
+        graph_proto = reader.readMessage();
+        has_graph = true;
+        break;
+      case kModelOpsetImport: {
+        ProtoReader opset = reader.readMessage();
+        std::string domain;
+        int64_t version = 0;
+        while (opset.next()) {
+          if (opset.field() == kOpsetDomain) {
+            domain = toString(opset.readBytes());
+          } else if (opset.field() == kOpsetVersion) {
+            version = opset.readInt64();
+          } else {
+            opset.skip();
+          }
+        }
+        opset_versions.emplace_back(std::move(domain), version);
+        break;
+      }
+      default:
+        reader.skip();
+    }
+  }
+  ONNX_ASSERTM(has_graph, "model has no graph");
+
+  auto g = std::make_unique<Graph>();
+  g->setExternalDataStore(ctx.external_data);
+  GraphImporter(&ctx, g.get(), /*is_subgraph=*/false).import(graph_proto);
+  g->opset_versions_mutable() = std::move(opset_versions);
+  return g;
+}
+
+std::unique_ptr<Graph> ImportModel(const std::string& path,
+                                   const ImportOptions& options) {
+  auto file = MappedFile::open(path);
+  auto slash = path.find_last_of('/');
+  std::string base_dir =
+      slash == std::string::npos ? std::string() : path.substr(0, slash);
+  return ImportModelFromBuffer(file->data(), file->size(), file, base_dir,
+                               options);
+}
+
+}  // namespace my_ai_training::ir
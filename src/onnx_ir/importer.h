@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "common/thread_pool.h"
+#include "onnx_ir/ir.h"
+
+namespace my_ai_training::ir {
+
+struct ImportOptions {
+  // Node and initializer protos (including their subgraphs) are decoded in
+  // parallel on 'pool' when set, 'protos_per_task' at a time. The Graph
+  // itself is always assembled on the calling thread.
+  ThreadPool* pool = nullptr;
+  size_t protos_per_task = 256;
+};
+
+// Import a serialized ONNX ModelProto into a Graph.
+//
+// The protobuf wire format is decoded directly into Graph/Node/Value, there
+// is no intermediate ModelProto. Op types and attribute names are interned
+// as Symbols, and tensor raw_data is not copied: initializers borrow their
+// bytes from the model file (which is mapped, see MappedFile) and tensors
+// stored as external data are mapped lazily on first access through
+// Graph::externalDataStore().
+//
+// Nodes are appended in topological order, which is the model's order
+// unless the model lists a node before one of its producers.
+//
+// NB: borrowed raw_data has whatever alignment it has in the file; code that
+// needs aligned payloads should copy (Tensor::mutableRawData() does).
+std::unique_ptr<Graph> ImportModel(const std::string& path,
+                                   const ImportOptions& options = {});
+
+// Same as ImportModel() for a model already in memory. Tensors may borrow
+// from [data, data + size), which stays alive as long as 'keep_alive' does.
+// Relative external data locations are resolved against 'base_dir'.
+std::unique_ptr<Graph> ImportModelFromBuffer(
+    const void* data, size_t size, std::shared_ptr<const void> keep_alive,
+    const std::string& base_dir = "", const ImportOptions& options = {});
+
+}  // namespace my_ai_training::ir
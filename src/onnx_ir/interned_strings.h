@@ -51,6 +51,7 @@ namespace my_ai_training::ir {
   _(Undefined)                      \
   _(FusionGroup)                    \
   _(MatMul)                         \
+  _(MatMulInteger)                  \
   _(Gemm)                           \
   _(Tile)                           \
   _(SubConstant)                    \
@@ -191,7 +192,40 @@ namespace my_ai_training::ir {
   _(num_groups)                     \
   _(stash_type)                     \
   _(block_size)                     \
-  _(output_dtype)
+  _(output_dtype)                   \
+  _(Relu)                           \
+  _(Clip)                           \
+  _(LeakyRelu)                      \
+  _(HardSigmoid)                    \
+  _(HardSwish)                      \
+  _(Erf)                            \
+  _(Gelu)                           \
+  _(Equal)                          \
+  _(Where)                          \
+  _(Shape)                          \
+  _(Gather)                         \
+  _(Split)                          \
+  _(MaxPool)                        \
+  _(AveragePool)                    \
+  _(GlobalAveragePool)              \
+  _(GlobalMaxPool)                  \
+  _(auto_pad)                       \
+  _(output_padding)                 \
+  _(output_shape)                   \
+  _(RandomNormal)                   \
+  _(RandomNormalLike)               \
+  _(RandomUniform)                  \
+  _(RandomUniformLike)              \
+  _(Multinomial)                    \
+  _(Bernoulli)                      \
+  _(allowzero)                      \
+  _(training_mode)                  \
+  _(Packing)                        \
+  _(elempack)                       \
+  _(conv_algorithm)                 \
+  _(gemm_mc)                        \
+  _(gemm_nc)                        \
+  _(num_threads)
 
 enum BuiltinSymbol {
 #define DEFINE_SYMBOL(s) k##s,
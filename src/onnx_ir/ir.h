@@ -18,8 +18,11 @@
 
 #include "onnx_ir/array_ref.h"
 #include "onnx_ir/assertions.h"
+#include "onnx_ir/external_data.h"
 #include "onnx_ir/graph_node_list.h"
 #include "onnx_ir/interned_strings.h"
+#include "onnx_ir/small_vector.h"
+#include "onnx_ir/tensor.h"
 
 #define MY_AI_TRAINING_DISALLOW_COPY_AND_ASSIGN(TypeName) \
   TypeName(const TypeName&) = delete;                     \
@@ -62,19 +65,58 @@ class ResourceGuard final {
   void release() { released_ = true; }
 };
 
+// One dimension of a Value's shape: unknown, a known extent, or a symbolic
+// extent (ONNX dim_param) named by an interned Symbol. Packed into 8 bytes,
+// the low two bits tag the kind and the rest holds the extent or the Symbol,
+// so shapes copy and compare as plain integers.
 struct Dimension final {
-  Dimension() : is_unknown(true), is_int(false), dim(-1) {}
-  Dimension(std::string param)  // NOLINT
-      : is_unknown(false), is_int(false), dim(-1), param(std::move(param)) {}
+  Dimension() : bits_(kUnknownTag) {}
+  Dimension(Symbol param)  // NOLINT
+      : bits_(static_cast<uint64_t>(static_cast<uint32_t>(param))
+                  << kTagBits |
+              kParamTag) {}
+  // otherwise a BuiltinSymbol would be promoted to an int64_t extent
+  Dimension(BuiltinSymbol param) : Dimension(Symbol(param)) {}  // NOLINT
+  Dimension(const std::string& param)  // NOLINT
+      : Dimension(Symbol(param)) {}
   Dimension(int64_t dim)  // NOLINT
-      : is_unknown(false), is_int(true), dim(dim) {}
+      : bits_(static_cast<uint64_t>(dim) << kTagBits | kIntTag) {
+    ONNX_ASSERTM(dim >= kMinDim && dim <= kMaxDim,
+                 "dimension %lld out of range", static_cast<long long>(dim));
+  }
+
+  bool is_unknown() const { return tag() == kUnknownTag; }
+  bool is_int() const { return tag() == kIntTag; }
+  bool is_param() const { return tag() == kParamTag; }
+  // the extent, -1 unless is_int()
+  int64_t dim() const {
+    return is_int() ? static_cast<int64_t>(bits_) >> kTagBits : -1;
+  }
+  Symbol param() const {
+    ONNX_ASSERT(is_param());
+    return Symbol(static_cast<uint32_t>(bits_ >> kTagBits));
+  }
+
+  bool operator==(const Dimension& other) const {
+    return bits_ == other.bits_;
+  }
+  bool operator!=(const Dimension& other) const {
+    return bits_ != other.bits_;
+  }
+
+  static constexpr int64_t kMaxDim = (int64_t(1) << 61) - 1;
+  static constexpr int64_t kMinDim = -kMaxDim - 1;
+
+ private:
+  static constexpr int kTagBits = 2;
+  enum : uint64_t { kUnknownTag = 0, kIntTag = 1, kParamTag = 2 };
+  uint64_t tag() const { return bits_ & ((uint64_t(1) << kTagBits) - 1); }
 
-  bool is_unknown;    // 表示维度是否是未知的
-  bool is_int;        // 表示已知的维度是否是一个整数
-  int64_t dim;        // 存储已知的整数维度值
-  std::string param;  // 存储非整数形式的维度信息
+  uint64_t bits_;
 };
 
+static_assert(sizeof(Dimension) == 8, "Dimension should stay packed");
+
 enum class AttributeKind : uint8_t {
   // float, float list, int, int list, string, string list,
   // tensor, tensor list, subgraph, subgraph list. type proto, type proto list
@@ -99,6 +141,160 @@ static inline const char* toString(AttributeKind kind) {
   return names[int(kind)];
 }
 
+struct AttributeValue {
+  explicit AttributeValue(Symbol name) : name(name) {}
+  using Ptr = std::unique_ptr<AttributeValue>;
+  Symbol name;
+  virtual AttributeKind kind() const = 0;
+  virtual Ptr clone() const = 0;
+  virtual ~AttributeValue() = default;
+};
+
+template <typename T, AttributeKind Kind>
+struct ScalarAttributeValue final : public AttributeValue {
+  using ConstructorType = const T&;
+  using ValueType = T;
+  ScalarAttributeValue(Symbol name, ConstructorType value_)
+      : AttributeValue(name), value_(value_) {}
+  ValueType& value() { return value_; }
+  virtual Ptr clone() const override {
+    return Ptr(new ScalarAttributeValue(name, value_));
+  }
+  virtual AttributeKind kind() const override { return Kind; }
+
+ private:
+  ValueType value_;
+};
+
+template <typename T, AttributeKind Kind>
+struct VectorAttributeValue final : public AttributeValue {
+  using ConstructorType = std::vector<T>&&;
+  using ValueType = std::vector<T>;
+  VectorAttributeValue(Symbol name, ConstructorType value_)
+      : AttributeValue(name), value_(std::move(value_)) {}
+  ValueType& value() { return value_; }
+  virtual AttributeKind kind() const override { return Kind; }
+  virtual std::unique_ptr<AttributeValue> clone() const override {
+    auto copy = value_;
+    return Ptr(new VectorAttributeValue(name, std::move(copy)));
+  }
+
+ private:
+  ValueType value_;
+};
+
+// NB: there is no TypeProto in this IR, so tp/tps attributes have no
+// accessors; the importer rejects them.
+using FloatAttr = ScalarAttributeValue<double, AttributeKind::f>;
+using FloatsAttr = VectorAttributeValue<double, AttributeKind::fs>;
+using IntAttr = ScalarAttributeValue<int64_t, AttributeKind::i>;
+using IntsAttr = VectorAttributeValue<int64_t, AttributeKind::is>;
+using StringAttr = ScalarAttributeValue<std::string, AttributeKind::s>;
+using StringsAttr = VectorAttributeValue<std::string, AttributeKind::ss>;
+using TensorAttr = ScalarAttributeValue<Tensor, AttributeKind::t>;
+using TensorsAttr = VectorAttributeValue<Tensor, AttributeKind::ts>;
+using GraphAttr =
+    ScalarAttributeValue<std::shared_ptr<Graph>, AttributeKind::g>;
+using GraphsAttr =
+    VectorAttributeValue<std::shared_ptr<Graph>, AttributeKind::gs>;
+
+// CRTP so that Node which inherits Attributes can be return for
+// method chaining e.g:
+// Node * n = g->create(kSelect)->set_i(kOffset,3)->set_f(kValue,3.5);
+// we return Derived* pointers because Nodes are normally held as pointers.
+template <typename Derived>
+struct Attributes {
+  Attributes() {}
+  void copyAttributes(const Attributes& rhs) {
+    values_.clear();
+    values_.reserve(rhs.values_.size());
+    for (auto& i : rhs.values_) {
+      values_.push_back(i->clone());
+    }
+  }
+  bool hasAttribute(Symbol name) const {
+    return find(name, false) != values_.end();
+  }
+  AttributeKind kindOf(Symbol name) const {
+    return (*find(name, true))->kind();
+  }
+  Derived* removeAttribute(Symbol name) {
+    values_.erase(find(name, true));
+    return This();
+  }
+  bool hasAttributes() const { return !values_.empty(); }
+  // The names are returned in order, since name actually is the index.
+  std::vector<Symbol> attributeNames() const {
+    std::vector<Symbol> names;
+    names.reserve(values_.size());
+    for (auto& a : values_) names.push_back(a->name);
+    return names;
+  }
+
+#define CREATE_ACCESSOR(Kind, method)                                     \
+  Derived* method##_(Symbol name, Kind##Attr::ConstructorType v) {        \
+    return set<Kind##Attr>(name,                                          \
+                           std::forward<Kind##Attr::ConstructorType>(v)); \
+  }                                                                       \
+  const Kind##Attr::ValueType& method(Symbol name) const {                \
+    return get<Kind##Attr>(name);                                         \
+  }
+
+  CREATE_ACCESSOR(Float, f)
+  CREATE_ACCESSOR(Floats, fs)
+  CREATE_ACCESSOR(String, s)
+  CREATE_ACCESSOR(Strings, ss)
+  CREATE_ACCESSOR(Int, i)
+  CREATE_ACCESSOR(Ints, is)
+  CREATE_ACCESSOR(Tensor, t)
+  CREATE_ACCESSOR(Tensors, ts)
+  CREATE_ACCESSOR(Graph, g)
+  CREATE_ACCESSOR(Graphs, gs)
+
+#undef CREATE_ACCESSOR
+
+ private:
+  Derived* This() { return static_cast<Derived*>(this); }
+  template <typename T>
+  Derived* set(Symbol name, typename T::ConstructorType v) {
+    auto it = find(name, false);
+    auto nv = AVPtr(new T(name, std::forward<typename T::ConstructorType>(v)));
+    if (it == values_.end()) {
+      values_.push_back(std::move(nv));
+    } else {
+      *it = std::move(nv);
+    }
+    return This();
+  }
+  template <typename T>
+  typename T::ValueType& get(Symbol name) const {
+    auto it = find(name, true);
+    T* child = static_cast<T*>(it->get());
+    return child->value();
+  }
+  using AVPtr = AttributeValue::Ptr;
+  // NB: For determinism, we use a vector rather than a hash map.  This does
+  // mean that lookups are O(n), so you shouldn't use Attributes to store
+  // a big pile of messages.
+  std::vector<AVPtr> values_;
+  using iterator = std::vector<AVPtr>::iterator;
+  iterator find(Symbol name, bool required) {
+    auto it = std::find_if(values_.begin(), values_.end(),
+                           [&](const AVPtr& v) { return v->name == name; });
+    ONNX_ASSERTM(!required || it != values_.end(),
+                 "required attribute %s not found", name.toString());
+    return it;
+  }
+  using const_iterator = std::vector<AVPtr>::const_iterator;
+  const_iterator find(Symbol name, bool required) const {
+    auto it = std::find_if(values_.begin(), values_.end(),
+                           [&](const AVPtr& v) { return v->name == name; });
+    ONNX_ASSERTM(!required || it != values_.end(),
+                 "required attribute %s not found", name.toString());
+    return it;
+  }
+};
+
 // Each use is represented by this type, see Node::uses()
 // 'user' is the consumer of the value, offset is the index into
 // 'user's input this where the produces will be found.
@@ -138,7 +334,8 @@ struct Value final {
   std::string unique_name_;
   int32_t elem_type_;
   bool has_sizes_;
-  std::vector<Dimension> sizes_;
+  // inline for the common ranks, see SmallVector
+  SmallVector<Dimension, 6> sizes_;
 
  public:
   Value* setElemType(int32_t elem_type) {
@@ -150,19 +347,20 @@ struct Value final {
 
   bool has_sizes() const { return has_sizes_; }
 
-  Value* setSizes(std::vector<Dimension> sizes) {
+  Value* setSizes(ArrayRef<Dimension> sizes) {
     has_sizes_ = true;
-    sizes_ = std::move(sizes);
+    sizes_.assign(sizes);
     return this;
   }
 
   Value* wipeSizes() {
     has_sizes_ = false;
-    sizes_ = std::vector<Dimension>();
+    sizes_.clear();
     return this;
   }
 
-  const std::vector<Dimension>& sizes() const { return sizes_; }
+  // NB: invalidated by setSizes()
+  ArrayRef<Dimension> sizes() const { return sizes_; }
 
   size_t unique() const { return unique_; }
 
@@ -209,7 +407,23 @@ struct Value final {
   }
 };
 
-struct Node {
+struct OpSetID final {
+  // Default Domain Constructor
+  explicit OpSetID(const int64_t version) : domain_(""), version_(version) {}
+
+  explicit OpSetID(std::string domain, int64_t version)
+      : domain_(std::move(domain)), version_(version) {}
+
+  const std::string& domain() const { return domain_; }
+  int64_t version() const { return version_; }
+  void setVersion(int64_t newVal) { version_ = newVal; }
+
+ private:
+  std::string domain_;
+  int64_t version_;
+};
+
+struct Node : public Attributes<Node> {
   MY_AI_TRAINING_DISALLOW_COPY_AND_ASSIGN(Node);
   friend struct Graph;
   friend struct Value;
@@ -276,6 +490,13 @@ struct Node {
     has_doc_string_ = true;
     doc_string_ = std::move(doc_string);
   }
+  // Subgraph attributes let other graphs reference values of this graph
+  // (see Value::uses()), so the owning graph is told about them.
+  Node* g_(Symbol name, GraphAttr::ConstructorType v);
+  Node* gs_(Symbol name, GraphsAttr::ConstructorType v);
+  using Attributes<Node>::g;
+  using Attributes<Node>::gs;
+
   NodeKind kind() const { return kind_; }
   Graph* owningGraph() { return graph_; }
   const Graph* owningGraph() const { return graph_; }
@@ -610,12 +831,530 @@ struct Graph final {
   // input
   Node* const initializer_node_;
 
+  // initializers_[i] is named initializer_names_[i]
+  std::vector<Tensor> initializers_;
   std::vector<std::string> initializer_names_;
 
+  // resolves initializers whose payload lives in external data files
+  std::shared_ptr<ExternalDataStore> external_data_;
+
   bool has_name_;
   std::string name_;
   bool has_doc_string_;
   std::string doc_string_;
+
+  // set once any value or initializer is explicitly given a name that looks
+  // like a generated one ("_v_N"); until then generated names are unique by
+  // construction and isNameUnique() need not scan the whole graph, which
+  // would make building a graph quadratic.
+  bool has_var_style_names_ = false;
+
+  // set once a node of this graph gets a subgraph attribute; until then no
+  // other graph can capture our values and Value::uses() needs no search
+  bool has_subgraphs_ = false;
+
+  std::vector<OpSetID> opset_versions_;
+
+  void noteName(const std::string& name) {
+    if (name.compare(0, 3, "_v_") == 0) has_var_style_names_ = true;
+  }
+
+  bool isNameUnique(const std::string& name) const {
+    if (!has_var_style_names_) return true;
+    if (std::find(initializer_names_.cbegin(), initializer_names_.cend(),
+                  name) != initializer_names_.cend()) {
+      return false;
+    }
+    for (const Value* v : all_values) {
+      if (v->has_unique_name() && v->uniqueName() == name) return false;
+    }
+    return true;
+  }
+
+ public:
+  Graph()
+      : next_unique_(0),
+        new_node_stage_(0),
+        output_(initOutput(create(kReturn, 0))),
+        input_(create(kParam, 0)),
+        initializer_node_(create(kParam, 0)),
+        has_name_(false),
+        has_doc_string_(false) {}
+
+  bool has_doc_string() const { return has_doc_string_; }
+  const std::string& docString() const { return doc_string_; }
+  void setDocString(std::string doc_string) {
+    has_doc_string_ = true;
+    doc_string_ = std::move(doc_string);
+  }
+
+  // Initializers
+  //
+  // Copying a Tensor only shares its payload, so adding, looking up and
+  // returning initializers never copies weights.
+
+  void addInitializer(Tensor& initializer) {
+    if (initializer.name().empty()) {
+      initializer.setName(toVarName(getNextUnique()));
+    } else {
+      noteName(initializer.name());
+    }
+    initializers_.push_back(initializer);
+    initializer_names_.push_back(initializer.name());
+  }
+
+  // For IR >= 4, initializer is not required to exist in input
+  // Add initializer into initializer node list and return its Value*
+  Value* addInitializerAndCreateValue(Tensor& initializer) {
+    addInitializer(initializer);
+    auto* init_value = initializer_node_->addOutput();
+    std::vector<Dimension> dim_sizes{initializer.sizes().cbegin(),
+                                     initializer.sizes().cend()};
+    init_value->setUniqueName(initializer.name());
+    init_value->setSizes(dim_sizes);
+    init_value->setElemType(initializer.elem_type());
+    return init_value;
+  }
+
+  // Register an initializer whose bytes live in an external data file,
+  // resolved through externalDataStore(). Nothing is read or mapped until
+  // the payload is first accessed.
+  Value* addExternalInitializerAndCreateValue(std::string name,
+                                              int32_t elem_type,
+                                              std::vector<int64_t> sizes,
+                                              const ExternalDataInfo& info) {
+    ONNX_ASSERTM(external_data_ != nullptr,
+                 "graph has no external data store");
+    Tensor initializer(elem_type, std::move(sizes));
+    initializer.setName(std::move(name));
+    initializer.setBuffer(external_data_->loadLazily(
+        info, initializer.expectedByteSize()));
+    return addInitializerAndCreateValue(initializer);
+  }
+
+  void eraseInitializer(const std::string& name) {
+    initializers_.erase(
+        std::remove_if(initializers_.begin(), initializers_.end(),
+                       [&name](Tensor& initializer) {
+                         return initializer.name() == name;
+                       }),
+        initializers_.end());
+    initializer_names_.erase(
+        std::remove(initializer_names_.begin(), initializer_names_.end(),
+                    name),
+        initializer_names_.end());
+    for (size_t i = 0; i < initializer_node_->outputs().size(); i++) {
+      if (initializer_node_->outputs()[i]->uniqueName() == name) {
+        initializer_node_->eraseOutput(i);
+        break;
+      }
+    }
+  }
+  void clearInitializers() {
+    initializers_.clear();
+    initializer_names_.clear();
+  }
+  const std::vector<Tensor>& initializers() const { return initializers_; }
+  const std::vector<std::string>& initializer_names() const {
+    return initializer_names_;
+  }
+  std::vector<Tensor>::const_iterator getInitializer(
+      const std::string& name) const {
+    for (auto it = initializers_.cbegin(); it != initializers_.cend(); ++it) {
+      if (name == it->name()) {
+        return it;
+      }
+    }
+    return initializers_.end();
+  }
+  // replace the payload of an existing initializer, e.g. after folding
+  void setInitializer(const std::string& name, Tensor initializer) {
+    for (auto& it : initializers_) {
+      if (it.name() == name) {
+        initializer.setName(name);
+        it = std::move(initializer);
+        return;
+      }
+    }
+    ONNX_ASSERTM(false, "no initializer named %s", name.c_str());
+  }
+
+  const std::shared_ptr<ExternalDataStore>& externalDataStore() const {
+    return external_data_;
+  }
+  void setExternalDataStore(std::shared_ptr<ExternalDataStore> store) {
+    external_data_ = std::move(store);
+  }
+
+  ArrayRef<Value*> inputs() { return input_->outputs(); }
+  ArrayRef<const Value*> inputs() const {
+    const auto& inputs = input_->outputs();
+    return {inputs.data(), inputs.size()};
+  }
+  ArrayRef<Value*> outputs() { return output_->inputs(); }
+  ArrayRef<const Value*> outputs() const {
+    return static_cast<const Node*>(output_)->inputs();
+  }
+  // values produced by initializers which are not graph inputs
+  ArrayRef<Value*> initializerValues() { return initializer_node_->outputs(); }
+  ArrayRef<const Value*> initializerValues() const {
+    return static_cast<const Node*>(initializer_node_)->outputs();
+  }
+  // whether 'v' is one of initializerValues(), i.e. a constant
+  bool isInitializerValue(const Value* v) const {
+    return v->node() == initializer_node_;
+  }
+  graph_node_list nodes() { return graph_node_list(output_, kNextDirection); }
+  const_graph_node_list nodes() const {
+    return const_graph_node_list(output_, kNextDirection);
+  }
+
+  size_t getNextUnique() {
+    std::string next_unique_name = toVarName(++next_unique_);
+    while (!isNameUnique(next_unique_name)) {
+      next_unique_name = toVarName(++next_unique_);
+    }
+    return next_unique_;
+  }
+
+  // These invocations of begin() on output of function are OK
+  // because graph_node_list is non-owning, so it doesn't matter
+  // if it immediately dies after the invocation.
+  graph_node_list_iterator begin() { return nodes().begin(); }
+  const_graph_node_list_iterator begin() const { return nodes().begin(); }
+  graph_node_list_iterator end() { return nodes().end(); }
+  const_graph_node_list_iterator end() const { return nodes().end(); }
+  graph_node_list_iterator rbegin() { return nodes().rbegin(); }
+  const_graph_node_list_iterator rbegin() const { return nodes().rbegin(); }
+  graph_node_list_iterator rend() { return nodes().rend(); }
+  const_graph_node_list_iterator rend() const { return nodes().rend(); }
+  Node* return_node() { return output_; }
+  const Node* return_node() const { return output_; }
+
+  Value* addInput() { return input_->addOutput(); }
+  void eraseInput(size_t i) { input_->eraseOutput(i); }
+  void advanceStage() { new_node_stage_++; }
+  void setStage(size_t new_stage) { new_node_stage_ = new_stage; }
+  size_t stage() const { return new_node_stage_; }
+  ResourceGuard setStageTemporary(size_t s) {
+    auto prev_stage = new_node_stage_;
+    new_node_stage_ = s;
+    return ResourceGuard(
+        [prev_stage, this]() { this->new_node_stage_ = prev_stage; });
+  }
+
+  size_t registerOutput(Value* n) {
+    output_->addInput(n);
+    return outputs().size() - 1;
+  }
+
+  Node* create(NodeKind kind, size_t num_outputs = 1) {
+    // NB: Node constructor adds node to all_nodes
+    auto n = new Node(this, kind);
+    for (size_t i = 0; i < num_outputs; i++) n->addOutput();
+    return n;
+  }
+
+  Node* create(NodeKind kind, ArrayRef<Value*> inputs,
+               size_t num_outputs = 1) {
+    auto n = create(kind, num_outputs);
+    for (auto i : inputs) n->addInput(i);
+    return n;
+  }
+
+  Node* appendNode(Node* n) {
+    ONNX_ASSERT(n->graph_ == this && !n->inGraphList());
+    n->insertBefore(output_);
+    return n;
+  }
+
+  Node* prependNode(Node* n) {
+    ONNX_ASSERT(n->graph_ == this && !n->inGraphList());
+    n->insertAfter(output_);
+    return n;
+  }
+
+  // Adds to graph initializer list, initializer names list, and as a graph
+  // input. Also syncs the initializer name, tensor name, and value name
+  Value* addInitializerAndInput(const Tensor& initializer,
+                                const std::string& name) {
+    Tensor initializerCopy = initializer;
+    std::vector<Dimension> dim_sizes{initializerCopy.sizes().cbegin(),
+                                     initializerCopy.sizes().cend()};
+    Value* new_init = addInput();
+    initializerCopy.setName(name);
+    new_init->setUniqueName(name);
+    new_init->setSizes(dim_sizes);
+    new_init->setElemType(initializerCopy.elem_type());
+    addInitializer(initializerCopy);
+    return new_init;
+  }
+
+  Value* addInitializerAndInput(const Tensor& initializer) {
+    return addInitializerAndInput(initializer, toVarName(getNextUnique()));
+  }
+
+  // Erases from graph initializer list, initializer names list, and as a
+  // graph input. Must have no uses
+  void eraseInitializerAndInput(Value* v) {
+    eraseInitializer(v->uniqueName());
+    if (v->node() == input_) {
+      eraseInput(v->offset());
+    }
+  }
+
+  ~Graph() {
+    for (const Node* n : all_nodes) delete n;
+    for (const Value* v : all_values) delete v;
+  }
+
+  bool has_name() const { return has_name_; }
+  const std::string& name() const { return name_; }
+  void setName(std::string name) {
+    has_name_ = true;
+    name_ = std::move(name);
+  }
+
+  std::vector<OpSetID>& opset_versions_mutable() { return opset_versions_; }
+  const std::vector<OpSetID>& opset_versions() const {
+    return opset_versions_;
+  }
+
+  bool hasSubgraphs() const { return has_subgraphs_; }
+
+  void forSelfAndEachSubGraph(const std::function<void(Graph*)>& fn) {
+    fn(this);
+    if (!has_subgraphs_) return;
+    for (const Node* node : all_nodes) {
+      for (const auto& attr : node->attributeNames()) {
+        if (node->kindOf(attr) == AttributeKind::g) {
+          std::shared_ptr<Graph> subgraph = node->g(attr);
+          subgraph->forSelfAndEachSubGraph(fn);
+        } else if (node->kindOf(attr) == AttributeKind::gs) {
+          for (const auto& subgraph : node->gs(attr)) {
+            subgraph->forSelfAndEachSubGraph(fn);
+          }
+        }
+      }
+    }
+  }
+
+  void forSelfAndEachSubGraph(
+      const std::function<void(const Graph*)>& fn) const {
+    fn(this);
+    if (!has_subgraphs_) return;
+    for (const Node* node : all_nodes) {
+      for (const auto& attr : node->attributeNames()) {
+        if (node->kindOf(attr) == AttributeKind::g) {
+          std::shared_ptr<const Graph> subgraph = node->g(attr);
+          subgraph->forSelfAndEachSubGraph(fn);
+        } else if (node->kindOf(attr) == AttributeKind::gs) {
+          for (const auto& subgraph : node->gs(attr)) {
+            std::shared_ptr<const Graph> const_subgraph = subgraph;
+            const_subgraph->forSelfAndEachSubGraph(fn);
+          }
+        }
+      }
+    }
+  }
+
+  void forEachNode(const std::function<void(Node*)>& fn) {
+    forSelfAndEachSubGraph([fn](Graph* graph) {
+      for (Node* node : graph->nodes()) {
+        fn(node);
+      }
+    });
+  }
+
+  void forEachNode(const std::function<void(const Node*)>& fn) const {
+    forSelfAndEachSubGraph([fn](const Graph* graph) {
+      for (const Node* node : graph->nodes()) {
+        fn(node);
+      }
+    });
+  }
+
+ private:
+  // should only be called in the constructor
+  Node* initOutput(Node* p) {
+    p->next() = p;
+    p->prev() = p;
+    p->setStage(std::numeric_limits<size_t>::max());
+    return p;
+  }
+
+  void freeNode(Node* n) {
+    auto it = all_nodes.find(n);
+    ONNX_ASSERT(it != all_nodes.end());
+    delete *it;
+    all_nodes.erase(it);
+  }
+  void freeValue(Value* v) {
+    auto it = all_values.find(v);
+    ONNX_ASSERT(it != all_values.end());
+    delete *it;
+    all_values.erase(it);
+  }
 };
 
+inline Value::Value(Node* node_, size_t offset_)
+    : node_(node_),
+      offset_(offset_),
+      unique_(node_->graph_->getNextUnique()),
+      stage_(node_->graph_->new_node_stage_),
+      has_unique_name_(false),
+      elem_type_(TensorProto_DataType_UNDEFINED),
+      has_sizes_(false) {
+  node_->graph_->all_values.emplace(this);
+}
+
+inline Graph* Value::owningGraph() { return node()->owningGraph(); }
+
+inline const Graph* Value::owningGraph() const {
+  return node()->owningGraph();
+}
+
+// Initializer names are also stored in graph.initializer_names_, they are
+// renamed together with the value.
+inline Value* Value::setUniqueName(const std::string& name,
+                                   bool rename_subgraph_captured_nodes) {
+  auto* graph = owningGraph();
+  graph->noteName(name);
+  if (has_unique_name() && rename_subgraph_captured_nodes) {
+    for (size_t i = 0; i < graph->initializer_names_.size(); i++) {
+      auto& initializer_name = graph->initializer_names_[i];
+      if (initializer_name == unique_name_) {
+        initializer_name = name;
+        graph->initializers_[i].setName(name);
+      }
+    }
+  }
+  unique_name_ = name;
+  has_unique_name_ = true;
+  return this;
+}
+
+// Values of a graph can also be used by its subgraphs, which refer to them
+// by name through `Captured` nodes; those uses are collected here too.
+inline const use_list Value::uses() const {
+  const Graph* graph = owningGraph();
+  if (!graph->hasSubgraphs()) return uses_in_current_graph_;
+  use_list all_uses = uses_in_current_graph_;
+  const std::string name = uniqueName();
+  graph->forEachNode([graph, &name, &all_uses](const Node* node) {
+    if (node->owningGraph() == graph) {
+      // skip non-subgraph
+      return;
+    }
+    if (node->kind() == kCaptured) {
+      const Value* output = node->outputs()[0];
+      if (output->uniqueName() == name) {
+        const auto output_uses = output->uses();
+        all_uses.insert(all_uses.end(), output_uses.begin(),
+                        output_uses.end());
+      }
+    }
+  });
+  return all_uses;
+}
+
+inline void Value::replaceAllUsesWith(Value* newValue) {
+  auto* graph = owningGraph();
+  ONNX_ASSERT(graph == newValue->owningGraph());
+  // propagate sizes and elem type
+  if (this->has_sizes()) {
+    newValue->setSizes(this->sizes());
+  }
+  if (this->elemType() != TensorProto_DataType_UNDEFINED) {
+    newValue->setElemType(this->elemType());
+  }
+  const auto unique_name = this->uniqueName();
+  // We do not want the optimization to change the graph output name
+  if (std::find(graph->outputs().rbegin(), graph->outputs().rend(), this) !=
+      graph->outputs().rend()) {
+    // fall back to the generated name, unique by construction
+    this->has_unique_name_ = false;
+    this->unique_name_.clear();
+    newValue->setUniqueName(unique_name, false);
+  }
+  for (auto u : uses_in_current_graph_) {
+    u.user->inputs_[u.offset] = newValue;
+    newValue->uses_in_current_graph_.push_back(u);
+  }
+  uses_in_current_graph_.clear();
+}
+
+inline Node::Node(Graph* graph_, NodeKind kind_)
+    : kind_(kind_),
+      graph_(graph_),
+      stage_(graph_->new_node_stage_),
+      has_name_(false),
+      has_domain_(false),
+      has_doc_string_(false),
+      has_overload_(false) {
+  graph_->all_nodes.emplace(this);
+}
+
+inline void Node::eraseOutput(size_t i) {
+  ONNX_ASSERT(i < outputs_.size());
+  ONNX_ASSERT(outputs_[i]->uses().empty());
+  Value* n = outputs_[i];
+  outputs_.erase(outputs_.begin() + i);
+  owningGraph()->freeValue(n);
+  for (size_t j = i; j < outputs_.size(); j++) {
+    outputs_[j]->offset_--;
+  }
+}
+
+inline bool Node::isBefore(Node* n) {
+  if (n == nullptr || this == n) {
+    // Bail out early.
+    return false;
+  }
+  // return true if node is Param (in initializers)
+  if (kind_ == kParam) {
+    return true;
+  }
+  // return false if target node is Param (in initializers)
+  if (n->kind() == kParam) {
+    return false;
+  }
+  ONNX_ASSERT(n->inGraphList());
+  for (Node* p = next(); p != *graph_->end(); p = p->next()) {
+    if (p == n) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void Node::destroy() {
+  ONNX_ASSERT(inGraphList());
+  while (!outputs().empty()) eraseOutput(outputs().size() - 1);
+  removeAllInputs();
+  removeFromList();
+  graph_->freeNode(this);
+}
+
+inline Node* Node::g_(Symbol name, GraphAttr::ConstructorType v) {
+  graph_->has_subgraphs_ = true;
+  return Attributes<Node>::g_(name, v);
+}
+
+inline Node* Node::gs_(Symbol name, GraphsAttr::ConstructorType v) {
+  graph_->has_subgraphs_ = true;
+  return Attributes<Node>::gs_(name, std::move(v));
+}
+
+inline graph_node_list_iterator Node::iterator() { return {this, 0}; }
+inline graph_node_list_iterator Node::reverseIterator() {
+  return iterator().reverse();
+}
+inline const_graph_node_list_iterator Node::iterator() const {
+  return {this, 0};
+}
+inline const_graph_node_list_iterator Node::reverseIterator() const {
+  return iterator().reverse();
+}
+
 }  // namespace my_ai_training::ir
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "onnx_ir/assertions.h"
+
+namespace my_ai_training::ir {
+
+// Protobuf wire types, see
+// https://protobuf.dev/programming-guides/encoding/#structure
+enum class WireType : uint8_t {
+  kVarint = 0,
+  kFixed64 = 1,
+  kLengthDelimited = 2,
+  kStartGroup = 3,
+  kEndGroup = 4,
+  kFixed32 = 5,
+};
+
+// Zero-copy cursor over one serialized protobuf message.
+//
+// Usage:
+//   ProtoReader reader(data, size);
+//   while (reader.next()) {
+//     switch (reader.field()) {
+//       case 1: name = reader.readBytes(); break;
+//       case 2: child = reader.readMessage(); break;
+//       default: reader.skip();
+//     }
+//   }
+//
+// Every field returned by next() must be consumed by exactly one read*() or
+// skip() call. Strings, bytes and sub-messages are returned as views into
+// the input, which must outlive them. Malformed input throws assert_error.
+class ProtoReader final {
+ public:
+  ProtoReader() : pos_(nullptr), end_(nullptr) {}
+  ProtoReader(const uint8_t* data, size_t size)
+      : pos_(data), end_(data + size) {}
+
+  // Advance to the next field, returns false at the end of the message.
+  bool next() {
+    if (pos_ >= end_) return false;
+    uint64_t key = varint();
+    field_ = static_cast<uint32_t>(key >> 3);
+    wire_type_ = static_cast<WireType>(key & 7);
+    ONNX_ASSERTM(field_ != 0, "invalid protobuf field number 0");
+    return true;
+  }
+
+  uint32_t field() const { return field_; }
+  WireType wireType() const { return wire_type_; }
+  const uint8_t* position() const { return pos_; }
+  size_t remaining() const { return static_cast<size_t>(end_ - pos_); }
+
+  uint64_t readVarint() {
+    expect(WireType::kVarint);
+    return varint();
+  }
+  int64_t readInt64() { return static_cast<int64_t>(readVarint()); }
+  int32_t readInt32() { return static_cast<int32_t>(readVarint()); }
+
+  float readFloat() {
+    expect(WireType::kFixed32);
+    return fixed<float>();
+  }
+  double readDouble() {
+    expect(WireType::kFixed64);
+    return fixed<double>();
+  }
+
+  std::string_view readBytes() {
+    expect(WireType::kLengthDelimited);
+    size_t size = length();
+    std::string_view bytes(reinterpret_cast<const char*>(pos_), size);
+    pos_ += size;
+    return bytes;
+  }
+
+  ProtoReader readMessage() {
+    std::string_view bytes = readBytes();
+    return ProtoReader(reinterpret_cast<const uint8_t*>(bytes.data()),
+                       bytes.size());
+  }
+
+  // Repeated scalar fields may arrive packed (one length-delimited run) or
+  // one element per field occurrence; both append to 'out'.
+  template <typename T>
+  void readRepeatedVarint(std::vector<T>* out) {
+    if (wire_type_ != WireType::kLengthDelimited) {
+      out->push_back(static_cast<T>(readVarint()));
+      return;
+    }
+    ProtoReader packed = readMessage();
+    while (packed.pos_ < packed.end_) {
+      out->push_back(static_cast<T>(packed.varint()));
+    }
+  }
+
+  // T is float (fixed32) or double (fixed64)
+  template <typename T>
+  void readRepeatedFixed(std::vector<T>* out) {
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "fixed32 or fixed64");
+    if (wire_type_ != WireType::kLengthDelimited) {
+      expect(sizeof(T) == 4 ? WireType::kFixed32 : WireType::kFixed64);
+      out->push_back(fixed<T>());
+      return;
+    }
+    std::string_view bytes = readBytes();
+    ONNX_ASSERTM(bytes.size() % sizeof(T) == 0,
+                 "packed field %u has a partial element", field_);
+    size_t old_size = out->size();
+    out->resize(old_size + bytes.size() / sizeof(T));
+    std::memcpy(out->data() + old_size, bytes.data(), bytes.size());
+  }
+
+  void skip() {
+    switch (wire_type_) {
+      case WireType::kVarint:
+        varint();
+        break;
+      case WireType::kFixed64:
+        advance(8);
+        break;
+      case WireType::kLengthDelimited:
+        advance(length());
+        break;
+      case WireType::kFixed32:
+        advance(4);
+        break;
+      default:
+        ONNX_ASSERTM(false, "unsupported protobuf wire type %d for field %u",
+                     static_cast<int>(wire_type_), field_);
+    }
+  }
+
+ private:
+  void expect(WireType wire_type) const {
+    ONNX_ASSERTM(wire_type_ == wire_type,
+                 "protobuf field %u has wire type %d, expected %d", field_,
+                 static_cast<int>(wire_type_), static_cast<int>(wire_type));
+  }
+
+  void advance(size_t n) {
+    ONNX_ASSERTM(n <= remaining(), "truncated protobuf field %u", field_);
+    pos_ += n;
+  }
+
+  uint64_t varint() {
+    // fast path: single byte
+    if (pos_ < end_ && *pos_ < 0x80) return *pos_++;
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      ONNX_ASSERTM(pos_ < end_, "truncated protobuf varint");
+      uint8_t byte = *pos_++;
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (byte < 0x80) return result;
+    }
+    ONNX_ASSERTM(false, "malformed protobuf varint");
+    return 0;
+  }
+
+  size_t length() {
+    uint64_t size = varint();
+    ONNX_ASSERTM(size <= remaining(), "truncated protobuf field %u", field_);
+    return static_cast<size_t>(size);
+  }
+
+  template <typename T>
+  T fixed() {
+    advance(sizeof(T));
+    T value;
+    std::memcpy(&value, pos_ - sizeof(T), sizeof(T));
+    return value;
+  }
+
+  const uint8_t* pos_;
+  const uint8_t* end_;
+  uint32_t field_ = 0;
+  WireType wire_type_ = WireType::kVarint;
+};
+
+}  // namespace my_ai_training::ir
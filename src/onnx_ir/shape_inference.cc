@@ -0,0 +1,1032 @@
+#include "onnx_ir/shape_inference.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace my_ai_training::ir {
+
+// InferenceContext
+
+bool InferenceContext::hasInput(size_t i) const {
+  return i < numInputs() && input(i)->node()->kind() != kUndefined;
+}
+
+const Tensor* InferenceContext::constantInput(size_t i) const {
+  if (!hasInput(i)) return nullptr;
+  const Value* v = input(i);
+  const Node* producer = v->node();
+  if (producer->kind() == kConstant && producer->hasAttribute(kvalue) &&
+      producer->kindOf(kvalue) == AttributeKind::t) {
+    return &producer->t(kvalue);
+  }
+  const Graph* graph = v->owningGraph();
+  if (!graph->isInitializerValue(v)) return nullptr;
+  auto it = graph->getInitializer(v->uniqueName());
+  return it == graph->initializers().end() ? nullptr : &*it;
+}
+
+bool InferenceContext::constantInts(size_t i,
+                                    std::vector<int64_t>* values) const {
+  const Tensor* t = constantInput(i);
+  if (t == nullptr || !t->hasRawData()) return false;
+  if (t->elem_type() == TensorProto_DataType_INT64) {
+    const int64_t* data = t->data<int64_t>();
+    values->assign(data, data + t->numel());
+    return true;
+  }
+  if (t->elem_type() == TensorProto_DataType_INT32) {
+    const int32_t* data = t->data<int32_t>();
+    values->assign(data, data + t->numel());
+    return true;
+  }
+  return false;
+}
+
+bool InferenceContext::constantFloats(size_t i,
+                                      std::vector<double>* values) const {
+  const Tensor* t = constantInput(i);
+  if (t == nullptr || !t->hasRawData()) return false;
+  if (t->elem_type() == TensorProto_DataType_FLOAT) {
+    const float* data = t->data<float>();
+    values->assign(data, data + t->numel());
+    return true;
+  }
+  if (t->elem_type() == TensorProto_DataType_DOUBLE) {
+    const double* data = t->data<double>();
+    values->assign(data, data + t->numel());
+    return true;
+  }
+  return false;
+}
+
+void InferenceContext::setOutputType(size_t i, int32_t elem_type) {
+  if (i >= numOutputs() || elem_type == TensorProto_DataType_UNDEFINED) {
+    return;
+  }
+  node_->outputs()[i]->setElemType(elem_type);
+}
+
+Dimension InferenceContext::mergeDims(const Dimension& a,
+                                      const Dimension& b) {
+  if (a == b || b.is_unknown()) return a;
+  if (a.is_unknown()) return b;
+  if (solver_ != nullptr) {
+    solver_->unify(a, b);
+    return solver_->resolve(a);
+  }
+  // a known extent is the better guess
+  return a.is_int() || !b.is_int() ? a : b;
+}
+
+void InferenceContext::setOutputShape(size_t i, ArrayRef<Dimension> shape) {
+  if (i >= numOutputs()) return;
+  if (solver_ == nullptr) {
+    node_->outputs()[i]->setSizes(shape);
+    return;
+  }
+  std::vector<Dimension> resolved;
+  resolved.reserve(shape.size());
+  for (const Dimension& d : shape) resolved.push_back(solver_->resolve(d));
+  node_->outputs()[i]->setSizes(resolved);
+}
+
+void InferenceContext::propagateInput(size_t from, size_t to) {
+  setOutputType(to, inputType(from));
+  if (hasInputShape(from)) setOutputShape(to, inputShape(from));
+}
+
+namespace {
+
+using Shape = std::vector<Dimension>;
+
+// Normalizes a possibly negative axis, false if out of range.
+bool normalizeAxis(int64_t* axis, size_t rank) {
+  int64_t r = static_cast<int64_t>(rank);
+  if (*axis < 0) *axis += r;
+  return *axis >= 0 && *axis < r;
+}
+
+int64_t intAttr(const Node* n, Symbol name, int64_t default_value) {
+  return n->hasAttribute(name) ? n->i(name) : default_value;
+}
+
+// ints attribute, or the constant input 'input' for opsets that moved it
+bool intsAttrOrInput(const InferenceContext& ctx, Symbol name, size_t input,
+                     std::vector<int64_t>* values) {
+  if (ctx.node()->hasAttribute(name)) {
+    *values = ctx.node()->is(name);
+    return true;
+  }
+  return ctx.constantInts(input, values);
+}
+
+Shape broadcastShapes(InferenceContext& ctx,
+                      const std::vector<ArrayRef<Dimension>>& shapes) {
+  size_t rank = 0;
+  for (auto& s : shapes) rank = std::max(rank, s.size());
+  Shape out(rank, Dimension(int64_t{1}));
+  for (auto& s : shapes) {
+    size_t offset = rank - s.size();
+    for (size_t i = 0; i < s.size(); i++) {
+      Dimension& d = out[offset + i];
+      // two different symbols are taken to be the same extent, as they
+      // are between the activations an elementwise op combines
+      d = d.is_param() && s[i].is_param() && ctx.solver() != nullptr
+              ? ctx.mergeDims(d, s[i])
+              : broadcastDims(d, s[i]);
+    }
+  }
+  return out;
+}
+
+void inferUnary(InferenceContext& ctx) { ctx.propagateInput(0, 0); }
+
+void inferDropout(InferenceContext& ctx) {
+  ctx.propagateInput(0, 0);
+  ctx.setOutputType(1, TensorProto_DataType_BOOL);
+  if (ctx.hasInputShape(0)) ctx.setOutputShape(1, ctx.inputShape(0));
+}
+
+// elementwise over broadcast inputs, output typed like input 'type_from' or
+// 'elem_type' if given
+void inferBroadcast(InferenceContext& ctx, size_t type_from,
+                    int32_t elem_type) {
+  ctx.setOutputType(0, elem_type != TensorProto_DataType_UNDEFINED
+                           ? elem_type
+                           : ctx.inputType(type_from));
+  std::vector<ArrayRef<Dimension>> shapes;
+  for (size_t i = 0; i < ctx.numInputs(); i++) {
+    if (!ctx.hasInputShape(i)) return;
+    shapes.push_back(ctx.inputShape(i));
+  }
+  if (!shapes.empty()) ctx.setOutputShape(0, broadcastShapes(ctx, shapes));
+}
+
+void inferBinary(InferenceContext& ctx) {
+  inferBroadcast(ctx, 0, TensorProto_DataType_UNDEFINED);
+}
+
+void inferComparison(InferenceContext& ctx) {
+  inferBroadcast(ctx, 0, TensorProto_DataType_BOOL);
+}
+
+void inferWhere(InferenceContext& ctx) {
+  inferBroadcast(ctx, 1, TensorProto_DataType_UNDEFINED);
+}
+
+void inferCast(InferenceContext& ctx) {
+  if (ctx.hasInputShape(0)) ctx.setOutputShape(0, ctx.inputShape(0));
+  if (ctx.node()->hasAttribute(kto)) {
+    ctx.setOutputType(0, static_cast<int32_t>(ctx.node()->i(kto)));
+  }
+}
+
+void inferConstant(InferenceContext& ctx) {
+  const Node* n = ctx.node();
+  if (!n->hasAttribute(kvalue) || n->kindOf(kvalue) != AttributeKind::t) {
+    return;
+  }
+  const Tensor& t = n->t(kvalue);
+  ctx.setOutputType(0, t.elem_type());
+  ctx.setOutputShape(0, Shape(t.sizes().begin(), t.sizes().end()));
+}
+
+void inferShape(InferenceContext& ctx) {
+  ctx.setOutputType(0, TensorProto_DataType_INT64);
+  if (!ctx.hasInputShape(0)) return;
+  ctx.setOutputShape(
+      0, Shape{Dimension(static_cast<int64_t>(ctx.inputShape(0).size()))});
+}
+
+void inferMatMulShape(InferenceContext& ctx) {
+  if (!ctx.hasInputShape(0) || !ctx.hasInputShape(1)) return;
+  Shape a = ctx.inputShape(0).vec();
+  Shape b = ctx.inputShape(1).vec();
+  if (a.empty() || b.empty()) return;
+  // 1-D operands are promoted to matrices and the extra dim dropped after
+  bool a_vector = a.size() == 1, b_vector = b.size() == 1;
+  if (a_vector) a.insert(a.begin(), Dimension(int64_t{1}));
+  if (b_vector) b.push_back(Dimension(int64_t{1}));
+  ctx.mergeDims(a.back(), b[b.size() - 2]);
+  Shape out =
+      broadcastShapes(ctx, {ArrayRef<Dimension>(a.data(), a.size() - 2),
+                            ArrayRef<Dimension>(b.data(), b.size() - 2)});
+  if (!a_vector) out.push_back(a[a.size() - 2]);
+  if (!b_vector) out.push_back(b.back());
+  ctx.setOutputShape(0, out);
+}
+
+void inferMatMul(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  inferMatMulShape(ctx);
+}
+
+void inferMatMulInteger(InferenceContext& ctx) {
+  ctx.setOutputType(0, TensorProto_DataType_INT32);
+  inferMatMulShape(ctx);
+}
+
+void inferGemm(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0) || !ctx.hasInputShape(1)) return;
+  auto a = ctx.inputShape(0);
+  auto b = ctx.inputShape(1);
+  if (a.size() != 2 || b.size() != 2) return;
+  bool trans_a = intAttr(ctx.node(), ktransA, 0) != 0;
+  bool trans_b = intAttr(ctx.node(), ktransB, 0) != 0;
+  ctx.mergeDims(trans_a ? a[0] : a[1], trans_b ? b[1] : b[0]);
+  ctx.setOutputShape(0, Shape{trans_a ? a[1] : a[0], trans_b ? b[0] : b[1]});
+}
+
+// Spatial attributes shared by Conv, ConvTranspose and the pooling ops.
+struct Window {
+  std::vector<int64_t> kernel, strides, dilations, pads;
+  std::string auto_pad = "NOTSET";
+
+  // false if the attributes do not fit 'spatial' dims
+  bool init(const Node* n, size_t spatial) {
+    if (n->hasAttribute(kkernel_shape)) kernel = n->is(kkernel_shape);
+    strides = n->hasAttribute(kstrides) ? n->is(kstrides)
+                                        : std::vector<int64_t>(spatial, 1);
+    dilations = n->hasAttribute(kdilations)
+                    ? n->is(kdilations)
+                    : std::vector<int64_t>(spatial, 1);
+    pads = n->hasAttribute(kpads) ? n->is(kpads)
+                                  : std::vector<int64_t>(2 * spatial, 0);
+    if (n->hasAttribute(kauto_pad)) auto_pad = n->s(kauto_pad);
+    return kernel.size() == spatial && strides.size() == spatial &&
+           dilations.size() == spatial && pads.size() == 2 * spatial;
+  }
+
+  int64_t effectiveKernel(size_t i) const {
+    return (kernel[i] - 1) * dilations[i] + 1;
+  }
+
+  // output extent of spatial dim i for a convolution or pooling
+  Dimension output(size_t i, const Dimension& in, bool ceil_mode) const {
+    if (auto_pad == "SAME_UPPER" || auto_pad == "SAME_LOWER") {
+      return divDims(addDims(in, strides[i] - 1), strides[i]);
+    }
+    int64_t padding =
+        auto_pad == "VALID" ? 0 : pads[i] + pads[i + kernel.size()];
+    Dimension span = subDims(addDims(in, padding), effectiveKernel(i));
+    if (ceil_mode) span = addDims(span, strides[i] - 1);
+    return addDims(divDims(span, strides[i]), int64_t{1});
+  }
+};
+
+void inferConv(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0) || !ctx.hasInputShape(1)) return;
+  auto x = ctx.inputShape(0);
+  auto w = ctx.inputShape(1);
+  if (x.size() < 3 || w.size() != x.size()) return;
+  size_t spatial = x.size() - 2;
+  Window window;
+  if (!ctx.node()->hasAttribute(kkernel_shape)) {
+    for (size_t i = 0; i < spatial; i++) {
+      if (!w[i + 2].is_int()) return;
+      window.kernel.push_back(w[i + 2].dim());
+    }
+  }
+  if (!window.init(ctx.node(), spatial)) return;
+  Shape out = {x[0], w[0]};
+  for (size_t i = 0; i < spatial; i++) {
+    out.push_back(window.output(i, x[i + 2], false));
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferConvTranspose(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0) || !ctx.hasInputShape(1)) return;
+  auto x = ctx.inputShape(0);
+  auto w = ctx.inputShape(1);
+  if (x.size() < 3 || w.size() != x.size()) return;
+  const Node* n = ctx.node();
+  size_t spatial = x.size() - 2;
+  Window window;
+  if (!n->hasAttribute(kkernel_shape)) {
+    for (size_t i = 0; i < spatial; i++) {
+      if (!w[i + 2].is_int()) return;
+      window.kernel.push_back(w[i + 2].dim());
+    }
+  }
+  if (!window.init(n, spatial)) return;
+  Shape out = {x[0], mulDims(w[1], intAttr(n, kgroup, 1))};
+  if (n->hasAttribute(koutput_shape)) {
+    const auto& output_shape = n->is(koutput_shape);
+    if (output_shape.size() != spatial) return;
+    out.insert(out.end(), output_shape.begin(), output_shape.end());
+    ctx.setOutputShape(0, out);
+    return;
+  }
+  std::vector<int64_t> output_padding =
+      n->hasAttribute(koutput_padding) ? n->is(koutput_padding)
+                                       : std::vector<int64_t>(spatial, 0);
+  if (output_padding.size() != spatial) return;
+  bool same = window.auto_pad == "SAME_UPPER" ||
+              window.auto_pad == "SAME_LOWER";
+  for (size_t i = 0; i < spatial; i++) {
+    Dimension scaled = mulDims(x[i + 2], window.strides[i]);
+    if (same) {
+      out.push_back(scaled);
+      continue;
+    }
+    // stride * (in - 1) + output_padding + effective kernel - pads
+    int64_t extra = output_padding[i] + window.effectiveKernel(i) -
+                    window.strides[i] - window.pads[i] -
+                    window.pads[i + spatial];
+    out.push_back(addDims(scaled, extra));
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferPool(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  ctx.setOutputType(1, TensorProto_DataType_INT64);  // MaxPool indices
+  if (!ctx.hasInputShape(0)) return;
+  auto x = ctx.inputShape(0);
+  if (x.size() < 3) return;
+  size_t spatial = x.size() - 2;
+  Window window;
+  if (!window.init(ctx.node(), spatial)) return;
+  bool ceil_mode = intAttr(ctx.node(), kceil_mode, 0) != 0;
+  Shape out = {x[0], x[1]};
+  for (size_t i = 0; i < spatial; i++) {
+    out.push_back(window.output(i, x[i + 2], ceil_mode));
+  }
+  ctx.setOutputShape(0, out);
+  ctx.setOutputShape(1, out);
+}
+
+void inferGlobalPool(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0)) return;
+  auto x = ctx.inputShape(0);
+  if (x.size() < 2) return;
+  Shape out = {x[0], x[1]};
+  out.resize(x.size(), Dimension(int64_t{1}));
+  ctx.setOutputShape(0, out);
+}
+
+void inferReshape(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  std::vector<int64_t> shape;
+  if (!ctx.constantInts(1, &shape)) {
+    // the rank is still known from the shape input
+    if (ctx.hasInputShape(1) && ctx.inputShape(1).size() == 1 &&
+        ctx.inputShape(1)[0].is_int() && ctx.inputShape(1)[0].dim() >= 0) {
+      ctx.setOutputShape(
+          0, Shape(static_cast<size_t>(ctx.inputShape(1)[0].dim())));
+    }
+    return;
+  }
+  bool allow_zero = intAttr(ctx.node(), kallowzero, 0) != 0;
+  Shape out;
+  int64_t infer_at = -1;
+  for (size_t i = 0; i < shape.size(); i++) {
+    if (shape[i] == 0 && !allow_zero) {
+      // copied from the input, whose extent may not be known
+      bool known = ctx.hasInputShape(0) && i < ctx.inputShape(0).size();
+      out.push_back(known ? ctx.inputShape(0)[i] : Dimension());
+    } else if (shape[i] == -1 && infer_at < 0) {
+      infer_at = static_cast<int64_t>(i);
+      out.emplace_back();
+    } else if (shape[i] >= 0) {
+      out.emplace_back(shape[i]);
+    } else {
+      return;
+    }
+  }
+  if (infer_at >= 0 && ctx.hasInputShape(0)) {
+    // symbolic: [N, S, 64] to [0, -1] is [N, 64*S]
+    Dimension total(int64_t{1});
+    for (auto& d : ctx.inputShape(0)) total = mulDims(total, d);
+    Dimension known(int64_t{1});
+    for (size_t i = 0; i < out.size(); i++) {
+      if (static_cast<int64_t>(i) != infer_at) known = mulDims(known, out[i]);
+    }
+    if (!(known.is_int() && known.dim() == 0)) {
+      out[infer_at] = divDims(total, known);
+    }
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferFlatten(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0)) return;
+  auto x = ctx.inputShape(0);
+  int64_t axis = intAttr(ctx.node(), kaxis, 1);
+  if (axis < 0) axis += static_cast<int64_t>(x.size());
+  if (axis < 0 || axis > static_cast<int64_t>(x.size())) return;
+  Dimension outer(int64_t{1}), inner(int64_t{1});
+  for (size_t i = 0; i < x.size(); i++) {
+    Dimension& d = static_cast<int64_t>(i) < axis ? outer : inner;
+    d = mulDims(d, x[i]);
+  }
+  ctx.setOutputShape(0, Shape{outer, inner});
+}
+
+void inferConcat(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0)) return;
+  Shape out = ctx.inputShape(0).vec();
+  int64_t axis = intAttr(ctx.node(), kaxis, 0);
+  if (!normalizeAxis(&axis, out.size())) return;
+  for (size_t i = 1; i < ctx.numInputs(); i++) {
+    if (!ctx.hasInputShape(i)) return;
+    auto s = ctx.inputShape(i);
+    if (s.size() != out.size()) return;
+    for (size_t d = 0; d < s.size(); d++) {
+      if (static_cast<int64_t>(d) == axis) {
+        out[d] = addDims(out[d], s[d]);
+      } else {
+        out[d] = ctx.mergeDims(out[d], s[d]);  // all inputs agree
+      }
+    }
+  }
+  ctx.setOutputShape(0, out);
+}
+
+// number of elements of a dim of extent 'dim' selected by Slice
+int64_t sliceLength(int64_t dim, int64_t start, int64_t end, int64_t step) {
+  if (dim == 0) return 0;  // and no index to clamp a backward walk to
+  if (start < 0) start += dim;
+  if (end < 0) end += dim;
+  // a stride of the dim or more takes one element, and no longer overflows
+  step = std::clamp<int64_t>(step, -dim, dim);
+  if (step > 0) {
+    start = std::clamp<int64_t>(start, 0, dim);
+    end = std::clamp<int64_t>(end, 0, dim);
+    return end > start ? (end - start - 1) / step + 1 : 0;
+  }
+  start = std::clamp<int64_t>(start, 0, dim - 1);
+  end = std::clamp<int64_t>(end, -1, dim - 1);
+  return start > end ? (start - end - 1) / -step + 1 : 0;
+}
+
+// Same for a symbolic dim, assuming the bounds fall inside it as they do in
+// exported graphs (x[1:], x[:-1], x[-k:]) since clamping has no symbolic
+// form.
+Dimension symbolicSliceLength(const Dimension& dim, int64_t start,
+                              int64_t end, int64_t step) {
+  const int64_t kEnd = std::numeric_limits<int32_t>::max();
+  if (dim.is_unknown() || step <= 0 || start >= kEnd) return Dimension();
+  Dimension from = start >= 0     ? Dimension(start)
+                   : start > -kEnd ? addDims(dim, Dimension(start))
+                                   : Dimension(int64_t{0});
+  Dimension to = end >= kEnd ? dim
+                 : end >= 0  ? Dimension(end)
+                 : end > -kEnd ? addDims(dim, Dimension(end))
+                               : Dimension(int64_t{0});
+  Dimension length = subDims(to, from);
+  if (step == 1) return length;
+  return divDims(addDims(length, Dimension(step - 1)), Dimension(step));
+}
+
+void inferSlice(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0)) return;
+  Shape out = ctx.inputShape(0).vec();
+  const Node* n = ctx.node();
+  std::vector<int64_t> starts, ends, axes, steps;
+  bool known;
+  if (n->hasAttribute(kstarts)) {  // opset < 10
+    starts = n->is(kstarts);
+    known = n->hasAttribute(kends);
+    if (known) ends = n->is(kends);
+    if (n->hasAttribute(kaxes)) axes = n->is(kaxes);
+  } else {
+    known = ctx.constantInts(1, &starts) && ctx.constantInts(2, &ends);
+    if (ctx.hasInput(3) && !ctx.constantInts(3, &axes)) {
+      // which dims change is unknown, only the rank is
+      ctx.setOutputShape(0, Shape(out.size()));
+      return;
+    }
+    if (ctx.hasInput(4) && !ctx.constantInts(4, &steps)) known = false;
+  }
+  if (axes.empty()) {
+    for (size_t i = 0; i < out.size(); i++) axes.push_back(i);
+    if (known) axes.resize(starts.size());
+  }
+  for (size_t i = 0; i < axes.size(); i++) {
+    int64_t axis = axes[i];
+    if (!normalizeAxis(&axis, out.size())) return;
+    if (!known || i >= starts.size() || i >= ends.size()) {
+      out[axis] = Dimension();
+      continue;
+    }
+    int64_t step = i < steps.size() ? steps[i] : 1;
+    if (step == 0) return;
+    Dimension& d = out[axis];
+    if (d.is_int()) {
+      d = Dimension(sliceLength(d.dim(), starts[i], ends[i], step));
+    } else {
+      d = symbolicSliceLength(d, starts[i], ends[i], step);
+    }
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferTranspose(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0)) return;
+  auto x = ctx.inputShape(0);
+  std::vector<int64_t> perm;
+  if (ctx.node()->hasAttribute(kperm)) {
+    perm = ctx.node()->is(kperm);
+  } else {
+    for (size_t i = x.size(); i > 0; i--) perm.push_back(i - 1);
+  }
+  if (perm.size() != x.size()) return;
+  Shape out;
+  for (int64_t p : perm) {
+    if (!normalizeAxis(&p, x.size())) return;
+    out.push_back(x[p]);
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferSqueeze(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0)) return;
+  auto x = ctx.inputShape(0);
+  std::vector<int64_t> axes;
+  bool has_axes = intsAttrOrInput(ctx, kaxes, 1, &axes);
+  if (!has_axes && ctx.hasInput(1)) return;  // not a constant
+  std::vector<bool> removed(x.size(), false);
+  if (has_axes) {
+    for (int64_t axis : axes) {
+      if (!normalizeAxis(&axis, x.size())) return;
+      removed[axis] = true;
+    }
+  } else {
+    // all dims of extent 1, which needs all extents
+    for (size_t i = 0; i < x.size(); i++) {
+      if (!x[i].is_int()) return;
+      removed[i] = x[i].dim() == 1;
+    }
+  }
+  Shape out;
+  for (size_t i = 0; i < x.size(); i++) {
+    if (!removed[i]) out.push_back(x[i]);
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferUnsqueeze(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0)) return;
+  auto x = ctx.inputShape(0);
+  std::vector<int64_t> axes;
+  if (!intsAttrOrInput(ctx, kaxes, 1, &axes)) return;
+  size_t rank = x.size() + axes.size();
+  std::vector<bool> inserted(rank, false);
+  for (int64_t axis : axes) {
+    if (!normalizeAxis(&axis, rank) || inserted[axis]) return;
+    inserted[axis] = true;
+  }
+  Shape out;
+  size_t next = 0;
+  for (size_t i = 0; i < rank; i++) {
+    out.push_back(inserted[i] ? Dimension(int64_t{1}) : x[next++]);
+  }
+  ctx.setOutputShape(0, out);
+}
+
+// Resize (X, roi, scales, sizes) and Upsample (X, scales)
+void inferResize(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0)) return;
+  auto x = ctx.inputShape(0);
+  const Node* n = ctx.node();
+  std::vector<int64_t> sizes;
+  if (n->kind() == kResize && ctx.constantInts(3, &sizes) &&
+      sizes.size() == x.size()) {
+    ctx.setOutputShape(0, Shape(sizes.begin(), sizes.end()));
+    return;
+  }
+  std::vector<double> scales;
+  if (n->hasAttribute(kscales)) {
+    scales = n->fs(kscales);
+  } else if (!ctx.constantFloats(n->kind() == kResize ? 2 : 1, &scales)) {
+    return;
+  }
+  if (scales.size() != x.size()) return;
+  Shape out;
+  for (size_t i = 0; i < x.size(); i++) {
+    if (scales[i] == 1.0) {
+      out.push_back(x[i]);
+    } else if (x[i].is_int()) {
+      out.emplace_back(static_cast<int64_t>(
+          std::floor(static_cast<double>(x[i].dim()) * scales[i])));
+    } else {
+      out.emplace_back();
+    }
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferExpand(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  std::vector<int64_t> shape;
+  if (!ctx.hasInputShape(0) || !ctx.constantInts(1, &shape)) return;
+  Shape target(shape.begin(), shape.end());
+  ctx.setOutputShape(0, broadcastShapes(ctx, {ctx.inputShape(0), target}));
+}
+
+void inferTile(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  std::vector<int64_t> repeats;
+  if (!ctx.hasInputShape(0) || !ctx.constantInts(1, &repeats)) return;
+  auto x = ctx.inputShape(0);
+  if (repeats.size() != x.size()) return;
+  Shape out;
+  for (size_t i = 0; i < x.size(); i++) {
+    out.push_back(mulDims(x[i], repeats[i]));
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferPad(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  std::vector<int64_t> pads;
+  if (!ctx.hasInputShape(0) || !intsAttrOrInput(ctx, kpads, 1, &pads)) return;
+  auto x = ctx.inputShape(0);
+  if (pads.size() != 2 * x.size()) return;
+  Shape out;
+  for (size_t i = 0; i < x.size(); i++) {
+    out.push_back(addDims(x[i], pads[i] + pads[i + x.size()]));
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferGather(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0) || !ctx.hasInputShape(1)) return;
+  auto data = ctx.inputShape(0);
+  int64_t axis = intAttr(ctx.node(), kaxis, 0);
+  if (!normalizeAxis(&axis, data.size())) return;
+  Shape out(data.begin(), data.begin() + axis);
+  auto indices = ctx.inputShape(1);
+  out.insert(out.end(), indices.begin(), indices.end());
+  out.insert(out.end(), data.begin() + axis + 1, data.end());
+  ctx.setOutputShape(0, out);
+}
+
+void inferSplit(InferenceContext& ctx) {
+  for (size_t i = 0; i < ctx.numOutputs(); i++) {
+    ctx.setOutputType(i, ctx.inputType(0));
+  }
+  if (!ctx.hasInputShape(0)) return;
+  auto x = ctx.inputShape(0);
+  int64_t axis = intAttr(ctx.node(), kaxis, 0);
+  if (!normalizeAxis(&axis, x.size())) return;
+  auto unknownParts = [&]() {
+    for (size_t i = 0; i < ctx.numOutputs(); i++) {
+      Shape out = x.vec();
+      out[axis] = Dimension();
+      ctx.setOutputShape(i, out);
+    }
+  };
+  std::vector<int64_t> split;
+  if (!intsAttrOrInput(ctx, ksplit, 1, &split)) {
+    if (ctx.hasInput(1)) return;  // not a constant
+    int64_t n = static_cast<int64_t>(ctx.numOutputs());
+    if (n == 0) return;
+    // parts of ceil(dim / n), the last one smaller if needed (opset 18);
+    // no such split when the parts before the last exceed the dim
+    int64_t dim = x[axis].is_int() ? x[axis].dim() : -1;
+    int64_t part = (dim + n - 1) / n;
+    if (dim < 0 || part * (n - 1) > dim) {
+      unknownParts();
+      return;
+    }
+    for (int64_t i = 0; i < n - 1; i++) split.push_back(part);
+    split.push_back(dim - part * (n - 1));
+  }
+  if (split.size() != ctx.numOutputs()) return;
+  for (int64_t extent : split) {
+    if (extent < 0) return;
+  }
+  for (size_t i = 0; i < split.size(); i++) {
+    Shape out = x.vec();
+    out[axis] = Dimension(split[i]);
+    ctx.setOutputShape(i, out);
+  }
+}
+
+void inferReduce(InferenceContext& ctx) {
+  ctx.setOutputType(0, ctx.inputType(0));
+  if (!ctx.hasInputShape(0)) return;
+  auto x = ctx.inputShape(0);
+  std::vector<int64_t> axes;
+  if (!intsAttrOrInput(ctx, kaxes, 1, &axes) && ctx.hasInput(1)) return;
+  bool keepdims = intAttr(ctx.node(), kkeepdims, 1) != 0;
+  std::vector<bool> reduced(x.size(), axes.empty());
+  for (int64_t axis : axes) {
+    if (!normalizeAxis(&axis, x.size())) return;
+    reduced[axis] = true;
+  }
+  Shape out;
+  for (size_t i = 0; i < x.size(); i++) {
+    if (!reduced[i]) {
+      out.push_back(x[i]);
+    } else if (keepdims) {
+      out.emplace_back(int64_t{1});
+    }
+  }
+  ctx.setOutputShape(0, out);
+}
+
+void inferArgMax(InferenceContext& ctx) {
+  ctx.setOutputType(0, TensorProto_DataType_INT64);
+  if (!ctx.hasInputShape(0)) return;
+  Shape out = ctx.inputShape(0).vec();
+  int64_t axis = intAttr(ctx.node(), kaxis, 0);
+  if (!normalizeAxis(&axis, out.size())) return;
+  if (intAttr(ctx.node(), kkeepdims, 1) != 0) {
+    out[axis] = Dimension(int64_t{1});
+  } else {
+    out.erase(out.begin() + axis);
+  }
+  ctx.setOutputShape(0, out);
+}
+
+// Outputs agree with both branches where the branches agree.
+void inferIf(InferenceContext& ctx) {
+  const Node* n = ctx.node();
+  if (!n->hasAttribute(kthen_branch) || !n->hasAttribute(kelse_branch)) {
+    return;
+  }
+  auto then_outputs = n->g(kthen_branch)->outputs();
+  auto else_outputs = n->g(kelse_branch)->outputs();
+  if (then_outputs.size() != ctx.numOutputs() ||
+      else_outputs.size() != ctx.numOutputs()) {
+    return;
+  }
+  for (size_t i = 0; i < ctx.numOutputs(); i++) {
+    const Value* a = then_outputs[i];
+    const Value* b = else_outputs[i];
+    if (a->elemType() == b->elemType()) ctx.setOutputType(i, a->elemType());
+    if (!a->has_sizes() || !b->has_sizes() ||
+        a->sizes().size() != b->sizes().size()) {
+      continue;
+    }
+    Shape out;
+    for (size_t d = 0; d < a->sizes().size(); d++) {
+      out.push_back(a->sizes()[d] == b->sizes()[d] ? a->sizes()[d]
+                                                   : Dimension());
+    }
+    ctx.setOutputShape(i, out);
+  }
+}
+
+std::unordered_map<uint32_t, InferenceFunction>& registry() {
+  static auto* rules = [] {
+    auto* r = new std::unordered_map<uint32_t, InferenceFunction>();
+    for (NodeKind k :
+         {kNeg, kSigmoid, kTanh, kExp, kLog, kSqrt, kRelu, kClip, kLeakyRelu,
+          kHardSigmoid, kHardSwish, kErf, kGelu, kSoftmax, kLogSoftmax,
+          kIdentity, kBatchNormalization}) {
+      (*r)[k] = inferUnary;
+    }
+    for (NodeKind k : {kAdd, kSub, kMul, kDiv, kPow, kPRelu}) {
+      (*r)[k] = inferBinary;
+    }
+    for (NodeKind k : {kGreater, kLess, kEqual}) (*r)[k] = inferComparison;
+    for (NodeKind k :
+         {kReduceL1, kReduceL2, kReduceLogSum, kReduceLogSumExp, kReduceMax,
+          kReduceMean, kReduceMin, kReduceProd, kReduceSum,
+          kReduceSumSquare}) {
+      (*r)[k] = inferReduce;
+    }
+    (*r)[kWhere] = inferWhere;
+    (*r)[kDropout] = inferDropout;
+    (*r)[kCast] = inferCast;
+    (*r)[kConstant] = inferConstant;
+    (*r)[kShape] = inferShape;
+    (*r)[kMatMul] = inferMatMul;
+    (*r)[kMatMulInteger] = inferMatMulInteger;
+    (*r)[kGemm] = inferGemm;
+    (*r)[kConv] = inferConv;
+    (*r)[kConvTranspose] = inferConvTranspose;
+    (*r)[kMaxPool] = inferPool;
+    (*r)[kAveragePool] = inferPool;
+    (*r)[kGlobalAveragePool] = inferGlobalPool;
+    (*r)[kGlobalMaxPool] = inferGlobalPool;
+    (*r)[kReshape] = inferReshape;
+    (*r)[kFlatten] = inferFlatten;
+    (*r)[kConcat] = inferConcat;
+    (*r)[kSlice] = inferSlice;
+    (*r)[kTranspose] = inferTranspose;
+    (*r)[kSqueeze] = inferSqueeze;
+    (*r)[kUnsqueeze] = inferUnsqueeze;
+    (*r)[kResize] = inferResize;
+    (*r)[kUpsample] = inferResize;
+    (*r)[kExpand] = inferExpand;
+    (*r)[kTile] = inferTile;
+    (*r)[kPad] = inferPad;
+    (*r)[kGather] = inferGather;
+    (*r)[kSplit] = inferSplit;
+    (*r)[kArgMax] = inferArgMax;
+    (*r)[kIf] = inferIf;
+    return r;
+  }();
+  return *rules;
+}
+
+// type and shape of a value, to tell whether inference changed it
+struct TypeAndShape {
+  explicit TypeAndShape(const Value* v)
+      : elem_type(v->elemType()), has_sizes(v->has_sizes()) {
+    if (has_sizes) sizes = v->sizes().vec();
+  }
+  bool matches(const Value* v) const {
+    return elem_type == v->elemType() && has_sizes == v->has_sizes() &&
+           (!has_sizes || v->sizes().equals(sizes));
+  }
+  int32_t elem_type;
+  bool has_sizes;
+  Shape sizes;
+};
+
+// Copies type and shape of 'from' into 'to', true if 'to' changed.
+bool copyInfo(const Value* from, Value* to) {
+  TypeAndShape before(to);
+  to->setElemType(from->elemType());
+  if (from->has_sizes()) {
+    to->setSizes(from->sizes());
+  } else {
+    to->wipeSizes();
+  }
+  return !before.matches(to);
+}
+
+// Runs the rule of 'n' and adds the outputs it changed to 'changed'.
+void inferNode(Node* n, DimSolver* solver, std::vector<Value*>* changed) {
+  auto& rules = registry();
+  auto it = rules.find(n->kind());
+  if (it == rules.end()) return;
+  std::vector<TypeAndShape> before;
+  before.reserve(n->outputs().size());
+  for (const Value* v : n->outputs()) before.emplace_back(v);
+  InferenceContext ctx(n, solver);
+  it->second(ctx);
+  for (size_t i = 0; i < before.size(); i++) {
+    if (!before[i].matches(n->outputs()[i])) {
+      changed->push_back(n->outputs()[i]);
+    }
+  }
+}
+
+template <typename Fn>
+void forEachSubgraph(Node* n, Fn fn) {
+  for (Symbol name : n->attributeNames()) {
+    AttributeKind kind = n->kindOf(name);
+    if (kind == AttributeKind::g) {
+      fn(*n->g(name));
+    } else if (kind == AttributeKind::gs) {
+      for (auto& g : n->gs(name)) fn(*g);
+    }
+  }
+}
+
+// Values visible to a subgraph by name, innermost graph first.
+struct Scope {
+  const Scope* parent = nullptr;
+  std::unordered_map<std::string, Value*> values;
+
+  Value* find(const std::string& name) const {
+    for (const Scope* s = this; s != nullptr; s = s->parent) {
+      auto it = s->values.find(name);
+      if (it != s->values.end()) return it->second;
+    }
+    return nullptr;
+  }
+};
+
+void inferGraph(Graph& graph, const Scope* parent, DimSolver* solver) {
+  Scope scope;
+  scope.parent = parent;
+  // only subgraphs look values up by name
+  bool track = graph.hasSubgraphs();
+  if (track) {
+    for (Value* v : graph.inputs()) scope.values[v->uniqueName()] = v;
+    for (Value* v : graph.initializerValues()) {
+      scope.values[v->uniqueName()] = v;
+    }
+  }
+  for (Node* n : graph.nodes()) {
+    if (n->kind() == kCaptured) {
+      Value* outer = parent ? parent->find(n->output()->uniqueName()) : nullptr;
+      if (outer != nullptr) copyInfo(outer, n->output());
+    } else {
+      forEachSubgraph(n, [&](Graph& g) { inferGraph(g, &scope, solver); });
+      std::vector<Value*> changed;
+      inferNode(n, solver, &changed);
+    }
+    if (track) {
+      for (Value* v : n->outputs()) scope.values[v->uniqueName()] = v;
+    }
+  }
+}
+
+// Rewrites the shapes inferred before the solver learned more.
+void resolveGraph(Graph& graph, const DimSolver& solver) {
+  std::vector<Dimension> sizes;
+  auto resolve = [&](Value* v) {
+    if (!v->has_sizes()) return;
+    sizes.clear();
+    for (const Dimension& d : v->sizes()) sizes.push_back(solver.resolve(d));
+    v->setSizes(sizes);
+  };
+  for (Value* v : graph.inputs()) resolve(v);
+  for (Node* n : graph.nodes()) {
+    for (Value* v : n->outputs()) resolve(v);
+    forEachSubgraph(n, [&](Graph& g) { resolveGraph(g, solver); });
+  }
+}
+
+}  // namespace
+
+void RegisterShapeInference(NodeKind kind, InferenceFunction fn) {
+  registry()[kind] = std::move(fn);
+}
+
+bool HasShapeInference(NodeKind kind) { return registry().count(kind) != 0; }
+
+void InferShapes(Graph& graph, DimSolver* solver) {
+  inferGraph(graph, nullptr, solver);
+  if (solver != nullptr) resolveGraph(graph, *solver);
+}
+
+size_t UpdateShapes(ArrayRef<Node*> nodes, DimSolver* solver, Graph* root) {
+  std::deque<Node*> worklist(nodes.begin(), nodes.end());
+  std::unordered_set<Node*> queued(nodes.begin(), nodes.end());
+  // subgraph -> node holding it, built on the first change that reaches
+  // the outputs of a subgraph
+  std::unordered_map<const Graph*, Node*> owners;
+  bool indexed = false;
+  auto ownerOf = [&](const Graph* g) -> Node* {
+    if (!indexed) {
+      indexed = true;
+      std::function<void(Graph&)> index = [&](Graph& graph) {
+        for (Node* n : graph.nodes()) {
+          forEachSubgraph(n, [&](Graph& sub) {
+            owners[&sub] = n;
+            index(sub);
+          });
+        }
+      };
+      if (root != nullptr) {
+        index(*root);
+      } else {
+        for (Node* n : nodes) {
+          Graph* g = n->owningGraph();
+          if (!owners.count(g)) index(*g);
+        }
+      }
+    }
+    auto it = owners.find(g);
+    return it == owners.end() ? nullptr : it->second;
+  };
+  auto enqueue = [&](Node* n) {
+    if (n != nullptr && queued.insert(n).second) worklist.push_back(n);
+  };
+
+  size_t count = 0;
+  auto propagate = [&](Value* v) {
+    for (const Use& use : v->uses()) {
+      Node* user = use.user;
+      // users in subgraphs see 'v' through a Captured node
+      Value* seen = user->inputs()[use.offset];
+      if (seen != v) copyInfo(v, seen);
+      if (user->kind() == kReturn) {
+        enqueue(ownerOf(user->owningGraph()));
+      } else {
+        enqueue(user);
+      }
+    }
+  };
+  while (!worklist.empty()) {
+    Node* n = worklist.front();
+    worklist.pop_front();
+    queued.erase(n);
+    count++;
+    std::vector<Value*> changed;
+    inferNode(n, solver, &changed);
+    for (Value* v : changed) propagate(v);
+  }
+  return count;
+}
+
+}  // namespace my_ai_training::ir
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "onnx_ir/ir.h"
+#include "onnx_ir/symbolic_dims.h"
+
+namespace my_ai_training::ir {
+
+// What an inference rule sees of the node it runs on. Rules read the
+// element types, shapes and constant payloads of the inputs and report
+// what they can tell about the outputs; outputs they say nothing about keep
+// what they had (e.g. a value_info from the model).
+class InferenceContext {
+ public:
+  explicit InferenceContext(Node* node, DimSolver* solver = nullptr)
+      : node_(node), solver_(solver) {}
+
+  Node* node() const { return node_; }
+  // equalities between dims are only tracked with a solver
+  DimSolver* solver() const { return solver_; }
+  size_t numInputs() const { return node_->inputs().size(); }
+  size_t numOutputs() const { return node_->outputs().size(); }
+
+  // false for missing and omitted (Undefined) optional inputs
+  bool hasInput(size_t i) const;
+  const Value* input(size_t i) const { return node_->inputs()[i]; }
+  int32_t inputType(size_t i) const {
+    return hasInput(i) ? input(i)->elemType()
+                       : int32_t(TensorProto_DataType_UNDEFINED);
+  }
+  bool hasInputShape(size_t i) const {
+    return hasInput(i) && input(i)->has_sizes();
+  }
+  ArrayRef<Dimension> inputShape(size_t i) const { return input(i)->sizes(); }
+
+  // payload of input i if it is an initializer or the output of a
+  // Constant, nullptr otherwise
+  const Tensor* constantInput(size_t i) const;
+  // constantInput(i) as integers, false if it is not a constant integer
+  // tensor
+  bool constantInts(size_t i, std::vector<int64_t>* values) const;
+  // same for floating point constants
+  bool constantFloats(size_t i, std::vector<double>* values) const;
+
+  // The extent of two dims the op requires to be equal (the inputs of a
+  // Concat off the axis, the inner dims of a MatMul). With a solver the
+  // equality is recorded, so 'b' may be renamed to 'a' everywhere.
+  Dimension mergeDims(const Dimension& a, const Dimension& b);
+
+  void setOutputType(size_t i, int32_t elem_type);
+  // with a solver the dims are resolved first
+  void setOutputShape(size_t i, ArrayRef<Dimension> shape);
+  // type of input 'from' and, if known, its shape
+  void propagateInput(size_t from, size_t to);
+
+ private:
+  Node* node_;
+  DimSolver* solver_;
+};
+
+// Computes the element type and shape of output i of a node from its
+// inputs and attributes.
+using InferenceFunction = std::function<void(InferenceContext&)>;
+
+// Register (or replace) the rule for 'kind'. Rules for the ONNX ops the
+// optimizer and runtime handle are built in, nodes without a rule are left
+// alone. Not thread-safe with concurrent inference.
+void RegisterShapeInference(NodeKind kind, InferenceFunction fn);
+bool HasShapeInference(NodeKind kind);
+
+// Infer every node of 'graph' and its subgraphs in order, starting from the
+// types and shapes of the graph inputs and initializers. With a solver,
+// the equalities the ops imply are recorded in it and every shape of the
+// graph is rewritten over the remaining free symbols at the end.
+void InferShapes(Graph& graph, DimSolver* solver = nullptr);
+
+// Incremental inference after a rewrite: re-infer 'nodes', then only the
+// users of outputs whose type or shape changed, following the use lists
+// (into subgraphs too) until nothing changes. A change reaching the outputs
+// of a subgraph goes on to the node holding it; for 'nodes' inside
+// subgraphs, 'root' is the graph they are nested in, since a subgraph does
+// not know its owner. Returns how many nodes were re-inferred.
+size_t UpdateShapes(ArrayRef<Node*> nodes, DimSolver* solver = nullptr,
+                    Graph* root = nullptr);
+
+}  // namespace my_ai_training::ir
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <cstring>
+#include <type_traits>
+
+#include "onnx_ir/array_ref.h"
+
+namespace my_ai_training::ir {
+
+// Vector of trivially copyable T that keeps up to N elements inline and only
+// allocates beyond that. Meant for short lists stored in every Value (e.g.
+// the shape), where a std::vector would cost a heap allocation and a pointer
+// chase for the common case.
+template <typename T, size_t N>
+class SmallVector final {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SmallVector only holds trivially copyable types");
+
+ public:
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  SmallVector() = default;
+  SmallVector(ArrayRef<T> values) { assign(values); }  // NOLINT
+  SmallVector(const SmallVector& other) { assign(other); }
+  SmallVector(SmallVector&& other) noexcept { moveFrom(&other); }
+  SmallVector& operator=(const SmallVector& other) {
+    if (this != &other) assign(other);
+    return *this;
+  }
+  SmallVector& operator=(SmallVector&& other) noexcept {
+    if (this != &other) {
+      release();
+      moveFrom(&other);
+    }
+    return *this;
+  }
+  ~SmallVector() { release(); }
+
+  void assign(ArrayRef<T> values) {
+    if (values.size() > capacity_) {
+      // cannot alias our storage, it is too small
+      size_ = 0;
+      reserve(values.size());
+    }
+    if (!values.empty()) {
+      std::memmove(data_, values.data(), values.size() * sizeof(T));
+    }
+    size_ = values.size();
+  }
+
+  void push_back(const T& value) {
+    if (size_ == capacity_) {
+      T copy = value;  // 'value' may point into the old storage
+      reserve(capacity_ * 2);
+      data_[size_++] = copy;
+      return;
+    }
+    data_[size_++] = value;
+  }
+
+  void reserve(size_t capacity) {
+    if (capacity <= capacity_) return;
+    T* data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+    if (size_) std::memcpy(data, data_, size_ * sizeof(T));
+    release();
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  void clear() { size_ = 0; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  // whether the elements are stored inline
+  bool isSmall() const { return data_ == inline_; }
+
+  T* data() { return data_; }
+  const T* data() const { return data_; }
+  T& operator[](size_t i) { return data_[i]; }
+  const T& operator[](size_t i) const { return data_[i]; }
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+  operator ArrayRef<T>() const { return {data_, size_}; }  // NOLINT
+
+ private:
+  void release() {
+    if (!isSmall()) ::operator delete(data_);
+    data_ = inline_;
+    capacity_ = N;
+  }
+
+  // 'this' holds no heap storage
+  void moveFrom(SmallVector* other) {
+    if (other->isSmall()) {
+      std::memcpy(inline_, other->inline_, other->size_ * sizeof(T));
+    } else {
+      data_ = other->data_;
+      capacity_ = other->capacity_;
+      other->data_ = other->inline_;
+      other->capacity_ = N;
+    }
+    size_ = other->size_;
+    other->size_ = 0;
+  }
+
+  T inline_[N];
+  T* data_ = inline_;
+  size_t size_ = 0;
+  size_t capacity_ = N;
+};
+
+}  // namespace my_ai_training::ir
@@ -0,0 +1,773 @@
+#include "onnx_ir/snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "onnx_ir/external_data.h"
+
+namespace my_ai_training::ir {
+
+namespace {
+
+// File layout, all integers native-endian:
+//
+//   SnapshotHeader
+//   one table per Section, each 8-byte aligned
+//   tensor payloads, each 64-byte aligned
+//
+// Records refer to each other by index. Variable-length lists (node inputs,
+// value dims, attribute lists, ...) are [begin, begin + count) ranges into
+// the kRefs, kInts and kFloats pools. Value ids are local to their graph:
+// its inputs come first, then its initializer values, then the outputs of
+// its nodes in order. Graph 0 is the main graph.
+
+constexpr char kMagic[8] = {'M', 'A', 'T', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t kByteOrderMark = 0x01020304;
+constexpr uint32_t kNone = 0xffffffff;
+constexpr uint64_t kNoData = ~uint64_t(0);
+constexpr size_t kBlobAlignment = 64;
+
+enum Section : uint32_t {
+  kStrings,     // StringRecord
+  kChars,       // char, the bytes of all strings
+  kDims,        // DimRecord
+  kValues,      // ValueRecord
+  kNodes,       // NodeRecord
+  kAttributes,  // AttributeRecord
+  kTensors,     // TensorRecord
+  kGraphs,      // GraphRecord
+  kOpsets,      // OpsetRecord
+  kRefs,        // uint32_t
+  kInts,        // int64_t
+  kFloats,      // double
+  kNumSections,
+};
+
+struct SectionRecord {
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t file_size;
+  SectionRecord sections[kNumSections];
+};
+
+struct StringRecord {
+  uint32_t offset;  // into kChars
+  uint32_t size;
+};
+
+enum DimKind : uint32_t { kDimUnknown, kDimInt, kDimParam };
+
+struct DimRecord {
+  int64_t dim;
+  uint32_t param;  // string
+  uint32_t kind;   // DimKind
+};
+
+struct ValueRecord {
+  uint32_t name;  // string or kNone
+  int32_t elem_type;
+  uint32_t dims_begin;  // kRefs, indices into kDims
+  uint32_t dims_count;  // kNone if the value has no sizes
+};
+
+struct NodeRecord {
+  uint32_t kind;  // string
+  uint32_t name, domain, doc_string, overload;  // string or kNone
+  uint32_t inputs_begin, inputs_count;          // kRefs, value ids
+  uint32_t outputs_count;
+  uint32_t attributes_begin, attributes_count;  // kAttributes
+};
+
+struct AttributeRecord {
+  uint32_t name;  // string
+  uint32_t kind;  // AttributeKind
+  // s: string; t: tensor; g: graph; fs: kFloats; is: kInts;
+  // ss, ts, gs: kRefs of strings, tensors, graphs
+  uint32_t begin;
+  uint32_t count;
+  int64_t i;
+  double f;
+};
+
+struct TensorRecord {
+  uint32_t name;  // string or kNone
+  int32_t elem_type;
+  uint32_t dims_begin, dims_count;        // kInts
+  uint32_t strings_begin, strings_count;  // kRefs, strings
+  uint64_t data_offset;                   // from the file start, or kNoData
+  uint64_t data_size;
+};
+
+struct GraphRecord {
+  uint32_t name, doc_string;  // string or kNone
+  uint32_t values_begin, values_count;
+  uint32_t inputs_count;
+  uint32_t initializers_begin, initializers_count;  // kTensors
+  // kRefs, indices of the initializers that have a value
+  uint32_t initializer_values_begin, initializer_values_count;
+  uint32_t nodes_begin, nodes_count;
+  uint32_t outputs_begin, outputs_count;  // kRefs, value ids
+  uint32_t reserved;
+};
+
+struct OpsetRecord {
+  uint32_t domain;  // string
+  uint32_t reserved;
+  int64_t version;
+};
+
+constexpr size_t kRecordSizes[kNumSections] = {
+    sizeof(StringRecord), sizeof(char),         sizeof(DimRecord),
+    sizeof(ValueRecord),  sizeof(NodeRecord),   sizeof(AttributeRecord),
+    sizeof(TensorRecord), sizeof(GraphRecord),  sizeof(OpsetRecord),
+    sizeof(uint32_t),     sizeof(int64_t),      sizeof(double),
+};
+
+// The layout is part of the format, make sure the compiler adds no padding.
+static_assert(sizeof(SnapshotHeader) == 24 + 16 * kNumSections, "");
+static_assert(sizeof(DimRecord) == 16, "");
+static_assert(sizeof(ValueRecord) == 16, "");
+static_assert(sizeof(NodeRecord) == 40, "");
+static_assert(sizeof(AttributeRecord) == 32, "");
+static_assert(sizeof(TensorRecord) == 40, "");
+static_assert(sizeof(GraphRecord) == 56, "");
+static_assert(sizeof(OpsetRecord) == 16, "");
+
+size_t alignUp(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+uint32_t toIndex(size_t n) {
+  ONNX_ASSERTM(n < kNone, "graph too large for a snapshot");
+  return static_cast<uint32_t>(n);
+}
+
+class SnapshotWriter {
+ public:
+  std::string write(const Graph& graph) {
+    addGraph(graph);
+    for (auto& opset : graph.opset_versions()) {
+      opsets_.push_back({addString(opset.domain()), 0, opset.version()});
+    }
+    return layout();
+  }
+
+ private:
+  uint32_t addString(std::string_view s) {
+    auto it = string_ids_.find(s);
+    if (it != string_ids_.end()) return it->second;
+    uint32_t id = toIndex(strings_.size());
+    strings_.push_back({toIndex(chars_.size()), toIndex(s.size())});
+    chars_.append(s.data(), s.size());
+    // keys view into owned copies, chars_ may reallocate
+    string_ids_.emplace(*owned_strings_.emplace(s).first, id);
+    return id;
+  }
+
+  uint32_t addOptionalString(bool present, const std::string& s) {
+    return present ? addString(s) : kNone;
+  }
+
+  template <typename T>
+  static uint32_t append(std::vector<T>* pool, const std::vector<T>& values) {
+    uint32_t begin = toIndex(pool->size());
+    pool->insert(pool->end(), values.begin(), values.end());
+    toIndex(pool->size());
+    return begin;
+  }
+
+  uint32_t addDim(const Dimension& d) {
+    // Symbol ids are per process, params are stored by name
+    DimRecord r{-1, kNone, kDimUnknown};
+    if (d.is_int()) {
+      r = {d.dim(), kNone, kDimInt};
+    } else if (d.is_param()) {
+      r = {-1, addString(d.param().toString()), kDimParam};
+    }
+    auto key = std::make_tuple(r.kind, r.dim, r.param);
+    auto it = dim_ids_.find(key);
+    if (it != dim_ids_.end()) return it->second;
+    uint32_t id = toIndex(dims_.size());
+    dims_.push_back(r);
+    dim_ids_.emplace(key, id);
+    return id;
+  }
+
+  ValueRecord valueRecord(const Value* v) {
+    ValueRecord r{kNone, v->elemType(), 0, kNone};
+    if (v->has_unique_name()) r.name = addString(v->uniqueName());
+    if (v->has_sizes()) {
+      std::vector<uint32_t> dims;
+      dims.reserve(v->sizes().size());
+      for (auto& d : v->sizes()) dims.push_back(addDim(d));
+      r.dims_begin = append(&refs_, dims);
+      r.dims_count = toIndex(dims.size());
+    }
+    return r;
+  }
+
+  uint32_t addTensor(const Tensor& t) {
+    TensorRecord r{};
+    r.name = addOptionalString(t.hasName(), t.name());
+    r.elem_type = t.elem_type();
+    r.dims_begin = append(&ints_, t.sizes());
+    r.dims_count = toIndex(t.sizes().size());
+    std::vector<uint32_t> strings;
+    for (auto& s : t.strings()) strings.push_back(addString(s));
+    r.strings_begin = append(&refs_, strings);
+    r.strings_count = toIndex(strings.size());
+    r.data_offset = kNoData;
+    r.data_size = 0;
+    uint32_t id = toIndex(tensors_.size());
+    if (t.hasRawData()) {
+      // resolves lazily loaded external data
+      blobs_.push_back({id, t.rawData()});
+      r.data_size = t.byteSize();
+    }
+    tensors_.push_back(r);
+    return id;
+  }
+
+  uint32_t addGraph(const Graph& g) {
+    uint32_t id = toIndex(graphs_.size());
+    graphs_.emplace_back();
+    GraphRecord r{};
+    r.name = addOptionalString(g.has_name(), g.name());
+    r.doc_string = addOptionalString(g.has_doc_string(), g.docString());
+
+    std::unordered_map<const Value*, uint32_t> value_ids;
+    r.values_begin = toIndex(values_.size());
+    auto addValue = [&](const Value* v) {
+      value_ids[v] = toIndex(values_.size() - r.values_begin);
+      values_.push_back(valueRecord(v));
+    };
+    auto valueId = [&](const Value* v) {
+      auto it = value_ids.find(v);
+      ONNX_ASSERTM(it != value_ids.end(),
+                   "%s is used before its definition or outside its graph",
+                   v->uniqueName().c_str());
+      return it->second;
+    };
+
+    for (const Value* v : g.inputs()) addValue(v);
+    r.inputs_count = toIndex(g.inputs().size());
+
+    std::unordered_map<std::string, const Value*> initializer_values;
+    for (const Value* v : g.initializerValues()) {
+      initializer_values[v->uniqueName()] = v;
+    }
+    std::vector<uint32_t> with_value;
+    r.initializers_begin = toIndex(tensors_.size());
+    for (size_t i = 0; i < g.initializers().size(); i++) {
+      addTensor(g.initializers()[i]);
+      auto it = initializer_values.find(g.initializer_names()[i]);
+      if (it == initializer_values.end()) continue;
+      with_value.push_back(toIndex(i));
+      addValue(it->second);
+    }
+    r.initializers_count = toIndex(g.initializers().size());
+    ONNX_ASSERTM(with_value.size() == initializer_values.size(),
+                 "initializer value without initializer");
+    r.initializer_values_begin = append(&refs_, with_value);
+    r.initializer_values_count = toIndex(with_value.size());
+
+    // node records are contiguous, subgraphs are added after them
+    std::vector<const Node*> nodes(g.begin(), g.end());
+    r.nodes_begin = toIndex(nodes_.size());
+    r.nodes_count = toIndex(nodes.size());
+    nodes_.resize(nodes_.size() + nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+      const Node* n = nodes[i];
+      NodeRecord nr{};
+      nr.kind = addString(n->kind().toString());
+      nr.name = addOptionalString(n->has_name(), n->name());
+      nr.domain = addOptionalString(n->has_domain(), n->domain());
+      nr.doc_string = addOptionalString(n->has_doc_string(), n->docString());
+      nr.overload = addOptionalString(n->has_overload(), n->overload());
+      std::vector<uint32_t> inputs;
+      for (const Value* v : n->inputs()) inputs.push_back(valueId(v));
+      nr.inputs_begin = append(&refs_, inputs);
+      nr.inputs_count = toIndex(inputs.size());
+      for (const Value* v : n->outputs()) addValue(v);
+      nr.outputs_count = toIndex(n->outputs().size());
+      nodes_[r.nodes_begin + i] = nr;
+    }
+    r.values_count = toIndex(values_.size() - r.values_begin);
+
+    std::vector<uint32_t> outputs;
+    for (const Value* v : g.outputs()) outputs.push_back(valueId(v));
+    r.outputs_begin = append(&refs_, outputs);
+    r.outputs_count = toIndex(outputs.size());
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+      std::vector<Symbol> names = nodes[i]->attributeNames();
+      uint32_t begin = toIndex(attributes_.size());
+      attributes_.resize(attributes_.size() + names.size());
+      for (size_t j = 0; j < names.size(); j++) {
+        attributes_[begin + j] = attributeRecord(nodes[i], names[j]);
+      }
+      nodes_[r.nodes_begin + i].attributes_begin = begin;
+      nodes_[r.nodes_begin + i].attributes_count = toIndex(names.size());
+    }
+
+    graphs_[id] = r;
+    return id;
+  }
+
+  AttributeRecord attributeRecord(const Node* n, Symbol name) {
+    AttributeRecord r{};
+    r.name = addString(name.toString());
+    AttributeKind kind = n->kindOf(name);
+    r.kind = static_cast<uint32_t>(kind);
+    std::vector<uint32_t> ids;
+    switch (kind) {
+      case AttributeKind::f:
+        r.f = n->f(name);
+        break;
+      case AttributeKind::i:
+        r.i = n->i(name);
+        break;
+      case AttributeKind::s:
+        r.begin = addString(n->s(name));
+        break;
+      case AttributeKind::t:
+        r.begin = addTensor(n->t(name));
+        break;
+      case AttributeKind::g:
+        r.begin = addGraph(*n->g(name));
+        break;
+      case AttributeKind::fs:
+        r.begin = append(&floats_, n->fs(name));
+        r.count = toIndex(n->fs(name).size());
+        break;
+      case AttributeKind::is:
+        r.begin = append(&ints_, n->is(name));
+        r.count = toIndex(n->is(name).size());
+        break;
+      case AttributeKind::ss:
+        for (auto& s : n->ss(name)) ids.push_back(addString(s));
+        break;
+      case AttributeKind::ts:
+        for (auto& t : n->ts(name)) ids.push_back(addTensor(t));
+        break;
+      case AttributeKind::gs:
+        for (auto& g : n->gs(name)) ids.push_back(addGraph(*g));
+        break;
+      default:
+        ONNX_ASSERTM(false, "attribute %s of kind %s is not supported",
+                     name.toString(), toString(kind));
+    }
+    if (kind == AttributeKind::ss || kind == AttributeKind::ts ||
+        kind == AttributeKind::gs) {
+      r.begin = append(&refs_, ids);
+      r.count = toIndex(ids.size());
+    }
+    return r;
+  }
+
+  std::string layout() {
+    struct Table {
+      const void* data;
+      size_t count;
+    };
+    Table tables[kNumSections] = {
+        {strings_.data(), strings_.size()},
+        {chars_.data(), chars_.size()},
+        {dims_.data(), dims_.size()},
+        {values_.data(), values_.size()},
+        {nodes_.data(), nodes_.size()},
+        {attributes_.data(), attributes_.size()},
+        {tensors_.data(), tensors_.size()},
+        {graphs_.data(), graphs_.size()},
+        {opsets_.data(), opsets_.size()},
+        {refs_.data(), refs_.size()},
+        {ints_.data(), ints_.size()},
+        {floats_.data(), floats_.size()},
+    };
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kSnapshotVersion;
+    header.byte_order = kByteOrderMark;
+    size_t pos = sizeof(header);
+    for (uint32_t s = 0; s < kNumSections; s++) {
+      pos = alignUp(pos, 8);
+      header.sections[s] = {pos, tables[s].count};
+      pos += tables[s].count * kRecordSizes[s];
+    }
+    for (auto& blob : blobs_) {
+      pos = alignUp(pos, kBlobAlignment);
+      tensors_[blob.tensor].data_offset = pos;
+      pos += tensors_[blob.tensor].data_size;
+    }
+    header.file_size = pos;
+
+    std::string out(pos, '\0');
+    std::memcpy(&out[0], &header, sizeof(header));
+    for (uint32_t s = 0; s < kNumSections; s++) {
+      if (tables[s].count == 0) continue;
+      std::memcpy(&out[header.sections[s].offset], tables[s].data,
+                  tables[s].count * kRecordSizes[s]);
+    }
+    for (auto& blob : blobs_) {
+      const TensorRecord& r = tensors_[blob.tensor];
+      if (r.data_size) std::memcpy(&out[r.data_offset], blob.data, r.data_size);
+    }
+    return out;
+  }
+
+  struct Blob {
+    uint32_t tensor;
+    const void* data;
+  };
+
+  std::vector<StringRecord> strings_;
+  std::string chars_;
+  std::unordered_set<std::string> owned_strings_;
+  std::unordered_map<std::string_view, uint32_t> string_ids_;
+  std::vector<DimRecord> dims_;
+  std::map<std::tuple<uint32_t, int64_t, uint32_t>, uint32_t> dim_ids_;
+  std::vector<ValueRecord> values_;
+  std::vector<NodeRecord> nodes_;
+  std::vector<AttributeRecord> attributes_;
+  std::vector<TensorRecord> tensors_;
+  std::vector<Blob> blobs_;
+  std::vector<GraphRecord> graphs_;
+  std::vector<OpsetRecord> opsets_;
+  std::vector<uint32_t> refs_;
+  std::vector<int64_t> ints_;
+  std::vector<double> floats_;
+};
+
+// Read-only view of a snapshot. Every index read from the file is checked
+// before use, a corrupt snapshot throws assert_error.
+class SnapshotReader {
+ public:
+  SnapshotReader(const uint8_t* data, size_t size,
+                 std::shared_ptr<const void> keep_alive)
+      : data_(data), size_(size), keep_alive_(std::move(keep_alive)) {
+    ONNX_ASSERTM(reinterpret_cast<uintptr_t>(data) % 8 == 0,
+                 "snapshot must be 8-byte aligned");
+    ONNX_ASSERTM(size >= sizeof(SnapshotHeader), "snapshot is truncated");
+    std::memcpy(&header_, data, sizeof(header_));
+    ONNX_ASSERTM(std::memcmp(header_.magic, kMagic, sizeof(kMagic)) == 0,
+                 "not a snapshot");
+    ONNX_ASSERTM(header_.version == kSnapshotVersion,
+                 "snapshot version %u is not supported (expected %u)",
+                 header_.version, kSnapshotVersion);
+    ONNX_ASSERTM(header_.byte_order == kByteOrderMark,
+                 "snapshot was written with a different byte order");
+    ONNX_ASSERTM(header_.file_size == size, "snapshot is truncated");
+    for (uint32_t s = 0; s < kNumSections; s++) {
+      const SectionRecord& section = header_.sections[s];
+      ONNX_ASSERTM(section.offset % 8 == 0 && section.offset <= size &&
+                       section.count <= (size - section.offset) /
+                                            kRecordSizes[s],
+                   "snapshot section %u is out of bounds", s);
+    }
+    symbols_.resize(count(kStrings));
+    interned_.resize(count(kStrings), false);
+    graph_loaded_.resize(count(kGraphs), false);
+  }
+
+  std::unique_ptr<Graph> read() {
+    ONNX_ASSERTM(count(kGraphs) > 0, "snapshot has no graph");
+    auto g = std::make_unique<Graph>();
+    readGraph(0, g.get());
+    for (size_t i = 0; i < count(kOpsets); i++) {
+      const auto& r = record<OpsetRecord>(kOpsets, i);
+      g->opset_versions_mutable().emplace_back(std::string(string(r.domain)),
+                                               r.version);
+    }
+    return g;
+  }
+
+ private:
+  size_t count(Section s) const { return header_.sections[s].count; }
+
+  template <typename T>
+  const T& record(Section s, size_t i) const {
+    ONNX_ASSERTM(i < count(s), "snapshot index %zu out of bounds", i);
+    return reinterpret_cast<const T*>(data_ + header_.sections[s].offset)[i];
+  }
+
+  // [begin, begin + n) of a pool
+  template <typename T>
+  const T* range(Section s, uint32_t begin, uint32_t n) const {
+    ONNX_ASSERTM(begin <= count(s) && n <= count(s) - begin,
+                 "snapshot range out of bounds");
+    return reinterpret_cast<const T*>(data_ + header_.sections[s].offset) +
+           begin;
+  }
+
+  std::string_view string(uint32_t id) const {
+    const auto& r = record<StringRecord>(kStrings, id);
+    return {range<char>(kChars, r.offset, r.size), r.size};
+  }
+
+  Symbol symbol(uint32_t id) {
+    ONNX_ASSERTM(id < count(kStrings), "snapshot index %u out of bounds", id);
+    if (!interned_[id]) {
+      symbols_[id] = Symbol(std::string(string(id)));
+      interned_[id] = true;
+    }
+    return symbols_[id];
+  }
+
+  void readValue(uint32_t id, Value* v) {
+    const auto& r = record<ValueRecord>(kValues, id);
+    if (r.name != kNone) v->setUniqueName(std::string(string(r.name)), false);
+    v->setElemType(r.elem_type);
+    if (r.dims_count == kNone) return;
+    const uint32_t* dims = range<uint32_t>(kRefs, r.dims_begin, r.dims_count);
+    SmallVector<Dimension, 6> sizes;
+    for (uint32_t i = 0; i < r.dims_count; i++) {
+      const auto& d = record<DimRecord>(kDims, dims[i]);
+      if (d.kind == kDimInt) {
+        sizes.push_back(d.dim);
+      } else if (d.kind == kDimParam) {
+        sizes.push_back(symbol(d.param));
+      } else {
+        sizes.push_back(Dimension());
+      }
+    }
+    v->setSizes(sizes);
+  }
+
+  // whether 'size' bytes are exactly the elements of 't', without
+  // overflowing on the sizes of a damaged record
+  static bool payloadMatches(const Tensor& t, uint64_t size) {
+    uint64_t elem_size = elemSizeOf(t.elem_type());
+    if (elem_size == 0) return false;
+    for (int64_t extent : t.sizes()) {
+      if (extent == 0) return size == 0;
+    }
+    uint64_t bound = size / elem_size;
+    uint64_t numel = 1;
+    for (int64_t extent : t.sizes()) {
+      uint64_t e = static_cast<uint64_t>(extent);
+      if (numel > bound / e) return false;
+      numel *= e;
+    }
+    return numel * elem_size == size;
+  }
+
+  Tensor readTensor(uint32_t id) {
+    const auto& r = record<TensorRecord>(kTensors, id);
+    ONNX_ASSERTM(r.elem_type > TensorProto_DataType_UNDEFINED &&
+                     r.elem_type <= TensorProto_DataType_BFLOAT16,
+                 "tensor %u has invalid element type %d", id, r.elem_type);
+    const int64_t* dims = range<int64_t>(kInts, r.dims_begin, r.dims_count);
+    for (uint32_t i = 0; i < r.dims_count; i++) {
+      ONNX_ASSERTM(dims[i] >= 0, "tensor %u has a negative dim", id);
+    }
+    Tensor t(r.elem_type, std::vector<int64_t>(dims, dims + r.dims_count));
+    if (r.name != kNone) t.setName(std::string(string(r.name)));
+    const uint32_t* strings =
+        range<uint32_t>(kRefs, r.strings_begin, r.strings_count);
+    for (uint32_t i = 0; i < r.strings_count; i++) {
+      t.strings().emplace_back(string(strings[i]));
+    }
+    if (r.data_offset != kNoData) {
+      ONNX_ASSERTM(
+          r.data_offset <= size_ && r.data_size <= size_ - r.data_offset,
+          "tensor payload out of bounds");
+      ONNX_ASSERTM(payloadMatches(t, r.data_size),
+                   "tensor %u payload does not match its sizes", id);
+      t.setBuffer(TensorBuffer::borrow(data_ + r.data_offset, r.data_size,
+                                       keep_alive_));
+    }
+    return t;
+  }
+
+  std::shared_ptr<Graph> readSubgraph(uint32_t id) {
+    auto g = std::make_shared<Graph>();
+    readGraph(id, g.get());
+    return g;
+  }
+
+  void readGraph(uint32_t id, Graph* g) {
+    const auto& r = record<GraphRecord>(kGraphs, id);
+    // each subgraph belongs to one attribute, this also rules out cycles
+    ONNX_ASSERTM(!graph_loaded_[id], "graph %u is referenced twice", id);
+    graph_loaded_[id] = true;
+    if (r.name != kNone) g->setName(std::string(string(r.name)));
+    if (r.doc_string != kNone) {
+      g->setDocString(std::string(string(r.doc_string)));
+    }
+
+    range<ValueRecord>(kValues, r.values_begin, r.values_count);
+    std::vector<Value*> values;
+    values.reserve(r.values_count);
+    auto defineValue = [&](Value* v) {
+      ONNX_ASSERTM(values.size() < r.values_count, "too many values");
+      readValue(r.values_begin + toIndex(values.size()), v);
+      values.push_back(v);
+    };
+    auto value = [&](uint32_t local_id) {
+      ONNX_ASSERTM(local_id < values.size(),
+                   "value %u used before its definition", local_id);
+      return values[local_id];
+    };
+
+    for (uint32_t i = 0; i < r.inputs_count; i++) defineValue(g->addInput());
+
+    range<TensorRecord>(kTensors, r.initializers_begin, r.initializers_count);
+    const uint32_t* with_value = range<uint32_t>(
+        kRefs, r.initializer_values_begin, r.initializer_values_count);
+    uint32_t next_with_value = 0;
+    for (uint32_t i = 0; i < r.initializers_count; i++) {
+      Tensor t = readTensor(r.initializers_begin + i);
+      if (next_with_value < r.initializer_values_count &&
+          with_value[next_with_value] == i) {
+        next_with_value++;
+        defineValue(g->addInitializerAndCreateValue(t));
+      } else {
+        g->addInitializer(t);
+      }
+    }
+
+    range<NodeRecord>(kNodes, r.nodes_begin, r.nodes_count);
+    for (uint32_t i = 0; i < r.nodes_count; i++) {
+      const auto& nr = record<NodeRecord>(kNodes, r.nodes_begin + i);
+      Node* n = g->create(symbol(nr.kind), nr.outputs_count);
+      for (Value* v : n->outputs()) defineValue(v);
+      if (nr.name != kNone) n->setName(std::string(string(nr.name)));
+      if (nr.domain != kNone) n->setDomain(std::string(string(nr.domain)));
+      if (nr.doc_string != kNone) {
+        n->setDocString(std::string(string(nr.doc_string)));
+      }
+      if (nr.overload != kNone) {
+        n->setOverload(std::string(string(nr.overload)));
+      }
+      g->appendNode(n);
+      const uint32_t* inputs =
+          range<uint32_t>(kRefs, nr.inputs_begin, nr.inputs_count);
+      for (uint32_t j = 0; j < nr.inputs_count; j++) {
+        n->addInput(value(inputs[j]));
+      }
+      range<AttributeRecord>(kAttributes, nr.attributes_begin,
+                             nr.attributes_count);
+      for (uint32_t j = 0; j < nr.attributes_count; j++) {
+        readAttribute(nr.attributes_begin + j, n);
+      }
+    }
+
+    const uint32_t* outputs =
+        range<uint32_t>(kRefs, r.outputs_begin, r.outputs_count);
+    for (uint32_t i = 0; i < r.outputs_count; i++) {
+      g->registerOutput(value(outputs[i]));
+    }
+  }
+
+  void readAttribute(uint32_t id, Node* n) {
+    const auto& r = record<AttributeRecord>(kAttributes, id);
+    Symbol name = symbol(r.name);
+    switch (static_cast<AttributeKind>(r.kind)) {
+      case AttributeKind::f:
+        n->f_(name, r.f);
+        break;
+      case AttributeKind::i:
+        n->i_(name, r.i);
+        break;
+      case AttributeKind::s:
+        n->s_(name, std::string(string(r.begin)));
+        break;
+      case AttributeKind::t:
+        n->t_(name, readTensor(r.begin));
+        break;
+      case AttributeKind::g:
+        n->g_(name, readSubgraph(r.begin));
+        break;
+      case AttributeKind::fs: {
+        const double* values = range<double>(kFloats, r.begin, r.count);
+        n->fs_(name, std::vector<double>(values, values + r.count));
+        break;
+      }
+      case AttributeKind::is: {
+        const int64_t* values = range<int64_t>(kInts, r.begin, r.count);
+        n->is_(name, std::vector<int64_t>(values, values + r.count));
+        break;
+      }
+      case AttributeKind::ss: {
+        const uint32_t* ids = range<uint32_t>(kRefs, r.begin, r.count);
+        std::vector<std::string> values;
+        for (uint32_t i = 0; i < r.count; i++) {
+          values.emplace_back(string(ids[i]));
+        }
+        n->ss_(name, std::move(values));
+        break;
+      }
+      case AttributeKind::ts: {
+        const uint32_t* ids = range<uint32_t>(kRefs, r.begin, r.count);
+        std::vector<Tensor> values;
+        for (uint32_t i = 0; i < r.count; i++) {
+          values.push_back(readTensor(ids[i]));
+        }
+        n->ts_(name, std::move(values));
+        break;
+      }
+      case AttributeKind::gs: {
+        const uint32_t* ids = range<uint32_t>(kRefs, r.begin, r.count);
+        std::vector<std::shared_ptr<Graph>> values;
+        for (uint32_t i = 0; i < r.count; i++) {
+          values.push_back(readSubgraph(ids[i]));
+        }
+        n->gs_(name, std::move(values));
+        break;
+      }
+      default:
+        ONNX_ASSERTM(false, "attribute kind %u is not supported", r.kind);
+    }
+  }
+
+  const uint8_t* data_;
+  size_t size_;
+  std::shared_ptr<const void> keep_alive_;
+  SnapshotHeader header_;
+  std::vector<Symbol> symbols_;
+  std::vector<bool> interned_;
+  std::vector<bool> graph_loaded_;
+};
+
+}  // namespace
+
+std::string SerializeSnapshot(const Graph& graph) {
+  return SnapshotWriter().write(graph);
+}
+
+void SaveSnapshot(const Graph& graph, const std::string& path) {
+  std::string bytes = SerializeSnapshot(graph);
+  FILE* fp = std::fopen(path.c_str(), "wb");
+  ONNX_ASSERTM(fp != nullptr, "cannot open %s", path.c_str());
+  size_t n = std::fwrite(bytes.data(), 1, bytes.size(), fp);
+  bool ok = std::fclose(fp) == 0 && n == bytes.size();
+  ONNX_ASSERTM(ok, "cannot write %s", path.c_str());
+}
+
+std::unique_ptr<Graph> LoadSnapshotFromBuffer(
+    const void* data, size_t size, std::shared_ptr<const void> keep_alive) {
+  return SnapshotReader(static_cast<const uint8_t*>(data), size,
+                        std::move(keep_alive))
+      .read();
+}
+
+std::unique_ptr<Graph> LoadSnapshot(const std::string& path) {
+  auto file = MappedFile::open(path);
+  return LoadSnapshotFromBuffer(file->data(), file->size(), file);
+}
+
+}  // namespace my_ai_training::ir
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "onnx_ir/ir.h"
+
+namespace my_ai_training::ir {
+
+// Binary snapshot of a Graph, meant to be produced once (e.g. right after
+// ImportModel() and the optimization passes) and loaded on every process
+// start instead of the ONNX protobuf.
+//
+// The file is a header followed by flat, fixed-size record tables: a string
+// table holding every Symbol and name once, a Dimension table, the values,
+// nodes (whose inputs are integer value ids), attributes, tensors and
+// (sub)graphs. Tensor payloads are stored as 64-byte aligned blobs. Loading
+// is a bounds-checked walk over these tables; nothing is parsed and tensor
+// payloads are never copied, so a mapped snapshot is shared read-only by
+// every process that loads it.
+//
+// The format is versioned (kSnapshotVersion) and native-endian; a snapshot
+// written on a machine of the other byte order is rejected.
+constexpr uint32_t kSnapshotVersion = 1;
+
+// Serialize 'graph', including its subgraphs and initializers. Lazily loaded
+// external initializers are resolved and stored inline.
+std::string SerializeSnapshot(const Graph& graph);
+
+// SerializeSnapshot() into the file at 'path', throws assert_error on I/O
+// failure.
+void SaveSnapshot(const Graph& graph, const std::string& path);
+
+// Load a snapshot written by SaveSnapshot(). The file is mapped (see
+// MappedFile) and stays mapped while any tensor of the graph refers to it.
+std::unique_ptr<Graph> LoadSnapshot(const std::string& path);
+
+// Same as LoadSnapshot() for a snapshot already in memory. Tensors borrow
+// from [data, data + size), which stays alive as long as 'keep_alive' does.
+// Their payloads are 64-byte aligned if 'data' is.
+std::unique_ptr<Graph> LoadSnapshotFromBuffer(
+    const void* data, size_t size, std::shared_ptr<const void> keep_alive);
+
+}  // namespace my_ai_training::ir
@@ -0,0 +1,644 @@
+#include "onnx_ir/symbolic_dims.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <utility>
+
+#include "onnx_ir/checked_math.h"
+
+namespace my_ai_training::ir {
+
+namespace {
+
+// beyond these an expression is not worth tracking
+constexpr size_t kMaxTerms = 16;
+constexpr size_t kMaxDegree = 8;
+// entries the process-wide caches below hold before they start over
+constexpr size_t kMaxCached = 4096;
+
+bool nameLess(Symbol a, Symbol b) {
+  return a != b && std::strcmp(a.toString(), b.toString()) < 0;
+}
+
+// highest degree first, then by factor names, so the constant term is last
+bool factorsLess(const std::vector<Symbol>& a, const std::vector<Symbol>& b) {
+  if (a.size() != b.size()) return a.size() > b.size();
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i] != b[i]) return nameLess(a[i], b[i]);
+  }
+  return false;
+}
+
+bool isIdentifierStart(char c) {
+  return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isIdentifierChar(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isIdentifier(const char* s) {
+  if (!isIdentifierStart(*s)) return false;
+  for (; *s != '\0'; s++) {
+    if (!isIdentifierChar(*s)) return false;
+  }
+  return true;
+}
+
+int64_t floorDivInt(int64_t a, int64_t k) {
+  int64_t q = a / k;
+  if (a % k != 0 && (a < 0) != (k < 0)) q--;
+  return q;
+}
+
+// floor((numerator)/divisor) factors made by DimExpr::floorDiv. Their
+// names parse back to them, so findFloorFactor() rebuilds the ones the
+// cache dropped.
+struct FloorFactor {
+  DimExpr numerator;
+  int64_t divisor = 1;
+};
+
+class FloorFactors {
+ public:
+  void add(Symbol s, const DimExpr& numerator, int64_t divisor) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (factors_.size() >= kMaxCached) factors_.clear();
+    factors_.emplace(s, FloorFactor{numerator, divisor});
+  }
+
+  bool find(Symbol s, FloorFactor* factor) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = factors_.find(s);
+    if (it == factors_.end()) return false;
+    *factor = it->second;
+    return true;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<Symbol, FloorFactor> factors_;
+};
+
+FloorFactors& floorFactors() {
+  static auto* factors = new FloorFactors();
+  return *factors;
+}
+
+// Recursive descent over the text of a dim:
+//   expr    := term (('+' | '-') term)*
+//   term    := unary ('*' unary | '/' integer)*
+//   unary   := '-' unary | primary
+//   primary := integer | identifier | '[' name ']' | '(' expr ')'
+//            | 'floor' '(' expr ')'
+// where '/' is floor division.
+class Parser {
+ public:
+  explicit Parser(const char* text) : p_(text) {}
+
+  // false unless all of the text is an expression
+  bool parse(DimExpr* e) {
+    if (!expr(e)) return false;
+    skip();
+    return *p_ == '\0' && e->valid();
+  }
+
+ private:
+  void skip() {
+    while (*p_ == ' ') p_++;
+  }
+
+  bool eat(char c) {
+    skip();
+    if (*p_ != c) return false;
+    p_++;
+    return true;
+  }
+
+  bool expr(DimExpr* e) {
+    if (!term(e)) return false;
+    for (;;) {
+      DimExpr rhs;
+      if (eat('+')) {
+        if (!term(&rhs)) return false;
+        *e = *e + rhs;
+      } else if (eat('-')) {
+        if (!term(&rhs)) return false;
+        *e = *e - rhs;
+      } else {
+        return true;
+      }
+    }
+  }
+
+  bool term(DimExpr* e) {
+    if (!unary(e)) return false;
+    for (;;) {
+      if (eat('*')) {
+        DimExpr rhs;
+        if (!unary(&rhs)) return false;
+        *e = *e * rhs;
+      } else if (eat('/')) {
+        int64_t divisor;
+        if (!integer(&divisor) || divisor == 0) return false;
+        *e = e->floorDiv(divisor);
+      } else {
+        return true;
+      }
+    }
+  }
+
+  bool unary(DimExpr* e) {
+    if (!eat('-')) return primary(e);
+    if (!unary(e)) return false;
+    *e = DimExpr() - *e;
+    return true;
+  }
+
+  bool integer(int64_t* value) {
+    skip();
+    if (!std::isdigit(static_cast<unsigned char>(*p_))) return false;
+    int64_t v = 0;
+    for (; std::isdigit(static_cast<unsigned char>(*p_)); p_++) {
+      if (mulOverflows(v, 10, &v) || addOverflows(v, *p_ - '0', &v)) {
+        return false;
+      }
+    }
+    *value = v;
+    return true;
+  }
+
+  bool primary(DimExpr* e) {
+    skip();
+    if (std::isdigit(static_cast<unsigned char>(*p_))) {
+      int64_t value;
+      if (!integer(&value)) return false;
+      *e = DimExpr(value);
+      return true;
+    }
+    if (eat('(')) return expr(e) && eat(')');
+    if (*p_ == '[') {
+      const char* end = std::strchr(p_ + 1, ']');
+      if (end == nullptr || end == p_ + 1) return false;
+      *e = DimExpr(Symbol(std::string(p_ + 1, end)));
+      p_ = end + 1;
+      return true;
+    }
+    if (!isIdentifierStart(*p_)) return false;
+    const char* start = p_;
+    while (isIdentifierChar(*p_)) p_++;
+    std::string name(start, p_);
+    if (name == "floor" && eat('(')) return expr(e) && eat(')');
+    *e = DimExpr(Symbol(name));
+    return true;
+  }
+
+  const char* p_;
+};
+
+// parsed params, most graphs only use a handful
+class ParseCache {
+ public:
+  DimExpr get(Symbol param) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      auto it = cache_.find(param);
+      if (it != cache_.end()) return it->second;
+    }
+    DimExpr e;
+    // a name that is not an expression is a symbol of its own
+    if (!Parser(param.toString()).parse(&e)) e = DimExpr(param);
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (cache_.size() >= kMaxCached) cache_.clear();
+    cache_.emplace(param, e);
+    return e;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<Symbol, DimExpr> cache_;
+};
+
+ParseCache& parseCache() {
+  static auto* cache = new ParseCache();
+  return *cache;
+}
+
+bool findFloorFactor(Symbol s, FloorFactor* factor) {
+  if (floorFactors().find(s, factor)) return true;
+  const char* name = s.toString();
+  if (std::strncmp(name, "floor(", 6) != 0) return false;
+  // parsing the name makes the factor again
+  DimExpr unused;
+  return Parser(name).parse(&unused) && floorFactors().find(s, factor);
+}
+
+bool isFloorFactor(Symbol s) {
+  FloorFactor unused;
+  return findFloorFactor(s, &unused);
+}
+
+Dimension checkedDim(int64_t value, bool overflow) {
+  if (overflow || value < Dimension::kMinDim || value > Dimension::kMaxDim) {
+    return Dimension();
+  }
+  return Dimension(value);
+}
+
+// a op b on the expression form, unknown if either is unknown
+template <typename Fn>
+Dimension symbolic(const Dimension& a, const Dimension& b, Fn fn) {
+  DimExpr x, y;
+  if (!DimExpr::fromDim(a, &x) || !DimExpr::fromDim(b, &y)) {
+    return Dimension();
+  }
+  return fn(x, y).toDim();
+}
+
+}  // namespace
+
+// DimExpr
+
+DimExpr::DimExpr(int64_t constant) {
+  if (constant != 0) terms_.push_back({{}, constant});
+}
+
+DimExpr::DimExpr(Symbol factor) { terms_.push_back({{factor}, 1}); }
+
+bool DimExpr::fromDim(const Dimension& d, DimExpr* expr) {
+  if (d.is_int()) {
+    *expr = DimExpr(d.dim());
+    return true;
+  }
+  if (!d.is_param()) return false;
+  *expr = parseCache().get(d.param());
+  return true;
+}
+
+Dimension DimExpr::toDim() const {
+  if (!valid_) return Dimension();
+  if (isConstant()) return checkedDim(constant(), false);
+  // a lone symbol keeps its name, brackets and all
+  if (terms_.size() == 1 && terms_[0].coeff == 1 &&
+      terms_[0].factors.size() == 1) {
+    return Dimension(terms_[0].factors[0]);
+  }
+  return Dimension(toString());
+}
+
+std::string DimExpr::toString() const {
+  if (!valid_) return "?";
+  if (terms_.empty()) return "0";
+  std::string s;
+  for (size_t i = 0; i < terms_.size(); i++) {
+    const Term& t = terms_[i];
+    if (i == 0) {
+      if (t.coeff < 0) s += "-";
+    } else {
+      s += t.coeff < 0 ? " - " : " + ";
+    }
+    uint64_t magnitude = t.coeff < 0 ? 0 - static_cast<uint64_t>(t.coeff)
+                                     : static_cast<uint64_t>(t.coeff);
+    bool first = true;
+    if (magnitude != 1 || t.factors.empty()) {
+      s += std::to_string(magnitude);
+      first = false;
+    }
+    for (Symbol f : t.factors) {
+      if (!first) s += "*";
+      first = false;
+      const char* name = f.toString();
+      if (isIdentifier(name) || isFloorFactor(f)) {
+        s += name;
+      } else {
+        s += "[";
+        s += name;
+        s += "]";
+      }
+    }
+  }
+  return s;
+}
+
+bool DimExpr::isConstant() const {
+  return valid_ && (terms_.empty() ||
+                    (terms_.size() == 1 && terms_[0].factors.empty()));
+}
+
+int64_t DimExpr::constant() const {
+  return !terms_.empty() && terms_.back().factors.empty()
+             ? terms_.back().coeff
+             : 0;
+}
+
+void DimExpr::normalize() {
+  if (valid_) {
+    std::sort(terms_.begin(), terms_.end(), [](const Term& a, const Term& b) {
+      return factorsLess(a.factors, b.factors);
+    });
+    std::vector<Term> merged;
+    merged.reserve(terms_.size());
+    for (Term& t : terms_) {
+      if (!merged.empty() && merged.back().factors == t.factors) {
+        valid_ &= !addOverflows(merged.back().coeff, t.coeff,
+                                &merged.back().coeff);
+      } else {
+        merged.push_back(std::move(t));
+      }
+    }
+    merged.erase(std::remove_if(merged.begin(), merged.end(),
+                                [](const Term& t) { return t.coeff == 0; }),
+                 merged.end());
+    terms_ = std::move(merged);
+    valid_ &= terms_.size() <= kMaxTerms;
+    for (const Term& t : terms_) valid_ &= t.factors.size() <= kMaxDegree;
+  }
+  if (!valid_) terms_.clear();
+}
+
+DimExpr DimExpr::operator+(const DimExpr& other) const {
+  DimExpr r = *this;
+  r.valid_ &= other.valid_;
+  r.terms_.insert(r.terms_.end(), other.terms_.begin(), other.terms_.end());
+  r.normalize();
+  return r;
+}
+
+DimExpr DimExpr::operator-(const DimExpr& other) const {
+  DimExpr r = *this;
+  r.valid_ &= other.valid_;
+  for (const Term& t : other.terms_) {
+    r.valid_ &= t.coeff != std::numeric_limits<int64_t>::min();
+    r.terms_.push_back({t.factors, -t.coeff});
+  }
+  r.normalize();
+  return r;
+}
+
+DimExpr DimExpr::operator*(const DimExpr& other) const {
+  DimExpr r;
+  r.valid_ = valid_ && other.valid_ &&
+             terms_.size() * other.terms_.size() <= kMaxTerms * kMaxTerms;
+  if (!r.valid_) return r;
+  for (const Term& a : terms_) {
+    for (const Term& b : other.terms_) {
+      Term t;
+      r.valid_ &= !mulOverflows(a.coeff, b.coeff, &t.coeff);
+      std::merge(a.factors.begin(), a.factors.end(), b.factors.begin(),
+                 b.factors.end(), std::back_inserter(t.factors), nameLess);
+      r.terms_.push_back(std::move(t));
+    }
+  }
+  r.normalize();
+  return r;
+}
+
+bool DimExpr::divideExact(const DimExpr& divisor, DimExpr* quotient) const {
+  if (!valid_ || !divisor.valid_ || divisor.terms_.size() != 1) return false;
+  const Term& d = divisor.terms_[0];
+  DimExpr q;
+  for (const Term& t : terms_) {
+    if (t.coeff % d.coeff != 0 ||
+        (t.coeff == std::numeric_limits<int64_t>::min() && d.coeff == -1) ||
+        !std::includes(t.factors.begin(), t.factors.end(), d.factors.begin(),
+                       d.factors.end(), nameLess)) {
+      return false;
+    }
+    Term r;
+    r.coeff = t.coeff / d.coeff;
+    std::set_difference(t.factors.begin(), t.factors.end(),
+                        d.factors.begin(), d.factors.end(),
+                        std::back_inserter(r.factors), nameLess);
+    q.terms_.push_back(std::move(r));
+  }
+  q.normalize();
+  *quotient = std::move(q);
+  return true;
+}
+
+DimExpr DimExpr::floorDiv(int64_t divisor) const {
+  if (!valid_ || divisor <= 0) {
+    DimExpr invalid;
+    invalid.valid_ = false;
+    return invalid;
+  }
+  if (divisor == 1) return *this;
+  // floor((k*A + B)/k) == A + floor(B/k) for integral A
+  DimExpr whole, rest;
+  for (const Term& t : terms_) {
+    int64_t q = floorDivInt(t.coeff, divisor);
+    int64_t r = t.coeff - q * divisor;
+    if (q != 0) whole.terms_.push_back({t.factors, q});
+    if (r != 0) rest.terms_.push_back({t.factors, r});
+  }
+  whole.normalize();
+  rest.normalize();
+  // 0 <= rest < divisor
+  if (rest.isConstant()) return whole;
+  std::string name = "floor((" + rest.toString() + ")/" +
+                     std::to_string(divisor) + ")";
+  Symbol factor(name);
+  floorFactors().add(factor, rest, divisor);
+  return whole + DimExpr(factor);
+}
+
+DimExpr DimExpr::substitute(
+    const std::function<bool(Symbol, DimExpr*)>& fn) const {
+  if (!valid_) return *this;
+  DimExpr out;
+  for (const Term& t : terms_) {
+    DimExpr product(t.coeff);
+    for (Symbol f : t.factors) {
+      DimExpr replacement;
+      FloorFactor floor;
+      if (fn(f, &replacement)) {
+      } else if (findFloorFactor(f, &floor)) {
+        replacement = floor.numerator.substitute(fn).floorDiv(floor.divisor);
+      } else {
+        replacement = DimExpr(f);
+      }
+      product = product * replacement;
+    }
+    out = out + product;
+  }
+  return out;
+}
+
+std::vector<Symbol> DimExpr::symbols() const {
+  std::vector<Symbol> out;
+  for (const Term& t : terms_) {
+    for (Symbol f : t.factors) {
+      if (std::find(out.begin(), out.end(), f) != out.end()) continue;
+      out.push_back(f);
+      FloorFactor floor;
+      if (findFloorFactor(f, &floor)) {
+        for (Symbol inner : floor.numerator.symbols()) {
+          if (std::find(out.begin(), out.end(), inner) == out.end()) {
+            out.push_back(inner);
+          }
+        }
+      }
+    }
+  }
+  return out;
+}
+
+bool DimExpr::operator==(const DimExpr& other) const {
+  if (!valid_ || !other.valid_ || terms_.size() != other.terms_.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < terms_.size(); i++) {
+    if (terms_[i].coeff != other.terms_[i].coeff ||
+        terms_[i].factors != other.terms_[i].factors) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Dimension arithmetic
+
+Dimension addDims(const Dimension& a, const Dimension& b) {
+  if (a.is_int() && b.is_int()) {
+    int64_t r;
+    return checkedDim(r, addOverflows(a.dim(), b.dim(), &r));
+  }
+  return symbolic(a, b, [](const DimExpr& x, const DimExpr& y) {
+    return x + y;
+  });
+}
+
+Dimension subDims(const Dimension& a, const Dimension& b) {
+  if (a.is_int() && b.is_int()) {
+    int64_t r;
+    return checkedDim(r, subOverflows(a.dim(), b.dim(), &r));
+  }
+  return symbolic(a, b, [](const DimExpr& x, const DimExpr& y) {
+    return x - y;
+  });
+}
+
+Dimension mulDims(const Dimension& a, const Dimension& b) {
+  if (a.is_int() && b.is_int()) {
+    int64_t r;
+    return checkedDim(r, mulOverflows(a.dim(), b.dim(), &r));
+  }
+  return symbolic(a, b, [](const DimExpr& x, const DimExpr& y) {
+    return x * y;
+  });
+}
+
+Dimension divDims(const Dimension& a, const Dimension& b) {
+  if (a.is_int() && b.is_int()) {
+    if (b.dim() == 0) return Dimension();
+    return Dimension(floorDivInt(a.dim(), b.dim()));
+  }
+  DimExpr x, y, q;
+  if (!DimExpr::fromDim(a, &x) || !DimExpr::fromDim(b, &y)) {
+    return Dimension();
+  }
+  if (y.isConstant() && y.constant() > 0) {
+    return x.floorDiv(y.constant()).toDim();
+  }
+  return x.divideExact(y, &q) ? q.toDim() : Dimension();
+}
+
+Dimension broadcastDims(const Dimension& a, const Dimension& b) {
+  if (a == b) return a;
+  if (a.is_int() && a.dim() == 1) return b;
+  if (b.is_int() && b.dim() == 1) return a;
+  // a symbolic dim broadcast against n > 1 must be n (or 1)
+  if (a.is_int() && !b.is_int()) return a;
+  if (b.is_int() && !a.is_int()) return b;
+  return Dimension();
+}
+
+// DimSolver
+
+DimExpr DimSolver::reduce(const DimExpr& e) const {
+  if (solved_.empty()) return e;
+  return e.substitute([this](Symbol s, DimExpr* value) {
+    auto it = solved_.find(s);
+    if (it == solved_.end()) return false;
+    *value = it->second;
+    return true;
+  });
+}
+
+bool DimSolver::unify(const Dimension& a, const Dimension& b) {
+  DimExpr x, y;
+  if (!DimExpr::fromDim(a, &x) || !DimExpr::fromDim(b, &y)) return true;
+  x = reduce(x);
+  y = reduce(y);
+  DimExpr diff = x - y;
+  if (!diff.valid() || diff.isZero()) return true;
+  if (diff.isConstant()) return false;
+
+  // symbols under a floor() cannot be solved for
+  std::vector<Symbol> nested;
+  for (Symbol s : diff.symbols()) {
+    FloorFactor floor;
+    if (!findFloorFactor(s, &floor)) continue;
+    nested.push_back(s);
+    for (Symbol inner : floor.numerator.symbols()) nested.push_back(inner);
+  }
+  std::vector<Symbol> candidates = y.symbols();
+  for (Symbol s : x.symbols()) candidates.push_back(s);
+  for (Symbol s : candidates) {
+    if (std::find(nested.begin(), nested.end(), s) != nested.end()) continue;
+    // diff == c*s + rest with s nowhere in rest
+    int64_t c = 0;
+    bool linear = true;
+    for (const DimExpr::Term& t : diff.terms_) {
+      if (std::find(t.factors.begin(), t.factors.end(), s) ==
+          t.factors.end()) {
+        continue;
+      }
+      linear &= c == 0 && t.factors.size() == 1;
+      c = t.coeff;
+    }
+    if (!linear || c == 0) continue;
+    DimExpr rest = diff - DimExpr(s) * DimExpr(c);
+    DimExpr value;
+    if (!(DimExpr() - rest).divideExact(DimExpr(c), &value)) continue;
+    auto replace = [&](Symbol f, DimExpr* e) {
+      if (f != s) return false;
+      *e = value;
+      return true;
+    };
+    for (auto& entry : solved_) entry.second = entry.second.substitute(replace);
+    solved_[s] = value;
+    return true;
+  }
+  return true;
+}
+
+Dimension DimSolver::resolve(const Dimension& d) const {
+  if (!d.is_param() || solved_.empty()) return d;
+  DimExpr e;
+  DimExpr::fromDim(d, &e);
+  DimExpr r = reduce(e);
+  return r == e ? d : r.toDim();
+}
+
+bool DimSolver::evaluate(const Dimension& d, int64_t* value) const {
+  Dimension r = resolve(d);
+  if (!r.is_int()) return false;
+  *value = r.dim();
+  return true;
+}
+
+bool DimSolver::evaluate(ArrayRef<Dimension> shape,
+                         std::vector<int64_t>* sizes) const {
+  sizes->resize(shape.size());
+  for (size_t i = 0; i < shape.size(); i++) {
+    if (!evaluate(shape[i], &(*sizes)[i])) return false;
+  }
+  return true;
+}
+
+}  // namespace my_ai_training::ir
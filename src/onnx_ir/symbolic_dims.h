@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "onnx_ir/ir.h"
+
+namespace my_ai_training::ir {
+
+// A dim as a polynomial with integer coefficients over symbolic dims, e.g.
+// 2*N*S + S - 1.
+//
+// Dimension stores a non-constant expression as a param named after its
+// canonical text, so equal expressions are equal Dimensions no matter how
+// they were computed, and a dim_param such as "N*S" read from a model is
+// understood as the product of N and S. Floor division that is not exact
+// becomes an opaque factor named "floor((E)/k)" which still substitutes and
+// evaluates through E. Names that are not identifiers are bracketed when
+// they appear inside a larger expression.
+class DimExpr final {
+ public:
+  DimExpr() = default;  // 0
+  explicit DimExpr(int64_t constant);
+  explicit DimExpr(Symbol factor);
+
+  // Parse a Dimension, false for unknown dims. Parsed params are cached.
+  static bool fromDim(const Dimension& d, DimExpr* expr);
+  // An int if constant, a param named toString() otherwise, unknown if the
+  // expression is not valid() or out of the Dimension range.
+  Dimension toDim() const;
+  std::string toString() const;
+
+  // false once an operation overflowed or the expression outgrew the size
+  // limits, such expressions only ever become unknown dims
+  bool valid() const { return valid_; }
+  bool isConstant() const;
+  // the constant term
+  int64_t constant() const;
+  bool isZero() const { return valid_ && terms_.empty(); }
+
+  DimExpr operator+(const DimExpr& other) const;
+  DimExpr operator-(const DimExpr& other) const;
+  DimExpr operator*(const DimExpr& other) const;
+  // Quotient by a single term (64, N, 2*S, ...), false if some term is not
+  // divisible by it.
+  bool divideExact(const DimExpr& divisor, DimExpr* quotient) const;
+  // floor(this / divisor) for divisor > 0, pulling the exactly divisible
+  // part of each term out of the floor
+  DimExpr floorDiv(int64_t divisor) const;
+
+  // Replace the factors for which 'fn' returns true by the expression it
+  // stores, recursing into floor() factors.
+  DimExpr substitute(const std::function<bool(Symbol, DimExpr*)>& fn) const;
+  // the factors, including the ones inside floor() factors
+  std::vector<Symbol> symbols() const;
+
+  bool operator==(const DimExpr& other) const;
+  bool operator!=(const DimExpr& other) const { return !(*this == other); }
+
+ private:
+  friend class DimSolver;
+
+  struct Term {
+    std::vector<Symbol> factors;  // sorted by name, repeated for powers
+    int64_t coeff;
+  };
+
+  // sorts and merges terms, drops zeros, enforces the size limits
+  void normalize();
+
+  std::vector<Term> terms_;  // highest degree first, the constant last
+  bool valid_ = true;
+};
+
+// Dimension arithmetic used by the shape inference rules: exact on known
+// extents, symbolic on params and unknown if either side is unknown.
+Dimension addDims(const Dimension& a, const Dimension& b);
+Dimension subDims(const Dimension& a, const Dimension& b);
+Dimension mulDims(const Dimension& a, const Dimension& b);
+// floor division
+Dimension divDims(const Dimension& a, const Dimension& b);
+// numpy-style broadcast of two dims; unknown if they cannot be reconciled
+Dimension broadcastDims(const Dimension& a, const Dimension& b);
+
+// Equalities between dims learned during shape inference (the inputs of a
+// Concat agree off the axis, the inner dims of a MatMul agree, ...) and
+// bindings of symbols to extents.
+//
+// Each equality that is linear in some symbol eliminates that symbol, so
+// every dim resolves to a canonical expression over the remaining free
+// symbols. Binding those (a batch size and sequence length bucket, say) on
+// a copy of the solver then evaluates every shape of the graph without
+// running inference again.
+class DimSolver final {
+ public:
+  // Record a == b. Symbols of 'b' are eliminated in preference to those of
+  // 'a', so pass the dim that should keep its name first. Returns false if
+  // the dims provably differ; equalities that cannot be solved for a
+  // symbol (N*S == M*T) are accepted but not recorded.
+  bool unify(const Dimension& a, const Dimension& b);
+  bool bind(const std::string& name, int64_t value) {
+    return unify(Dimension(value), Dimension(name));
+  }
+
+  // 'd' with solved symbols substituted; params that do not change keep
+  // their name
+  Dimension resolve(const Dimension& d) const;
+  // false unless 'd' resolves to a known extent
+  bool evaluate(const Dimension& d, int64_t* value) const;
+  bool evaluate(ArrayRef<Dimension> shape, std::vector<int64_t>* sizes) const;
+
+  // number of eliminated symbols
+  size_t numSolved() const { return solved_.size(); }
+
+ private:
+  DimExpr reduce(const DimExpr& e) const;
+
+  // eliminated symbol -> expression over free symbols
+  std::unordered_map<Symbol, DimExpr> solved_;
+};
+
+}  // namespace my_ai_training::ir
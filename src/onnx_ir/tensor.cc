@@ -0,0 +1,93 @@
+#include "onnx_ir/tensor.h"
+
+#include <cstring>
+#include <new>
+
+namespace my_ai_training::ir {
+
+size_t elemSizeOf(int32_t elem_type) {
+  switch (elem_type) {
+    case TensorProto_DataType_BOOL:
+    case TensorProto_DataType_UINT8:
+    case TensorProto_DataType_INT8:
+      return 1;
+    case TensorProto_DataType_UINT16:
+    case TensorProto_DataType_INT16:
+    case TensorProto_DataType_FLOAT16:
+    case TensorProto_DataType_BFLOAT16:
+      return 2;
+    case TensorProto_DataType_FLOAT:
+    case TensorProto_DataType_INT32:
+    case TensorProto_DataType_UINT32:
+      return 4;
+    case TensorProto_DataType_INT64:
+    case TensorProto_DataType_UINT64:
+    case TensorProto_DataType_DOUBLE:
+    case TensorProto_DataType_COMPLEX64:
+      return 8;
+    case TensorProto_DataType_COMPLEX128:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+TensorBuffer::~TensorBuffer() {
+  if (owned_ && data_) {
+    ::operator delete(const_cast<void*>(data_), std::align_val_t(kAlignment));
+  }
+}
+
+std::shared_ptr<TensorBuffer> TensorBuffer::allocate(size_t size) {
+  // never hand out a null pointer, even for empty tensors
+  void* data = ::operator new(size ? size : 1, std::align_val_t(kAlignment));
+  return std::shared_ptr<TensorBuffer>(
+      new TensorBuffer(data, size, /*owned=*/true, nullptr));
+}
+
+std::shared_ptr<TensorBuffer> TensorBuffer::copyFrom(const void* data,
+                                                     size_t size) {
+  auto buffer = allocate(size);
+  if (size) std::memcpy(buffer->mutableData(), data, size);
+  return buffer;
+}
+
+std::shared_ptr<TensorBuffer> TensorBuffer::borrow(
+    const void* data, size_t size, std::shared_ptr<const void> keep_alive) {
+  return std::shared_ptr<TensorBuffer>(
+      new TensorBuffer(data, size, /*owned=*/false, std::move(keep_alive)));
+}
+
+std::shared_ptr<TensorBuffer> TensorBuffer::lazy(
+    size_t size, std::function<std::shared_ptr<TensorBuffer>()> loader) {
+  std::shared_ptr<TensorBuffer> buffer(
+      new TensorBuffer(nullptr, size, /*owned=*/false, nullptr));
+  buffer->resolved_.store(false, std::memory_order_relaxed);
+  buffer->loader_ = std::move(loader);
+  return buffer;
+}
+
+void TensorBuffer::resolve() const {
+  // if the loader throws, the once_flag stays unset and the next access
+  // retries
+  std::call_once(resolve_once_, [this]() {
+    std::shared_ptr<TensorBuffer> target = loader_();
+    TENSOR_ASSERTM(target && target->size() == size_,
+                   "lazy tensor buffer expected %zu bytes", size_);
+    data_ = target->data();
+    keep_alive_ = std::move(target);
+    resolved_.store(true, std::memory_order_release);
+  });
+}
+
+void* Tensor::mutableRawData() {
+  if (!buffer_) return nullptr;
+  // NB: use_count() is only a snapshot. Tensors are not synchronized, so the
+  // caller must not race this with copies of the same Tensor object.
+  if (buffer_.use_count() > 1 || !buffer_->isOwned()) {
+    buffer_ = TensorBuffer::copyFrom(buffer_->data(), buffer_->size());
+  }
+  return buffer_->mutableData();
+}
+
+}  // namespace my_ai_training::ir
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "onnx_ir/assertions.h"
+#include "onnx_ir/common.h"
+
+namespace my_ai_training::ir {
+
+// Mirrors onnx.proto TensorProto.DataType, so elem types read from a model
+// can be stored in Value::elemType() / Tensor::elem_type() unchanged.
+enum TensorProto_DataType : int32_t {
+  TensorProto_DataType_UNDEFINED = 0,
+  TensorProto_DataType_FLOAT = 1,
+  TensorProto_DataType_UINT8 = 2,
+  TensorProto_DataType_INT8 = 3,
+  TensorProto_DataType_UINT16 = 4,
+  TensorProto_DataType_INT16 = 5,
+  TensorProto_DataType_INT32 = 6,
+  TensorProto_DataType_INT64 = 7,
+  TensorProto_DataType_STRING = 8,
+  TensorProto_DataType_BOOL = 9,
+  TensorProto_DataType_FLOAT16 = 10,
+  TensorProto_DataType_DOUBLE = 11,
+  TensorProto_DataType_UINT32 = 12,
+  TensorProto_DataType_UINT64 = 13,
+  TensorProto_DataType_COMPLEX64 = 14,
+  TensorProto_DataType_COMPLEX128 = 15,
+  TensorProto_DataType_BFLOAT16 = 16,
+};
+
+// Size in bytes of one element of 'elem_type'. Returns 0 for STRING and
+// UNDEFINED, which have no fixed-size raw representation.
+size_t elemSizeOf(int32_t elem_type);
+
+// The payload of a Tensor, shared between all copies of that Tensor.
+//
+// The bytes are either owned (allocated here, 64-byte aligned) or borrowed
+// from another object, e.g. a mapped model file. A borrowed buffer keeps its
+// owner alive through 'keep_alive' and is never written to: Tensor detaches
+// into an owned copy before the first write (copy-on-write).
+//
+// A lazy buffer knows its size up front but only produces its bytes, through
+// a loader returning another buffer, the first time data() is called. Copies
+// of a Tensor share the lazy buffer, so the loader runs at most once.
+class TensorBuffer final {
+ public:
+  ONNX_DISALLOW_COPY_ASSIGNMENT_AND_MOVE(TensorBuffer);
+  ~TensorBuffer();
+
+  static constexpr size_t kAlignment = 64;
+
+  // uninitialized owned buffer of 'size' bytes
+  static std::shared_ptr<TensorBuffer> allocate(size_t size);
+  // owned copy of [data, data + size)
+  static std::shared_ptr<TensorBuffer> copyFrom(const void* data, size_t size);
+  // read-only view of [data, data + size), valid while 'keep_alive' lives
+  static std::shared_ptr<TensorBuffer> borrow(
+      const void* data, size_t size, std::shared_ptr<const void> keep_alive);
+  // 'size' bytes produced by 'loader' on first access
+  static std::shared_ptr<TensorBuffer> lazy(
+      size_t size, std::function<std::shared_ptr<TensorBuffer>()> loader);
+
+  const void* data() const {
+    if (_ONNX_EXPECT(!resolved_.load(std::memory_order_acquire), 0)) {
+      resolve();
+    }
+    return data_;
+  }
+  void* mutableData() {
+    ONNX_ASSERTM(owned_, "cannot write to a borrowed tensor buffer");
+    return const_cast<void*>(data_);
+  }
+  size_t size() const { return size_; }
+  bool isOwned() const { return owned_; }
+  // false until a lazy buffer has been loaded
+  bool isResolved() const { return resolved_.load(std::memory_order_acquire); }
+
+ private:
+  TensorBuffer(const void* data, size_t size, bool owned,
+               std::shared_ptr<const void> keep_alive)
+      : data_(data),
+        size_(size),
+        owned_(owned),
+        keep_alive_(std::move(keep_alive)),
+        resolved_(true) {}
+
+  void resolve() const;
+
+  mutable const void* data_;
+  size_t size_;
+  bool owned_;
+  mutable std::shared_ptr<const void> keep_alive_;
+  mutable std::atomic<bool> resolved_;
+  mutable std::once_flag resolve_once_;
+  std::function<std::shared_ptr<TensorBuffer>()> loader_;
+};
+
+// An IR tensor: name, dims, element type and payload.
+//
+// Fixed-size element types are always stored as raw little-endian bytes (the
+// TensorProto raw_data layout) in a TensorBuffer; STRING tensors keep their
+// elements in strings(). Copying a Tensor is O(1): the copy shares the buffer
+// until either side asks for mutable access, so cloning initializers during
+// graph rewrites never duplicates weights.
+struct Tensor final {
+ private:
+  bool has_name_;
+  std::string name_;
+  int32_t elem_type_;
+  std::vector<int64_t> sizes_;
+  std::shared_ptr<TensorBuffer> buffer_;
+  std::vector<std::string> string_data_;
+
+ public:
+  Tensor() : has_name_(false), elem_type_(TensorProto_DataType_UNDEFINED) {}
+  Tensor(int32_t elem_type, std::vector<int64_t> sizes)
+      : has_name_(false), elem_type_(elem_type), sizes_(std::move(sizes)) {}
+
+  Tensor(const Tensor&) = default;
+  Tensor& operator=(const Tensor&) = default;
+  Tensor(Tensor&&) = default;
+  Tensor& operator=(Tensor&&) = default;
+
+  const std::vector<int64_t>& sizes() const { return sizes_; }
+  std::vector<int64_t>& sizes() { return sizes_; }
+
+  // product of sizes()[dim:]
+  int64_t size_from_dim(int dim) const {
+    if (dim < 0) dim += static_cast<int>(sizes_.size());
+    ONNX_ASSERT(dim >= 0 && static_cast<size_t>(dim) <= sizes_.size());
+    int64_t result = 1;
+    for (auto it = sizes_.begin() + dim; it != sizes_.end(); ++it) {
+      result *= *it;
+    }
+    return result;
+  }
+
+  int64_t numel() const { return size_from_dim(0); }
+
+  int32_t elem_type() const { return elem_type_; }
+  int32_t& elem_type() { return elem_type_; }
+
+  bool hasName() const { return has_name_; }
+  const std::string& name() const { return name_; }
+  void setName(std::string name) {
+    has_name_ = true;
+    name_ = std::move(name);
+  }
+
+  std::vector<std::string>& strings() { return string_data_; }
+  const std::vector<std::string>& strings() const { return string_data_; }
+
+  // Raw payload
+
+  bool hasRawData() const { return buffer_ != nullptr; }
+
+  // number of payload bytes implied by sizes() and elem_type()
+  size_t expectedByteSize() const {
+    return static_cast<size_t>(numel()) * elemSizeOf(elem_type_);
+  }
+
+  size_t byteSize() const { return buffer_ ? buffer_->size() : 0; }
+
+  // true if another Tensor currently references the same payload
+  bool isShared() const { return buffer_ && buffer_.use_count() > 1; }
+
+  // true if the payload aliases memory owned by someone else (e.g. a mapped
+  // file); such a payload is copied before the first write
+  bool isBorrowed() const { return buffer_ && !buffer_->isOwned(); }
+
+  const std::shared_ptr<TensorBuffer>& buffer() const { return buffer_; }
+
+  const void* rawData() const { return buffer_ ? buffer_->data() : nullptr; }
+
+  // Returns a writable pointer to the payload, first detaching it into a
+  // private owned copy if it is shared with another Tensor or borrowed.
+  void* mutableRawData();
+
+  // Alias an existing buffer, no bytes are copied.
+  void setBuffer(std::shared_ptr<TensorBuffer> buffer) {
+    buffer_ = std::move(buffer);
+  }
+
+  // Copy 'size' bytes into a new owned buffer.
+  void setRawData(const void* data, size_t size) {
+    buffer_ = TensorBuffer::copyFrom(data, size);
+  }
+
+  // Allocate an owned, uninitialized buffer of expectedByteSize() bytes.
+  void* allocate() {
+    buffer_ = TensorBuffer::allocate(expectedByteSize());
+    return buffer_->mutableData();
+  }
+
+  void clearData() {
+    buffer_.reset();
+    string_data_.clear();
+  }
+
+  template <typename T>
+  const T* data() const {
+    TENSOR_ASSERTM(elemSizeOf(elem_type_) == sizeof(T),
+                   "element size of type %d is not %zu", elem_type_,
+                   sizeof(T));
+    return static_cast<const T*>(rawData());
+  }
+
+  template <typename T>
+  T* mutableData() {
+    TENSOR_ASSERTM(elemSizeOf(elem_type_) == sizeof(T),
+                   "element size of type %d is not %zu", elem_type_,
+                   sizeof(T));
+    return static_cast<T*>(mutableRawData());
+  }
+};
+
+}  // namespace my_ai_training::ir
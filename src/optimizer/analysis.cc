@@ -0,0 +1,203 @@
+#include "optimizer/analysis.h"
+
+#include <string>
+
+#include "onnx_ir/shape_inference.h"
+
+namespace my_ai_training::optimization {
+
+// AnalysisManager
+
+void AnalysisManager::invalidate(uint32_t mutated) {
+  if (mutated == GraphState::kNone) return;
+  for (auto it = cache_.begin(); it != cache_.end();) {
+    if (it->second.depends_on & mutated) {
+      it = cache_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+namespace {
+
+// names of the outer values read by 'graph' and its subgraphs
+void collectCaptures(ir::Graph& graph, std::vector<std::string>* names) {
+  for (ir::Node* n : graph.nodes()) {
+    if (n->kind() == ir::kCaptured) {
+      names->push_back(n->output()->uniqueName());
+    }
+    for (ir::Symbol name : n->attributeNames()) {
+      if (n->kindOf(name) == ir::AttributeKind::g) {
+        collectCaptures(*n->g(name), names);
+      } else if (n->kindOf(name) == ir::AttributeKind::gs) {
+        for (auto& g : n->gs(name)) collectCaptures(*g, names);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+// UseDefAnalysis
+
+UseDefAnalysis::UseDefAnalysis(ir::Graph& graph, AnalysisManager&)
+    : graph_(&graph) {
+  for (ir::Value* v : graph.inputs()) values_.push_back(v);
+  for (ir::Value* v : graph.initializerValues()) values_.push_back(v);
+  for (ir::Node* n : graph.nodes()) {
+    nodes_.push_back(n);
+    positions_[n] = nodes_.size();
+    for (ir::Value* v : n->outputs()) values_.push_back(v);
+  }
+  positions_[graph.return_node()] = endPosition();
+  value_ids_.reserve(values_.size());
+  for (size_t i = 0; i < values_.size(); i++) value_ids_[values_[i]] = i;
+
+  users_.resize(values_.size());
+  captured_.resize(values_.size());
+  // a node's reads are added together, so duplicates are adjacent
+  auto addUser = [this](const ir::Value* v, ir::Node* user) {
+    auto& users = users_[valueId(v)];
+    if (users.empty() || users.back() != user) users.push_back(user);
+  };
+  std::unordered_map<std::string, ir::Value*> by_name;
+  if (graph.hasSubgraphs()) {
+    for (ir::Value* v : values_) by_name[v->uniqueName()] = v;
+  }
+  std::vector<std::string> captures;
+  for (ir::Node* n : nodes_) {
+    for (ir::Value* input : n->inputs()) addUser(input, n);
+    if (!graph.hasSubgraphs()) continue;
+    captures.clear();
+    for (ir::Symbol name : n->attributeNames()) {
+      if (n->kindOf(name) == ir::AttributeKind::g) {
+        collectCaptures(*n->g(name), &captures);
+      } else if (n->kindOf(name) == ir::AttributeKind::gs) {
+        for (auto& g : n->gs(name)) collectCaptures(*g, &captures);
+      }
+    }
+    for (const std::string& name : captures) {
+      // names not found belong to an enclosing subgraph
+      auto it = by_name.find(name);
+      if (it == by_name.end()) continue;
+      addUser(it->second, n);
+      captured_[valueId(it->second)] = true;
+    }
+  }
+  for (ir::Value* v : graph.outputs()) addUser(v, graph.return_node());
+}
+
+size_t UseDefAnalysis::position(const ir::Node* n) const {
+  auto it = positions_.find(n);
+  if (it != positions_.end()) return it->second;
+  ONNX_ASSERTM(n->kind() == ir::kParam && n->owningGraph() == graph_,
+               "node is not part of the analyzed graph");
+  return 0;
+}
+
+size_t UseDefAnalysis::valueId(const ir::Value* v) const {
+  auto it = value_ids_.find(v);
+  ONNX_ASSERTM(it != value_ids_.end(),
+               "value %s is not part of the analyzed graph",
+               v->uniqueName().c_str());
+  return it->second;
+}
+
+// LivenessAnalysis
+
+LivenessAnalysis::LivenessAnalysis(ir::Graph& graph, AnalysisManager& analyses)
+    : use_def_(&analyses.get<UseDefAnalysis>(graph)) {
+  const auto& values = use_def_->values();
+  size_t end = use_def_->endPosition();
+  last_use_.resize(values.size());
+  dying_.resize(end + 1);
+  // live[p] - live[p - 1]: a value is live while the nodes in (def, last]
+  // run
+  std::vector<int64_t> delta(end + 2, 0);
+  for (size_t i = 0; i < values.size(); i++) {
+    ir::Value* v = values[i];
+    size_t def = use_def_->position(v->node());
+    const auto& users = use_def_->users(v);
+    size_t last = users.empty() ? def : use_def_->position(users.back());
+    last_use_[i] = last;
+    dying_[last].push_back(v);
+    if (last > def) {
+      delta[def + 1]++;
+      delta[last + 1]--;
+    }
+  }
+  int64_t live = 0;
+  for (size_t p = 1; p <= end; p++) {
+    live += delta[p];
+    max_live_ = std::max(max_live_, static_cast<size_t>(live));
+  }
+}
+
+size_t LivenessAnalysis::lastUse(const ir::Value* v) const {
+  return last_use_[use_def_->valueId(v)];
+}
+
+const std::vector<ir::Value*>& LivenessAnalysis::dyingAt(
+    const ir::Node* n) const {
+  return dying_[use_def_->position(n)];
+}
+
+bool LivenessAnalysis::liveAt(const ir::Value* v, size_t position) const {
+  return use_def_->position(v->node()) < position && position <= lastUse(v);
+}
+
+// DominanceAnalysis
+
+DominanceAnalysis::DominanceAnalysis(ir::Graph& graph,
+                                     AnalysisManager& analyses)
+    : use_def_(&analyses.get<UseDefAnalysis>(graph)) {
+  size_t end = use_def_->endPosition();
+  std::vector<std::vector<size_t>> preds(end + 1);
+  for (ir::Value* v : use_def_->values()) {
+    size_t def = use_def_->position(v->node());
+    for (ir::Node* user : use_def_->users(v)) {
+      preds[use_def_->position(user)].push_back(def);
+    }
+  }
+  // Cooper, Harvey and Kennedy's intersection; the graph order is a
+  // topological order, so a single sweep settles every node and idom_[p] is
+  // always before p
+  idom_.assign(end + 1, 0);
+  auto intersect = [this](size_t a, size_t b) {
+    while (a != b) {
+      while (a > b) a = idom_[a];
+      while (b > a) b = idom_[b];
+    }
+    return a;
+  };
+  for (size_t p = 1; p <= end; p++) {
+    if (preds[p].empty()) continue;  // Constant and such hang off the inputs
+    size_t dom = preds[p][0];
+    for (size_t i = 1; i < preds[p].size(); i++) {
+      dom = intersect(dom, preds[p][i]);
+    }
+    idom_[p] = dom;
+  }
+}
+
+ir::Node* DominanceAnalysis::idom(const ir::Node* n) const {
+  size_t p = idom_[use_def_->position(n)];
+  return p == 0 ? nullptr : use_def_->nodes()[p - 1];
+}
+
+bool DominanceAnalysis::dominates(const ir::Node* a,
+                                  const ir::Node* b) const {
+  size_t pa = use_def_->position(a);
+  size_t pb = use_def_->position(b);
+  while (pb > pa) pb = idom_[pb];
+  return pb == pa;
+}
+
+// ShapeAnalysis
+
+ShapeAnalysis::ShapeAnalysis(ir::Graph& graph, AnalysisManager&) {
+  ir::InferShapes(graph, &solver_);
+}
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "onnx_ir/ir.h"
+#include "onnx_ir/symbolic_dims.h"
+
+namespace my_ai_training::optimization {
+
+// The parts of a graph a pass can change. Analyses say which parts they are
+// computed from and stay cached until a pass reports changing one of them.
+struct GraphState {
+  enum : uint32_t {
+    kNone = 0,
+    // nodes, their order, inputs and outputs, graph inputs and outputs
+    kStructure = 1u << 0,
+    kAttributes = 1u << 1,
+    // initializer payloads
+    kInitializers = 1u << 2,
+    // element types and shapes stored on values
+    kTypes = 1u << 3,
+    kAll = ~0u,
+  };
+};
+
+class AnalysisManager;
+
+// Something computed from a graph that passes share. Subclasses provide
+//   static constexpr uint32_t kDependsOn;  // GraphState bits
+//   Subclass(ir::Graph& graph, AnalysisManager& analyses);
+// and may get the analyses they build on from 'analyses' while constructed.
+class Analysis {
+ public:
+  virtual ~Analysis() = default;
+};
+
+// Computes analyses on first use and caches them per graph until
+// invalidate() is told that state they depend on changed.
+class AnalysisManager {
+ public:
+  template <typename A>
+  A& get(ir::Graph& graph) {
+    Key key{&graph, id<A>()};
+    auto it = cache_.find(key);
+    if (it != cache_.end()) return static_cast<A&>(*it->second.analysis);
+    // constructing may get (and insert) other analyses first
+    auto analysis = std::make_unique<A>(graph, *this);
+    A& result = *analysis;
+    cache_[key] = Entry{std::move(analysis), A::kDependsOn};
+    computed_++;
+    return result;
+  }
+
+  // nullptr unless already computed and still valid
+  template <typename A>
+  A* getCached(ir::Graph& graph) {
+    auto it = cache_.find(Key{&graph, id<A>()});
+    return it == cache_.end() ? nullptr
+                              : static_cast<A*>(it->second.analysis.get());
+  }
+
+  // Drop every analysis depending on the GraphState bits in 'mutated', of
+  // any graph since changing a graph can change what its subgraphs see.
+  void invalidate(uint32_t mutated);
+  void clear() { cache_.clear(); }
+
+  // how many analyses have been computed, for tests and statistics
+  size_t numComputed() const { return computed_; }
+
+ private:
+  template <typename A>
+  static const void* id() {
+    static const char key = 0;
+    return &key;
+  }
+
+  using Key = std::pair<const ir::Graph*, const void*>;
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<const void*>()(key.first) * 31 +
+             std::hash<const void*>()(key.second);
+    }
+  };
+  struct Entry {
+    std::unique_ptr<Analysis> analysis;
+    uint32_t depends_on;
+  };
+
+  std::unordered_map<Key, Entry, KeyHash> cache_;
+  size_t computed_ = 0;
+};
+
+// Positions and dense ids for the nodes and values of one graph, and the
+// nodes of that graph reading each value. Reads from subgraphs are
+// attributed to the node holding the subgraph, which Value::uses() would
+// otherwise find by searching the whole graph for every value.
+class UseDefAnalysis : public Analysis {
+ public:
+  static constexpr uint32_t kDependsOn = GraphState::kStructure;
+
+  UseDefAnalysis(ir::Graph& graph, AnalysisManager& analyses);
+
+  // the nodes in graph order
+  const std::vector<ir::Node*>& nodes() const { return nodes_; }
+  // inputs, initializer values, then node outputs in graph order
+  const std::vector<ir::Value*>& values() const { return values_; }
+
+  // 0 for the graph inputs and initializers, i + 1 for nodes()[i] and
+  // endPosition() for the return node
+  size_t position(const ir::Node* n) const;
+  size_t endPosition() const { return nodes_.size() + 1; }
+  // index into values()
+  size_t valueId(const ir::Value* v) const;
+
+  // distinct nodes of the graph reading 'v', in graph order, the return
+  // node last if 'v' is a graph output
+  const std::vector<ir::Node*>& users(const ir::Value* v) const {
+    return users_[valueId(v)];
+  }
+  // whether a subgraph reads 'v' by name, through a Captured node
+  bool isCaptured(const ir::Value* v) const { return captured_[valueId(v)]; }
+
+ private:
+  const ir::Graph* graph_;
+  std::vector<ir::Node*> nodes_;
+  std::vector<ir::Value*> values_;
+  std::unordered_map<const ir::Node*, size_t> positions_;
+  std::unordered_map<const ir::Value*, size_t> value_ids_;
+  std::vector<std::vector<ir::Node*>> users_;
+  std::vector<bool> captured_;
+};
+
+// Where each value dies: the position of its last reader.
+class LivenessAnalysis : public Analysis {
+ public:
+  static constexpr uint32_t kDependsOn = GraphState::kStructure;
+
+  LivenessAnalysis(ir::Graph& graph, AnalysisManager& analyses);
+
+  // position (see UseDefAnalysis) of the last node reading 'v';
+  // endPosition() for graph outputs, the defining position if unused
+  size_t lastUse(const ir::Value* v) const;
+  // values whose last reader is 'n', so their storage is free after it
+  const std::vector<ir::Value*>& dyingAt(const ir::Node* n) const;
+  // defined before 'position' and read at or after it
+  bool liveAt(const ir::Value* v, size_t position) const;
+  // the most values live across a node boundary
+  size_t maxLive() const { return max_live_; }
+
+ private:
+  const UseDefAnalysis* use_def_;
+  std::vector<size_t> last_use_;  // by value id
+  std::vector<std::vector<ir::Value*>> dying_;  // by position
+  size_t max_live_ = 0;
+};
+
+// Dominators of the dataflow graph rooted at the graph inputs: a node
+// dominates another if every path from the inputs to the other node passes
+// through it.
+class DominanceAnalysis : public Analysis {
+ public:
+  static constexpr uint32_t kDependsOn = GraphState::kStructure;
+
+  DominanceAnalysis(ir::Graph& graph, AnalysisManager& analyses);
+
+  // nearest strict dominator, nullptr if only the graph inputs dominate
+  // 'n'
+  ir::Node* idom(const ir::Node* n) const;
+  // also true for a == b; the graph inputs dominate everything
+  bool dominates(const ir::Node* a, const ir::Node* b) const;
+
+ private:
+  const UseDefAnalysis* use_def_;
+  std::vector<size_t> idom_;  // by position, 0 for the graph inputs
+};
+
+// Element types and shapes of every value, inferred once and kept until a
+// pass changes something they are computed from.
+class ShapeAnalysis : public Analysis {
+ public:
+  static constexpr uint32_t kDependsOn =
+      GraphState::kStructure | GraphState::kAttributes |
+      GraphState::kInitializers | GraphState::kTypes;
+
+  ShapeAnalysis(ir::Graph& graph, AnalysisManager& analyses);
+
+  // equalities between the symbolic dims of the graph
+  const ir::DimSolver& solver() const { return solver_; }
+
+ private:
+  ir::DimSolver solver_;
+};
+
+}  // namespace my_ai_training::optimization
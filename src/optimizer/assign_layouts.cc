@@ -0,0 +1,300 @@
+#include "optimizer/assign_layouts.h"
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "optimizer/analysis.h"
+
+namespace my_ai_training::optimization {
+
+int NativeElempack() {
+#if defined(__AVX512F__)
+  return 16;
+#elif defined(__AVX__)
+  return 8;
+#elif defined(__SSE2__) || defined(__ARM_NEON)
+  return 4;
+#else
+  return 1;
+#endif
+}
+
+int PreferredElempack(int64_t channels, int max_elempack) {
+  for (int elempack : {16, 8, 4}) {
+    if (elempack <= max_elempack && channels > 0 &&
+        channels % elempack == 0) {
+      return elempack;
+    }
+  }
+  return 1;
+}
+
+int Elempack(const ir::Value* v) {
+  const ir::Node* n = v->node();
+  return n->hasAttribute(ir::kelempack) ? n->i(ir::kelempack) : 1;
+}
+
+namespace {
+
+// how an op treats the layout of the values it reads
+enum class LayoutRule {
+  // reads and produces elempack 1
+  kUnpacked,
+  // produces the layout of input 0
+  kFollow,
+  // reads any layout of input 0, produces the preferred one of its output
+  kConvert,
+  // elementwise over inputs of one shape and scalars, in any one layout
+  kSameShape,
+};
+
+struct PackedOp {
+  ir::NodeKind kind;
+  LayoutRule rule;
+};
+
+// The ops whose kernels in src/runtime read and write packed layouts; a
+// Conv only when it is depthwise. Every other op reads elempack 1.
+const PackedOp kPackedOps[] = {
+    {ir::kConv, LayoutRule::kConvert},
+    {ir::kNeg, LayoutRule::kFollow},
+    {ir::kExp, LayoutRule::kFollow},
+    {ir::kSigmoid, LayoutRule::kFollow},
+    {ir::kTanh, LayoutRule::kFollow},
+    {ir::kAdd, LayoutRule::kSameShape},
+    {ir::kSub, LayoutRule::kSameShape},
+    {ir::kMul, LayoutRule::kSameShape},
+    {ir::kDiv, LayoutRule::kSameShape},
+    {ir::kPow, LayoutRule::kSameShape},
+};
+
+LayoutRule ruleOf(ir::NodeKind kind) {
+  for (const PackedOp& op : kPackedOps) {
+    if (op.kind == kind) return op.rule;
+  }
+  return LayoutRule::kUnpacked;
+}
+
+bool hasSubgraphs(const ir::Node* n) {
+  for (ir::Symbol name : n->attributeNames()) {
+    if (n->kindOf(name) == ir::AttributeKind::g ||
+        n->kindOf(name) == ir::AttributeKind::gs) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// the extent of the dim a packed layout interleaves, or -1
+int64_t channels(const ir::Value* v) {
+  if (!v->has_sizes() || v->sizes().size() < 3 || v->sizes().size() > 5 ||
+      !v->sizes()[1].is_int()) {
+    return -1;
+  }
+  return v->sizes()[1].dim();
+}
+
+// a Conv with a group per input and output channel
+bool isDepthwise(const ir::Node* n) {
+  int64_t groups = n->hasAttribute(ir::kgroup) ? n->i(ir::kgroup) : 1;
+  return groups > 1 && !n->inputs().empty() &&
+         channels(n->inputs()[0]) == groups &&
+         channels(n->output()) == groups;
+}
+
+// A FusionGroup runs in the layout its first op takes when the ops after
+// it keep that layout.
+LayoutRule ruleOf(const ir::Node* n) {
+  if (n->kind() != ir::kFusionGroup) {
+    if (hasSubgraphs(n) || (n->kind() == ir::kConv && !isDepthwise(n))) {
+      return LayoutRule::kUnpacked;
+    }
+    return ruleOf(n->kind());
+  }
+  const ir::Graph& body = *n->g(ir::kSubgraph);
+  LayoutRule rule = LayoutRule::kUnpacked;
+  bool first = true;
+  for (const ir::Node* inner : body.nodes()) {
+    LayoutRule inner_rule = ruleOf(inner);
+    if (first) {
+      rule = inner_rule;
+      first = false;
+    } else if (inner_rule == LayoutRule::kSameShape &&
+               (rule == LayoutRule::kFollow ||
+                rule == LayoutRule::kSameShape)) {
+      rule = LayoutRule::kSameShape;
+    } else if (inner_rule != LayoutRule::kFollow) {
+      return LayoutRule::kUnpacked;
+    }
+  }
+  return rule;
+}
+
+// known extents of 'v', or false
+bool staticSizes(const ir::Value* v, std::vector<int64_t>* sizes) {
+  if (!v->has_sizes()) return false;
+  sizes->clear();
+  for (const ir::Dimension& d : v->sizes()) {
+    if (!d.is_int()) return false;
+    sizes->push_back(d.dim());
+  }
+  return true;
+}
+
+// a value broadcasting the same way against any layout of a tensor
+bool isScalar(const ir::Value* v) {
+  if (v->node()->kind() == ir::kUndefined) return true;
+  std::vector<int64_t> sizes;
+  return staticSizes(v, &sizes) && sizes.size() <= 1 &&
+         (sizes.empty() || sizes[0] == 1);
+}
+
+class Assigner {
+ public:
+  Assigner(ir::Graph& graph, const UseDefAnalysis& use_def, int max_elempack)
+      : graph_(graph), use_def_(use_def), max_elempack_(max_elempack) {}
+
+  size_t run() {
+    // the snapshot does not see the Packing nodes made along the way
+    for (ir::Node* n : use_def_.nodes()) assign(n);
+    std::unordered_set<const ir::Value*> renamed;
+    for (size_t i = 0; i < graph_.outputs().size(); i++) {
+      ir::Value* v = graph_.outputs()[i];
+      if (elempackOf(v) == 1) continue;
+      ir::Value* unpacked = convert(v, 1);
+      if (renamed.insert(v).second) {
+        std::string name = v->uniqueName();
+        v->setUniqueName(ir::toVarName(graph_.getNextUnique()), false);
+        unpacked->setUniqueName(name, false);
+      }
+      graph_.return_node()->replaceInput(i, unpacked);
+    }
+    return changes_;
+  }
+
+ private:
+  int elempackOf(const ir::Value* v) const {
+    auto it = elempacks_.find(v);
+    return it == elempacks_.end() ? 1 : it->second;
+  }
+
+  // 'v' in 'elempack', through a Packing node made once per layout
+  ir::Value* convert(ir::Value* v, int elempack) {
+    if (elempackOf(v) == elempack) return v;
+    auto key = std::make_pair(v, elempack);
+    auto it = conversions_.find(key);
+    if (it != conversions_.end()) return it->second;
+    ir::Node* packing = graph_.create(ir::kPacking, {v}, 1);
+    packing->i_(ir::kelempack, elempack);
+    ir::Value* out = packing->output();
+    out->setElemType(v->elemType());
+    if (v->has_sizes()) out->setSizes(v->sizes());
+    if (v->node()->kind() == ir::kParam) {
+      graph_.prependNode(packing);
+    } else {
+      packing->insertAfter(v->node());
+    }
+    if (elempack != 1) elempacks_[out] = elempack;
+    conversions_[key] = out;
+    changes_++;
+    return out;
+  }
+
+  void assign(ir::Node* n) {
+    LayoutRule rule = ruleOf(n);
+    if (n->inputs().empty()) rule = LayoutRule::kUnpacked;
+    int elempack = 1;
+    // which inputs are read in 'elempack'; the others, like weights, are
+    // read unpacked
+    std::vector<bool> packed(n->inputs().size(), false);
+    switch (rule) {
+      case LayoutRule::kUnpacked:
+        break;
+      case LayoutRule::kFollow:
+        elempack = elempackOf(n->inputs()[0]);
+        packed[0] = true;
+        break;
+      case LayoutRule::kConvert:
+        // reads input 0 as it is
+        packed[0] = true;
+        elempack = PreferredElempack(channels(n->output()), max_elempack_);
+        break;
+      case LayoutRule::kSameShape:
+        elempack = sameShapeElempack(n, &packed);
+        break;
+    }
+    if (n->outputs().size() != 1 || use_def_.isCaptured(n->output())) {
+      elempack = 1;
+    }
+    for (size_t i = 0; i < n->inputs().size(); i++) {
+      ir::Value* v = n->inputs()[i];
+      int wanted = 1;
+      if (packed[i]) {
+        wanted = rule == LayoutRule::kConvert ? elempackOf(v) : elempack;
+      }
+      if (elempackOf(v) != wanted) n->replaceInput(i, convert(v, wanted));
+    }
+    if (elempack != 1) {
+      n->i_(ir::kelempack, elempack);
+      elempacks_[n->output()] = elempack;
+      changes_++;
+    }
+  }
+
+  // the layout the first packed input is in, when all inputs that are not
+  // scalars have one known shape
+  int sameShapeElempack(const ir::Node* n, std::vector<bool>* packed) const {
+    std::vector<int64_t> shape, sizes;
+    int elempack = 1;
+    for (size_t i = 0; i < n->inputs().size(); i++) {
+      const ir::Value* v = n->inputs()[i];
+      if (isScalar(v)) continue;
+      if (!staticSizes(v, &sizes) || (!shape.empty() && sizes != shape)) {
+        return 1;
+      }
+      shape = sizes;
+      (*packed)[i] = true;
+      if (elempack == 1) elempack = elempackOf(v);
+    }
+    if (elempack == 1) packed->assign(packed->size(), false);
+    return elempack;
+  }
+
+  ir::Graph& graph_;
+  const UseDefAnalysis& use_def_;
+  int max_elempack_;
+  size_t changes_ = 0;
+  std::unordered_map<const ir::Value*, int> elempacks_;
+  std::map<std::pair<ir::Value*, int>, ir::Value*> conversions_;
+};
+
+}  // namespace
+
+const std::vector<ir::NodeKind>& PackedLayoutKinds() {
+  static const auto* kinds = [] {
+    auto* kinds = new std::vector<ir::NodeKind>();
+    for (const PackedOp& op : kPackedOps) kinds->push_back(op.kind);
+    return kinds;
+  }();
+  return *kinds;
+}
+
+PassResult AssignLayouts::runPass(ir::Graph& graph,
+                                  AnalysisManager& analyses) {
+  for (const ir::Node* n : graph.nodes()) {
+    // already assigned
+    if (n->kind() == ir::kPacking || n->hasAttribute(ir::kelempack)) {
+      return PassResult::unchanged();
+    }
+  }
+  const UseDefAnalysis& use_def = analyses.get<UseDefAnalysis>(graph);
+  Assigner assigner(graph, use_def, max_elempack_);
+  return PassResult::changed(assigner.run(), GraphState::kStructure |
+                                                 GraphState::kAttributes);
+}
+
+}  // namespace my_ai_training::optimization
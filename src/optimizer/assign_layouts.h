@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "optimizer/pass.h"
+
+namespace my_ai_training::optimization {
+
+// The widest elempack the SIMD kernels of this build use: 16 floats for
+// AVX-512, 8 for AVX, 4 for SSE2 or NEON, otherwise 1.
+int NativeElempack();
+
+// The elempack a tensor with 'channels' channels is stored in: the widest
+// of 16, 8 and 4 that is at most 'max_elempack' and divides 'channels', or
+// 1. This is the rule ncnn::Mat uses for its packed layouts.
+int PreferredElempack(int64_t channels, int max_elempack);
+
+// The elempack AssignLayouts chose for 'v', 1 for graph inputs and
+// initializers and for graphs it did not run on.
+int Elempack(const ir::Value* v);
+
+// The ops AssignLayouts may give a packed layout. Their kernels must have
+// Kernel::runs_packed set.
+const std::vector<ir::NodeKind>& PackedLayoutKinds();
+
+// Picks the memory layout of every value: elempack 1, or a packed layout
+// where groups of elempack channels (dim 1 of a rank 3 to 5 tensor) are
+// interleaved, as ncnn::Mat stores them. The choice is written to the
+// 'elempack' attribute of the producing node, which is left unset for 1.
+//
+// Only ops whose runtime kernels read and write packed layouts take one:
+// a depthwise Conv reads any layout and produces the preferred one of its
+// output channels, Neg, Exp, Sigmoid and Tanh keep the layout of their
+// input, and Add, Sub, Mul, Div and Pow run packed over inputs of one
+// shape, as do FusionGroups made of such ops. Every other op, other Convs
+// included, reads elempack 1. A Packing node with an 'elempack' attribute
+// converts a value where a reader needs another layout; one is made per
+// value and layout however many nodes read it. Graph outputs and values
+// read by subgraphs are returned unpacked, under their original names.
+//
+// Run this last: the shapes stay logical, but the other passes do not keep
+// the attributes and Packing nodes consistent.
+class AssignLayouts : public Pass {
+ public:
+  explicit AssignLayouts(int max_elempack = NativeElempack())
+      : max_elempack_(max_elempack) {}
+
+  std::string getPassName() const override { return "assign_layouts"; }
+  PassResult runPass(ir::Graph& graph, AnalysisManager& analyses) override;
+
+ private:
+  int max_elempack_;
+};
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,258 @@
+#include "optimizer/eliminate_common_subexpressions.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace my_ai_training::optimization {
+
+namespace {
+
+void hashCombine(size_t* seed, size_t value) {
+  *seed ^= value + 0x9e3779b97f4a7c15ull + (*seed << 6) + (*seed >> 2);
+}
+
+size_t hashTensor(const ir::Tensor& t) {
+  size_t seed = std::hash<int32_t>()(t.elem_type());
+  for (int64_t size : t.sizes()) hashCombine(&seed, std::hash<int64_t>()(size));
+  hashCombine(&seed, t.byteSize());
+  // the leading bytes are enough to tell most constants apart
+  const auto* bytes = static_cast<const unsigned char*>(t.rawData());
+  for (size_t i = 0; i < std::min<size_t>(t.byteSize(), 64); i++) {
+    hashCombine(&seed, bytes[i]);
+  }
+  for (const std::string& s : t.strings()) {
+    hashCombine(&seed, std::hash<std::string>()(s));
+  }
+  return seed;
+}
+
+bool sameTensor(const ir::Tensor& a, const ir::Tensor& b) {
+  return a.elem_type() == b.elem_type() && a.sizes() == b.sizes() &&
+         a.byteSize() == b.byteSize() &&
+         (a.byteSize() == 0 ||
+          memcmp(a.rawData(), b.rawData(), a.byteSize()) == 0) &&
+         a.strings() == b.strings();
+}
+
+template <typename T>
+size_t hashList(const std::vector<T>& values) {
+  size_t seed = values.size();
+  for (const T& v : values) hashCombine(&seed, std::hash<T>()(v));
+  return seed;
+}
+
+// attribute names in a canonical order, or false if 'n' has attributes
+// that are not compared
+bool sortedAttributeNames(const ir::Node* n, std::vector<ir::Symbol>* names) {
+  *names = n->attributeNames();
+  for (ir::Symbol name : *names) {
+    switch (n->kindOf(name)) {
+      case ir::AttributeKind::g:
+      case ir::AttributeKind::gs:
+      case ir::AttributeKind::tp:
+      case ir::AttributeKind::tps:
+        return false;
+      default:
+        break;
+    }
+  }
+  std::sort(names->begin(), names->end());
+  return true;
+}
+
+size_t hashAttribute(const ir::Node* n, ir::Symbol name) {
+  switch (n->kindOf(name)) {
+    case ir::AttributeKind::f:
+      return std::hash<double>()(n->f(name));
+    case ir::AttributeKind::fs:
+      return hashList(n->fs(name));
+    case ir::AttributeKind::i:
+      return std::hash<int64_t>()(n->i(name));
+    case ir::AttributeKind::is:
+      return hashList(n->is(name));
+    case ir::AttributeKind::s:
+      return std::hash<std::string>()(n->s(name));
+    case ir::AttributeKind::ss:
+      return hashList(n->ss(name));
+    case ir::AttributeKind::t:
+      return hashTensor(n->t(name));
+    case ir::AttributeKind::ts: {
+      size_t seed = n->ts(name).size();
+      for (const ir::Tensor& t : n->ts(name)) hashCombine(&seed, hashTensor(t));
+      return seed;
+    }
+    default:
+      return 0;
+  }
+}
+
+bool sameAttribute(const ir::Node* a, const ir::Node* b, ir::Symbol name) {
+  if (a->kindOf(name) != b->kindOf(name)) return false;
+  switch (a->kindOf(name)) {
+    case ir::AttributeKind::f:
+      return a->f(name) == b->f(name);
+    case ir::AttributeKind::fs:
+      return a->fs(name) == b->fs(name);
+    case ir::AttributeKind::i:
+      return a->i(name) == b->i(name);
+    case ir::AttributeKind::is:
+      return a->is(name) == b->is(name);
+    case ir::AttributeKind::s:
+      return a->s(name) == b->s(name);
+    case ir::AttributeKind::ss:
+      return a->ss(name) == b->ss(name);
+    case ir::AttributeKind::t:
+      return sameTensor(a->t(name), b->t(name));
+    case ir::AttributeKind::ts: {
+      const auto& ta = a->ts(name);
+      const auto& tb = b->ts(name);
+      if (ta.size() != tb.size()) return false;
+      for (size_t i = 0; i < ta.size(); i++) {
+        if (!sameTensor(ta[i], tb[i])) return false;
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+bool isNondeterministic(ir::NodeKind kind) {
+  switch (kind) {
+    case ir::kRandomNormal:
+    case ir::kRandomNormalLike:
+    case ir::kRandomUniform:
+    case ir::kRandomUniformLike:
+    case ir::kMultinomial:
+    case ir::kBernoulli:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// A node considered for merging, with its attribute names in canonical
+// order so they are only looked up once.
+struct Candidate {
+  ir::Node* node;
+  std::vector<ir::Symbol> attributes;
+};
+
+size_t hashNode(const Candidate& c) {
+  const ir::Node* n = c.node;
+  size_t seed = std::hash<uint32_t>()(n->kind());
+  hashCombine(&seed, std::hash<std::string>()(n->domain()));
+  hashCombine(&seed, n->outputs().size());
+  for (const ir::Value* v : n->inputs()) {
+    hashCombine(&seed, std::hash<const ir::Value*>()(v));
+  }
+  for (ir::Symbol name : c.attributes) {
+    hashCombine(&seed, std::hash<uint32_t>()(name));
+    hashCombine(&seed, hashAttribute(n, name));
+  }
+  return seed;
+}
+
+bool sameNode(const Candidate& a, const Candidate& b) {
+  const ir::Node* x = a.node;
+  const ir::Node* y = b.node;
+  if (x->kind() != y->kind() || x->domain() != y->domain() ||
+      x->outputs().size() != y->outputs().size() ||
+      x->inputs().size() != y->inputs().size() ||
+      a.attributes != b.attributes) {
+    return false;
+  }
+  for (size_t i = 0; i < x->inputs().size(); i++) {
+    if (x->inputs()[i] != y->inputs()[i]) return false;
+  }
+  for (ir::Symbol name : a.attributes) {
+    if (!sameAttribute(x, y, name)) return false;
+  }
+  return true;
+}
+
+size_t eliminateInGraph(ir::Graph& graph, AnalysisManager& analyses) {
+  size_t removed = 0;
+  // subgraphs first, while this graph's nodes are all still alive; one
+  // shared by several attributes must not be seen with stale analyses
+  auto eliminate = [&](ir::Graph& subgraph) {
+    size_t count = eliminateInGraph(subgraph, analyses);
+    if (count > 0) analyses.invalidate(GraphState::kStructure);
+    removed += count;
+  };
+  for (ir::Node* n : graph.nodes()) {
+    for (ir::Symbol name : n->attributeNames()) {
+      if (n->kindOf(name) == ir::AttributeKind::g) {
+        eliminate(*n->g(name));
+      } else if (n->kindOf(name) == ir::AttributeKind::gs) {
+        for (auto& g : n->gs(name)) eliminate(*g);
+      }
+    }
+  }
+
+  auto& use_def = analyses.get<UseDefAnalysis>(graph);
+  std::unordered_set<const ir::Value*> graph_outputs(graph.outputs().begin(),
+                                                     graph.outputs().end());
+  // Subgraphs find captured values by name and graph outputs are known by
+  // name, so 'n' is only replaced if no name would need to move onto a
+  // value that already has a meaning.
+  auto replaceable = [&](ir::Node* n, ir::Node* m) {
+    for (size_t i = 0; i < n->outputs().size(); i++) {
+      ir::Value* from = n->outputs()[i];
+      ir::Value* to = m->outputs()[i];
+      if (use_def.isCaptured(from)) return false;
+      if (graph_outputs.count(from) != 0 &&
+          (graph_outputs.count(to) != 0 || use_def.isCaptured(to))) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  std::unordered_map<size_t, std::vector<Candidate>> table;
+  // advance before destroying, the iterator would be left dangling
+  for (auto it = graph.begin(); it != graph.end();) {
+    ir::Node* n = *it;
+    ++it;
+    Candidate c{n, {}};
+    if (n->kind() == ir::kCaptured || n->kind() == ir::kUndefined ||
+        n->outputs().empty() || isNondeterministic(n->kind()) ||
+        !sortedAttributeNames(n, &c.attributes)) {
+      continue;
+    }
+    auto& bucket = table[hashNode(c)];
+    auto same = std::find_if(
+        bucket.begin(), bucket.end(),
+        [&c](const Candidate& other) { return sameNode(c, other); });
+    if (same == bucket.end()) {
+      bucket.push_back(std::move(c));
+      continue;
+    }
+    ir::Node* m = same->node;
+    if (!replaceable(n, m)) continue;
+    for (size_t i = 0; i < n->outputs().size(); i++) {
+      if (graph_outputs.count(n->outputs()[i]) != 0) {
+        graph_outputs.insert(m->outputs()[i]);
+      }
+      n->outputs()[i]->replaceAllUsesWith(m->outputs()[i]);
+    }
+    n->destroy();
+    removed++;
+  }
+  return removed;
+}
+
+}  // namespace
+
+PassResult EliminateCommonSubexpressions::runPass(ir::Graph& graph,
+                                                  AnalysisManager& analyses) {
+  return PassResult::changed(eliminateInGraph(graph, analyses),
+                             GraphState::kStructure);
+}
+
+}  // namespace my_ai_training::optimization
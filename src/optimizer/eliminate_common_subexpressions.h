@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+#include "optimizer/pass.h"
+
+namespace my_ai_training::optimization {
+
+// Hash-consing: a node computing the same kind, from the same inputs and
+// with the same attributes as an earlier node is replaced by it. Exported
+// models repeat Shape -> Gather -> Unsqueeze chains once per use; since
+// inputs are compared by identity and every replacement happens before the
+// nodes reading it are visited, whole chains collapse in one sweep.
+//
+// Nondeterministic ops (RandomNormal and such) and nodes holding subgraphs
+// are never merged. Subgraphs are handled separately, each with a table of
+// its own.
+class EliminateCommonSubexpressions : public Pass {
+ public:
+  std::string getPassName() const override {
+    return "eliminate_common_subexpressions";
+  }
+  PassResult runPass(ir::Graph& graph, AnalysisManager& analyses) override;
+};
+
+}  // namespace my_ai_training::optimization
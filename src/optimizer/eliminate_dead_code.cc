@@ -0,0 +1,94 @@
+#include "optimizer/eliminate_dead_code.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace my_ai_training::optimization {
+
+namespace {
+
+size_t eliminateInSubgraphs(ir::Graph& graph, AnalysisManager& analyses);
+
+// A single sweep from the last node to the first. The readers of every
+// value are counted once up front and decremented as dead nodes go, so a
+// chain that only fed dead nodes is removed in the same sweep; asking
+// hasUses() instead would search every subgraph per value.
+size_t eliminateInGraph(ir::Graph& graph, AnalysisManager& analyses) {
+  size_t removed = eliminateInSubgraphs(graph, analyses);
+
+  auto& use_def = analyses.get<UseDefAnalysis>(graph);
+  const auto& values = use_def.values();
+  const auto& nodes = use_def.nodes();
+  std::vector<size_t> readers(values.size());
+  // values read by the node at each position, subgraph captures included
+  std::vector<std::vector<size_t>> reads(use_def.endPosition() + 1);
+  for (size_t i = 0; i < values.size(); i++) {
+    readers[i] = use_def.users(values[i]).size();
+    for (ir::Node* user : use_def.users(values[i])) {
+      reads[use_def.position(user)].push_back(i);
+    }
+  }
+
+  std::vector<ir::Node*> dead;
+  for (size_t p = nodes.size(); p > 0; p--) {
+    ir::Node* n = nodes[p - 1];
+    bool is_dead = std::all_of(
+        n->outputs().begin(), n->outputs().end(),
+        [&](ir::Value* v) { return readers[use_def.valueId(v)] == 0; });
+    if (!is_dead) continue;
+    for (size_t i : reads[p]) readers[i]--;
+    dead.push_back(n);
+  }
+
+  std::vector<std::string> dead_initializers;
+  std::unordered_set<std::string> input_names;
+  for (ir::Value* v : graph.inputs()) input_names.insert(v->uniqueName());
+  for (ir::Value* v : graph.initializerValues()) {
+    // an initializer named like an input is that input's default
+    if (readers[use_def.valueId(v)] == 0 &&
+        input_names.count(v->uniqueName()) == 0) {
+      dead_initializers.push_back(v->uniqueName());
+    }
+  }
+
+  // 'dead' runs from last to first, so readers go before what they read
+  for (ir::Node* n : dead) n->destroy();
+  for (const std::string& name : dead_initializers) {
+    graph.eraseInitializer(name);
+  }
+  return removed + dead.size() + dead_initializers.size();
+}
+
+// A subgraph may be shared by several attributes; the analyses of a changed
+// one are dropped before it is seen again.
+size_t eliminateInSubgraphs(ir::Graph& graph, AnalysisManager& analyses) {
+  size_t removed = 0;
+  auto eliminate = [&](ir::Graph& subgraph) {
+    size_t count = eliminateInGraph(subgraph, analyses);
+    if (count > 0) analyses.invalidate(GraphState::kStructure);
+    removed += count;
+  };
+  for (ir::Node* n : graph.nodes()) {
+    for (ir::Symbol name : n->attributeNames()) {
+      if (n->kindOf(name) == ir::AttributeKind::g) {
+        eliminate(*n->g(name));
+      } else if (n->kindOf(name) == ir::AttributeKind::gs) {
+        for (auto& g : n->gs(name)) eliminate(*g);
+      }
+    }
+  }
+  return removed;
+}
+
+}  // namespace
+
+PassResult EliminateDeadCode::runPass(ir::Graph& graph,
+                                      AnalysisManager& analyses) {
+  size_t removed = eliminateInGraph(graph, analyses);
+  return PassResult::changed(
+      removed, GraphState::kStructure | GraphState::kInitializers);
+}
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+#include "optimizer/pass.h"
+
+namespace my_ai_training::optimization {
+
+// Removes nodes none of whose outputs are read, by another node, a subgraph
+// or the graph outputs, and initializers nothing reads. Subgraphs are
+// cleaned first so captures they no longer need stop keeping values alive.
+class EliminateDeadCode : public Pass {
+ public:
+  std::string getPassName() const override { return "eliminate_dead_code"; }
+  PassResult runPass(ir::Graph& graph, AnalysisManager& analyses) override;
+};
+
+}  // namespace my_ai_training::optimization
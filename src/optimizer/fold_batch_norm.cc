@@ -0,0 +1,250 @@
+#include "optimizer/fold_batch_norm.h"
+
+#include <cmath>
+#include <vector>
+
+#include "optimizer/fold_constants.h"
+
+namespace my_ai_training::optimization {
+
+namespace {
+
+bool isFloating(int32_t elem_type) {
+  return elem_type == ir::TensorProto_DataType_FLOAT ||
+         elem_type == ir::TensorProto_DataType_DOUBLE;
+}
+
+// a FLOAT or DOUBLE constant widened to double
+bool readFloats(const ir::Tensor* t, std::vector<double>* values) {
+  if (t == nullptr || !isFloating(t->elem_type()) ||
+      t->byteSize() != t->expectedByteSize()) {
+    return false;
+  }
+  if (t->elem_type() == ir::TensorProto_DataType_FLOAT) {
+    const float* data = t->data<float>();
+    values->assign(data, data + t->numel());
+  } else {
+    const double* data = t->data<double>();
+    values->assign(data, data + t->numel());
+  }
+  return true;
+}
+
+// a new initializer of 'elem_type' holding 'values'
+ir::Value* addInitializer(ir::Graph& graph, int32_t elem_type,
+                          std::vector<int64_t> sizes,
+                          const std::vector<double>& values) {
+  ir::Tensor t(elem_type, std::move(sizes));
+  t.allocate();
+  if (elem_type == ir::TensorProto_DataType_FLOAT) {
+    float* data = t.mutableData<float>();
+    for (size_t i = 0; i < values.size(); i++) {
+      data[i] = static_cast<float>(values[i]);
+    }
+  } else {
+    double* data = t.mutableData<double>();
+    for (size_t i = 0; i < values.size(); i++) data[i] = values[i];
+  }
+  return graph.addInitializerAndCreateValue(t);
+}
+
+// The per channel affine map of a BatchNormalization, y = x * scale +
+// shift, or false if it is not an inference one with constant parameters.
+bool batchNormAffine(const ir::Node* bn, std::vector<double>* scale,
+                     std::vector<double>* shift) {
+  if (bn->inputs().size() != 5 || bn->outputs().size() != 1) return false;
+  if (bn->hasAttribute(ir::ktraining_mode) &&
+      bn->i(ir::ktraining_mode) != 0) {
+    return false;
+  }
+  // opset < 9 could normalize per activation instead of per channel
+  if (bn->hasAttribute(ir::kspatial) && bn->i(ir::kspatial) == 0) {
+    return false;
+  }
+  std::vector<double> gamma, beta, mean, var;
+  if (!readFloats(FindConstant(bn->inputs()[1]), &gamma) ||
+      !readFloats(FindConstant(bn->inputs()[2]), &beta) ||
+      !readFloats(FindConstant(bn->inputs()[3]), &mean) ||
+      !readFloats(FindConstant(bn->inputs()[4]), &var)) {
+    return false;
+  }
+  size_t channels = gamma.size();
+  if (beta.size() != channels || mean.size() != channels ||
+      var.size() != channels) {
+    return false;
+  }
+  double epsilon = bn->hasAttribute(ir::kepsilon) ? bn->f(ir::kepsilon) : 1e-5;
+  scale->resize(channels);
+  shift->resize(channels);
+  for (size_t c = 0; c < channels; c++) {
+    (*scale)[c] = gamma[c] / std::sqrt(var[c] + epsilon);
+    (*shift)[c] = beta[c] - mean[c] * (*scale)[c];
+  }
+  return true;
+}
+
+// Conv and ConvTranspose: W is [M, C/group, k...] and [C, M/group, k...]
+// for M output channels.
+bool foldIntoConv(ir::Node* conv, const std::vector<double>& scale,
+                  const std::vector<double>& shift) {
+  const ir::Tensor* w = FindConstant(conv->inputs()[1]);
+  std::vector<double> weights, bias;
+  if (!readFloats(w, &weights) || w->sizes().size() < 2) return false;
+  const auto& sizes = w->sizes();
+  int64_t group = conv->hasAttribute(ir::kgroup) ? conv->i(ir::kgroup) : 1;
+  bool transposed = conv->kind() == ir::kConvTranspose;
+  size_t channels = transposed ? sizes[1] * group : sizes[0];
+  if (group <= 0 || channels != scale.size() || sizes[0] % group != 0) {
+    return false;
+  }
+  bool has_bias = conv->inputs().size() > 2 &&
+                  conv->inputs()[2]->node()->kind() != ir::kUndefined;
+  if (has_bias) {
+    if (!readFloats(FindConstant(conv->inputs()[2]), &bias) ||
+        bias.size() != channels) {
+      return false;
+    }
+  } else {
+    bias.assign(channels, 0);
+  }
+
+  // each output channel scales contiguous runs of 'inner' weights
+  int64_t inner = w->size_from_dim(2);
+  for (int64_t i = 0; i < sizes[0]; i++) {
+    for (int64_t j = 0; j < sizes[1]; j++) {
+      size_t out_channel =
+          transposed ? (i / (sizes[0] / group)) * sizes[1] + j : i;
+      double s = scale[out_channel];
+      double* run = weights.data() + (i * sizes[1] + j) * inner;
+      for (int64_t k = 0; k < inner; k++) run[k] *= s;
+    }
+  }
+  for (size_t c = 0; c < channels; c++) {
+    bias[c] = bias[c] * scale[c] + shift[c];
+  }
+
+  ir::Graph& graph = *conv->owningGraph();
+  conv->replaceInput(1, addInitializer(graph, w->elem_type(), sizes, weights));
+  ir::Value* b = addInitializer(graph, w->elem_type(),
+                                {static_cast<int64_t>(channels)}, bias);
+  if (conv->inputs().size() > 2) {
+    conv->replaceInput(2, b);
+  } else {
+    conv->addInput(b);
+  }
+  return true;
+}
+
+// Gemm: Y = alpha * A' B' + beta * C with B' = B or B^T of N columns. The
+// columns of B' are scaled and C becomes a vector of N, so a C varying
+// along the rows is not folded.
+bool foldIntoGemm(ir::Node* gemm, const std::vector<double>& scale,
+                  const std::vector<double>& shift) {
+  const ir::Tensor* w = FindConstant(gemm->inputs()[1]);
+  std::vector<double> weights, c;
+  if (!readFloats(w, &weights) || w->sizes().size() != 2) return false;
+  bool trans_b = gemm->hasAttribute(ir::ktransB) && gemm->i(ir::ktransB) != 0;
+  int64_t rows = w->sizes()[0];
+  int64_t cols = w->sizes()[1];
+  size_t n = trans_b ? rows : cols;
+  if (n != scale.size()) return false;
+  double beta = gemm->hasAttribute(ir::kbeta) ? gemm->f(ir::kbeta) : 1.0;
+
+  bool has_c = gemm->inputs().size() > 2 &&
+               gemm->inputs()[2]->node()->kind() != ir::kUndefined;
+  std::vector<double> bias(n, 0);
+  if (has_c) {
+    const ir::Tensor* t = FindConstant(gemm->inputs()[2]);
+    if (!readFloats(t, &c)) return false;
+    // [], [1], [N] or [1, N]
+    const auto& sizes = t->sizes();
+    bool per_column = c.size() == n && (sizes.size() == 1 ||
+                                        (sizes.size() == 2 && sizes[0] == 1));
+    if (c.size() != 1 && !per_column) return false;
+    for (size_t j = 0; j < n; j++) bias[j] = beta * c[c.size() == 1 ? 0 : j];
+  }
+
+  for (int64_t i = 0; i < rows; i++) {
+    double* row = weights.data() + i * cols;
+    if (trans_b) {
+      for (int64_t j = 0; j < cols; j++) row[j] *= scale[i];
+    } else {
+      for (int64_t j = 0; j < cols; j++) row[j] *= scale[j];
+    }
+  }
+  for (size_t j = 0; j < n; j++) bias[j] = bias[j] * scale[j] + shift[j];
+
+  ir::Graph& graph = *gemm->owningGraph();
+  gemm->replaceInput(1, addInitializer(graph, w->elem_type(), w->sizes(),
+                                       weights));
+  ir::Value* b = addInitializer(graph, w->elem_type(),
+                                {static_cast<int64_t>(n)}, bias);
+  if (gemm->inputs().size() > 2) {
+    gemm->replaceInput(2, b);
+  } else {
+    gemm->addInput(b);
+  }
+  gemm->f_(ir::kbeta, 1.0);
+  return true;
+}
+
+size_t foldInGraph(ir::Graph& graph, AnalysisManager& analyses) {
+  size_t count = 0;
+  auto fold = [&](ir::Graph& subgraph) {
+    size_t changes = foldInGraph(subgraph, analyses);
+    if (changes > 0) analyses.invalidate(GraphState::kStructure);
+    count += changes;
+  };
+  for (ir::Node* n : graph.nodes()) {
+    for (ir::Symbol name : n->attributeNames()) {
+      if (n->kindOf(name) == ir::AttributeKind::g) {
+        fold(*n->g(name));
+      } else if (n->kindOf(name) == ir::AttributeKind::gs) {
+        for (auto& g : n->gs(name)) fold(*g);
+      }
+    }
+  }
+
+  auto& use_def = analyses.get<UseDefAnalysis>(graph);
+  std::vector<ir::Node*> folded;
+  std::vector<double> scale, shift;
+  for (ir::Node* bn : use_def.nodes()) {
+    if (bn->kind() != ir::kBatchNormalization || bn->inputs().empty() ||
+        bn->outputs().size() != 1) {
+      continue;
+    }
+    ir::Value* x = bn->inputs()[0];
+    ir::Node* producer = x->node();
+    ir::NodeKind kind = producer->kind();
+    if (kind != ir::kConv && kind != ir::kConvTranspose &&
+        kind != ir::kGemm) {
+      continue;
+    }
+    // the BatchNormalization output is moved onto 'x', which must have no
+    // other reader; a name captured by a subgraph cannot move
+    if (use_def.users(x).size() != 1 || use_def.isCaptured(x) ||
+        use_def.isCaptured(bn->output()) || producer->inputs().size() < 2) {
+      continue;
+    }
+    if (!batchNormAffine(bn, &scale, &shift)) continue;
+    bool ok = kind == ir::kGemm ? foldIntoGemm(producer, scale, shift)
+                                : foldIntoConv(producer, scale, shift);
+    if (!ok) continue;
+    bn->output()->replaceAllUsesWith(x);
+    folded.push_back(bn);
+  }
+  for (ir::Node* bn : folded) bn->destroy();
+  return count + folded.size();
+}
+
+}  // namespace
+
+PassResult FoldBatchNorm::runPass(ir::Graph& graph,
+                                  AnalysisManager& analyses) {
+  size_t folded = foldInGraph(graph, analyses);
+  return PassResult::changed(folded, GraphState::kStructure |
+                                         GraphState::kInitializers |
+                                         GraphState::kAttributes);
+}
+
+}  // namespace my_ai_training::optimization
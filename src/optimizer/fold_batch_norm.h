@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+#include "optimizer/pass.h"
+
+namespace my_ai_training::optimization {
+
+// Folds an inference BatchNormalization into the Conv, ConvTranspose or
+// Gemm producing its input: with s = scale / sqrt(var + epsilon) per
+// output channel, the weights become W * s and the bias (b - mean) * s +
+// B, which saves reading and writing the whole activation map again.
+//
+// The weights, the bias and the BatchNormalization parameters must be
+// FLOAT or DOUBLE constants and the producer's output must only be read by
+// the BatchNormalization. New initializers are created for the folded
+// weights, since the old ones may be shared; eliminate_dead_code drops the
+// old ones.
+class FoldBatchNorm : public Pass {
+ public:
+  std::string getPassName() const override { return "fold_batch_norm"; }
+  PassResult runPass(ir::Graph& graph, AnalysisManager& analyses) override;
+};
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,155 @@
+#include "optimizer/fold_constants.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "optimizer/reference_kernels.h"
+
+namespace my_ai_training::optimization {
+
+const ir::Tensor* FindConstant(const ir::Value* v) {
+  const ir::Node* producer = v->node();
+  if (producer->kind() == ir::kConstant &&
+      producer->hasAttribute(ir::kvalue) &&
+      producer->kindOf(ir::kvalue) == ir::AttributeKind::t) {
+    return &producer->t(ir::kvalue);
+  }
+  const ir::Graph* graph = v->owningGraph();
+  if (!graph->isInitializerValue(v)) return nullptr;
+  for (const ir::Value* input : graph->inputs()) {
+    if (input->uniqueName() == v->uniqueName()) return nullptr;
+  }
+  auto it = graph->getInitializer(v->uniqueName());
+  return it == graph->initializers().end() ? nullptr : &*it;
+}
+
+namespace {
+
+bool hasSubgraphs(const ir::Node* n) {
+  for (ir::Symbol name : n->attributeNames()) {
+    if (n->kindOf(name) == ir::AttributeKind::g ||
+        n->kindOf(name) == ir::AttributeKind::gs) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// FindConstant() for many values of one graph, without searching the
+// graph inputs for each.
+class Constants {
+ public:
+  explicit Constants(ir::Graph& graph) {
+    std::unordered_set<std::string> inputs;
+    for (ir::Value* v : graph.inputs()) inputs.insert(v->uniqueName());
+    for (ir::Value* v : graph.initializerValues()) {
+      if (inputs.count(v->uniqueName()) != 0) continue;
+      auto it = graph.getInitializer(v->uniqueName());
+      if (it != graph.initializers().end()) values_[v] = &*it;
+    }
+  }
+
+  // nullptr unless 'v' is constant
+  const ir::Tensor* find(const ir::Value* v) const {
+    const ir::Node* producer = v->node();
+    if (producer->kind() == ir::kConstant &&
+        producer->hasAttribute(ir::kvalue) &&
+        producer->kindOf(ir::kvalue) == ir::AttributeKind::t) {
+      return &producer->t(ir::kvalue);
+    }
+    auto it = values_.find(v);
+    return it == values_.end() ? nullptr : it->second;
+  }
+
+ private:
+  std::unordered_map<const ir::Value*, const ir::Tensor*> values_;
+};
+
+size_t foldInGraph(ir::Graph& graph, size_t max_output_bytes) {
+  size_t folded = 0;
+  for (ir::Node* n : graph.nodes()) {
+    for (ir::Symbol name : n->attributeNames()) {
+      if (n->kindOf(name) == ir::AttributeKind::g) {
+        folded += foldInGraph(*n->g(name), max_output_bytes);
+      } else if (n->kindOf(name) == ir::AttributeKind::gs) {
+        for (auto& g : n->gs(name)) folded += foldInGraph(*g, max_output_bytes);
+      }
+    }
+  }
+
+  // payloads folded in this sweep, by value; initializers are only added
+  // at the end since adding one may move the others
+  std::unordered_map<const ir::Value*, ir::Tensor> results;
+  Constants constants(graph);
+  auto constantOf = [&](const ir::Value* v) -> const ir::Tensor* {
+    auto it = results.find(v);
+    return it != results.end() ? &it->second : constants.find(v);
+  };
+
+  std::vector<const ir::Tensor*> inputs;
+  std::vector<ir::Tensor> outputs;
+  std::vector<ir::Node*> folded_nodes;
+  for (ir::Node* n : graph.nodes()) {
+    if (!HasReferenceKernel(n->kind()) || hasSubgraphs(n)) continue;
+    inputs.clear();
+    bool constant = true;
+    for (ir::Value* v : n->inputs()) {
+      if (v->node()->kind() == ir::kUndefined) {
+        inputs.push_back(nullptr);  // an omitted optional input
+        continue;
+      }
+      const ir::Tensor* t = constantOf(v);
+      constant &= t != nullptr;
+      inputs.push_back(t);
+    }
+    if (!constant || !EvaluateNode(n, inputs, &outputs)) continue;
+    if (outputs[0].byteSize() > max_output_bytes) continue;
+    results[n->output()] = std::move(outputs[0]);
+    folded_nodes.push_back(n);
+  }
+
+  std::unordered_set<const ir::Node*> folded_set(folded_nodes.begin(),
+                                                 folded_nodes.end());
+  for (ir::Node* n : folded_nodes) {
+    ir::Value* out = n->output();
+    // values only read by other folded nodes need no initializer
+    const auto uses = out->uses();
+    if (std::all_of(uses.begin(), uses.end(), [&](const ir::Use& u) {
+          return folded_set.count(u.user) != 0;
+        })) {
+      continue;
+    }
+    ir::Tensor& t = results[out];
+    // the initializer takes the name of the value it replaces, so graph
+    // outputs and subgraphs capturing it by name still find it
+    std::string name = out->uniqueName();
+    out->setUniqueName(ir::toVarName(graph.getNextUnique()), false);
+    t.setName(name);
+    ir::Value* init = graph.addInitializerAndCreateValue(t);
+    out->replaceAllUsesWith(init);
+    // replaceAllUsesWith() moves the name of a graph output onto 'init'
+    // without renaming its initializer
+    init->setUniqueName(name, false);
+    std::vector<ir::Dimension> sizes(t.sizes().begin(), t.sizes().end());
+    init->setSizes(sizes);
+    init->setElemType(t.elem_type());
+  }
+  // readers first: the folded nodes may still read one another
+  for (auto it = folded_nodes.rbegin(); it != folded_nodes.rend(); ++it) {
+    (*it)->destroy();
+  }
+  return folded + folded_nodes.size();
+}
+
+}  // namespace
+
+PassResult FoldConstants::runPass(ir::Graph& graph, AnalysisManager&) {
+  size_t folded = foldInGraph(graph, max_output_bytes_);
+  return PassResult::changed(folded, GraphState::kStructure |
+                                         GraphState::kInitializers |
+                                         GraphState::kTypes);
+}
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+
+#include "optimizer/pass.h"
+
+namespace my_ai_training::optimization {
+
+// Evaluates nodes whose inputs are all constants (Constant outputs and
+// initializers that are not also graph inputs, which a caller may feed)
+// with the reference kernels and replaces their outputs by initializers of
+// the same name. Folding a node usually makes its constant inputs dead;
+// eliminate_dead_code removes them.
+//
+// Results larger than 'max_output_bytes' are not folded: an Expand of a
+// scalar would otherwise trade a cheap runtime op for a large weight.
+class FoldConstants : public Pass {
+ public:
+  static constexpr size_t kDefaultMaxOutputBytes = size_t{1} << 20;
+
+  explicit FoldConstants(size_t max_output_bytes = kDefaultMaxOutputBytes)
+      : max_output_bytes_(max_output_bytes) {}
+
+  std::string getPassName() const override { return "fold_constants"; }
+  PassResult runPass(ir::Graph& graph, AnalysisManager& analyses) override;
+
+ private:
+  size_t max_output_bytes_;
+};
+
+// The payload of 'v' if it is a constant: the output of a Constant node or
+// an initializer that is not also a graph input. nullptr otherwise.
+const ir::Tensor* FindConstant(const ir::Value* v);
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,226 @@
+#include "optimizer/fuse_operators.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace my_ai_training::optimization {
+
+ir::Node* CreateFusionGroup(const std::vector<ir::Node*>& nodes) {
+  ONNX_ASSERT(!nodes.empty());
+  ir::Graph& graph = *nodes[0]->owningGraph();
+  ir::Node* last = nodes.back();
+  auto subgraph = std::make_shared<ir::Graph>();
+  ir::Node* group = graph.create(ir::kFusionGroup, last->outputs().size());
+
+  auto copyInfo = [](const ir::Value* from, ir::Value* to) {
+    to->setElemType(from->elemType());
+    if (from->has_sizes()) to->setSizes(from->sizes());
+  };
+  // outer value -> the subgraph value standing for it
+  std::unordered_map<const ir::Value*, ir::Value*> inner;
+  for (ir::Node* n : nodes) {
+    ONNX_ASSERT(n->owningGraph() == &graph);
+    ir::Node* copy = subgraph->create(n->kind(), n->outputs().size());
+    for (ir::Value* v : n->inputs()) {
+      auto it = inner.find(v);
+      if (it == inner.end()) {
+        ir::Value* param = subgraph->addInput();
+        copyInfo(v, param);
+        group->addInput(v);
+        it = inner.emplace(v, param).first;
+      }
+      copy->addInput(it->second);
+    }
+    copy->copyAttributes(*n);
+    if (n->has_name()) copy->setName(n->name());
+    if (n->has_domain()) copy->setDomain(n->domain());
+    for (size_t i = 0; i < n->outputs().size(); i++) {
+      copyInfo(n->outputs()[i], copy->outputs()[i]);
+      inner[n->outputs()[i]] = copy->outputs()[i];
+    }
+    subgraph->appendNode(copy);
+  }
+  for (size_t i = 0; i < last->outputs().size(); i++) {
+    subgraph->registerOutput(inner[last->outputs()[i]]);
+    copyInfo(last->outputs()[i], group->outputs()[i]);
+  }
+  group->g_(ir::kSubgraph, subgraph);
+
+  // every input is defined before the last node, every reader is after it
+  group->insertBefore(last);
+  for (size_t i = 0; i < last->outputs().size(); i++) {
+    last->outputs()[i]->replaceAllUsesWith(group->outputs()[i]);
+  }
+  for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) (*it)->destroy();
+  return group;
+}
+
+namespace {
+
+bool isActivation(ir::NodeKind kind) {
+  switch (kind) {
+    case ir::kRelu:
+    case ir::kLeakyRelu:
+    case ir::kClip:
+    case ir::kSigmoid:
+    case ir::kTanh:
+    case ir::kHardSwish:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool isElementwise(ir::NodeKind kind) {
+  return kind == ir::kAdd || kind == ir::kMul || kind == ir::kSigmoid ||
+         kind == ir::kTanh;
+}
+
+bool hasSubgraphs(const ir::Node* n) {
+  for (ir::Symbol name : n->attributeNames()) {
+    if (n->kindOf(name) == ir::AttributeKind::g ||
+        n->kindOf(name) == ir::AttributeKind::gs) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool isConstant(const ir::Value* v) {
+  return v->node()->kind() == ir::kConstant ||
+         v->owningGraph()->isInitializerValue(v);
+}
+
+// whether 'n' is a binary Add reading the output of 'producer'
+bool isAddOf(const ir::Node* n, const ir::Node* producer) {
+  return n != nullptr && n->kind() == ir::kAdd && n->inputs().size() == 2 &&
+         (n->inputs()[0] == producer->output() ||
+          n->inputs()[1] == producer->output());
+}
+
+// the operand of a binary 'n' that is not the output of 'producer'
+const ir::Value* otherInput(const ir::Node* n, const ir::Node* producer) {
+  return n->inputs()[0] == producer->output() ? n->inputs()[1]
+                                              : n->inputs()[0];
+}
+
+// Finds the chains of one graph against a snapshot of its uses; the graph
+// is only rewritten once all are found.
+class ChainMatcher {
+ public:
+  ChainMatcher(ir::Graph& graph, const UseDefAnalysis& use_def)
+      : graph_(graph), use_def_(use_def) {}
+
+  std::vector<std::vector<ir::Node*>> match() {
+    std::vector<std::vector<ir::Node*>> chains;
+    for (ir::Node* n : use_def_.nodes()) {
+      if (claimed_.count(n) != 0 || !fusible(n)) continue;
+      std::vector<ir::Node*> chain = matchFrom(n);
+      // a subgraph reading the last output by name would lose it to the
+      // group; next() already keeps the earlier ones uncaptured
+      if (use_def_.isCaptured(chain.back()->output())) chain.pop_back();
+      if (chain.size() < 2) continue;
+      claimed_.insert(chain.begin(), chain.end());
+      chains.push_back(std::move(chain));
+    }
+    return chains;
+  }
+
+ private:
+  bool fusible(const ir::Node* n) const {
+    return n->outputs().size() == 1 && !hasSubgraphs(n);
+  }
+
+  // the only reader of the output of 'n', if it can join the chain
+  ir::Node* next(ir::Node* n) const {
+    ir::Value* v = n->output();
+    const auto& users = use_def_.users(v);
+    if (users.size() != 1 || use_def_.isCaptured(v)) return nullptr;
+    ir::Node* user = users[0];
+    if (user == graph_.return_node() || claimed_.count(user) != 0 ||
+        !fusible(user)) {
+      return nullptr;
+    }
+    return user;
+  }
+
+  // 'n' followed by an activation, if there is one
+  void addActivation(ir::Node* n, std::vector<ir::Node*>* chain) const {
+    ir::Node* act = next(n);
+    if (act != nullptr && isActivation(act->kind())) chain->push_back(act);
+  }
+
+  std::vector<ir::Node*> matchFrom(ir::Node* head) const {
+    std::vector<ir::Node*> chain{head};
+    ir::Node* n = next(head);
+    switch (head->kind()) {
+      case ir::kConv:
+        if (n != nullptr && n->kind() == ir::kBatchNormalization) {
+          chain.push_back(n);
+        }
+        addActivation(chain.back(), &chain);
+        break;
+      case ir::kGemm:
+        // a constant bias, anything else is better left to Gemm's own C
+        if (isAddOf(n, head) && isConstant(otherInput(n, head))) {
+          chain.push_back(n);
+        }
+        addActivation(chain.back(), &chain);
+        break;
+      case ir::kMatMul:
+        if (!isAddOf(n, head)) break;
+        chain.push_back(n);
+        addActivation(n, &chain);
+        break;
+      default:
+        while (isElementwise(chain.back()->kind())) {
+          ir::Node* following = next(chain.back());
+          if (following == nullptr || !isElementwise(following->kind())) {
+            break;
+          }
+          chain.push_back(following);
+        }
+        break;
+    }
+    return chain;
+  }
+
+  ir::Graph& graph_;
+  const UseDefAnalysis& use_def_;
+  std::unordered_set<const ir::Node*> claimed_;
+};
+
+size_t fuseInGraph(ir::Graph& graph, AnalysisManager& analyses) {
+  size_t fused = 0;
+  auto fuse = [&](ir::Graph& subgraph) {
+    size_t count = fuseInGraph(subgraph, analyses);
+    if (count > 0) analyses.invalidate(GraphState::kStructure);
+    fused += count;
+  };
+  for (ir::Node* n : graph.nodes()) {
+    if (n->kind() == ir::kFusionGroup) continue;  // already fused
+    for (ir::Symbol name : n->attributeNames()) {
+      if (n->kindOf(name) == ir::AttributeKind::g) {
+        fuse(*n->g(name));
+      } else if (n->kindOf(name) == ir::AttributeKind::gs) {
+        for (auto& g : n->gs(name)) fuse(*g);
+      }
+    }
+  }
+
+  auto chains =
+      ChainMatcher(graph, analyses.get<UseDefAnalysis>(graph)).match();
+  for (const auto& chain : chains) CreateFusionGroup(chain);
+  return fused + chains.size();
+}
+
+}  // namespace
+
+PassResult FuseOperators::runPass(ir::Graph& graph,
+                                  AnalysisManager& analyses) {
+  return PassResult::changed(fuseInGraph(graph, analyses),
+                             GraphState::kStructure);
+}
+
+}  // namespace my_ai_training::optimization
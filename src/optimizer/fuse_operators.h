@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "optimizer/pass.h"
+
+namespace my_ai_training::optimization {
+
+// Groups chains of nodes the runtime can execute in one pass over memory
+// into FusionGroup nodes:
+//   Conv [-> BatchNormalization] [-> activation]
+//   Gemm [-> Add of a constant bias] [-> activation]
+//   MatMul -> Add [-> activation]
+//   Add, Mul, Sigmoid and Tanh chains
+// where the activation is Relu, LeakyRelu, Clip, Sigmoid, Tanh or
+// HardSwish, every value inside a chain is read only by the next node, and
+// no value of a chain is captured by a subgraph.
+class FuseOperators : public Pass {
+ public:
+  std::string getPassName() const override { return "fuse_operators"; }
+  PassResult runPass(ir::Graph& graph, AnalysisManager& analyses) override;
+};
+
+// Replaces 'nodes', in graph order, by a FusionGroup node holding copies of
+// them as its Subgraph attribute. The values the nodes read from outside
+// become the inputs of the group, in order of first use, and the outputs
+// of the last node its outputs; every other output must only be read
+// within 'nodes', and no output may be captured by a subgraph. Returns the
+// group, placed where the last node was.
+ir::Node* CreateFusionGroup(const std::vector<ir::Node*>& nodes);
+
+}  // namespace my_ai_training::optimization
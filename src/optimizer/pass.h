@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+#include "onnx_ir/ir.h"
+#include "optimizer/analysis.h"
+
+namespace my_ai_training::optimization {
+
+// What a pass did to the graph.
+struct PassResult {
+  // rewrites made, for statistics
+  size_t num_changes = 0;
+  // GraphState bits the pass changed; analyses depending on them are
+  // dropped, all others stay cached for the passes that follow
+  uint32_t mutated = GraphState::kNone;
+
+  static PassResult unchanged() { return {}; }
+  static PassResult changed(size_t num_changes, uint32_t mutated) {
+    return {num_changes, num_changes == 0 ? GraphState::kNone : mutated};
+  }
+  bool changedGraph() const { return mutated != GraphState::kNone; }
+};
+
+// A graph to graph transformation. Passes get the analyses they need from
+// 'analyses' rather than recomputing them and must report what they
+// changed, which keeps the rest of the cache valid.
+class Pass {
+ public:
+  virtual ~Pass() = default;
+
+  virtual std::string getPassName() const = 0;
+  virtual PassResult runPass(ir::Graph& graph, AnalysisManager& analyses) = 0;
+};
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,101 @@
+#include "optimizer/pass_manager.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "optimizer/assign_layouts.h"
+#include "optimizer/eliminate_common_subexpressions.h"
+#include "optimizer/eliminate_dead_code.h"
+#include "optimizer/fold_batch_norm.h"
+#include "optimizer/fold_constants.h"
+#include "optimizer/fuse_operators.h"
+#include "optimizer/sink_transposes.h"
+
+namespace my_ai_training::optimization {
+
+// PassManager
+
+void PassManager::add(std::shared_ptr<Pass> pass) {
+  ONNX_ASSERT(pass != nullptr);
+  PassStatistics stats;
+  stats.name = pass->getPassName();
+  stats_.push_back(std::move(stats));
+  passes_.push_back(std::move(pass));
+}
+
+size_t PassManager::run(ir::Graph& graph, AnalysisManager& analyses) {
+  size_t total = 0;
+  rounds_ = 0;
+  while (rounds_ < max_rounds_) {
+    rounds_++;
+    bool changed = false;
+    for (size_t i = 0; i < passes_.size(); i++) {
+      auto start = std::chrono::steady_clock::now();
+      PassResult result = passes_[i]->runPass(graph, analyses);
+      analyses.invalidate(result.mutated);
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      PassStatistics& stats = stats_[i];
+      stats.runs++;
+      stats.num_changes += result.num_changes;
+      stats.seconds += elapsed.count();
+      total += result.num_changes;
+      changed |= result.changedGraph();
+    }
+    if (!changed) break;
+  }
+  return total;
+}
+
+size_t PassManager::run(ir::Graph& graph) {
+  AnalysisManager analyses;
+  return run(graph, analyses);
+}
+
+// PassRegistry
+
+PassRegistry& PassRegistry::global() {
+  static auto* registry = [] {
+    auto* registry = new PassRegistry();
+    registry->registerPass(std::make_shared<EliminateDeadCode>());
+    registry->registerPass(std::make_shared<EliminateCommonSubexpressions>());
+    registry->registerPass(std::make_shared<FoldConstants>());
+    registry->registerPass(std::make_shared<FoldBatchNorm>());
+    registry->registerPass(std::make_shared<SinkTransposes>());
+    registry->registerPass(std::make_shared<FuseOperators>());
+    registry->registerPass(std::make_shared<AssignLayouts>());
+    return registry;
+  }();
+  return *registry;
+}
+
+void PassRegistry::registerPass(std::shared_ptr<Pass> pass) {
+  ONNX_ASSERT(pass != nullptr);
+  std::string name = pass->getPassName();
+  passes_[name] = std::move(pass);
+}
+
+std::shared_ptr<Pass> PassRegistry::find(const std::string& name) const {
+  auto it = passes_.find(name);
+  return it == passes_.end() ? nullptr : it->second;
+}
+
+std::vector<std::string> PassRegistry::names() const {
+  std::vector<std::string> names;
+  for (auto& entry : passes_) names.push_back(entry.first);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+PassManager CreatePipeline(const std::vector<std::string>& names) {
+  PassManager manager;
+  for (const std::string& name : names) {
+    auto pass = PassRegistry::global().find(name);
+    ONNX_ASSERTM(pass != nullptr, "unknown pass %s", name.c_str());
+    manager.add(std::move(pass));
+  }
+  return manager;
+}
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "optimizer/pass.h"
+
+namespace my_ai_training::optimization {
+
+struct PassStatistics {
+  std::string name;
+  size_t runs = 0;
+  size_t num_changes = 0;
+  double seconds = 0;
+};
+
+// Runs passes in order, sharing one AnalysisManager between them so an
+// analysis is only recomputed after a pass changed what it depends on.
+class PassManager {
+ public:
+  void add(std::shared_ptr<Pass> pass);
+  const std::vector<std::shared_ptr<Pass>>& passes() const { return passes_; }
+
+  // Repeat the pipeline until a round changes nothing, at most 'max_rounds'
+  // times. The default of 1 runs it once.
+  void setMaxRounds(size_t max_rounds) { max_rounds_ = max_rounds; }
+
+  // Run the pipeline on 'graph' and return the number of changes made.
+  // 'analyses' may hold analyses of the graph from before; they are used and
+  // left valid for whatever runs next.
+  size_t run(ir::Graph& graph, AnalysisManager& analyses);
+  size_t run(ir::Graph& graph);
+
+  // per pass, accumulated over all runs
+  const std::vector<PassStatistics>& statistics() const { return stats_; }
+  // rounds made by the last run
+  size_t rounds() const { return rounds_; }
+
+ private:
+  std::vector<std::shared_ptr<Pass>> passes_;
+  std::vector<PassStatistics> stats_;
+  size_t max_rounds_ = 1;
+  size_t rounds_ = 0;
+};
+
+// Passes by name, for pipelines given as a list of names. A registered
+// pass is shared by every pipeline using it, so it must not keep state
+// between runs.
+class PassRegistry {
+ public:
+  // holds the passes of src/optimizer under their getPassName()
+  static PassRegistry& global();
+
+  // replaces a pass of the same name
+  void registerPass(std::shared_ptr<Pass> pass);
+  // nullptr if there is no such pass
+  std::shared_ptr<Pass> find(const std::string& name) const;
+  std::vector<std::string> names() const;
+
+ private:
+  std::unordered_map<std::string, std::shared_ptr<Pass>> passes_;
+};
+
+// A PassManager running the registered passes 'names' in order. Throws on
+// unknown names.
+PassManager CreatePipeline(const std::vector<std::string>& names);
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,574 @@
+#include "optimizer/reference_kernels.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+namespace my_ai_training::optimization {
+
+namespace {
+
+using ir::Tensor;
+using Sizes = std::vector<int64_t>;
+
+int64_t numelOf(const Sizes& sizes) {
+  int64_t n = 1;
+  for (int64_t size : sizes) n *= size;
+  return n;
+}
+
+// row-major element strides of 'sizes'
+Sizes stridesOf(const Sizes& sizes) {
+  Sizes strides(sizes.size(), 1);
+  for (size_t i = sizes.size(); i > 1; i--) {
+    strides[i - 2] = strides[i - 1] * sizes[i - 1];
+  }
+  return strides;
+}
+
+bool normalizeAxis(int64_t* axis, size_t rank) {
+  int64_t r = static_cast<int64_t>(rank);
+  if (*axis < 0) *axis += r;
+  return *axis >= 0 && *axis < r;
+}
+
+// Calls fn(i, offsets) for every element i of a row-major tensor of
+// 'sizes', where offsets[k] starts at 0 and moves by strides[k][d] per step
+// along dim d: the element of input k that output element i reads.
+template <size_t N, typename Fn>
+void forEachElement(const Sizes& sizes, const std::array<Sizes, N>& strides,
+                    Fn fn) {
+  int64_t total = numelOf(sizes);
+  Sizes index(sizes.size(), 0);
+  std::array<int64_t, N> offsets{};
+  for (int64_t i = 0; i < total; i++) {
+    fn(i, offsets);
+    for (size_t d = sizes.size(); d > 0; d--) {
+      size_t k = d - 1;
+      if (++index[k] < sizes[k]) {
+        for (size_t j = 0; j < N; j++) offsets[j] += strides[j][k];
+        break;
+      }
+      for (size_t j = 0; j < N; j++) {
+        offsets[j] -= strides[j][k] * (sizes[k] - 1);
+      }
+      index[k] = 0;
+    }
+  }
+}
+
+// A tensor of 'sizes' whose element i is element base + offset(i) of 'in',
+// which covers Transpose, Slice and Expand.
+Tensor gatherStrided(const Tensor& in, const Sizes& sizes,
+                     const Sizes& strides, int64_t base) {
+  Tensor out(in.elem_type(), sizes);
+  size_t elem = ir::elemSizeOf(in.elem_type());
+  auto* dst = static_cast<char*>(out.allocate());
+  const auto* src = static_cast<const char*>(in.rawData()) + base * elem;
+  forEachElement<1>(sizes, {strides},
+                    [&](int64_t i, const std::array<int64_t, 1>& offsets) {
+                      memcpy(dst + i * elem, src + offsets[0] * elem, elem);
+                    });
+  return out;
+}
+
+// The same payload under other sizes, no bytes are copied.
+Tensor withSizes(const Tensor& in, Sizes sizes) {
+  Tensor out(in.elem_type(), std::move(sizes));
+  out.setBuffer(in.buffer());
+  return out;
+}
+
+// multidirectional (numpy) broadcast
+bool broadcastSizes(const Sizes& a, const Sizes& b, Sizes* out) {
+  size_t rank = std::max(a.size(), b.size());
+  out->assign(rank, 1);
+  for (size_t i = 0; i < rank; i++) {
+    int64_t x = i < rank - a.size() ? 1 : a[i - (rank - a.size())];
+    int64_t y = i < rank - b.size() ? 1 : b[i - (rank - b.size())];
+    if (x != y && x != 1 && y != 1) return false;
+    (*out)[i] = x == 1 ? y : x;
+  }
+  return true;
+}
+
+// strides reading 'in' broadcast to 'out', 0 along the broadcast dims
+Sizes broadcastStrides(const Sizes& in, const Sizes& out) {
+  Sizes in_strides = stridesOf(in);
+  Sizes strides(out.size(), 0);
+  size_t lead = out.size() - in.size();
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] != 1) strides[lead + i] = in_strides[i];
+  }
+  return strides;
+}
+
+bool readInts(const Tensor* t, Sizes* values) {
+  if (t == nullptr) return false;
+  if (t->elem_type() == ir::TensorProto_DataType_INT64) {
+    const int64_t* data = t->data<int64_t>();
+    values->assign(data, data + t->numel());
+    return true;
+  }
+  if (t->elem_type() == ir::TensorProto_DataType_INT32) {
+    const int32_t* data = t->data<int32_t>();
+    values->assign(data, data + t->numel());
+    return true;
+  }
+  return false;
+}
+
+// ints attribute, or input 'input' for opsets that moved it there
+bool intsAttrOrInput(const ir::Node* n, ir::Symbol name,
+                     const std::vector<const Tensor*>& inputs, size_t input,
+                     Sizes* values) {
+  if (n->hasAttribute(name)) {
+    *values = n->is(name);
+    return true;
+  }
+  return input < inputs.size() && readInts(inputs[input], values);
+}
+
+// Calls fn(T()) with the C++ type of 'elem_type' and returns its result;
+// false for types without one (strings, float16, complex).
+template <typename Fn>
+bool visitType(int32_t elem_type, Fn&& fn) {
+  switch (elem_type) {
+    case ir::TensorProto_DataType_FLOAT:
+      return fn(float());
+    case ir::TensorProto_DataType_DOUBLE:
+      return fn(double());
+    case ir::TensorProto_DataType_INT8:
+      return fn(int8_t());
+    case ir::TensorProto_DataType_UINT8:
+      return fn(uint8_t());
+    case ir::TensorProto_DataType_INT16:
+      return fn(int16_t());
+    case ir::TensorProto_DataType_UINT16:
+      return fn(uint16_t());
+    case ir::TensorProto_DataType_INT32:
+      return fn(int32_t());
+    case ir::TensorProto_DataType_UINT32:
+      return fn(uint32_t());
+    case ir::TensorProto_DataType_INT64:
+      return fn(int64_t());
+    case ir::TensorProto_DataType_UINT64:
+      return fn(uint64_t());
+    case ir::TensorProto_DataType_BOOL:
+      return fn(bool());
+    default:
+      return false;
+  }
+}
+
+// Integers wrap around like they do at runtime, through unsigned
+// arithmetic since signed overflow is undefined here.
+template <typename T>
+bool applyBinary(ir::NodeKind kind, T a, T b, T* out) {
+  if constexpr (std::is_floating_point_v<T>) {
+    switch (kind) {
+      case ir::kAdd:
+        *out = a + b;
+        return true;
+      case ir::kSub:
+        *out = a - b;
+        return true;
+      case ir::kMul:
+        *out = a * b;
+        return true;
+      case ir::kDiv:
+        *out = a / b;
+        return true;
+      case ir::kPow:
+        *out = static_cast<T>(std::pow(a, b));
+        return true;
+      default:
+        return false;
+    }
+  } else {
+    // at least unsigned int, or the operands would promote to int
+    using U = std::common_type_t<std::make_unsigned_t<T>, unsigned>;
+    switch (kind) {
+      case ir::kAdd:
+        *out = static_cast<T>(static_cast<U>(a) + static_cast<U>(b));
+        return true;
+      case ir::kSub:
+        *out = static_cast<T>(static_cast<U>(a) - static_cast<U>(b));
+        return true;
+      case ir::kMul:
+        *out = static_cast<T>(static_cast<U>(a) * static_cast<U>(b));
+        return true;
+      case ir::kDiv:
+        if (b == 0) return false;
+        if (std::is_signed_v<T> && b == T(-1)) {
+          *out = static_cast<T>(U(0) - static_cast<U>(a));
+        } else {
+          *out = static_cast<T>(a / b);
+        }
+        return true;
+      case ir::kPow: {
+        // a negative exponent would need a fraction
+        if (b < T(0)) return false;
+        U result = 1, base = static_cast<U>(a);
+        for (U e = static_cast<U>(b); e != 0; e >>= 1) {
+          if (e & 1) result *= base;
+          base *= base;
+        }
+        *out = static_cast<T>(result);
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+}
+
+bool evaluateBinary(const ir::Node* n, const Tensor& a, const Tensor& b,
+                    std::vector<Tensor>* outputs) {
+  if (a.elem_type() != b.elem_type()) return false;
+  Sizes sizes;
+  if (!broadcastSizes(a.sizes(), b.sizes(), &sizes)) return false;
+  Tensor out(a.elem_type(), sizes);
+  out.allocate();
+  std::array<Sizes, 2> strides{broadcastStrides(a.sizes(), sizes),
+                               broadcastStrides(b.sizes(), sizes)};
+  bool ok = visitType(a.elem_type(), [&](auto tag) {
+    using T = decltype(tag);
+    if constexpr (std::is_same_v<T, bool>) {
+      return false;
+    } else {
+      const T* x = a.data<T>();
+      const T* y = b.data<T>();
+      T* z = out.mutableData<T>();
+      bool valid = true;
+      forEachElement<2>(sizes, strides,
+                        [&](int64_t i, const std::array<int64_t, 2>& o) {
+                          valid &= applyBinary(n->kind(), x[o[0]], y[o[1]],
+                                               &z[i]);
+                        });
+      return valid;
+    }
+  });
+  if (!ok) return false;
+  outputs->push_back(std::move(out));
+  return true;
+}
+
+template <typename From, typename To>
+bool castValue(From v, To* out) {
+  if constexpr (std::is_same_v<To, bool>) {
+    *out = v != From(0);
+  } else if constexpr (std::is_floating_point_v<From> &&
+                       std::is_integral_v<To>) {
+    // a float out of the range of an integer type has no defined
+    // conversion; NaN fails both tests
+    long double x = v;
+    if (!(x > static_cast<long double>(std::numeric_limits<To>::min()) - 1 &&
+          x < static_cast<long double>(std::numeric_limits<To>::max()) + 1)) {
+      return false;
+    }
+    *out = static_cast<To>(v);
+  } else {
+    *out = static_cast<To>(v);
+  }
+  return true;
+}
+
+bool evaluateCast(const ir::Node* n, const Tensor& in,
+                  std::vector<Tensor>* outputs) {
+  if (!n->hasAttribute(ir::kto)) return false;
+  Tensor out(static_cast<int32_t>(n->i(ir::kto)), in.sizes());
+  if (ir::elemSizeOf(out.elem_type()) == 0) return false;
+  out.allocate();
+  bool ok = visitType(in.elem_type(), [&](auto from_tag) {
+    using From = decltype(from_tag);
+    return visitType(out.elem_type(), [&](auto to_tag) {
+      using To = decltype(to_tag);
+      const From* x = in.data<From>();
+      To* y = out.mutableData<To>();
+      for (int64_t i = 0; i < in.numel(); i++) {
+        if (!castValue(x[i], &y[i])) return false;
+      }
+      return true;
+    });
+  });
+  if (!ok) return false;
+  outputs->push_back(std::move(out));
+  return true;
+}
+
+bool evaluateReshape(const ir::Node* n, const std::vector<const Tensor*>& in,
+                     std::vector<Tensor>* outputs) {
+  Sizes shape;
+  if (in.size() < 2 || !readInts(in[1], &shape)) return false;
+  bool allow_zero =
+      n->hasAttribute(ir::kallowzero) && n->i(ir::kallowzero) != 0;
+  const Sizes& x = in[0]->sizes();
+  int64_t known = 1;
+  int64_t infer_at = -1;
+  for (size_t i = 0; i < shape.size(); i++) {
+    if (shape[i] == 0 && !allow_zero) {
+      if (i >= x.size()) return false;
+      shape[i] = x[i];
+    } else if (shape[i] == -1 && infer_at < 0) {
+      infer_at = static_cast<int64_t>(i);
+      continue;
+    } else if (shape[i] < 0) {
+      return false;
+    }
+    known *= shape[i];
+  }
+  if (infer_at >= 0) {
+    if (known == 0 || in[0]->numel() % known != 0) return false;
+    shape[infer_at] = in[0]->numel() / known;
+  } else if (known != in[0]->numel()) {
+    return false;
+  }
+  outputs->push_back(withSizes(*in[0], std::move(shape)));
+  return true;
+}
+
+bool evaluateConcat(const ir::Node* n, const std::vector<const Tensor*>& in,
+                    std::vector<Tensor>* outputs) {
+  if (!n->hasAttribute(ir::kaxis) || in.empty()) return false;
+  const Tensor& first = *in[0];
+  int64_t axis = n->i(ir::kaxis);
+  if (!normalizeAxis(&axis, first.sizes().size())) return false;
+  Sizes sizes = first.sizes();
+  sizes[axis] = 0;
+  for (const Tensor* t : in) {
+    if (t == nullptr || t->elem_type() != first.elem_type() ||
+        t->sizes().size() != sizes.size()) {
+      return false;
+    }
+    for (size_t d = 0; d < sizes.size(); d++) {
+      if (d != static_cast<size_t>(axis) && t->sizes()[d] != sizes[d]) {
+        return false;
+      }
+    }
+    sizes[axis] += t->sizes()[axis];
+  }
+  Tensor out(first.elem_type(), sizes);
+  auto* dst = static_cast<char*>(out.allocate());
+  size_t elem = ir::elemSizeOf(first.elem_type());
+  int64_t outer = 1;
+  for (int64_t d = 0; d < axis; d++) outer *= sizes[d];
+  // each input contributes a block of its dims from 'axis' on per outer
+  // index
+  for (int64_t o = 0; o < outer; o++) {
+    for (const Tensor* t : in) {
+      size_t block = t->size_from_dim(static_cast<int>(axis)) * elem;
+      if (block == 0) continue;
+      memcpy(dst, static_cast<const char*>(t->rawData()) + o * block, block);
+      dst += block;
+    }
+  }
+  outputs->push_back(std::move(out));
+  return true;
+}
+
+bool evaluateSlice(const ir::Node* n, const std::vector<const Tensor*>& in,
+                   std::vector<Tensor>* outputs) {
+  const Tensor& x = *in[0];
+  Sizes starts, ends, axes, steps;
+  if (n->hasAttribute(ir::kstarts)) {  // opset < 10
+    if (!n->hasAttribute(ir::kends)) return false;
+    starts = n->is(ir::kstarts);
+    ends = n->is(ir::kends);
+    if (n->hasAttribute(ir::kaxes)) axes = n->is(ir::kaxes);
+  } else {
+    if (in.size() < 3 || !readInts(in[1], &starts) ||
+        !readInts(in[2], &ends)) {
+      return false;
+    }
+    if (in.size() > 3 && in[3] != nullptr && !readInts(in[3], &axes)) {
+      return false;
+    }
+    if (in.size() > 4 && in[4] != nullptr && !readInts(in[4], &steps)) {
+      return false;
+    }
+  }
+  if (starts.size() != ends.size()) return false;
+  if (axes.empty()) {
+    for (size_t i = 0; i < starts.size(); i++) axes.push_back(i);
+  }
+  if (steps.empty()) steps.assign(starts.size(), 1);
+  if (axes.size() != starts.size() || steps.size() != starts.size()) {
+    return false;
+  }
+
+  Sizes sizes = x.sizes();
+  Sizes strides = stridesOf(sizes);
+  int64_t base = 0;
+  for (size_t i = 0; i < axes.size(); i++) {
+    int64_t axis = axes[i];
+    int64_t step = steps[i];
+    if (!normalizeAxis(&axis, sizes.size()) || step == 0) return false;
+    int64_t dim = x.sizes()[axis];
+    if (dim == 0) continue;  // empty, and no index to clamp a backward walk to
+    int64_t start = starts[i] < 0 ? starts[i] + dim : starts[i];
+    int64_t end = ends[i] < 0 ? ends[i] + dim : ends[i];
+    // a stride of the dim or more takes one element; clamped, neither the
+    // length nor the strides overflow
+    step = std::clamp<int64_t>(step, -dim, dim);
+    // clamped as the spec says, differently for a backward walk
+    if (step > 0) {
+      start = std::clamp<int64_t>(start, 0, dim);
+      end = std::clamp<int64_t>(end, 0, dim);
+      sizes[axis] = end > start ? (end - start - 1) / step + 1 : 0;
+    } else {
+      start = std::clamp<int64_t>(start, 0, dim - 1);
+      end = std::clamp<int64_t>(end, -1, dim - 1);
+      sizes[axis] = start > end ? (start - end - 1) / -step + 1 : 0;
+    }
+    if (sizes[axis] > 0) base += start * strides[axis];
+    strides[axis] *= step;
+  }
+  outputs->push_back(gatherStrided(x, sizes, strides, base));
+  return true;
+}
+
+bool evaluateTranspose(const ir::Node* n, const Tensor& x,
+                       std::vector<Tensor>* outputs) {
+  size_t rank = x.sizes().size();
+  Sizes perm;
+  if (n->hasAttribute(ir::kperm)) {
+    perm = n->is(ir::kperm);
+  } else {
+    for (size_t i = rank; i > 0; i--) perm.push_back(i - 1);
+  }
+  if (perm.size() != rank) return false;
+  Sizes x_strides = stridesOf(x.sizes());
+  Sizes sizes, strides;
+  std::vector<bool> seen(rank, false);
+  for (int64_t p : perm) {
+    if (!normalizeAxis(&p, rank) || seen[p]) return false;
+    seen[p] = true;
+    sizes.push_back(x.sizes()[p]);
+    strides.push_back(x_strides[p]);
+  }
+  outputs->push_back(gatherStrided(x, sizes, strides, 0));
+  return true;
+}
+
+bool evaluateSqueeze(const ir::Node* n, const std::vector<const Tensor*>& in,
+                     std::vector<Tensor>* outputs) {
+  const Sizes& x = in[0]->sizes();
+  Sizes axes;
+  bool has_axes = intsAttrOrInput(n, ir::kaxes, in, 1, &axes);
+  if (!has_axes && in.size() > 1 && in[1] != nullptr) return false;
+  std::vector<bool> removed(x.size(), false);
+  if (has_axes) {
+    for (int64_t axis : axes) {
+      if (!normalizeAxis(&axis, x.size()) || x[axis] != 1) return false;
+      removed[axis] = true;
+    }
+  } else {
+    for (size_t i = 0; i < x.size(); i++) removed[i] = x[i] == 1;
+  }
+  Sizes sizes;
+  for (size_t i = 0; i < x.size(); i++) {
+    if (!removed[i]) sizes.push_back(x[i]);
+  }
+  outputs->push_back(withSizes(*in[0], std::move(sizes)));
+  return true;
+}
+
+bool evaluateUnsqueeze(const ir::Node* n,
+                       const std::vector<const Tensor*>& in,
+                       std::vector<Tensor>* outputs) {
+  const Sizes& x = in[0]->sizes();
+  Sizes axes;
+  if (!intsAttrOrInput(n, ir::kaxes, in, 1, &axes)) return false;
+  size_t rank = x.size() + axes.size();
+  std::vector<bool> inserted(rank, false);
+  for (int64_t axis : axes) {
+    if (!normalizeAxis(&axis, rank) || inserted[axis]) return false;
+    inserted[axis] = true;
+  }
+  Sizes sizes;
+  size_t next = 0;
+  for (size_t i = 0; i < rank; i++) {
+    sizes.push_back(inserted[i] ? 1 : x[next++]);
+  }
+  outputs->push_back(withSizes(*in[0], std::move(sizes)));
+  return true;
+}
+
+bool evaluateExpand(const std::vector<const Tensor*>& in,
+                    std::vector<Tensor>* outputs) {
+  Sizes shape, sizes;
+  if (in.size() < 2 || !readInts(in[1], &shape)) return false;
+  if (!broadcastSizes(in[0]->sizes(), shape, &sizes)) return false;
+  outputs->push_back(
+      gatherStrided(*in[0], sizes, broadcastStrides(in[0]->sizes(), sizes),
+                    0));
+  return true;
+}
+
+}  // namespace
+
+const std::vector<ir::NodeKind>& ReferenceKernelKinds() {
+  static const std::vector<ir::NodeKind> kinds{
+      ir::kAdd,     ir::kSub,       ir::kMul,     ir::kDiv,
+      ir::kPow,     ir::kCast,      ir::kReshape, ir::kConcat,
+      ir::kSlice,   ir::kTranspose, ir::kSqueeze, ir::kUnsqueeze,
+      ir::kExpand};
+  return kinds;
+}
+
+bool HasReferenceKernel(ir::NodeKind kind) {
+  const std::vector<ir::NodeKind>& kinds = ReferenceKernelKinds();
+  return std::find(kinds.begin(), kinds.end(), kind) != kinds.end();
+}
+
+bool EvaluateNode(const ir::Node* n,
+                  const std::vector<const ir::Tensor*>& inputs,
+                  std::vector<ir::Tensor>* outputs) {
+  outputs->clear();
+  if (!HasReferenceKernel(n->kind()) || n->outputs().size() != 1 ||
+      inputs.empty() || inputs[0] == nullptr) {
+    return false;
+  }
+  // every kernel reads fixed-size elements from complete payloads
+  for (const Tensor* t : inputs) {
+    if (t == nullptr) continue;
+    if (ir::elemSizeOf(t->elem_type()) == 0 ||
+        t->byteSize() != t->expectedByteSize()) {
+      return false;
+    }
+  }
+  switch (n->kind()) {
+    case ir::kAdd:
+    case ir::kSub:
+    case ir::kMul:
+    case ir::kDiv:
+    case ir::kPow:
+      return inputs.size() == 2 && inputs[1] != nullptr &&
+             evaluateBinary(n, *inputs[0], *inputs[1], outputs);
+    case ir::kCast:
+      return evaluateCast(n, *inputs[0], outputs);
+    case ir::kReshape:
+      return evaluateReshape(n, inputs, outputs);
+    case ir::kConcat:
+      return evaluateConcat(n, inputs, outputs);
+    case ir::kSlice:
+      return evaluateSlice(n, inputs, outputs);
+    case ir::kTranspose:
+      return evaluateTranspose(n, *inputs[0], outputs);
+    case ir::kSqueeze:
+      return evaluateSqueeze(n, inputs, outputs);
+    case ir::kUnsqueeze:
+      return evaluateUnsqueeze(n, inputs, outputs);
+    case ir::kExpand:
+      return evaluateExpand(inputs, outputs);
+    default:
+      return false;
+  }
+}
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include "onnx_ir/ir.h"
+
+namespace my_ai_training::optimization {
+
+// Reference CPU kernels for evaluating nodes at compile time: Add, Sub,
+// Mul, Div and Pow with broadcasting, Cast, and the data movement ops
+// Reshape, Concat, Slice, Transpose, Squeeze, Unsqueeze and Expand. They
+// are written to be obviously right rather than fast; they run once per
+// model, on small tensors.
+
+// the ops EvaluateNode() has a kernel for, and whether 'kind' is one
+const std::vector<ir::NodeKind>& ReferenceKernelKinds();
+bool HasReferenceKernel(ir::NodeKind kind);
+
+// Computes the outputs of 'n' from the payloads of its inputs, nullptr for
+// omitted optional inputs. Returns false, with 'outputs' unspecified, if
+// the op, an attribute or an element type is not supported or the inputs
+// are invalid for the op (integer division by zero, a Cast out of range),
+// leaving the node to the runtime.
+bool EvaluateNode(const ir::Node* n,
+                  const std::vector<const ir::Tensor*>& inputs,
+                  std::vector<ir::Tensor>* outputs);
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,320 @@
+#include "optimizer/sink_transposes.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "optimizer/fold_constants.h"
+
+namespace my_ai_training::optimization {
+
+namespace {
+
+using Perm = std::vector<int64_t>;
+
+bool isElementwise(ir::NodeKind kind) {
+  switch (kind) {
+    case ir::kAdd:
+    case ir::kSub:
+    case ir::kMul:
+    case ir::kDiv:
+    case ir::kPow:
+    case ir::kNeg:
+    case ir::kExp:
+    case ir::kLog:
+    case ir::kSqrt:
+    case ir::kErf:
+    case ir::kRelu:
+    case ir::kLeakyRelu:
+    case ir::kSigmoid:
+    case ir::kHardSigmoid:
+    case ir::kHardSwish:
+    case ir::kTanh:
+    case ir::kClip:
+    case ir::kCast:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// names of the values read by subgraphs, which must keep their names
+void collectCaptures(const ir::Graph& graph,
+                     std::unordered_set<std::string>* names) {
+  for (const ir::Node* n : graph.nodes()) {
+    if (n->kind() == ir::kCaptured) names->insert(n->output()->uniqueName());
+    for (ir::Symbol name : n->attributeNames()) {
+      if (n->kindOf(name) == ir::AttributeKind::g) {
+        collectCaptures(*n->g(name), names);
+      } else if (n->kindOf(name) == ir::AttributeKind::gs) {
+        for (auto& g : n->gs(name)) collectCaptures(*g, names);
+      }
+    }
+  }
+}
+
+// known extents of 'v', or false
+bool staticSizes(const ir::Value* v, std::vector<int64_t>* sizes) {
+  if (!v->has_sizes()) return false;
+  sizes->clear();
+  for (const ir::Dimension& d : v->sizes()) {
+    if (!d.is_int()) return false;
+    sizes->push_back(d.dim());
+  }
+  return true;
+}
+
+bool isIdentity(const Perm& perm) {
+  for (size_t i = 0; i < perm.size(); i++) {
+    if (perm[i] != static_cast<int64_t>(i)) return false;
+  }
+  return true;
+}
+
+class Sinker {
+ public:
+  explicit Sinker(ir::Graph& graph) : graph_(graph) {
+    collectCaptures(graph, &captured_);
+  }
+
+  size_t run() {
+    size_t changes = 0;
+    // a rewrite only creates nodes after the one visited and only destroys
+    // it or nodes before it
+    for (auto it = graph_.begin(); it != graph_.end();) {
+      ir::Node* n = *it;
+      ++it;
+      if (n->kind() == ir::kTranspose) {
+        changes += simplifyTranspose(n);
+      } else if (n->kind() == ir::kReshape) {
+        changes += simplifyReshape(n);
+      } else if (isElementwise(n->kind())) {
+        changes += sinkBelow(n);
+      }
+    }
+    return changes;
+  }
+
+ private:
+  bool isCaptured(const ir::Value* v) const {
+    return captured_.count(v->uniqueName()) != 0;
+  }
+
+  bool isGraphOutput(const ir::Value* v) const {
+    const auto& outputs = graph_.outputs();
+    return std::find(outputs.begin(), outputs.end(), v) != outputs.end();
+  }
+
+  // the perm of Transpose 'n', which needs the rank when it is implicit
+  bool permOf(const ir::Node* n, Perm* perm) const {
+    if (n->hasAttribute(ir::kperm)) {
+      *perm = n->is(ir::kperm);
+    } else {
+      if (!n->input()->has_sizes()) return false;
+      perm->clear();
+      for (size_t i = n->input()->sizes().size(); i > 0; i--) {
+        perm->push_back(i - 1);
+      }
+    }
+    std::vector<bool> seen(perm->size(), false);
+    for (int64_t& p : *perm) {
+      if (p < 0) p += perm->size();
+      if (p < 0 || p >= static_cast<int64_t>(perm->size()) || seen[p]) {
+        return false;
+      }
+      seen[p] = true;
+    }
+    return true;
+  }
+
+  // Whether the readers of 'from' can read 'to' instead. A graph output
+  // name moves onto 'to', which it must not take from an input, an
+  // initializer or another output; captured names do not move at all.
+  bool canForward(const ir::Value* from, const ir::Value* to) const {
+    if (isCaptured(from)) return false;
+    return !isGraphOutput(from) ||
+           (to->node()->kind() != ir::kParam && !isGraphOutput(to) &&
+            !isCaptured(to));
+  }
+
+  bool forward(ir::Node* n, ir::Value* to) {
+    if (!canForward(n->output(), to)) return false;
+    n->output()->replaceAllUsesWith(to);
+    n->destroy();
+    return true;
+  }
+
+  void destroyIfUnused(ir::Node* n) {
+    if (n->output()->uses().empty()) n->destroy();
+  }
+
+  size_t simplifyTranspose(ir::Node* n) {
+    Perm perm;
+    if (!permOf(n, &perm)) return 0;
+    size_t changes = 0;
+    ir::Node* producer = n->input()->node();
+    Perm inner;
+    if (producer->kind() == ir::kTranspose && permOf(producer, &inner) &&
+        inner.size() == perm.size()) {
+      // output dim i is dim perm[i] of the inner output, which is dim
+      // inner[perm[i]] of its input
+      Perm composed(perm.size());
+      for (size_t i = 0; i < perm.size(); i++) composed[i] = inner[perm[i]];
+      n->replaceInput(0, producer->input());
+      n->is_(ir::kperm, Perm(composed));
+      destroyIfUnused(producer);
+      perm = std::move(composed);
+      changes++;
+    }
+    if (isIdentity(perm)) {
+      return forward(n, n->input()) ? changes + 1 : changes;
+    }
+    // moving only dims of extent 1 keeps the element order
+    // permOf keeps perm to [0, perm.size()), which a Transpose of another
+    // rank would still index the sizes past
+    std::vector<int64_t> sizes;
+    if (!staticSizes(n->input(), &sizes) || sizes.size() != perm.size()) {
+      return changes;
+    }
+    Perm moved;
+    for (int64_t p : perm) {
+      if (sizes[p] != 1) moved.push_back(p);
+    }
+    if (!std::is_sorted(moved.begin(), moved.end())) return changes;
+    std::vector<int64_t> shape;
+    for (int64_t p : perm) shape.push_back(sizes[p]);
+    // the Reshape output is a fresh node output
+    if (isCaptured(n->output())) return changes;
+    ir::Tensor t(ir::TensorProto_DataType_INT64,
+                 {static_cast<int64_t>(shape.size())});
+    t.setRawData(shape.data(), shape.size() * sizeof(int64_t));
+    ir::Node* reshape = graph_.create(
+        ir::kReshape, {n->input(), graph_.addInitializerAndCreateValue(t)},
+        1);
+    reshape->insertBefore(n);
+    forward(n, reshape->output());
+    return changes + 1;
+  }
+
+  size_t simplifyReshape(ir::Node* n) {
+    if (n->inputs().size() != 2) return 0;
+    size_t changes = 0;
+    ir::Node* producer = n->inputs()[0]->node();
+    const ir::Tensor* shape = FindConstant(n->inputs()[1]);
+    bool allow_zero =
+        n->hasAttribute(ir::kallowzero) && n->i(ir::kallowzero) != 0;
+    if (producer->kind() == ir::kReshape && shape != nullptr &&
+        shape->elem_type() == ir::TensorProto_DataType_INT64) {
+      // a 0 copies a dim of the intermediate shape, which goes away
+      const int64_t* data = shape->data<int64_t>();
+      if (allow_zero || std::find(data, data + shape->numel(), 0) ==
+                            data + shape->numel()) {
+        n->replaceInput(0, producer->inputs()[0]);
+        destroyIfUnused(producer);
+        changes++;
+      }
+    }
+    std::vector<int64_t> in, out;
+    if (staticSizes(n->inputs()[0], &in) && staticSizes(n->output(), &out) &&
+        in == out && forward(n, n->inputs()[0])) {
+      changes++;
+    }
+    return changes;
+  }
+
+  // a value broadcasting the same way against any layout of a tensor
+  bool isScalar(const ir::Value* v) const {
+    if (v->node()->kind() == ir::kUndefined) return true;
+    std::vector<int64_t> sizes;
+    if (!staticSizes(v, &sizes)) {
+      const ir::Tensor* t = FindConstant(v);
+      if (t == nullptr) return false;
+      sizes = t->sizes();
+    }
+    return sizes.size() <= 1 && (sizes.empty() || sizes[0] == 1);
+  }
+
+  // op(Transpose(x, p), ...) into Transpose(op(x, ...), p) when every other
+  // operand is a Transpose of the same perm or a scalar and the Transposes
+  // read by 'n' are read by nothing else, so no Transpose is added
+  size_t sinkBelow(ir::Node* n) {
+    if (n->outputs().size() != 1 || isCaptured(n->output())) return 0;
+    Perm perm;
+    std::vector<ir::Node*> transposes;
+    for (ir::Value* v : n->inputs()) {
+      ir::Node* producer = v->node();
+      if (producer->kind() != ir::kTranspose) {
+        if (!isScalar(v)) return 0;
+        continue;
+      }
+      Perm p;
+      if (!permOf(producer, &p) || (!perm.empty() && p != perm) ||
+          isCaptured(v)) {
+        return 0;
+      }
+      for (const ir::Use& use : v->uses()) {
+        if (use.user != n) return 0;
+      }
+      perm = p;
+      if (std::find(transposes.begin(), transposes.end(), producer) ==
+          transposes.end()) {
+        transposes.push_back(producer);
+      }
+    }
+    if (transposes.empty()) return 0;
+
+    for (size_t i = 0; i < n->inputs().size(); i++) {
+      ir::Node* producer = n->inputs()[i]->node();
+      if (producer->kind() == ir::kTranspose) {
+        n->replaceInput(i, producer->input());
+      }
+    }
+    for (ir::Node* t : transposes) t->destroy();
+
+    ir::Node* sunk = graph_.create(ir::kTranspose, 1);
+    sunk->is_(ir::kperm, Perm(perm));
+    sunk->insertAfter(n);
+    ir::Value* out = n->output();
+    out->replaceAllUsesWith(sunk->output());
+    sunk->addInput(out);
+    // 'out' has the layout from before the Transpose now
+    if (sunk->output()->has_sizes() &&
+        sunk->output()->sizes().size() == perm.size()) {
+      std::vector<ir::Dimension> sizes(perm.size());
+      for (size_t i = 0; i < perm.size(); i++) {
+        sizes[perm[i]] = sunk->output()->sizes()[i];
+      }
+      out->setSizes(sizes);
+    }
+    return 1;
+  }
+
+  ir::Graph& graph_;
+  std::unordered_set<std::string> captured_;
+};
+
+size_t sinkInGraph(ir::Graph& graph) {
+  size_t changes = 0;
+  for (ir::Node* n : graph.nodes()) {
+    for (ir::Symbol name : n->attributeNames()) {
+      if (n->kindOf(name) == ir::AttributeKind::g) {
+        changes += sinkInGraph(*n->g(name));
+      } else if (n->kindOf(name) == ir::AttributeKind::gs) {
+        for (auto& g : n->gs(name)) changes += sinkInGraph(*g);
+      }
+    }
+  }
+  return changes + Sinker(graph).run();
+}
+
+}  // namespace
+
+PassResult SinkTransposes::runPass(ir::Graph& graph, AnalysisManager&) {
+  return PassResult::changed(
+      sinkInGraph(graph), GraphState::kStructure | GraphState::kAttributes |
+                              GraphState::kInitializers | GraphState::kTypes);
+}
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+#include "optimizer/pass.h"
+
+namespace my_ai_training::optimization {
+
+// Removes the layout shuffling exporters leave between NCHW and NHWC parts
+// of a model or around attention heads. In one forward sweep it:
+//   - composes Transpose(Transpose(x)) into one Transpose,
+//   - turns a Transpose that only moves dims of extent 1 into a Reshape,
+//   - merges Reshape(Reshape(x)) into one Reshape,
+//   - drops Transposes with an identity perm and Reshapes to the shape their
+//     input already has,
+//   - sinks Transposes below elementwise ops whose other operands are
+//     scalars or Transposes of the same perm, so they meet and cancel the
+//     Transpose the model applies afterwards.
+// Each Transpose removed saves a full copy of its input at runtime.
+class SinkTransposes : public Pass {
+ public:
+  std::string getPassName() const override { return "sink_transposes"; }
+  PassResult runPass(ir::Graph& graph, AnalysisManager& analyses) override;
+};
+
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,471 @@
+#include "runtime/autotuner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ncnn/cpu.h"
+#include "onnx_ir/assertions.h"
+#include "optimizer/assign_layouts.h"
+#include "runtime/convolution.h"
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+constexpr char kCacheHeader[] = "# kernel tuning cache v1";
+
+// A new file next to 'path' for its next contents, named uniquely so
+// that processes saving at the same time do not write to the same one.
+FILE* createTemporary(const std::string& path, std::string* name) {
+#ifdef _WIN32
+  static std::atomic<int> counter{0};
+  *name = path + "." + std::to_string(_getpid()) + "." +
+          std::to_string(counter++) + ".tmp";
+  return fopen(name->c_str(), "wbx");
+#else
+  std::vector<char> pattern(path.begin(), path.end());
+  for (char c : std::string(".XXXXXX")) pattern.push_back(c);
+  pattern.push_back('\0');
+  int fd = mkstemp(pattern.data());
+  if (fd < 0) return nullptr;
+  *name = pattern.data();
+  // mkstemp makes it private to the owner
+  fchmod(fd, 0644);
+  FILE* file = fdopen(fd, "wb");
+  if (file == nullptr) {
+    close(fd);
+    remove(name->c_str());
+  }
+  return file;
+#endif
+}
+
+const char* isaName(GemmIsa isa) {
+  switch (isa) {
+    case GemmIsa::kGeneric:
+      return "generic";
+    case GemmIsa::kAvx2Fma:
+      return "avx2_fma";
+    case GemmIsa::kAvx512:
+      return "avx512";
+    case GemmIsa::kAvx512Vnni:
+      return "avx512_vnni";
+  }
+  return "unknown";
+}
+
+// A line of the cache file: the CPU model, the key and the configuration,
+// separated by tabs.
+std::string formatLine(const std::string& cpu_model, const std::string& key,
+                       const TuningConfig& config) {
+  std::ostringstream line;
+  line << cpu_model << '\t' << key << '\t' << config.algorithm << ' '
+       << config.blocking.mc << ' ' << config.blocking.nc << ' '
+       << config.threads;
+  return line.str();
+}
+
+bool parseLine(const std::string& line, std::string* cpu_model,
+               std::string* key, TuningConfig* config) {
+  size_t first = line.find('\t');
+  if (first == std::string::npos) return false;
+  size_t second = line.find('\t', first + 1);
+  if (second == std::string::npos) return false;
+  *cpu_model = line.substr(0, first);
+  *key = line.substr(first + 1, second - first - 1);
+  std::istringstream values(line.substr(second + 1));
+  TuningConfig parsed;
+  if (!(values >> parsed.algorithm >> parsed.blocking.mc >>
+        parsed.blocking.nc >> parsed.threads)) {
+    return false;
+  }
+  // a damaged line must not reach Sgemm
+  if (parsed.blocking.mc <= 0 || parsed.blocking.mc % kGemmRowQuantum != 0 ||
+      parsed.blocking.nc <= 0 ||
+      parsed.blocking.nc % kGemmColumnQuantum != 0) {
+    return false;
+  }
+  *config = parsed;
+  return true;
+}
+
+// tabs and line breaks would split the fields of the cache file
+std::string sanitize(std::string s) {
+  std::replace_if(
+      s.begin(), s.end(), [](char c) { return c == '\t' || c == '\n'; },
+      ' ');
+  return s;
+}
+
+// the sizes of 'v' if they are all known
+bool staticSizes(const ir::Value* v, std::vector<int64_t>* sizes) {
+  if (!v->has_sizes()) return false;
+  sizes->clear();
+  for (const ir::Dimension& d : v->sizes()) {
+    if (!d.is_int()) return false;
+    sizes->push_back(d.dim());
+  }
+  return true;
+}
+
+// Sets attribute 'name' of 'n' to 'value' and returns whether it changed.
+bool setInt(ir::Node* n, ir::Symbol name, int64_t value) {
+  if (n->hasAttribute(name) && n->kindOf(name) == ir::AttributeKind::i &&
+      n->i(name) == value) {
+    return false;
+  }
+  n->i_(name, value);
+  return true;
+}
+
+// Measures the kernels of one graph and its FusionGroups on synthetic
+// data.
+class GraphTuner {
+ public:
+  GraphTuner(Autotuner& tuner, IntraOpPool* pool)
+      : tuner_(tuner), isa_(BestGemmIsa()) {
+    frame_.intra_op_pool = pool;
+    threads_ = pool != nullptr ? pool->numThreads() : 1;
+  }
+
+  // 'group_elempack' is the layout of the FusionGroup 'graph' is the body
+  // of, -1 for the main graph
+  size_t run(ir::Graph& graph, int group_elempack) {
+    size_t changes = 0;
+    for (ir::Node* n : graph.nodes()) {
+      if (n->kind() == ir::kFusionGroup && n->hasAttribute(ir::kSubgraph)) {
+        changes +=
+            run(*n->g(ir::kSubgraph), optimization::Elempack(n->output()));
+        continue;
+      }
+      int elempack = group_elempack >= 0
+                         ? group_elempack
+                         : optimization::Elempack(n->output());
+      TuningConfig config;
+      if (n->kind() == ir::kConv) {
+        if (!tuneConv(*n, elempack, &config)) continue;
+        changes += setInt(n, ir::kconv_algorithm, config.algorithm);
+      } else if (n->kind() == ir::kGemm || n->kind() == ir::kMatMul) {
+        if (!tuneGemm(*n, &config)) continue;
+      } else {
+        continue;
+      }
+      changes += setInt(n, ir::kgemm_mc, config.blocking.mc);
+      changes += setInt(n, ir::kgemm_nc, config.blocking.nc);
+      changes += setInt(n, ir::knum_threads, config.threads);
+    }
+    return changes;
+  }
+
+ private:
+  using Prepare = std::function<std::function<void()>(const TuningConfig&)>;
+
+  // the GEMM blockings to try around 'base'
+  static std::vector<TuningConfig> blockings(const TuningConfig& base) {
+    std::vector<TuningConfig> configs;
+    for (int64_t mc : {48, 120, 240}) {
+      for (int64_t nc : {128, 512}) {
+        TuningConfig config = base;
+        config.blocking.mc = mc;
+        config.blocking.nc = nc;
+        configs.push_back(config);
+      }
+    }
+    return configs;
+  }
+
+  // all threads, half of them and one
+  std::vector<TuningConfig> threadCounts(const TuningConfig& base) const {
+    std::vector<TuningConfig> configs{base};
+    configs.back().threads = 0;
+    for (int threads : {threads_ / 2, 1}) {
+      if (threads < 1 || threads >= threads_ ||
+          threads == configs.back().threads) {
+        continue;
+      }
+      configs.push_back(base);
+      configs.back().threads = threads;
+    }
+    return configs;
+  }
+
+  // the algorithms first, then the blockings of the best one if it runs
+  // GEMMs, then the threads
+  TuningConfig search(std::vector<TuningConfig> candidates, bool gemm,
+                      const Prepare& prepare) {
+    TuningConfig best = Autotuner::Fastest(candidates, prepare);
+    if (gemm) best = Autotuner::Fastest(blockings(best), prepare);
+    return Autotuner::Fastest(threadCounts(best), prepare);
+  }
+
+  KernelContext context(const TuningConfig& config) {
+    return KernelContext(nullptr, nullptr, &frame_)
+        .withMaxThreads(config.threads);
+  }
+
+  bool tuneConv(const ir::Node& n, int elempack, TuningConfig* config) {
+    std::vector<int64_t> x, w;
+    ConvGeometry geometry;
+    if (n.inputs().size() < 2 || !staticSizes(n.inputs()[0], &x) ||
+        !staticSizes(n.inputs()[1], &w) || x.size() != w.size() ||
+        !ConvGeometryOf(ConvAttributesOf(n), w, &geometry) ||
+        x[1] != geometry.channels) {
+      return false;
+    }
+    int64_t batch = x[0];
+    int64_t height = x.size() == 4 ? x[2] : 1;
+    int64_t width = x.back();
+    ConvGeometry resolved = geometry.resolved(height, width);
+    int64_t output_h = resolved.outputHeight(height);
+    int64_t output_w = resolved.outputWidth(width);
+    if (output_h <= 0 || output_w <= 0) return false;
+    // as the Conv kernel runs them
+    if (!geometry.isDepthwise() || geometry.channels % elempack != 0) {
+      elempack = 1;
+    }
+    const ConvGeometry& g = resolved;
+    std::ostringstream key;
+    key << "Conv c" << g.channels << " m" << g.outputs << " g" << g.groups
+        << " k" << g.kernel_h << "x" << g.kernel_w << " s" << g.stride_h
+        << "x" << g.stride_w << " d" << g.dilation_h << "x" << g.dilation_w
+        << " p" << g.pad_top << "," << g.pad_left << "," << g.pad_bottom
+        << "," << g.pad_right << " in" << batch << "x" << height << "x"
+        << width << " ep" << elempack << " " << isaName(isa_);
+    if (tuner_.find(key.str(), config)) return true;
+
+    std::vector<TuningConfig> candidates;
+    for (ConvAlgorithm algorithm :
+         {ConvAlgorithm::kDepthwise, ConvAlgorithm::kGemm1x1,
+          ConvAlgorithm::kIm2col, ConvAlgorithm::kWinograd43,
+          ConvAlgorithm::kWinograd63}) {
+      // grouped GEMMs of one channel each lose to depthwise kernels
+      if (!ConvSupports(algorithm, geometry) ||
+          geometry.isDepthwise() != (algorithm == ConvAlgorithm::kDepthwise)) {
+        continue;
+      }
+      candidates.emplace_back();
+      candidates.back().algorithm = static_cast<int>(algorithm);
+    }
+    std::vector<float> weights(
+        w[0] * w[1] * geometry.kernel_h * geometry.kernel_w, 0.01f);
+    auto input = std::make_shared<ncnn::Mat>(
+        static_cast<int>(width), static_cast<int>(height),
+        static_cast<int>(batch * geometry.channels / elempack),
+        sizeof(float) * elempack, elempack);
+    std::fill_n(static_cast<float*>(input->data),
+                input->total() * elempack, 0.5f);
+    auto output = std::make_shared<ncnn::Mat>(
+        static_cast<int>(output_w), static_cast<int>(output_h),
+        static_cast<int>(batch * geometry.outputs / elempack),
+        sizeof(float) * elempack, elempack);
+    Prepare prepare = [&](const TuningConfig& c) {
+      auto conv = std::make_shared<ConvWeights>(
+          geometry, static_cast<ConvAlgorithm>(c.algorithm), weights.data(),
+          nullptr, elempack, c.blocking);
+      KernelContext ctx = context(c);
+      return std::function<void()>([=]() {
+        conv->run(*input, batch, height, width, output.get(), ctx);
+      });
+    };
+    *config = search(candidates,
+                     candidates[0].algorithm !=
+                         static_cast<int>(ConvAlgorithm::kDepthwise),
+                     prepare);
+    tuner_.record(key.str(), *config);
+    return true;
+  }
+
+  bool tuneGemm(const ir::Node& n, TuningConfig* config) {
+    std::vector<int64_t> a, b;
+    if (n.inputs().size() < 2 || !staticSizes(n.inputs()[0], &a) ||
+        !staticSizes(n.inputs()[1], &b) || a.size() < 2 || b.size() != 2) {
+      return false;
+    }
+    bool trans_a = false, trans_b = false;
+    if (n.kind() == ir::kGemm) {
+      if (a.size() != 2) return false;
+      trans_a = n.hasAttribute(ir::ktransA) && n.i(ir::ktransA);
+      trans_b = n.hasAttribute(ir::ktransB) && n.i(ir::ktransB);
+    }
+    int64_t m = a[a.size() - (trans_a ? 1 : 2)];
+    int64_t k = a[a.size() - (trans_a ? 2 : 1)];
+    int64_t n_cols = trans_b ? b[0] : b[1];
+    if ((trans_b ? b[1] : b[0]) != k || m <= 0 || k <= 0 || n_cols <= 0) {
+      return false;
+    }
+    // a batched MatMul runs one GEMM per batch, each on one thread
+    int64_t batch = 1;
+    for (size_t i = 0; i + 2 < a.size(); i++) batch *= a[i];
+    if (batch <= 0) return false;
+    std::ostringstream key;
+    key << "Sgemm b" << batch << " m" << m << " k" << k << " n" << n_cols
+        << " " << isaName(isa_);
+    if (tuner_.find(key.str(), config)) return true;
+
+    std::vector<float> b_values(k * n_cols, 0.01f);
+    auto packed = std::make_shared<PackedGemmB>(b_values.data(), k, n_cols,
+                                                n_cols, 1, isa_);
+    auto a_values =
+        std::make_shared<std::vector<float>>(batch * m * k, 0.5f);
+    auto c_values = std::make_shared<std::vector<float>>(batch * m * n_cols);
+    Prepare prepare = [&](const TuningConfig& c) {
+      KernelContext ctx = context(c);
+      GemmBlocking blocking = c.blocking;
+      return std::function<void()>([=]() {
+        ForEachGemm(batch, ctx, [&](int64_t i) {
+          Sgemm(m, a_values->data() + i * m * k, k, 1, 1.f, *packed,
+                c_values->data() + i * m * n_cols, n_cols, 1, false, ctx,
+                blocking);
+        });
+      });
+    };
+    *config = search({TuningConfig()}, true, prepare);
+    tuner_.record(key.str(), *config);
+    return true;
+  }
+
+  Autotuner& tuner_;
+  GemmIsa isa_;
+  Frame frame_;
+  int threads_;
+};
+
+}  // namespace
+
+TuningConfig TuningConfigOf(const ir::Node& node) {
+  auto read = [&node](ir::Symbol name, int64_t default_value) {
+    return node.hasAttribute(name) &&
+                   node.kindOf(name) == ir::AttributeKind::i
+               ? node.i(name)
+               : default_value;
+  };
+  TuningConfig config;
+  config.algorithm =
+      static_cast<int>(read(ir::kconv_algorithm, config.algorithm));
+  config.blocking.mc = read(ir::kgemm_mc, config.blocking.mc);
+  config.blocking.nc = read(ir::kgemm_nc, config.blocking.nc);
+  config.threads = static_cast<int>(read(ir::knum_threads, config.threads));
+  if (config.blocking.mc <= 0 ||
+      config.blocking.mc % kGemmRowQuantum != 0 ||
+      config.blocking.nc <= 0 ||
+      config.blocking.nc % kGemmColumnQuantum != 0) {
+    config.blocking = GemmBlocking();
+  }
+  return config;
+}
+
+Autotuner::Autotuner(std::string cache_path, std::string cpu_model)
+    : cache_path_(std::move(cache_path)),
+      cpu_model_(sanitize(cpu_model.empty() ? ncnn::cpu_model_name()
+                                            : std::move(cpu_model))) {
+  if (cache_path_.empty()) return;
+  std::ifstream file(cache_path_);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::string model, key;
+    TuningConfig config;
+    if (!parseLine(line, &model, &key, &config)) continue;
+    if (model == cpu_model_) {
+      results_[key] = config;
+    } else {
+      other_lines_.push_back(line);
+    }
+  }
+}
+
+size_t Autotuner::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return results_.size();
+}
+
+bool Autotuner::find(const std::string& key, TuningConfig* config) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = results_.find(key);
+  if (it == results_.end()) return false;
+  *config = it->second;
+  return true;
+}
+
+void Autotuner::record(const std::string& key, const TuningConfig& config) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  results_[sanitize(key)] = config;
+  changed_ = true;
+}
+
+bool Autotuner::save() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (cache_path_.empty() || !changed_) return true;
+  std::ostringstream contents;
+  contents << kCacheHeader << '\n';
+  for (const std::string& line : other_lines_) contents << line << '\n';
+  for (const auto& [key, config] : results_) {
+    contents << formatLine(cpu_model_, key, config) << '\n';
+  }
+  // written aside and renamed, so readers never see half a file
+  std::string temporary;
+  FILE* file = createTemporary(cache_path_, &temporary);
+  if (file == nullptr) return false;
+  std::string bytes = contents.str();
+  bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary.c_str(), cache_path_.c_str()) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+  changed_ = false;
+  return true;
+}
+
+TuningConfig Autotuner::Fastest(
+    const std::vector<TuningConfig>& candidates,
+    const std::function<std::function<void()>(const TuningConfig&)>& prepare,
+    int repeats) {
+  ONNX_ASSERT(!candidates.empty());
+  if (candidates.size() == 1) return candidates[0];
+  size_t best = 0;
+  double best_seconds = 0;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    std::function<void()> call = prepare(candidates[i]);
+    call();
+    double seconds = 0;
+    for (int r = 0; r < std::max(repeats, 1); r++) {
+      auto start = std::chrono::steady_clock::now();
+      call();
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      if (r == 0 || elapsed.count() < seconds) seconds = elapsed.count();
+    }
+    if (i == 0 || seconds < best_seconds) {
+      best = i;
+      best_seconds = seconds;
+    }
+  }
+  return candidates[best];
+}
+
+optimization::PassResult Autotune::runPass(ir::Graph& graph,
+                                           optimization::AnalysisManager&) {
+  size_t changes = GraphTuner(*tuner_, pool_).run(graph, -1);
+  tuner_->save();
+  return optimization::PassResult::changed(
+      changes, optimization::GraphState::kAttributes);
+}
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/intra_op_pool.h"
+#include "onnx_ir/ir.h"
+#include "optimizer/pass.h"
+#include "runtime/gemm.h"
+
+namespace my_ai_training::runtime {
+
+// A way to run a kernel, which the autotuner measures against others.
+struct TuningConfig {
+  // a ConvAlgorithm for Conv, -1 for the others
+  int algorithm = -1;
+  GemmBlocking blocking;
+  // threads of the intra-op pool, all of them if 0
+  int threads = 0;
+};
+
+// The configuration Autotune recorded on 'node', the defaults where it
+// recorded none.
+TuningConfig TuningConfigOf(const ir::Node& node);
+
+// The best configurations of kernels by op, shape and GemmIsa, measured on
+// one CPU model and kept in a cache file across runs of the process. The
+// lines of the file for other CPU models are kept as they are, so one
+// file can serve machines of several kinds. Thread safe.
+class Autotuner {
+ public:
+  // Loads the results in 'cache_path' for 'cpu_model', none if the path
+  // is empty or there is no file yet. The model defaults to
+  // ncnn::cpu_model_name().
+  explicit Autotuner(std::string cache_path = std::string(),
+                     std::string cpu_model = std::string());
+
+  const std::string& cpuModel() const { return cpu_model_; }
+  size_t size() const;
+
+  // false if 'key' was not tuned
+  bool find(const std::string& key, TuningConfig* config) const;
+  void record(const std::string& key, const TuningConfig& config);
+
+  // Replaces the cache file with the results, if any were recorded since
+  // it was loaded; false if it could not be written.
+  bool save();
+
+  // The candidate whose call 'prepare' returns runs fastest: the best of
+  // 'repeats' timed calls after one to warm up. A single candidate is
+  // returned without running it.
+  static TuningConfig Fastest(
+      const std::vector<TuningConfig>& candidates,
+      const std::function<std::function<void()>(const TuningConfig&)>&
+          prepare,
+      int repeats = 3);
+
+ private:
+  std::string cache_path_;
+  std::string cpu_model_;
+  mutable std::mutex mutex_;
+  std::map<std::string, TuningConfig> results_;
+  // the lines of the file for other CPU models
+  std::vector<std::string> other_lines_;
+  bool changed_ = false;
+};
+
+// Picks the kernel configurations of Conv, Gemm and MatMul nodes with
+// static shapes, FusionGroup bodies included, and writes them to the
+// attributes of the nodes the kernels read: conv_algorithm, gemm_mc,
+// gemm_nc and num_threads. Each op, shape and GemmIsa is measured once
+// per CPU model, on synthetic data; later loads reuse the results of
+// 'tuner', whose cache file is saved after the pass. 'pool' is the
+// intra-op pool the sessions run on, null for their own thread.
+//
+// Run it after assign_layouts: depthwise layers are measured in the
+// layout they run in.
+class Autotune : public optimization::Pass {
+ public:
+  explicit Autotune(std::shared_ptr<Autotuner> tuner,
+                    IntraOpPool* pool = nullptr)
+      : tuner_(std::move(tuner)), pool_(pool) {}
+
+  std::string getPassName() const override { return "autotune"; }
+  optimization::PassResult runPass(
+      ir::Graph& graph, optimization::AnalysisManager& analyses) override;
+
+ private:
+  std::shared_ptr<Autotuner> tuner_;
+  IntraOpPool* pool_;
+};
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,194 @@
+#include "runtime/batching_server.h"
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+// whether requests 'a' and 'b' may share a batch
+bool sameItems(const std::vector<SlotValue>& a,
+               const std::vector<SlotValue>& b) {
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].elem_type != b[i].elem_type ||
+        !std::equal(a[i].sizes.begin() + 1, a[i].sizes.end(),
+                    b[i].sizes.begin() + 1, b[i].sizes.end())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+BatchingServer::BatchingServer(std::shared_ptr<const ExecutionPlan> plan,
+                               BatchingOptions options)
+    : plan_(std::move(plan)), options_(std::move(options)) {
+  ONNX_ASSERTM(options_.max_batch_size > 0 && options_.num_runners > 0,
+               "a batching server needs a batch size and runners");
+  for (int i = 0; i < options_.num_runners; i++) {
+    runners_.emplace_back([this]() { runnerLoop(); });
+  }
+}
+
+BatchingServer::~BatchingServer() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& runner : runners_) runner.join();
+}
+
+std::future<BatchResult> BatchingServer::submit(
+    std::vector<SlotValue> inputs) {
+  const auto& slots = plan_->inputSlots();
+  ONNX_ASSERTM(inputs.size() == slots.size(),
+               "the graph has %zu inputs, not %zu", slots.size(),
+               inputs.size());
+  Request request;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    SlotValue& value = inputs[i];
+    ONNX_ASSERTM(!value.sizes.empty() && value.mat.elempack == 1,
+                 "input %zu is not an unpacked tensor of rank 1 or more", i);
+    if (i == 0) request.items = value.sizes[0];
+    ONNX_ASSERTM(value.sizes[0] == request.items,
+                 "input %zu has %lld items, input 0 %lld", i,
+                 (long long)value.sizes[0], (long long)request.items);
+    if (value.elem_type == ir::TensorProto_DataType_UNDEFINED) {
+      value.elem_type = plan_->slots()[slots[i]].elem_type;
+    }
+  }
+  request.inputs = std::move(inputs);
+  request.arrival = Clock::now();
+  std::future<BatchResult> result = request.promise.get_future();
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    queued_items_ += request.items;
+    queue_.push_back(std::move(request));
+  }
+  // runners filling up a batch check whether it is full
+  cv_.notify_all();
+  return result;
+}
+
+void BatchingServer::runnerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) return;
+    // the deadline is the front request's, which changes when another
+    // runner takes the one before
+    while (!stop_ && !queue_.empty() &&
+           queued_items_ < options_.max_batch_size) {
+      Clock::time_point deadline =
+          queue_.front().arrival + options_.max_latency;
+      if (Clock::now() >= deadline) break;
+      cv_.wait_until(lock, deadline);
+    }
+    // another runner took it
+    if (queue_.empty()) continue;
+    std::vector<Request> batch = takeBatch();
+    lock.unlock();
+    runBatch(batch);
+    lock.lock();
+  }
+}
+
+std::vector<BatchingServer::Request> BatchingServer::takeBatch() {
+  std::vector<Request> batch;
+  int64_t items = queue_.front().items;
+  batch.push_back(std::move(queue_.front()));
+  queue_.pop_front();
+  for (auto it = queue_.begin(); it != queue_.end();) {
+    if (items + it->items <= options_.max_batch_size &&
+        sameItems(batch[0].inputs, it->inputs)) {
+      items += it->items;
+      batch.push_back(std::move(*it));
+      it = queue_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  queued_items_ -= items;
+  return batch;
+}
+
+void BatchingServer::runBatch(std::vector<Request>& batch) {
+  try {
+    Frame frame = plan_->createFrame(options_.allocator);
+    frame.intra_op_pool = options_.intra_op_pool;
+    int64_t items = 0;
+    for (const Request& request : batch) items += request.items;
+    for (size_t i = 0; i < plan_->inputSlots().size(); i++) {
+      const SlotValue& first = batch[0].inputs[i];
+      if (batch.size() == 1) {
+        plan_->setInput(frame, i, first.mat, first.sizes, first.elem_type);
+        continue;
+      }
+      std::vector<int64_t> sizes = first.sizes;
+      sizes[0] = items;
+      ncnn::Mat mat;
+      CreateMat(sizes, first.mat.elemsize, 1, options_.allocator, &mat);
+      int64_t begin = 0;
+      for (const Request& request : batch) {
+        const SlotValue& value = request.inputs[i];
+        CopyMat(value.mat, SliceDim0(mat, sizes, begin, request.items));
+        begin += request.items;
+      }
+      plan_->setInput(frame, i, mat, std::move(sizes), first.elem_type);
+    }
+    if (options_.inter_op_pool != nullptr) {
+      plan_->run(frame, *options_.inter_op_pool);
+    } else {
+      plan_->run(frame);
+    }
+
+    auto outputs = std::make_shared<std::vector<SlotValue>>();
+    for (size_t i = 0; i < plan_->outputSlots().size(); i++) {
+      SlotValue out = plan_->output(frame, i);
+      if (out.mat.elempack != 1) {
+        ncnn::Mat unpacked;
+        ncnn::convert_packing(out.mat, unpacked, 1, options_.allocator);
+        out.mat = unpacked;
+      }
+      ONNX_ASSERTM(batch.size() == 1 ||
+                       (!out.sizes.empty() && out.sizes[0] == items),
+                   "output %zu does not have the batch of %lld as dim 0", i,
+                   (long long)items);
+      outputs->push_back(std::move(out));
+    }
+    // set once nothing can throw any more
+    std::vector<BatchResult> results(batch.size());
+    int64_t begin = 0;
+    for (size_t r = 0; r < batch.size(); r++) {
+      results[r].batch = outputs;
+      for (const SlotValue& out : *outputs) {
+        if (batch.size() == 1) {
+          results[r].outputs.push_back(out);
+          continue;
+        }
+        SlotValue value;
+        value.mat = SliceDim0(out.mat, out.sizes, begin, batch[r].items);
+        value.sizes = out.sizes;
+        value.sizes[0] = batch[r].items;
+        value.elem_type = out.elem_type;
+        results[r].outputs.push_back(std::move(value));
+      }
+      begin += batch[r].items;
+    }
+    for (size_t r = 0; r < batch.size(); r++) {
+      batch[r].promise.set_value(std::move(results[r]));
+    }
+  } catch (...) {
+    for (Request& request : batch) {
+      request.promise.set_exception(std::current_exception());
+    }
+  }
+}
+
+}  // namespace my_ai_training::runtime
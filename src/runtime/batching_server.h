@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/intra_op_pool.h"
+#include "common/work_stealing_pool.h"
+#include "runtime/execution_plan.h"
+
+namespace my_ai_training::runtime {
+
+struct BatchingOptions {
+  // requests of at most this many items along dim 0 in all run together;
+  // a larger request runs alone
+  int64_t max_batch_size = 8;
+  // how long the oldest queued request waits for others to join its batch
+  std::chrono::microseconds max_latency{2000};
+  // batches running at once; while they run, the next one fills up
+  int num_runners = 2;
+  // run the batches' instructions in parallel if set
+  WorkStealingPool* inter_op_pool = nullptr;
+  // for the loops inside kernels, if set
+  IntraOpPool* intra_op_pool = nullptr;
+  ncnn::Allocator* allocator = nullptr;
+};
+
+// The outputs of one request: views of its items in the outputs of its
+// batch, which 'batch' keeps alive.
+struct BatchResult {
+  std::vector<SlotValue> outputs;
+  std::shared_ptr<const void> batch;
+};
+
+// Serves many small requests by running them in batches: queued requests
+// whose inputs only differ in the extent of dim 0 are concatenated along it
+// and run as one, and the outputs are split along it again. A batch starts
+// once it is full or its oldest request waited for 'max_latency'.
+//
+// A request alone in its batch runs on its own inputs. Otherwise each input
+// item is copied once, into its place in the batch; outputs are never
+// copied. Every graph output must then have the batch as dim 0.
+class BatchingServer {
+ public:
+  BatchingServer(std::shared_ptr<const ExecutionPlan> plan,
+                 BatchingOptions options = BatchingOptions());
+  // runs the queued requests, then joins the runners
+  ~BatchingServer();
+
+  BatchingServer(const BatchingServer&) = delete;
+  BatchingServer& operator=(const BatchingServer&) = delete;
+
+  // Queues a request with one unpacked value per graph input, all of rank 1
+  // or more and with the same extent along dim 0. Throws if they are not;
+  // errors of the run are set on the future.
+  std::future<BatchResult> submit(std::vector<SlotValue> inputs);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Request {
+    std::vector<SlotValue> inputs;
+    int64_t items = 0;
+    Clock::time_point arrival;
+    std::promise<BatchResult> promise;
+  };
+
+  void runnerLoop();
+  // the oldest request and the queued ones of the same item shapes, in
+  // order, as long as they fit; called with mutex_ held
+  std::vector<Request> takeBatch();
+  void runBatch(std::vector<Request>& batch);
+
+  const std::shared_ptr<const ExecutionPlan> plan_;
+  const BatchingOptions options_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Request> queue_;
+  int64_t queued_items_ = 0;
+  bool stop_ = false;
+  std::vector<std::thread> runners_;
+};
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,188 @@
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ncnn/mat.h"
+#include "optimizer/assign_layouts.h"
+#include "optimizer/fold_constants.h"
+#include "runtime/autotuner.h"
+#include "runtime/convolution.h"
+#include "runtime/kernels.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+constexpr int32_t kFloat = ir::TensorProto_DataType_FLOAT;
+
+// the extent of dim 'i' of 'v', or -1 if it is not known
+int64_t staticExtent(const ir::Value* v, size_t i) {
+  if (!v->has_sizes() || i >= v->sizes().size()) return -1;
+  const ir::Dimension& d = v->sizes()[i];
+  return d.is_int() ? d.dim() : -1;
+}
+
+// The algorithm and layout of a layer: the tuned algorithm if it has one,
+// and depthwise ones run in the elempack of their output, which then needs
+// no conversion.
+std::shared_ptr<const ConvWeights> makeWeights(const ConvGeometry& geometry,
+                                               const TuningConfig& tuning,
+                                               const float* weights,
+                                               const float* bias,
+                                               int64_t output_h,
+                                               int64_t output_w,
+                                               int elempack) {
+  ConvAlgorithm algorithm =
+      DefaultConvAlgorithm(geometry, output_h, output_w);
+  if (tuning.algorithm >= 0 &&
+      ConvSupports(static_cast<ConvAlgorithm>(tuning.algorithm), geometry)) {
+    algorithm = static_cast<ConvAlgorithm>(tuning.algorithm);
+  }
+  if (geometry.channels % elempack != 0) elempack = 1;
+  return std::make_shared<ConvWeights>(geometry, algorithm, weights, bias,
+                                       elempack, tuning.blocking);
+}
+
+struct ConvParams {
+  ConvAttributes attrs;
+  TuningConfig tuning;
+  // W and B transformed when the plan is compiled, if they are constants
+  std::shared_ptr<const ConvWeights> weights;
+  // or on the first run, if their slots are constants only there: in the
+  // body of a FusionGroup
+  mutable std::once_flag once;
+  mutable std::shared_ptr<const ConvWeights> first_run_weights;
+};
+
+std::shared_ptr<const void> prepareConv(const ir::Node& node) {
+  auto params = std::make_shared<ConvParams>();
+  params->attrs = ConvAttributesOf(node);
+  params->tuning = TuningConfigOf(node);
+
+  const ir::Tensor* w = optimization::FindConstant(node.inputs()[1]);
+  const ir::Tensor* b = nullptr;
+  bool has_bias = node.inputs().size() > 2 &&
+                  node.inputs()[2]->node()->kind() != ir::kUndefined;
+  if (has_bias) b = optimization::FindConstant(node.inputs()[2]);
+  ConvGeometry geometry;
+  if (w == nullptr || w->elem_type() != kFloat ||
+      w->byteSize() != w->expectedByteSize() ||
+      !ConvGeometryOf(params->attrs, w->sizes(), &geometry) ||
+      (has_bias && (b == nullptr || b->elem_type() != kFloat ||
+                    b->sizes() != std::vector<int64_t>{geometry.outputs}))) {
+    return params;
+  }
+  const ir::Value* y = node.output();
+  bool one_dimensional = w->sizes().size() == 3;
+  params->weights = makeWeights(
+      geometry, params->tuning, w->data<float>(),
+      b != nullptr ? b->data<float>() : nullptr,
+      one_dimensional ? 1 : staticExtent(y, 2),
+      staticExtent(y, one_dimensional ? 2 : 3),
+      optimization::Elempack(y));
+  return params;
+}
+
+// The weights of a run from W and B in their slots, copied out of the
+// padded channels of their Mats. Null if they do not fit the input.
+std::shared_ptr<const ConvWeights> weightsOf(const ConvParams& params,
+                                             const Instruction& inst,
+                                             const KernelContext& ctx) {
+  const SlotValue& w = ctx.input(inst, 1);
+  ConvGeometry geometry;
+  if (w.elem_type != kFloat ||
+      !ConvGeometryOf(params.attrs, w.sizes, &geometry)) {
+    return nullptr;
+  }
+  ir::Tensor w_tensor, b_tensor;
+  MatToTensor(w.mat, w.elem_type, w.sizes, &w_tensor);
+  const float* bias = nullptr;
+  if (ctx.hasInput(inst, 2)) {
+    const SlotValue& b = ctx.input(inst, 2);
+    if (b.elem_type != kFloat ||
+        b.sizes != std::vector<int64_t>{geometry.outputs}) {
+      return nullptr;
+    }
+    MatToTensor(b.mat, b.elem_type, b.sizes, &b_tensor);
+    bias = b_tensor.data<float>();
+  }
+  const SlotInfo& y = ctx.outputInfo(inst, 0);
+  bool one_dimensional = w.sizes.size() == 3;
+  int64_t output_h = -1, output_w = -1;
+  if (y.has_static_sizes && y.sizes.size() == w.sizes.size()) {
+    output_h = one_dimensional ? 1 : y.sizes[2];
+    output_w = y.sizes.back();
+  }
+  return makeWeights(geometry, params.tuning, w_tensor.data<float>(), bias,
+                     output_h, output_w, y.elempack);
+}
+
+// Conv: 1-D and 2-D convolutions in float, as ConvWeights computes them,
+// converting to and from the layout of its algorithm
+bool runConv(const Instruction& inst, KernelContext& ctx) {
+  const ConvParams& params = inst.paramsAs<ConvParams>();
+  const SlotValue& x = ctx.input(inst, 0);
+  size_t rank = x.sizes.size();
+  if (x.elem_type != kFloat || (rank != 3 && rank != 4)) return false;
+  std::shared_ptr<const ConvWeights> weights = params.weights;
+  if (weights == nullptr) {
+    bool constant = ctx.inputInfo(inst, 1).constant &&
+                    (!ctx.hasInput(inst, 2) || ctx.inputInfo(inst, 2).constant);
+    if (constant) {
+      std::call_once(params.once, [&] {
+        params.first_run_weights = weightsOf(params, inst, ctx);
+      });
+      weights = params.first_run_weights;
+    } else {
+      weights = weightsOf(params, inst, ctx);
+    }
+  }
+  if (weights == nullptr) return false;
+  const ConvGeometry& geometry = weights->geometry();
+  if (ctx.input(inst, 1).sizes.size() != rank ||
+      x.sizes[1] != geometry.channels) {
+    return false;
+  }
+  int64_t batch = x.sizes[0];
+  int64_t height = rank == 4 ? x.sizes[2] : 1;
+  int64_t width = x.sizes.back();
+  ConvGeometry resolved = geometry.resolved(height, width);
+  int64_t output_h = resolved.outputHeight(height);
+  int64_t output_w = resolved.outputWidth(width);
+  if (output_h <= 0 || output_w <= 0) return false;
+  std::vector<int64_t> sizes{batch, geometry.outputs};
+  if (rank == 4) sizes.push_back(output_h);
+  sizes.push_back(output_w);
+
+  KernelContext tuned = ctx.withMaxThreads(params.tuning.threads);
+  int elempack = weights->elempack();
+  ncnn::Mat input = x.mat;
+  if (input.elempack != elempack) {
+    ncnn::convert_packing(x.mat, input, elempack, ctx.allocator());
+  }
+  if (ctx.outputInfo(inst, 0).elempack == elempack) {
+    ncnn::Mat& y = ctx.createOutput(inst, 0, sizes, kFloat);
+    weights->run(input, batch, height, width, &y, tuned);
+    return true;
+  }
+  ncnn::Mat output;
+  CreateMat(sizes, sizeof(float), elempack, ctx.allocator(), &output);
+  weights->run(input, batch, height, width, &output, tuned);
+  SlotValue& y = ctx.output(inst, 0);
+  ncnn::convert_packing(output, y.mat, ctx.outputInfo(inst, 0).elempack,
+                        ctx.allocator());
+  y.sizes = std::move(sizes);
+  y.elem_type = kFloat;
+  return true;
+}
+
+}  // namespace
+
+void RegisterConvKernels(KernelRegistry* registry) {
+  // packed when depthwise, the only Convs assign_layouts packs
+  registry->registerKernel(ir::kConv, Kernel{runConv, prepareConv, true});
+}
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,580 @@
+#include "runtime/convolution.h"
+
+#include <algorithm>
+
+#include "onnx_ir/assertions.h"
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+// Output pixels im2col gathers columns for at once.
+constexpr int64_t kIm2colPixels = 2048;
+
+// The Winograd transforms of ncnn: G of the kernel, B^T of the input and
+// A^T of the output, for tiles of 'r' x 'r' outputs from 'alpha' x 'alpha'
+// inputs.
+struct WinogradTransform {
+  int r;
+  int alpha;
+  const float* g;   // alpha x 3
+  const float* bt;  // alpha x alpha
+  const float* at;  // r x alpha
+};
+
+constexpr float kG43[6][3] = {{1.f / 4, 0, 0},
+                              {-1.f / 6, -1.f / 6, -1.f / 6},
+                              {-1.f / 6, 1.f / 6, -1.f / 6},
+                              {1.f / 24, 1.f / 12, 1.f / 6},
+                              {1.f / 24, -1.f / 12, 1.f / 6},
+                              {0, 0, 1}};
+constexpr float kBt43[6][6] = {
+    {4, 0, -5, 0, 1, 0},  {0, -4, -4, 1, 1, 0}, {0, 4, -4, -1, 1, 0},
+    {0, -2, -1, 2, 1, 0}, {0, 2, -1, -2, 1, 0}, {0, 4, 0, -5, 0, 1}};
+constexpr float kAt43[4][6] = {{1, 1, 1, 1, 1, 0},
+                               {0, 1, -1, 2, -2, 0},
+                               {0, 1, 1, 4, 4, 0},
+                               {0, 1, -1, 8, -8, 1}};
+
+constexpr float kG63[8][3] = {{1, 0, 0},
+                              {-2.f / 9, -2.f / 9, -2.f / 9},
+                              {-2.f / 9, 2.f / 9, -2.f / 9},
+                              {1.f / 90, 1.f / 45, 2.f / 45},
+                              {1.f / 90, -1.f / 45, 2.f / 45},
+                              {1.f / 45, 1.f / 90, 1.f / 180},
+                              {1.f / 45, -1.f / 90, 1.f / 180},
+                              {0, 0, 1}};
+constexpr float kBt63[8][8] = {
+    {1, 0, -5.25f, 0, 5.25f, 0, -1, 0},
+    {0, 1, 1, -4.25f, -4.25f, 1, 1, 0},
+    {0, -1, 1, 4.25f, -4.25f, -1, 1, 0},
+    {0, 0.5f, 0.25f, -2.5f, -1.25f, 2, 1, 0},
+    {0, -0.5f, 0.25f, 2.5f, -1.25f, -2, 1, 0},
+    {0, 2, 4, -2.5f, -5, 0.5f, 1, 0},
+    {0, -2, 4, 2.5f, -5, -0.5f, 1, 0},
+    {0, -1, 0, 5.25f, 0, -5.25f, 0, 1}};
+constexpr float kAt63[6][8] = {{1, 1, 1, 1, 1, 32, 32, 0},
+                               {0, 1, -1, 2, -2, 16, -16, 0},
+                               {0, 1, 1, 4, 4, 8, 8, 0},
+                               {0, 1, -1, 8, -8, 4, -4, 0},
+                               {0, 1, 1, 16, 16, 2, 2, 0},
+                               {0, 1, -1, 32, -32, 1, -1, 1}};
+
+const WinogradTransform& winogradOf(ConvAlgorithm algorithm) {
+  static const WinogradTransform f43{4, 6, kG43[0], kBt43[0], kAt43[0]};
+  static const WinogradTransform f63{6, 8, kG63[0], kBt63[0], kAt63[0]};
+  return algorithm == ConvAlgorithm::kWinograd63 ? f63 : f43;
+}
+
+// Channels the Winograd transforms work on at once, as the lanes of their
+// vectors.
+constexpr int kLanes = 16;
+
+// out = l * x * l^T for kLanes matrices interleaved: the p x q matrix l,
+// x of [q][q][kLanes] and out of [p][p][kLanes]. The zeros of l are
+// skipped.
+void sandwich(const float* l, int p, int q, const float* x, float* out) {
+  float lx[8 * 8 * kLanes];
+  for (int i = 0; i < p; i++) {
+    for (int j = 0; j < q; j++) {
+      float* sum = lx + (i * q + j) * kLanes;
+      std::fill_n(sum, kLanes, 0.f);
+      for (int t = 0; t < q; t++) {
+        float coef = l[i * q + t];
+        if (coef == 0.f) continue;
+        const float* v = x + (t * q + j) * kLanes;
+        for (int c = 0; c < kLanes; c++) sum[c] += coef * v[c];
+      }
+    }
+  }
+  for (int i = 0; i < p; i++) {
+    for (int j = 0; j < p; j++) {
+      float* sum = out + (i * p + j) * kLanes;
+      std::fill_n(sum, kLanes, 0.f);
+      for (int t = 0; t < q; t++) {
+        float coef = l[j * q + t];
+        if (coef == 0.f) continue;
+        const float* v = lx + (i * q + t) * kLanes;
+        for (int c = 0; c < kLanes; c++) sum[c] += coef * v[c];
+      }
+    }
+  }
+}
+
+// The depthwise layer over channels interleaved by EP, the lanes of which
+// the compiler vectorizes.
+template <int EP>
+void depthwise(const float* weights, const float* bias,
+               const ncnn::Mat& input, const ConvGeometry& g, int64_t batch,
+               int64_t height, int64_t width, ncnn::Mat* output,
+               const KernelContext& ctx) {
+  int64_t out_h = g.outputHeight(height);
+  int64_t out_w = g.outputWidth(width);
+  int64_t kernel_size = g.kernel_h * g.kernel_w;
+  int64_t packs = g.channels / EP;
+  ctx.parallelFor(static_cast<size_t>(batch * packs), [&](size_t begin,
+                                                          size_t end) {
+    for (size_t q = begin; q < end; q++) {
+      int64_t pack = static_cast<int64_t>(q) % packs;
+      const float* in = input.channel(static_cast<int>(q));
+      float* out = output->channel(static_cast<int>(q));
+      const float* w = weights + pack * kernel_size * EP;
+      const float* b = bias + pack * EP;
+      for (int64_t oy = 0; oy < out_h; oy++) {
+        for (int64_t ox = 0; ox < out_w; ox++) {
+          float sum[EP];
+          for (int l = 0; l < EP; l++) sum[l] = b[l];
+          for (int64_t ky = 0; ky < g.kernel_h; ky++) {
+            int64_t iy = oy * g.stride_h - g.pad_top + ky * g.dilation_h;
+            if (iy < 0 || iy >= height) continue;
+            for (int64_t kx = 0; kx < g.kernel_w; kx++) {
+              int64_t ix = ox * g.stride_w - g.pad_left + kx * g.dilation_w;
+              if (ix < 0 || ix >= width) continue;
+              const float* x = in + (iy * width + ix) * EP;
+              const float* wk = w + (ky * g.kernel_w + kx) * EP;
+              for (int l = 0; l < EP; l++) sum[l] += x[l] * wk[l];
+            }
+          }
+          float* y = out + (oy * out_w + ox) * EP;
+          for (int l = 0; l < EP; l++) y[l] = sum[l];
+        }
+      }
+    }
+  });
+}
+
+// the pads at the beginning and the end of a dim that auto_pad SAME gives
+void samePads(const std::string& auto_pad, int64_t in, int64_t stride,
+              int64_t kernel, int64_t dilation, int64_t* begin,
+              int64_t* end) {
+  int64_t out = (in + stride - 1) / stride;
+  int64_t extent = (kernel - 1) * dilation + 1;
+  int64_t total = std::max<int64_t>(0, (out - 1) * stride + extent - in);
+  *begin = auto_pad == "SAME_LOWER" ? total - total / 2 : total / 2;
+  *end = total - *begin;
+}
+
+int64_t outputExtent(int64_t in, int64_t pads, int64_t stride,
+                     int64_t kernel, int64_t dilation) {
+  if (in < 0) return -1;
+  int64_t extent = (kernel - 1) * dilation + 1;
+  if (in + pads < extent) return 0;
+  return (in + pads - extent) / stride + 1;
+}
+
+}  // namespace
+
+ConvGeometry ConvGeometry::resolved(int64_t height, int64_t width) const {
+  ConvGeometry g = *this;
+  if (auto_pad == "NOTSET") return g;
+  g.auto_pad = "NOTSET";
+  if (auto_pad == "VALID") {
+    g.pad_top = g.pad_left = g.pad_bottom = g.pad_right = 0;
+    return g;
+  }
+  samePads(auto_pad, height, stride_h, kernel_h, dilation_h, &g.pad_top,
+           &g.pad_bottom);
+  samePads(auto_pad, width, stride_w, kernel_w, dilation_w, &g.pad_left,
+           &g.pad_right);
+  return g;
+}
+
+int64_t ConvGeometry::outputHeight(int64_t height) const {
+  return outputExtent(height, pad_top + pad_bottom, stride_h, kernel_h,
+                      dilation_h);
+}
+
+int64_t ConvGeometry::outputWidth(int64_t width) const {
+  return outputExtent(width, pad_left + pad_right, stride_w, kernel_w,
+                      dilation_w);
+}
+
+ConvAttributes ConvAttributesOf(const ir::Node& node) {
+  ConvAttributes attrs;
+  if (node.hasAttribute(ir::kkernel_shape)) {
+    attrs.kernel_shape = node.is(ir::kkernel_shape);
+  }
+  if (node.hasAttribute(ir::kstrides)) attrs.strides = node.is(ir::kstrides);
+  if (node.hasAttribute(ir::kdilations)) {
+    attrs.dilations = node.is(ir::kdilations);
+  }
+  if (node.hasAttribute(ir::kpads)) attrs.pads = node.is(ir::kpads);
+  if (node.hasAttribute(ir::kgroup)) attrs.group = node.i(ir::kgroup);
+  if (node.hasAttribute(ir::kauto_pad)) attrs.auto_pad = node.s(ir::kauto_pad);
+  return attrs;
+}
+
+bool ConvGeometryOf(const ConvAttributes& attrs,
+                    const std::vector<int64_t>& w_sizes,
+                    ConvGeometry* g) {
+  if (w_sizes.size() != 3 && w_sizes.size() != 4) return false;
+  size_t spatial = w_sizes.size() - 2;
+  auto fits = [spatial](const std::vector<int64_t>& values, size_t count) {
+    return values.empty() || values.size() == count;
+  };
+  if (!fits(attrs.strides, spatial) || !fits(attrs.dilations, spatial) ||
+      !fits(attrs.pads, 2 * spatial) ||
+      (!attrs.kernel_shape.empty() &&
+       !std::equal(attrs.kernel_shape.begin(), attrs.kernel_shape.end(),
+                   w_sizes.begin() + 2, w_sizes.end()))) {
+    return false;
+  }
+  if (attrs.group <= 0 || w_sizes[0] % attrs.group != 0) return false;
+  *g = ConvGeometry();
+  g->outputs = w_sizes[0];
+  g->channels = w_sizes[1] * attrs.group;
+  g->groups = attrs.group;
+  g->kernel_w = w_sizes.back();
+  if (!attrs.strides.empty()) g->stride_w = attrs.strides.back();
+  if (!attrs.dilations.empty()) g->dilation_w = attrs.dilations.back();
+  if (!attrs.pads.empty()) {
+    g->pad_left = attrs.pads[spatial - 1];
+    g->pad_right = attrs.pads.back();
+  }
+  if (spatial == 2) {
+    g->kernel_h = w_sizes[2];
+    if (!attrs.strides.empty()) g->stride_h = attrs.strides[0];
+    if (!attrs.dilations.empty()) g->dilation_h = attrs.dilations[0];
+    if (!attrs.pads.empty()) {
+      g->pad_top = attrs.pads[0];
+      g->pad_bottom = attrs.pads[2];
+    }
+  }
+  g->auto_pad = attrs.auto_pad;
+  return g->stride_h > 0 && g->stride_w > 0 && g->dilation_h > 0 &&
+         g->dilation_w > 0;
+}
+
+bool ConvSupports(ConvAlgorithm algorithm, const ConvGeometry& geometry) {
+  const ConvGeometry& g = geometry;
+  switch (algorithm) {
+    case ConvAlgorithm::kDepthwise:
+      return g.isDepthwise();
+    case ConvAlgorithm::kGemm1x1:
+      // SAME pads nothing for these either
+      return g.kernel_h == 1 && g.kernel_w == 1 && g.stride_h == 1 &&
+             g.stride_w == 1 &&
+             (g.auto_pad != "NOTSET" ||
+              (g.pad_top == 0 && g.pad_left == 0 && g.pad_bottom == 0 &&
+               g.pad_right == 0));
+    case ConvAlgorithm::kIm2col:
+      return true;
+    case ConvAlgorithm::kWinograd43:
+    case ConvAlgorithm::kWinograd63:
+      return g.groups == 1 && g.kernel_h == 3 && g.kernel_w == 3 &&
+             g.stride_h == 1 && g.stride_w == 1 && g.dilation_h == 1 &&
+             g.dilation_w == 1;
+  }
+  return false;
+}
+
+ConvAlgorithm DefaultConvAlgorithm(const ConvGeometry& geometry,
+                                   int64_t output_h, int64_t output_w) {
+  if (ConvSupports(ConvAlgorithm::kDepthwise, geometry)) {
+    return ConvAlgorithm::kDepthwise;
+  }
+  if (ConvSupports(ConvAlgorithm::kGemm1x1, geometry)) {
+    return ConvAlgorithm::kGemm1x1;
+  }
+  if (ConvSupports(ConvAlgorithm::kWinograd43, geometry) &&
+      geometry.channels >= 8 && geometry.outputs >= 8) {
+    return output_h >= 16 && output_w >= 16 ? ConvAlgorithm::kWinograd63
+                                            : ConvAlgorithm::kWinograd43;
+  }
+  return ConvAlgorithm::kIm2col;
+}
+
+ConvWeights::ConvWeights(const ConvGeometry& geometry,
+                         ConvAlgorithm algorithm, const float* weights,
+                         const float* bias, int elempack,
+                         const GemmBlocking& blocking)
+    : geometry_(geometry),
+      algorithm_(algorithm),
+      elempack_(algorithm == ConvAlgorithm::kDepthwise ? elempack : 1),
+      blocking_(blocking) {
+  const ConvGeometry& g = geometry_;
+  ONNX_ASSERTM(g.groups > 0 && g.channels % g.groups == 0 &&
+                   g.outputs % g.groups == 0,
+               "a convolution of %lld channels to %lld in %lld groups",
+               (long long)g.channels, (long long)g.outputs,
+               (long long)g.groups);
+  ONNX_ASSERTM(ConvSupports(algorithm, g),
+               "a convolution algorithm that does not fit the layer");
+  ONNX_ASSERTM(g.channels % elempack_ == 0,
+               "%lld channels in elempack %d", (long long)g.channels,
+               elempack_);
+  bias_.assign(g.outputs, 0.f);
+  if (bias != nullptr) std::copy(bias, bias + g.outputs, bias_.begin());
+  int64_t kernel_size = g.kernel_h * g.kernel_w;
+  switch (algorithm) {
+    case ConvAlgorithm::kDepthwise:
+      depthwise_.resize(g.channels * kernel_size);
+      for (int64_t c = 0; c < g.channels; c++) {
+        for (int64_t i = 0; i < kernel_size; i++) {
+          int64_t pack = c / elempack_, lane = c % elempack_;
+          depthwise_[(pack * kernel_size + i) * elempack_ + lane] =
+              weights[c * kernel_size + i];
+        }
+      }
+      break;
+    case ConvAlgorithm::kGemm1x1:
+    case ConvAlgorithm::kIm2col: {
+      // packed as A once per group, rather than by every GEMM
+      int64_t group_outputs = g.outputs / g.groups;
+      int64_t k = g.channels / g.groups * kernel_size;
+      for (int64_t group = 0; group < g.groups; group++) {
+        group_weights_.emplace_back(weights + group * group_outputs * k,
+                                    group_outputs, k, k, 1);
+      }
+      break;
+    }
+    case ConvAlgorithm::kWinograd43:
+    case ConvAlgorithm::kWinograd63: {
+      // U = G g G^T, as [alpha * alpha][channels][outputs]
+      const WinogradTransform& t = winogradOf(algorithm);
+      int64_t points = t.alpha * t.alpha;
+      std::vector<float> u(points * g.channels * g.outputs);
+      float kernels[3 * 3 * kLanes], transformed[8 * 8 * kLanes];
+      for (int64_t c = 0; c < g.channels; c++) {
+        for (int64_t m0 = 0; m0 < g.outputs; m0 += kLanes) {
+          int lanes = static_cast<int>(std::min<int64_t>(kLanes,
+                                                         g.outputs - m0));
+          std::fill_n(kernels, 3 * 3 * kLanes, 0.f);
+          for (int l = 0; l < lanes; l++) {
+            const float* kernel = weights + ((m0 + l) * g.channels + c) * 9;
+            for (int i = 0; i < 9; i++) kernels[i * kLanes + l] = kernel[i];
+          }
+          sandwich(t.g, t.alpha, 3, kernels, transformed);
+          for (int64_t pos = 0; pos < points; pos++) {
+            std::copy_n(transformed + pos * kLanes, lanes,
+                        u.data() + (pos * g.channels + c) * g.outputs + m0);
+          }
+        }
+      }
+      for (int64_t pos = 0; pos < points; pos++) {
+        packed_.emplace_back(u.data() + pos * g.channels * g.outputs,
+                             g.channels, g.outputs, g.outputs, 1);
+      }
+      break;
+    }
+  }
+}
+
+void ConvWeights::run(const ncnn::Mat& input, int64_t batch, int64_t height,
+                      int64_t width, ncnn::Mat* output,
+                      const KernelContext& ctx) const {
+  ConvGeometry geometry = geometry_.resolved(height, width);
+  switch (algorithm_) {
+    case ConvAlgorithm::kDepthwise:
+      runDepthwise(input, geometry, batch, height, width, output, ctx);
+      break;
+    case ConvAlgorithm::kWinograd43:
+    case ConvAlgorithm::kWinograd63:
+      runWinograd(input, geometry, batch, height, width, output, ctx);
+      break;
+    default:
+      runGemm(input, geometry, batch, height, width, output, ctx);
+      break;
+  }
+}
+
+void ConvWeights::runDepthwise(const ncnn::Mat& input,
+                               const ConvGeometry& geometry, int64_t batch,
+                               int64_t height, int64_t width,
+                               ncnn::Mat* output,
+                               const KernelContext& ctx) const {
+  const float* w = depthwise_.data();
+  const float* b = bias_.data();
+  switch (elempack_) {
+    case 4:
+      depthwise<4>(w, b, input, geometry, batch, height, width, output, ctx);
+      break;
+    case 8:
+      depthwise<8>(w, b, input, geometry, batch, height, width, output, ctx);
+      break;
+    case 16:
+      depthwise<16>(w, b, input, geometry, batch, height, width, output,
+                    ctx);
+      break;
+    default:
+      depthwise<1>(w, b, input, geometry, batch, height, width, output, ctx);
+      break;
+  }
+}
+
+// Y = W * X per group, for X the input or its patches packed as B a block
+// of pixels at a time, so the micro-kernels store rows of pixels of the
+// output channels directly.
+void ConvWeights::runGemm(const ncnn::Mat& input, const ConvGeometry& g,
+                          int64_t batch, int64_t height, int64_t width,
+                          ncnn::Mat* output, const KernelContext& ctx) const {
+  int64_t out_h = g.outputHeight(height);
+  int64_t out_w = g.outputWidth(width);
+  int64_t pixels = out_h * out_w;
+  int64_t in_cstep = static_cast<int64_t>(input.cstep);
+  int64_t out_cstep = static_cast<int64_t>(output->cstep);
+  int64_t group_channels = g.channels / g.groups;
+  int64_t group_outputs = g.outputs / g.groups;
+  int64_t kernel_size = g.kernel_h * g.kernel_w;
+  int64_t k = group_channels * kernel_size;
+  // the bias, which the GEMMs add to
+  ctx.parallelFor(static_cast<size_t>(batch * g.outputs),
+                  [&](size_t begin, size_t end) {
+                    for (size_t q = begin; q < end; q++) {
+                      float* y = output->channel(static_cast<int>(q));
+                      std::fill_n(y, pixels, bias_[q % g.outputs]);
+                    }
+                  });
+  ncnn::Mat columns;
+  if (algorithm_ == ConvAlgorithm::kIm2col) {
+    columns.create(static_cast<int>(std::min(pixels, kIm2colPixels) * k),
+                   size_t{4}, ctx.allocator());
+  }
+  for (int64_t n = 0; n < batch; n++) {
+    for (int64_t group = 0; group < g.groups; group++) {
+      const float* x =
+          input.channel(static_cast<int>(n * g.channels +
+                                         group * group_channels));
+      float* y = output->channel(
+          static_cast<int>(n * g.outputs + group * group_outputs));
+      const PackedGemmA& w = group_weights_[group];
+      for (int64_t p0 = 0; p0 < pixels; p0 += kIm2colPixels) {
+        int64_t count = std::min(kIm2colPixels, pixels - p0);
+        if (algorithm_ == ConvAlgorithm::kGemm1x1) {
+          PackedGemmB b(x + p0, k, count, in_cstep, 1, ctx);
+          Sgemm(w, b, y + p0, out_cstep, 1, true, ctx, blocking_);
+          continue;
+        }
+        float* cols = columns;
+        // row i of the patches of pixels [p0, p0 + count)
+        ctx.parallelFor(static_cast<size_t>(k), [&](size_t begin,
+                                                    size_t end) {
+          for (size_t i = begin; i < end; i++) {
+            int64_t c = static_cast<int64_t>(i) / kernel_size;
+            int64_t ky = static_cast<int64_t>(i) % kernel_size / g.kernel_w;
+            int64_t kx = static_cast<int64_t>(i) % g.kernel_w;
+            const float* plane = x + c * in_cstep;
+            float* row = cols + i * count;
+            // output row by output row, from pixel p0
+            int64_t oy = p0 / out_w, ox = p0 % out_w;
+            for (int64_t j = 0; j < count; oy++, ox = 0) {
+              int64_t run = std::min(count - j, out_w - ox);
+              int64_t iy = oy * g.stride_h - g.pad_top + ky * g.dilation_h;
+              if (iy < 0 || iy >= height) {
+                std::fill_n(row + j, run, 0.f);
+                j += run;
+                continue;
+              }
+              const float* in = plane + iy * width;
+              int64_t ix = ox * g.stride_w - g.pad_left + kx * g.dilation_w;
+              for (int64_t e = 0; e < run; e++, ix += g.stride_w) {
+                row[j + e] = ix >= 0 && ix < width ? in[ix] : 0.f;
+              }
+              j += run;
+            }
+          }
+        });
+        PackedGemmB b(cols, k, count, count, 1, ctx);
+        Sgemm(w, b, y + p0, out_cstep, 1, true, ctx, blocking_);
+      }
+    }
+  }
+}
+
+// Tiles of the input transformed to V = B^T d B, then for each of the
+// alpha * alpha points M = V * U over the channels as a GEMM of tiles x
+// channels, and the tiles of the output A^T M A.
+void ConvWeights::runWinograd(const ncnn::Mat& input, const ConvGeometry& g,
+                              int64_t batch, int64_t height, int64_t width,
+                              ncnn::Mat* output,
+                              const KernelContext& ctx) const {
+  const WinogradTransform& t = winogradOf(algorithm_);
+  int r = t.r, alpha = t.alpha, points = alpha * alpha;
+  int64_t out_h = g.outputHeight(height);
+  int64_t out_w = g.outputWidth(width);
+  int64_t tiles_w = (out_w + r - 1) / r;
+  int64_t tiles = (out_h + r - 1) / r * tiles_w;
+  int64_t channels = g.channels, outputs = g.outputs;
+  int64_t in_cstep = static_cast<int64_t>(input.cstep);
+  int64_t out_cstep = static_cast<int64_t>(output->cstep);
+  // [points][tiles][channels] and [points][tiles][outputs]
+  ncnn::Mat v(static_cast<int>(tiles * channels), points, size_t{4},
+              ctx.allocator());
+  ncnn::Mat m(static_cast<int>(tiles * outputs), points, size_t{4},
+              ctx.allocator());
+  for (int64_t n = 0; n < batch; n++) {
+    const float* x = input.channel(static_cast<int>(n * channels));
+    float* y = output->channel(static_cast<int>(n * outputs));
+    ctx.parallelFor(static_cast<size_t>(tiles), [&](size_t begin,
+                                                     size_t end) {
+      float d[8 * 8 * kLanes], transformed[8 * 8 * kLanes];
+      for (size_t tile = begin; tile < end; tile++) {
+        int64_t y0 = static_cast<int64_t>(tile) / tiles_w * r - g.pad_top;
+        int64_t x0 = static_cast<int64_t>(tile) % tiles_w * r - g.pad_left;
+        for (int64_t c0 = 0; c0 < channels; c0 += kLanes) {
+          int lanes =
+              static_cast<int>(std::min<int64_t>(kLanes, channels - c0));
+          std::fill_n(d, alpha * alpha * kLanes, 0.f);
+          for (int l = 0; l < lanes; l++) {
+            const float* plane = x + (c0 + l) * in_cstep;
+            for (int i = 0; i < alpha; i++) {
+              int64_t iy = y0 + i;
+              if (iy < 0 || iy >= height) continue;
+              for (int j = 0; j < alpha; j++) {
+                int64_t ix = x0 + j;
+                if (ix < 0 || ix >= width) continue;
+                d[(i * alpha + j) * kLanes + l] = plane[iy * width + ix];
+              }
+            }
+          }
+          sandwich(t.bt, alpha, alpha, d, transformed);
+          for (int pos = 0; pos < points; pos++) {
+            std::copy_n(transformed + pos * kLanes, lanes,
+                        v.row(pos) + tile * channels + c0);
+          }
+        }
+      }
+    });
+    ctx.parallelFor(static_cast<size_t>(points), [&](size_t begin,
+                                                      size_t end) {
+      for (size_t pos = begin; pos < end; pos++) {
+        int row = static_cast<int>(pos);
+        Sgemm(tiles, v.row(row), channels, 1, 1.f, packed_[pos], m.row(row),
+              outputs, 1, false, ctx, blocking_);
+      }
+    });
+    ctx.parallelFor(static_cast<size_t>(tiles), [&](size_t begin,
+                                                     size_t end) {
+      float product[8 * 8 * kLanes], tile_out[6 * 6 * kLanes];
+      for (size_t tile = begin; tile < end; tile++) {
+        int64_t oy0 = static_cast<int64_t>(tile) / tiles_w * r;
+        int64_t ox0 = static_cast<int64_t>(tile) % tiles_w * r;
+        int64_t rows = std::min<int64_t>(r, out_h - oy0);
+        int64_t cols = std::min<int64_t>(r, out_w - ox0);
+        for (int64_t o0 = 0; o0 < outputs; o0 += kLanes) {
+          int lanes =
+              static_cast<int>(std::min<int64_t>(kLanes, outputs - o0));
+          for (int pos = 0; pos < points; pos++) {
+            const float* values = m.row(pos) + tile * outputs + o0;
+            float* lane = product + pos * kLanes;
+            std::copy_n(values, lanes, lane);
+            std::fill(lane + lanes, lane + kLanes, 0.f);
+          }
+          sandwich(t.at, r, alpha, product, tile_out);
+          for (int l = 0; l < lanes; l++) {
+            float* plane = y + (o0 + l) * out_cstep;
+            float bias = bias_[o0 + l];
+            for (int64_t i = 0; i < rows; i++) {
+              for (int64_t j = 0; j < cols; j++) {
+                plane[(oy0 + i) * out_w + ox0 + j] =
+                    tile_out[(i * r + j) * kLanes + l] + bias;
+              }
+            }
+          }
+        }
+      }
+    });
+  }
+}
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ncnn/mat.h"
+#include "runtime/gemm.h"
+#include "runtime/kernel.h"
+
+namespace my_ai_training::runtime {
+
+// The geometry of a 2-D convolution; 1-D ones have kernels of height 1.
+struct ConvGeometry {
+  int64_t channels = 0;
+  int64_t outputs = 0;
+  int64_t groups = 1;
+  int64_t kernel_h = 1;
+  int64_t kernel_w = 1;
+  int64_t stride_h = 1;
+  int64_t stride_w = 1;
+  int64_t dilation_h = 1;
+  int64_t dilation_w = 1;
+  int64_t pad_top = 0;
+  int64_t pad_left = 0;
+  int64_t pad_bottom = 0;
+  int64_t pad_right = 0;
+  // ONNX's auto_pad: NOTSET keeps the pads, the others set them per input
+  std::string auto_pad = "NOTSET";
+
+  bool isDepthwise() const {
+    return groups > 1 && groups == channels && groups == outputs;
+  }
+  // with the pads auto_pad gives an input of 'height' x 'width'
+  ConvGeometry resolved(int64_t height, int64_t width) const;
+  // extents of the output of a resolved() geometry, or -1 if unknown
+  int64_t outputHeight(int64_t height) const;
+  int64_t outputWidth(int64_t width) const;
+};
+
+// The attributes of a Conv node, empty when absent.
+struct ConvAttributes {
+  std::vector<int64_t> kernel_shape;
+  std::vector<int64_t> strides;
+  std::vector<int64_t> dilations;
+  std::vector<int64_t> pads;
+  int64_t group = 1;
+  std::string auto_pad = "NOTSET";
+};
+
+ConvAttributes ConvAttributesOf(const ir::Node& node);
+
+// The geometry of a Conv with weights of 'w_sizes', or false if it is not
+// one of 1 or 2 spatial dims or the attributes do not fit.
+bool ConvGeometryOf(const ConvAttributes& attrs,
+                    const std::vector<int64_t>& w_sizes,
+                    ConvGeometry* geometry);
+
+// The ways a layer can be computed.
+enum class ConvAlgorithm {
+  // per channel, on inputs in any elempack
+  kDepthwise,
+  // a GEMM reading the input in place, for 1x1 kernels of stride 1
+  kGemm1x1,
+  // a GEMM on patches of the input gathered into columns
+  kIm2col,
+  // Winograd F(4x4, 3x3) and F(6x6, 3x3): 3x3 kernels of stride 1 as
+  // 36 or 64 GEMMs in the transformed domain
+  kWinograd43,
+  kWinograd63,
+};
+
+// whether 'algorithm' computes layers of 'geometry'
+bool ConvSupports(ConvAlgorithm algorithm, const ConvGeometry& geometry);
+
+// The algorithm a layer runs when none was tuned for it: depthwise kernels
+// for depthwise layers, the input as it is for pointwise ones, Winograd
+// for 3x3 ones with enough channels to amortize the transforms, F(6x6) on
+// outputs of at least 16 x 16, and im2col otherwise. The output extents
+// may be -1 if unknown.
+ConvAlgorithm DefaultConvAlgorithm(const ConvGeometry& geometry,
+                                   int64_t output_h, int64_t output_w);
+
+// The weights of a layer transformed for its algorithm once, so runs only
+// transform activations: packed as A of a GEMM per group, or as B per
+// point of the Winograd domain, or interleaved per elempack for depthwise
+// layers.
+class ConvWeights {
+ public:
+  // 'weights' is [outputs, channels / groups, kernel_h, kernel_w] and
+  // 'bias' [outputs] or null. 'elempack' is the layout depthwise layers
+  // run in; the others run unpacked, their GEMMs in blocks of 'blocking'.
+  ConvWeights(const ConvGeometry& geometry, ConvAlgorithm algorithm,
+              const float* weights, const float* bias, int elempack = 1,
+              const GemmBlocking& blocking = GemmBlocking());
+
+  const ConvGeometry& geometry() const { return geometry_; }
+  ConvAlgorithm algorithm() const { return algorithm_; }
+  int elempack() const { return elempack_; }
+  const GemmBlocking& blocking() const { return blocking_; }
+
+  // Convolves 'input', 'batch' tensors of [channels, height, width] in
+  // elempack(), into 'output', allocated for [batch, outputs, out_h,
+  // out_w] in elempack(), on the intra-op pool of 'ctx'.
+  void run(const ncnn::Mat& input, int64_t batch, int64_t height,
+           int64_t width, ncnn::Mat* output, const KernelContext& ctx) const;
+
+ private:
+  void runDepthwise(const ncnn::Mat& input, const ConvGeometry& geometry,
+                    int64_t batch, int64_t height, int64_t width,
+                    ncnn::Mat* output, const KernelContext& ctx) const;
+  void runGemm(const ncnn::Mat& input, const ConvGeometry& geometry,
+               int64_t batch, int64_t height, int64_t width,
+               ncnn::Mat* output, const KernelContext& ctx) const;
+  void runWinograd(const ncnn::Mat& input, const ConvGeometry& geometry,
+                   int64_t batch, int64_t height, int64_t width,
+                   ncnn::Mat* output, const KernelContext& ctx) const;
+
+  ConvGeometry geometry_;
+  ConvAlgorithm algorithm_;
+  int elempack_;
+  GemmBlocking blocking_;
+  // A of the GEMM of each group for the 1x1 and im2col algorithms,
+  // [outputs / groups, channels / groups * kernel_h * kernel_w]
+  std::vector<PackedGemmA> group_weights_;
+  // B of the GEMM of each point of the Winograd domain
+  std::vector<PackedGemmB> packed_;
+  // [channels / elempack, kernel_h * kernel_w, elempack]
+  std::vector<float> depthwise_;
+  // one per output, zeros without a bias
+  std::vector<float> bias_;
+};
+
+}  // namespace my_ai_training::runtime
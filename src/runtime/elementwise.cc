@@ -0,0 +1,327 @@
+#include "runtime/elementwise.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "ncnn/cpu.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MY_AI_TRAINING_ELEMENTWISE_X86 1
+#include <immintrin.h>
+#else
+#define MY_AI_TRAINING_ELEMENTWISE_X86 0
+#endif
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+// e^x = 2^n * e^r for n = round(x / ln 2), with r in [-ln 2 / 2, ln 2 / 2]
+// from x - n * ln 2 in two steps, and e^r from a polynomial. 2^n is two
+// factors, so results near the ends of the range of float stay exact
+// rather than overflow in the scale.
+constexpr float kExpMin = -104.f;
+constexpr float kExpMax = 88.73f;
+constexpr float kLog2e = 1.44269504088896341f;
+constexpr float kLn2Hi = 0.693359375f;
+constexpr float kLn2Lo = -2.12194440e-4f;
+constexpr float kExpP[6] = {1.9875691500e-4f, 1.3981999507e-3f,
+                            8.3334519073e-3f, 4.1665795894e-2f,
+                            1.6666665459e-1f, 5.0000001201e-1f};
+// tanh(x) = x + x^3 * P(x^2) below kTanhSmall, 1 - 2 / (e^2|x| + 1) with
+// the sign of x above, which is 1 in float from kTanhMax on
+constexpr float kTanhSmall = 0.625f;
+constexpr float kTanhMax = 10.f;
+constexpr float kTanhP[5] = {-5.70498872745e-3f, 2.06390887954e-2f,
+                             -5.37397155531e-2f, 1.33314422036e-1f,
+                             -3.33332819422e-1f};
+
+float powerOfTwo(int32_t n) {
+  int32_t bits = (n + 127) << 23;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+float expGeneric(float x) {
+  if (std::isnan(x)) return x;
+  x = std::min(std::max(x, kExpMin), kExpMax);
+  float fn = std::floor(x * kLog2e + 0.5f);
+  float r = x - fn * kLn2Hi - fn * kLn2Lo;
+  float p = kExpP[0];
+  for (int i = 1; i < 6; i++) p = p * r + kExpP[i];
+  float y = p * r * r + r + 1.f;
+  int32_t n = static_cast<int32_t>(fn);
+  int32_t half = n >> 1;
+  return y * powerOfTwo(half) * powerOfTwo(n - half);
+}
+
+float tanhGeneric(float x) {
+  float a = std::fabs(x);
+  if (a < kTanhSmall) {
+    float z = x * x;
+    float p = kTanhP[0];
+    for (int i = 1; i < 5; i++) p = p * z + kTanhP[i];
+    return x + x * z * p;
+  }
+  float t = 1.f - 2.f / (expGeneric(2.f * std::min(a, kTanhMax)) + 1.f);
+  return std::copysign(t, x);
+}
+
+void expGenericArray(const float* x, float* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) y[i] = expGeneric(x[i]);
+}
+
+void sigmoidGenericArray(const float* x, float* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) y[i] = 1.f / (1.f + expGeneric(-x[i]));
+}
+
+void tanhGenericArray(const float* x, float* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) y[i] = tanhGeneric(x[i]);
+}
+
+#if MY_AI_TRAINING_ELEMENTWISE_X86
+
+// The same steps on 8 lanes. The clamps take x second, so NaNs pass
+// through them.
+__attribute__((target("avx2,fma"))) __m256 exp8(__m256 x) {
+  x = _mm256_min_ps(_mm256_set1_ps(kExpMax),
+                    _mm256_max_ps(_mm256_set1_ps(kExpMin), x));
+  __m256 fn = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(kLog2e),
+                                              _mm256_set1_ps(0.5f)));
+  __m256 r = _mm256_fnmadd_ps(fn, _mm256_set1_ps(kLn2Hi), x);
+  r = _mm256_fnmadd_ps(fn, _mm256_set1_ps(kLn2Lo), r);
+  __m256 p = _mm256_set1_ps(kExpP[0]);
+  for (int i = 1; i < 6; i++) {
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP[i]));
+  }
+  __m256 y = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r,
+                             _mm256_add_ps(r, _mm256_set1_ps(1.f)));
+  __m256i n = _mm256_cvttps_epi32(fn);
+  __m256i half = _mm256_srai_epi32(n, 1);
+  __m256i bias = _mm256_set1_epi32(127);
+  __m256 scale1 = _mm256_castsi256_ps(
+      _mm256_slli_epi32(_mm256_add_epi32(half, bias), 23));
+  __m256 scale2 = _mm256_castsi256_ps(_mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_sub_epi32(n, half), bias), 23));
+  return _mm256_mul_ps(_mm256_mul_ps(y, scale1), scale2);
+}
+
+__attribute__((target("avx2,fma"))) __m256 sigmoid8(__m256 x) {
+  __m256 one = _mm256_set1_ps(1.f);
+  __m256 e = exp8(_mm256_sub_ps(_mm256_setzero_ps(), x));
+  return _mm256_div_ps(one, _mm256_add_ps(one, e));
+}
+
+__attribute__((target("avx2,fma"))) __m256 tanh8(__m256 x) {
+  __m256 sign = _mm256_set1_ps(-0.f);
+  __m256 a = _mm256_andnot_ps(sign, x);
+  __m256 z = _mm256_mul_ps(x, x);
+  __m256 p = _mm256_set1_ps(kTanhP[0]);
+  for (int i = 1; i < 5; i++) {
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(kTanhP[i]));
+  }
+  __m256 small = _mm256_fmadd_ps(_mm256_mul_ps(x, z), p, x);
+  __m256 one = _mm256_set1_ps(1.f);
+  __m256 e = exp8(_mm256_mul_ps(
+      _mm256_set1_ps(2.f), _mm256_min_ps(_mm256_set1_ps(kTanhMax), a)));
+  __m256 large = _mm256_sub_ps(
+      one, _mm256_div_ps(_mm256_set1_ps(2.f), _mm256_add_ps(e, one)));
+  large = _mm256_or_ps(large, _mm256_and_ps(sign, x));
+  __m256 is_small =
+      _mm256_cmp_ps(a, _mm256_set1_ps(kTanhSmall), _CMP_LT_OQ);
+  return _mm256_blendv_ps(large, small, is_small);
+}
+
+// f over whole vectors, and the tail through masked loads and stores
+template <__m256 (*F)(__m256)>
+__attribute__((target("avx2,fma"))) void mapAvx2(const float* x, float* y,
+                                                 int64_t n) {
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) _mm256_storeu_ps(y + i, F(_mm256_loadu_ps(x + i)));
+  if (i == n) return;
+  __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(int(n - i)),
+                                    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  _mm256_maskstore_ps(y + i, mask, F(_mm256_maskload_ps(x + i, mask)));
+}
+
+// GCC 12's AVX-512 intrinsics pass _mm512_undefined_*() as the unused
+// merge source, which -Wmaybe-uninitialized reports once inlined here
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__((target("avx512f"))) __m512 exp16(__m512 x) {
+  x = _mm512_min_ps(_mm512_set1_ps(kExpMax),
+                    _mm512_max_ps(_mm512_set1_ps(kExpMin), x));
+  __m512 fn = _mm512_roundscale_ps(
+      _mm512_fmadd_ps(x, _mm512_set1_ps(kLog2e), _mm512_set1_ps(0.5f)),
+      _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  __m512 r = _mm512_fnmadd_ps(fn, _mm512_set1_ps(kLn2Hi), x);
+  r = _mm512_fnmadd_ps(fn, _mm512_set1_ps(kLn2Lo), r);
+  __m512 p = _mm512_set1_ps(kExpP[0]);
+  for (int i = 1; i < 6; i++) {
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kExpP[i]));
+  }
+  __m512 y = _mm512_fmadd_ps(_mm512_mul_ps(p, r), r,
+                             _mm512_add_ps(r, _mm512_set1_ps(1.f)));
+  __m512i n = _mm512_cvttps_epi32(fn);
+  __m512i half = _mm512_srai_epi32(n, 1);
+  __m512i bias = _mm512_set1_epi32(127);
+  __m512 scale1 = _mm512_castsi512_ps(
+      _mm512_slli_epi32(_mm512_add_epi32(half, bias), 23));
+  __m512 scale2 = _mm512_castsi512_ps(_mm512_slli_epi32(
+      _mm512_add_epi32(_mm512_sub_epi32(n, half), bias), 23));
+  return _mm512_mul_ps(_mm512_mul_ps(y, scale1), scale2);
+}
+
+__attribute__((target("avx512f"))) __m512 sigmoid16(__m512 x) {
+  __m512 one = _mm512_set1_ps(1.f);
+  __m512 e = exp16(_mm512_sub_ps(_mm512_setzero_ps(), x));
+  return _mm512_div_ps(one, _mm512_add_ps(one, e));
+}
+
+__attribute__((target("avx512f"))) __m512 tanh16(__m512 x) {
+  __m512 a = _mm512_abs_ps(x);
+  __m512 z = _mm512_mul_ps(x, x);
+  __m512 p = _mm512_set1_ps(kTanhP[0]);
+  for (int i = 1; i < 5; i++) {
+    p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(kTanhP[i]));
+  }
+  __m512 small = _mm512_fmadd_ps(_mm512_mul_ps(x, z), p, x);
+  __m512 one = _mm512_set1_ps(1.f);
+  __m512 e = exp16(_mm512_mul_ps(
+      _mm512_set1_ps(2.f), _mm512_min_ps(_mm512_set1_ps(kTanhMax), a)));
+  __m512 large = _mm512_sub_ps(
+      one, _mm512_div_ps(_mm512_set1_ps(2.f), _mm512_add_ps(e, one)));
+  // large takes the sign of x, and small already has it
+  __mmask16 negative =
+      _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_LT_OQ);
+  large = _mm512_mask_blend_ps(negative, large,
+                               _mm512_sub_ps(_mm512_setzero_ps(), large));
+  __mmask16 is_small =
+      _mm512_cmp_ps_mask(a, _mm512_set1_ps(kTanhSmall), _CMP_LT_OQ);
+  return _mm512_mask_blend_ps(is_small, large, small);
+}
+
+template <__m512 (*F)(__m512)>
+__attribute__((target("avx512f"))) void mapAvx512(const float* x, float* y,
+                                                  int64_t n) {
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(y + i, F(_mm512_loadu_ps(x + i)));
+  }
+  if (i == n) return;
+  __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1);
+  _mm512_mask_storeu_ps(y + i, mask, F(_mm512_maskz_loadu_ps(mask, x + i)));
+}
+
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif  // MY_AI_TRAINING_ELEMENTWISE_X86
+
+struct VectorFunctions {
+  void (*exp)(const float*, float*, int64_t);
+  void (*sigmoid)(const float*, float*, int64_t);
+  void (*tanh)(const float*, float*, int64_t);
+};
+
+const VectorFunctions& vectorFunctions() {
+  static const VectorFunctions functions = []() -> VectorFunctions {
+#if MY_AI_TRAINING_ELEMENTWISE_X86
+    if (ncnn::cpu_support_x86_avx512()) {
+      return {mapAvx512<exp16>, mapAvx512<sigmoid16>, mapAvx512<tanh16>};
+    }
+    if (ncnn::cpu_support_x86_avx2() && ncnn::cpu_support_x86_fma()) {
+      return {mapAvx2<exp8>, mapAvx2<sigmoid8>, mapAvx2<tanh8>};
+    }
+#endif
+    return {expGenericArray, sigmoidGenericArray, tanhGenericArray};
+  }();
+  return functions;
+}
+
+}  // namespace
+
+void VectorExp(const float* x, float* y, int64_t n) {
+  vectorFunctions().exp(x, y, n);
+}
+
+void VectorSigmoid(const float* x, float* y, int64_t n) {
+  vectorFunctions().sigmoid(x, y, n);
+}
+
+void VectorTanh(const float* x, float* y, int64_t n) {
+  vectorFunctions().tanh(x, y, n);
+}
+
+bool Broadcast::init(const std::vector<int64_t>& a,
+                     const std::vector<int64_t>& b) {
+  size_t rank = std::max(a.size(), b.size());
+  // the operands padded with leading 1s to the rank of the output
+  std::vector<int64_t> padded[2] = {std::vector<int64_t>(rank, 1),
+                                    std::vector<int64_t>(rank, 1)};
+  std::copy(a.begin(), a.end(), padded[0].end() - a.size());
+  std::copy(b.begin(), b.end(), padded[1].end() - b.size());
+  sizes_.assign(rank, 1);
+  for (size_t d = 0; d < rank; d++) {
+    int64_t x = padded[0][d], y = padded[1][d];
+    if (x != y && x != 1 && y != 1) return false;
+    sizes_[d] = x == 1 ? y : x;
+  }
+
+  // The runs start at the first dim from which each operand either
+  // advances or repeats, and within the channel planes of the tensors that
+  // Mats store in channels.
+  size_t lowest = 0;
+  for (size_t r : {rank, a.size(), b.size()}) {
+    if (r >= 3 && r <= 5) lowest = std::max(lowest, rank - r + 2);
+  }
+  // -1 while only dims of extent 1 were seen
+  int state[2] = {-1, -1};
+  size_t start = rank;
+  while (start > lowest) {
+    size_t d = start - 1;
+    if (sizes_[d] != 1) {
+      bool fits = true;
+      for (int i = 0; i < 2; i++) {
+        int advances = padded[i][d] != 1 ? 1 : 0;
+        if (state[i] >= 0 && state[i] != advances) fits = false;
+      }
+      if (!fits) break;
+      for (int i = 0; i < 2; i++) state[i] = padded[i][d] != 1 ? 1 : 0;
+    }
+    start = d;
+  }
+  row_size_ = 1;
+  for (size_t d = start; d < rank; d++) row_size_ *= sizes_[d];
+  outer_sizes_.assign(sizes_.begin(), sizes_.begin() + start);
+  rows_ = 1;
+  for (int64_t extent : outer_sizes_) rows_ *= extent;
+  for (int i = 0; i < 2; i++) {
+    advances_[i] = state[i] != 0;
+    outer_strides_[i].assign(start, 0);
+    int64_t stride = 1;
+    for (size_t d = rank; d-- > 0;) {
+      if (d < start && padded[i][d] != 1) outer_strides_[i][d] = stride;
+      stride *= padded[i][d];
+    }
+  }
+  return true;
+}
+
+int64_t Broadcast::operandIndex(int i, int64_t row) const {
+  int64_t index = 0;
+  for (size_t d = outer_sizes_.size(); d-- > 0;) {
+    index += row % outer_sizes_[d] * outer_strides_[i][d];
+    row /= outer_sizes_[d];
+  }
+  return index;
+}
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace my_ai_training::runtime {
+
+// y[i] = e^x[i], 1 / (1 + e^-x[i]) and tanh(x[i]) for 'n' floats, where
+// 'y' may be 'x'. The Cephes polynomials, within a few ulp over the range
+// of float, in AVX-512 or AVX2 and FMA when the CPU has them.
+void VectorExp(const float* x, float* y, int64_t n);
+void VectorSigmoid(const float* x, float* y, int64_t n);
+void VectorTanh(const float* x, float* y, int64_t n);
+
+// The numpy broadcast of two tensors, as runs of elements that each tensor
+// holds contiguously when stored unpacked in a Mat: the output is rows()
+// runs of rowSize() elements, along which an operand either advances or
+// repeats one element. Runs never cross the channels of a Mat.
+class Broadcast {
+ public:
+  // false if 'a' and 'b' do not broadcast
+  bool init(const std::vector<int64_t>& a, const std::vector<int64_t>& b);
+
+  const std::vector<int64_t>& sizes() const { return sizes_; }
+  int64_t rows() const { return rows_; }
+  int64_t rowSize() const { return row_size_; }
+  // whether operand 'i', 0 for a and 1 for b, advances along a run
+  bool advances(int i) const { return advances_[i]; }
+  // the index of the first element of run 'row' in the row-major order of
+  // operand 'i'
+  int64_t operandIndex(int i, int64_t row) const;
+
+ private:
+  std::vector<int64_t> sizes_;
+  // the dims before the runs, with the strides of each operand there, 0
+  // where it broadcasts
+  std::vector<int64_t> outer_sizes_;
+  std::vector<int64_t> outer_strides_[2];
+  int64_t rows_ = 0;
+  int64_t row_size_ = 1;
+  bool advances_[2] = {false, false};
+};
+
+// y = op(a, b) over a run of 'n' elements, in loops the compiler
+// vectorizes; an operand that does not advance repeats its first element.
+// 'y' may be an operand that advances.
+template <typename Op>
+void BinaryRun(const Op& op, const float* a, bool a_advances, const float* b,
+               bool b_advances, float* y, int64_t n) {
+  if (a_advances && b_advances) {
+    for (int64_t i = 0; i < n; i++) y[i] = op(a[i], b[i]);
+  } else if (a_advances) {
+    float b0 = *b;
+    for (int64_t i = 0; i < n; i++) y[i] = op(a[i], b0);
+  } else if (b_advances) {
+    float a0 = *a;
+    for (int64_t i = 0; i < n; i++) y[i] = op(a0, b[i]);
+  } else {
+    float y0 = op(*a, *b);
+    for (int64_t i = 0; i < n; i++) y[i] = y0;
+  }
+}
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "ncnn/mat.h"
+#include "runtime/elementwise.h"
+#include "runtime/kernels.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+constexpr int32_t kFloat = ir::TensorProto_DataType_FLOAT;
+
+// floats of a channel a task of the intra-op pool works on at least
+constexpr int64_t kBlock = 16384;
+
+int64_t numel(const std::vector<int64_t>& sizes) {
+  int64_t n = 1;
+  for (int64_t extent : sizes) n *= extent;
+  return n;
+}
+
+float* channelData(const ncnn::Mat& m, int64_t q) {
+  return reinterpret_cast<float*>(static_cast<unsigned char*>(m.data) +
+                                  m.cstep * q * m.elemsize);
+}
+
+// Calls fn(q, begin, end) on ranges of the floats of channel q, covering
+// those of every channel of Mats of the shape and layout of 'like'.
+template <typename F>
+void forEachSpan(const ncnn::Mat& like, const KernelContext& ctx, F fn) {
+  int64_t channels = like.dims >= 3 ? like.c : 1;
+  int64_t plane = static_cast<int64_t>(like.w) * like.h * like.d *
+                  like.elempack;
+  int64_t blocks = (plane + kBlock - 1) / kBlock;
+  ctx.parallelFor(static_cast<size_t>(channels * blocks),
+                  [&](size_t begin, size_t end) {
+                    for (size_t t = begin; t < end; t++) {
+                      int64_t q = static_cast<int64_t>(t) / blocks;
+                      int64_t first = static_cast<int64_t>(t) % blocks *
+                                      kBlock;
+                      fn(q, first, std::min(plane, first + kBlock));
+                    }
+                  });
+}
+
+struct AddOp {
+  float operator()(float a, float b) const { return a + b; }
+};
+struct SubOp {
+  float operator()(float a, float b) const { return a - b; }
+};
+struct MulOp {
+  float operator()(float a, float b) const { return a * b; }
+};
+struct DivOp {
+  float operator()(float a, float b) const { return a / b; }
+};
+struct PowOp {
+  float operator()(float a, float b) const {
+    return b == 2.f ? a * a : std::pow(a, b);
+  }
+};
+struct PReluOp {
+  float operator()(float x, float slope) const {
+    return x < 0.f ? x * slope : x;
+  }
+};
+
+// Y = op(A, B) for inputs of the output's shape and layout, or scalars:
+// the layouts assign_layouts packs these ops in, and the common case
+// unpacked. Writes over an input where it can. False if the inputs are
+// not of that kind.
+template <typename Op>
+bool binarySameShape(const Instruction& inst, KernelContext& ctx,
+                     const std::vector<int64_t>& sizes) {
+  const SlotValue& a = ctx.input(inst, 0);
+  const SlotValue& b = ctx.input(inst, 1);
+  int elempack = ctx.outputInfo(inst, 0).elempack;
+  bool a_full = a.sizes == sizes && a.mat.elempack == elempack;
+  bool b_full = b.sizes == sizes && b.mat.elempack == elempack;
+  if ((!a_full && (numel(a.sizes) != 1 || a.mat.elempack != 1)) ||
+      (!b_full && (numel(b.sizes) != 1 || b.mat.elempack != 1))) {
+    return false;
+  }
+  size_t in_place = a_full && ctx.canOverwriteInput(inst, 0) ? 0 : 1;
+  ncnn::Mat& y = ctx.createOutputInPlace(inst, 0, in_place, sizes, kFloat);
+  forEachSpan(y, ctx, [&](int64_t q, int64_t begin, int64_t end) {
+    const float* a_data = a_full ? channelData(a.mat, q) + begin
+                                 : static_cast<const float*>(a.mat.data);
+    const float* b_data = b_full ? channelData(b.mat, q) + begin
+                                 : static_cast<const float*>(b.mat.data);
+    BinaryRun(Op(), a_data, a_full, b_data, b_full,
+              channelData(y, q) + begin, end - begin);
+  });
+  return true;
+}
+
+// Y = op(A, B) broadcast, on unpacked copies of packed inputs, in runs of
+// elements along which each input advances or repeats one.
+template <typename Op>
+bool binaryBroadcast(const Instruction& inst, KernelContext& ctx,
+                     const Broadcast& broadcast) {
+  const SlotValue& a = ctx.input(inst, 0);
+  const SlotValue& b = ctx.input(inst, 1);
+  const std::vector<int64_t>& sizes = broadcast.sizes();
+  int elempack = ctx.outputInfo(inst, 0).elempack;
+  ncnn::Mat output;
+  if (elempack == 1) {
+    size_t in_place = a.sizes == sizes && ctx.canOverwriteInput(inst, 0)
+                          ? 0
+                          : 1;
+    output = ctx.createOutputInPlace(inst, 0, in_place, sizes, kFloat);
+  } else {
+    CreateMat(sizes, sizeof(float), 1, ctx.allocator(), &output);
+  }
+  ncnn::Mat a_mat = a.mat, b_mat = b.mat;
+  if (a_mat.elempack != 1) {
+    ncnn::convert_packing(a.mat, a_mat, 1, ctx.allocator());
+  }
+  if (b_mat.elempack != 1) {
+    ncnn::convert_packing(b.mat, b_mat, 1, ctx.allocator());
+  }
+  if (broadcast.rows() * broadcast.rowSize() > 0) {
+    int64_t row_size = broadcast.rowSize();
+    ctx.parallelFor(
+        static_cast<size_t>(broadcast.rows()),
+        [&](size_t begin, size_t end) {
+          for (size_t r = begin; r < end; r++) {
+            int64_t row = static_cast<int64_t>(r);
+            BinaryRun(Op(),
+                      static_cast<const float*>(ElementData(
+                          a_mat, a.sizes, broadcast.operandIndex(0, row))),
+                      broadcast.advances(0),
+                      static_cast<const float*>(ElementData(
+                          b_mat, b.sizes, broadcast.operandIndex(1, row))),
+                      broadcast.advances(1),
+                      static_cast<float*>(
+                          ElementData(output, sizes, row * row_size)),
+                      row_size);
+          }
+        },
+        IntraOpPool::Schedule::kStatic,
+        static_cast<size_t>(std::max<int64_t>(1, kBlock / row_size)));
+  }
+  if (elempack != 1) {
+    SlotValue& y = ctx.output(inst, 0);
+    ncnn::convert_packing(output, y.mat, elempack, ctx.allocator());
+    y.sizes = sizes;
+    y.elem_type = kFloat;
+  }
+  return true;
+}
+
+// Add, Sub, Mul, Div and Pow: numpy broadcasting in float, and the
+// reference kernels for the other element types
+template <typename Op>
+bool runBinary(const Instruction& inst, KernelContext& ctx) {
+  const SlotValue& a = ctx.input(inst, 0);
+  const SlotValue& b = ctx.input(inst, 1);
+  if (a.elem_type != kFloat || b.elem_type != kFloat) {
+    return RunReference(inst, ctx);
+  }
+  Broadcast broadcast;
+  if (!broadcast.init(a.sizes, b.sizes)) return false;
+  return binarySameShape<Op>(inst, ctx, broadcast.sizes()) ||
+         binaryBroadcast<Op>(inst, ctx, broadcast);
+}
+
+// PRelu: the slope broadcasts to X, in float
+bool runPRelu(const Instruction& inst, KernelContext& ctx) {
+  const SlotValue& x = ctx.input(inst, 0);
+  const SlotValue& slope = ctx.input(inst, 1);
+  Broadcast broadcast;
+  if (x.elem_type != kFloat || slope.elem_type != kFloat ||
+      !broadcast.init(x.sizes, slope.sizes) || broadcast.sizes() != x.sizes) {
+    return false;
+  }
+  return binarySameShape<PReluOp>(inst, ctx, x.sizes) ||
+         binaryBroadcast<PReluOp>(inst, ctx, broadcast);
+}
+
+void negate(const float* x, float* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) y[i] = -x[i];
+}
+
+// Neg, Exp, Sigmoid and Tanh in float, in the layout of the output and
+// over the input where it can
+template <void (*F)(const float*, float*, int64_t)>
+bool runUnary(const Instruction& inst, KernelContext& ctx) {
+  const SlotValue& x = ctx.input(inst, 0);
+  if (x.elem_type != kFloat) return false;
+  // the output takes over the input's Mat only while nothing else holds it
+  ncnn::Mat& y = ctx.createOutputInPlace(inst, 0, 0, x.sizes, kFloat);
+  ncnn::Mat input = x.mat;
+  if (input.elempack != y.elempack) {
+    ncnn::convert_packing(x.mat, input, y.elempack, ctx.allocator());
+  }
+  forEachSpan(y, ctx, [&](int64_t q, int64_t begin, int64_t end) {
+    F(channelData(input, q) + begin, channelData(y, q) + begin,
+      end - begin);
+  });
+  return true;
+}
+
+}  // namespace
+
+void RegisterElementwiseKernels(KernelRegistry* registry) {
+  registry->registerKernel(ir::kAdd,
+                           Kernel{runBinary<AddOp>, PrepareReference, true});
+  registry->registerKernel(ir::kSub,
+                           Kernel{runBinary<SubOp>, PrepareReference, true});
+  registry->registerKernel(ir::kMul,
+                           Kernel{runBinary<MulOp>, PrepareReference, true});
+  registry->registerKernel(ir::kDiv,
+                           Kernel{runBinary<DivOp>, PrepareReference, true});
+  registry->registerKernel(ir::kPow,
+                           Kernel{runBinary<PowOp>, PrepareReference, true});
+  registry->registerKernel(ir::kPRelu, Kernel{runPRelu, nullptr});
+  registry->registerKernel(ir::kNeg,
+                           Kernel{runUnary<negate>, nullptr, true});
+  registry->registerKernel(ir::kExp,
+                           Kernel{runUnary<VectorExp>, nullptr, true});
+  registry->registerKernel(ir::kSigmoid,
+                           Kernel{runUnary<VectorSigmoid>, nullptr, true});
+  registry->registerKernel(ir::kTanh,
+                           Kernel{runUnary<VectorTanh>, nullptr, true});
+}
+
+}  // namespace my_ai_training::runtime
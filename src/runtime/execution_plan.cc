@@ -0,0 +1,409 @@
+#include "runtime/execution_plan.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "optimizer/assign_layouts.h"
+#include "optimizer/fold_constants.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+
+// Builds the instructions and slots of a plan from a graph.
+class Lowering {
+ public:
+  Lowering(const KernelRegistry& kernels, ExecutionPlan* plan)
+      : kernels_(kernels), plan_(*plan) {}
+
+  void run(const ir::Graph& graph) {
+    for (const ir::Value* v : graph.inputs()) {
+      uint32_t slot = slotOf(v, 1);
+      plan_.inputs_.push_back(slot);
+      plan_.input_names_.push_back(v->uniqueName());
+      auto it = graph.getInitializer(v->uniqueName());
+      if (it != graph.initializers().end()) addConstant(slot, *it);
+    }
+    lowerNodes(graph, -1);
+    for (const ir::Value* v : graph.outputs()) {
+      plan_.outputs_.push_back(slotOf(v, -1));
+      plan_.output_names_.push_back(v->uniqueName());
+    }
+    computeReleases();
+    computeDependencies();
+  }
+
+ private:
+  // 'elempack' -1 takes the one assign_layouts chose
+  uint32_t slotOf(const ir::Value* v, int elempack) {
+    auto it = slots_.find(v);
+    if (it != slots_.end()) return it->second;
+    if (v->node()->kind() == ir::kUndefined) return kNoSlot;
+    SlotInfo info;
+    info.elem_type = v->elemType();
+    info.elempack = elempack < 0 ? optimization::Elempack(v) : elempack;
+    if (v->has_sizes()) {
+      info.has_static_sizes = true;
+      for (const ir::Dimension& d : v->sizes()) {
+        if (!d.is_int()) {
+          info.has_static_sizes = false;
+          info.sizes.clear();
+          break;
+        }
+        info.sizes.push_back(d.dim());
+      }
+    }
+    uint32_t slot = static_cast<uint32_t>(plan_.slots_.size());
+    plan_.slots_.push_back(std::move(info));
+    slots_[v] = slot;
+    if (const ir::Tensor* t = optimization::FindConstant(v)) {
+      addConstant(slot, *t);
+      constant_slots_.insert(slot);
+      plan_.slots_[slot].constant = true;
+    }
+    return slot;
+  }
+
+  void addConstant(uint32_t slot, const ir::Tensor& t) {
+    SlotValue value;
+    TensorToMat(t, plan_.slots_[slot].elempack, nullptr, &value.mat);
+    value.sizes = t.sizes();
+    value.elem_type = t.elem_type();
+    plan_.constants_.emplace_back(slot, std::move(value));
+  }
+
+  // 'elempack' overrides the layout of the values made by the nodes, for
+  // the body of a FusionGroup running in the layout of the group
+  void lowerNodes(const ir::Graph& graph, int elempack) {
+    for (const ir::Node* n : graph.nodes()) {
+      if (n->kind() == ir::kUndefined) continue;
+      // read from the constant slots
+      if (n->kind() == ir::kConstant &&
+          optimization::FindConstant(n->output()) != nullptr) {
+        continue;
+      }
+      const Kernel* kernel = kernels_.find(n->kind());
+      if (kernel == nullptr && n->kind() == ir::kFusionGroup) {
+        inlineGroup(n);
+        continue;
+      }
+      ONNX_ASSERTM(kernel != nullptr, "no kernel for %s",
+                   n->kind().toString());
+      constexpr size_t kMaxOperands = std::numeric_limits<uint16_t>::max();
+      ONNX_ASSERTM(n->inputs().size() <= kMaxOperands &&
+                       n->outputs().size() <= kMaxOperands,
+                   "%s has too many operands", n->kind().toString());
+      Instruction inst;
+      inst.kernel = kernel->run;
+      inst.op = n->kind();
+      inst.num_inputs = static_cast<uint16_t>(n->inputs().size());
+      inst.num_outputs = static_cast<uint16_t>(n->outputs().size());
+      inst.first_operand = static_cast<uint32_t>(plan_.operands_.size());
+      for (const ir::Value* v : n->inputs()) {
+        plan_.operands_.push_back(slotOf(v, -1));
+      }
+      for (const ir::Value* v : n->outputs()) {
+        plan_.operands_.push_back(slotOf(v, elempack));
+      }
+      if (kernel->prepare != nullptr) {
+        plan_.params_.push_back(kernel->prepare(*n));
+        inst.params = plan_.params_.back().get();
+      }
+      plan_.instructions_.push_back(inst);
+    }
+  }
+
+  // the body's nodes, reading the group's inputs and writing its outputs
+  void inlineGroup(const ir::Node* group) {
+    const ir::Graph& body = *group->g(ir::kSubgraph);
+    ONNX_ASSERT(body.inputs().size() == group->inputs().size() &&
+                body.outputs().size() == group->outputs().size());
+    for (size_t i = 0; i < body.inputs().size(); i++) {
+      slots_[body.inputs()[i]] = slotOf(group->inputs()[i], -1);
+    }
+    for (size_t i = 0; i < body.outputs().size(); i++) {
+      ONNX_ASSERTM(slots_.count(body.outputs()[i]) == 0,
+                   "FusionGroup output %zu is not computed by the group", i);
+      slots_[body.outputs()[i]] = slotOf(group->outputs()[i], -1);
+    }
+    lowerNodes(body, optimization::Elempack(group->output()));
+  }
+
+  // frees each slot after its last reader, or its writer if it has none;
+  // constants, graph inputs, which the caller owns, and graph outputs stay.
+  // Slots read once may be overwritten by their reader.
+  void computeReleases() {
+    std::vector<size_t> last(plan_.slots_.size(), kNoReader);
+    for (size_t i = 0; i < plan_.instructions_.size(); i++) {
+      const Instruction& inst = plan_.instructions_[i];
+      for (size_t k = 0; k < inst.num_inputs + inst.num_outputs; k++) {
+        uint32_t slot = plan_.operands_[inst.first_operand + k];
+        if (slot != kNoSlot) last[slot] = i;
+      }
+    }
+    std::unordered_set<uint32_t> kept(plan_.outputs_.begin(),
+                                      plan_.outputs_.end());
+    kept.insert(plan_.inputs_.begin(), plan_.inputs_.end());
+    kept.insert(constant_slots_.begin(), constant_slots_.end());
+    std::vector<std::vector<uint32_t>> released(plan_.instructions_.size());
+    for (uint32_t slot = 0; slot < last.size(); slot++) {
+      if (last[slot] != kNoReader && kept.count(slot) == 0) {
+        released[last[slot]].push_back(slot);
+      }
+    }
+    plan_.slot_uses_.assign(plan_.slots_.size(), 0);
+    for (uint32_t slot : plan_.operands_) {
+      if (slot != kNoSlot && kept.count(slot) == 0) plan_.slot_uses_[slot]++;
+    }
+    std::vector<uint32_t> readers(plan_.slots_.size(), 0);
+    for (const Instruction& inst : plan_.instructions_) {
+      for (size_t k = 0; k < inst.num_inputs; k++) {
+        uint32_t slot = plan_.operands_[inst.first_operand + k];
+        if (slot != kNoSlot) readers[slot]++;
+      }
+    }
+    for (uint32_t slot = 0; slot < readers.size(); slot++) {
+      plan_.slots_[slot].single_reader =
+          readers[slot] == 1 && kept.count(slot) == 0;
+    }
+    for (size_t i = 0; i < released.size(); i++) {
+      Instruction& inst = plan_.instructions_[i];
+      inst.first_release = static_cast<uint32_t>(plan_.releases_.size());
+      inst.num_releases = static_cast<uint32_t>(released[i].size());
+      plan_.releases_.insert(plan_.releases_.end(), released[i].begin(),
+                             released[i].end());
+    }
+  }
+
+  // an edge from the writer of each input slot to its readers
+  void computeDependencies() {
+    const auto& instructions = plan_.instructions_;
+    std::vector<uint32_t> writer(plan_.slots_.size(), kNoWriter);
+    for (uint32_t i = 0; i < instructions.size(); i++) {
+      const Instruction& inst = instructions[i];
+      for (size_t k = 0; k < inst.num_outputs; k++) {
+        uint32_t slot = plan_.operands_[inst.first_operand + inst.num_inputs +
+                                        k];
+        writer[slot] = i;
+      }
+    }
+    std::vector<std::vector<uint32_t>> dependents(instructions.size());
+    plan_.num_dependencies_.assign(instructions.size(), 0);
+    std::vector<uint32_t> writers;
+    for (uint32_t i = 0; i < instructions.size(); i++) {
+      const Instruction& inst = instructions[i];
+      writers.clear();
+      for (size_t k = 0; k < inst.num_inputs; k++) {
+        uint32_t slot = plan_.operands_[inst.first_operand + k];
+        if (slot != kNoSlot && writer[slot] != kNoWriter) {
+          writers.push_back(writer[slot]);
+        }
+      }
+      std::sort(writers.begin(), writers.end());
+      writers.erase(std::unique(writers.begin(), writers.end()),
+                    writers.end());
+      for (uint32_t w : writers) dependents[w].push_back(i);
+      plan_.num_dependencies_[i] = static_cast<uint32_t>(writers.size());
+      if (writers.empty()) plan_.roots_.push_back(i);
+    }
+    plan_.first_dependent_.push_back(0);
+    for (const auto& d : dependents) {
+      plan_.dependents_.insert(plan_.dependents_.end(), d.begin(), d.end());
+      plan_.first_dependent_.push_back(
+          static_cast<uint32_t>(plan_.dependents_.size()));
+    }
+  }
+
+  static constexpr uint32_t kNoWriter = std::numeric_limits<uint32_t>::max();
+  static constexpr size_t kNoReader = std::numeric_limits<size_t>::max();
+
+  const KernelRegistry& kernels_;
+  ExecutionPlan& plan_;
+  std::unordered_map<const ir::Value*, uint32_t> slots_;
+  std::unordered_set<uint32_t> constant_slots_;
+};
+
+std::shared_ptr<const ExecutionPlan> ExecutionPlan::Compile(
+    const ir::Graph& graph, const KernelRegistry& kernels) {
+  auto plan = std::make_shared<ExecutionPlan>();
+  Lowering(kernels, plan.get()).run(graph);
+  return plan;
+}
+
+Frame ExecutionPlan::createFrame(ncnn::Allocator* allocator) const {
+  Frame frame;
+  frame.allocator = allocator;
+  frame.slots.resize(slots_.size());
+  for (const auto& constant : constants_) {
+    frame.slots[constant.first] = constant.second;
+  }
+  return frame;
+}
+
+void ExecutionPlan::setInput(Frame& frame, size_t i, const ncnn::Mat& mat,
+                             std::vector<int64_t> sizes,
+                             int32_t elem_type) const {
+  ONNX_ASSERTM(i < inputs_.size(), "the graph has %zu inputs",
+               inputs_.size());
+  SlotValue& value = frame.slots[inputs_[i]];
+  value.mat = mat;
+  value.sizes = std::move(sizes);
+  value.elem_type = elem_type != ir::TensorProto_DataType_UNDEFINED
+                        ? elem_type
+                        : slots_[inputs_[i]].elem_type;
+}
+
+void ExecutionPlan::run(Frame& frame) const {
+  ONNX_ASSERT(frame.slots.size() == slots_.size());
+  KernelContext ctx(operands_.data(), slots_.data(), &frame);
+  const uint32_t* releases = releases_.data();
+  for (const Instruction& inst : instructions_) {
+    if (!inst.kernel(inst, ctx)) {
+      ONNX_ASSERTM(false, "kernel of %s failed", inst.op.toString());
+    }
+    for (uint32_t k = 0; k < inst.num_releases; k++) {
+      frame.slots[releases[inst.first_release + k]].mat.release();
+    }
+  }
+}
+
+// One run of a plan on a WorkStealingPool: a task per instruction, spawned
+// by whichever of its dependencies finishes last. It deletes itself once
+// the last one finished, after calling 'done'.
+class ParallelRun {
+ public:
+  ParallelRun(const ExecutionPlan& plan, Frame& frame, WorkStealingPool& pool,
+              std::function<void(std::exception_ptr)> done)
+      : plan_(plan),
+        frame_(frame),
+        pool_(pool),
+        done_(std::move(done)),
+        ctx_(plan.operands_.data(), plan.slots_.data(), &frame),
+        tasks_(plan.instructions_.size()),
+        pending_(new std::atomic<uint32_t>[plan.instructions_.size()]),
+        uses_(new std::atomic<uint32_t>[plan.slots_.size()]),
+        remaining_(plan.instructions_.size()) {
+    for (size_t i = 0; i < tasks_.size(); i++) {
+      tasks_[i].run_ = this;
+      tasks_[i].index_ = static_cast<uint32_t>(i);
+      pending_[i].store(plan.num_dependencies_[i], std::memory_order_relaxed);
+    }
+    for (size_t slot = 0; slot < plan.slots_.size(); slot++) {
+      uses_[slot].store(plan.slot_uses_[slot], std::memory_order_relaxed);
+    }
+  }
+
+  void start() {
+    if (tasks_.empty()) {
+      finish();
+      return;
+    }
+    // the run may finish and delete this as soon as the last root is
+    // spawned, so only locals are touched after that
+    WorkStealingPool& pool = pool_;
+    Task* tasks = tasks_.data();
+    for (uint32_t i : plan_.roots_) pool.spawn(&tasks[i]);
+  }
+
+ private:
+  class Task final : public WorkStealingPool::Task {
+   public:
+    void run() override { run_->execute(index_); }
+
+    ParallelRun* run_ = nullptr;
+    uint32_t index_ = 0;
+  };
+
+  void execute(uint32_t i) {
+    const Instruction& inst = plan_.instructions_[i];
+    if (!failed_.load(std::memory_order_relaxed)) {
+      try {
+        if (!inst.kernel(inst, ctx_)) {
+          ONNX_ASSERTM(false, "kernel of %s failed", inst.op.toString());
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (!error_) error_ = std::current_exception();
+        failed_.store(true, std::memory_order_relaxed);
+      }
+    }
+    for (size_t k = 0; k < inst.num_inputs + inst.num_outputs; k++) {
+      uint32_t slot = plan_.operands_[inst.first_operand + k];
+      if (slot == kNoSlot || plan_.slot_uses_[slot] == 0) continue;
+      if (uses_[slot].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        frame_.slots[slot].mat.release();
+      }
+    }
+    for (const uint32_t* d = plan_.dependentsBegin(i);
+         d != plan_.dependentsEnd(i); d++) {
+      if (pending_[*d].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        pool_.spawn(&tasks_[*d]);
+      }
+    }
+    // the other tasks are done with this once the count drops to zero
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) finish();
+  }
+
+  void finish() {
+    std::function<void(std::exception_ptr)> done = std::move(done_);
+    std::exception_ptr error = error_;
+    delete this;
+    done(error);
+  }
+
+  const ExecutionPlan& plan_;
+  Frame& frame_;
+  WorkStealingPool& pool_;
+  std::function<void(std::exception_ptr)> done_;
+  KernelContext ctx_;
+  std::vector<Task> tasks_;
+  // per instruction, the dependencies that did not finish yet
+  std::unique_ptr<std::atomic<uint32_t>[]> pending_;
+  // per slot, the operands of instructions that did not finish yet
+  std::unique_ptr<std::atomic<uint32_t>[]> uses_;
+  std::atomic<size_t> remaining_;
+  std::atomic<bool> failed_{false};
+  std::mutex mutex_;
+  std::exception_ptr error_;
+};
+
+void ExecutionPlan::runAsync(
+    Frame& frame, WorkStealingPool& pool,
+    std::function<void(std::exception_ptr)> done) const {
+  ONNX_ASSERT(frame.slots.size() == slots_.size());
+  (new ParallelRun(*this, frame, pool, std::move(done)))->start();
+}
+
+void ExecutionPlan::run(Frame& frame, WorkStealingPool& pool) const {
+  struct Wait {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    std::atomic<bool> finished{false};
+    std::exception_ptr error;
+  } wait;
+  runAsync(frame, pool, [&wait](std::exception_ptr error) {
+    std::lock_guard<std::mutex> guard(wait.mutex);
+    wait.error = error;
+    wait.done = true;
+    wait.finished.store(true, std::memory_order_release);
+    wait.cv.notify_all();
+  });
+  // a worker helps with the run; the lock then waits for 'done' to stop
+  // touching 'wait'
+  if (pool.currentWorker() >= 0) {
+    while (!wait.finished.load(std::memory_order_acquire)) {
+      if (!pool.tryRunOne()) std::this_thread::yield();
+    }
+  }
+  std::unique_lock<std::mutex> lock(wait.mutex);
+  wait.cv.wait(lock, [&wait]() { return wait.done; });
+  if (wait.error) std::rethrow_exception(wait.error);
+}
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/work_stealing_pool.h"
+#include "runtime/kernel.h"
+
+namespace my_ai_training::runtime {
+
+// A graph lowered for execution: its nodes in order as a flat array of
+// instructions bound to their kernels, whose operands index a table of
+// slots, one per value. Running it is one indexed loop over that array,
+// without walking the node list or following Value pointers, and each
+// slot's Mat is released right after its last reader, so the allocator can
+// hand the memory to the next one.
+//
+// The plan also records which instructions read the results of which, so
+// independent branches can run at the same time on a WorkStealingPool.
+//
+// A plan is immutable once compiled and may run in any number of frames at
+// once.
+class ExecutionPlan {
+ public:
+  // Lowers 'graph', keeping the elempacks and Packing nodes assign_layouts
+  // chose; FusionGroups without a kernel of their own are inlined. Throws
+  // if a node has no kernel.
+  static std::shared_ptr<const ExecutionPlan> Compile(
+      const ir::Graph& graph,
+      const KernelRegistry& kernels = KernelRegistry::global());
+
+  const std::vector<Instruction>& instructions() const {
+    return instructions_;
+  }
+  const std::vector<uint32_t>& operands() const { return operands_; }
+  const std::vector<uint32_t>& releases() const { return releases_; }
+  const std::vector<SlotInfo>& slots() const { return slots_; }
+  // slots of the graph inputs and outputs, and their names
+  const std::vector<uint32_t>& inputSlots() const { return inputs_; }
+  const std::vector<uint32_t>& outputSlots() const { return outputs_; }
+  const std::vector<std::string>& inputNames() const { return input_names_; }
+  const std::vector<std::string>& outputNames() const {
+    return output_names_;
+  }
+
+  // A frame with the slots of constants filled in, and those of inputs
+  // with an initializer of the same name holding it as default.
+  Frame createFrame(ncnn::Allocator* allocator = nullptr) const;
+
+  // Binds graph input 'i' to 'mat', holding an unpacked tensor of 'sizes';
+  // 'mat' is not copied. The element type defaults to the declared one.
+  void setInput(Frame& frame, size_t i, const ncnn::Mat& mat,
+                std::vector<int64_t> sizes,
+                int32_t elem_type = ir::TensorProto_DataType_UNDEFINED) const;
+
+  // Runs every instruction; throws if a kernel fails.
+  void run(Frame& frame) const;
+
+  // Runs each instruction on 'pool' once the instructions writing its
+  // inputs finished, so the kernels and the frame's allocator must be
+  // thread safe. Slots are released once all their instructions ran. On a
+  // worker of 'pool' the caller runs tasks while it waits; other callers
+  // block. Throws the first error of a kernel, after the instructions
+  // already started finished; later ones are skipped.
+  void run(Frame& frame, WorkStealingPool& pool) const;
+
+  // Like run(), but returns at once; 'done' gets the first error of a
+  // kernel, or null, on the worker that ran the last instruction, or on
+  // the calling thread for a plan without instructions. The plan and
+  // 'frame' must live until then.
+  void runAsync(Frame& frame, WorkStealingPool& pool,
+                std::function<void(std::exception_ptr)> done) const;
+
+  // the instructions reading outputs of instruction 'i'
+  const uint32_t* dependentsBegin(size_t i) const {
+    return dependents_.data() + first_dependent_[i];
+  }
+  const uint32_t* dependentsEnd(size_t i) const {
+    return dependents_.data() + first_dependent_[i + 1];
+  }
+  // the number of instructions whose outputs instruction 'i' reads
+  uint32_t numDependencies(size_t i) const { return num_dependencies_[i]; }
+
+  const SlotValue& output(const Frame& frame, size_t i) const {
+    return frame.slots[outputs_[i]];
+  }
+
+ private:
+  friend class Lowering;
+  friend class ParallelRun;
+
+  std::vector<Instruction> instructions_;
+  std::vector<uint32_t> operands_;
+  std::vector<uint32_t> releases_;
+  std::vector<SlotInfo> slots_;
+  // the values of the constant slots, and the defaults of input slots
+  std::vector<std::pair<uint32_t, SlotValue>> constants_;
+  std::vector<uint32_t> inputs_;
+  std::vector<uint32_t> outputs_;
+  std::vector<std::string> input_names_;
+  std::vector<std::string> output_names_;
+  // the dependency graph of the instructions, in compressed rows
+  std::vector<uint32_t> first_dependent_;
+  std::vector<uint32_t> dependents_;
+  std::vector<uint32_t> num_dependencies_;
+  // instructions without dependencies
+  std::vector<uint32_t> roots_;
+  // how often each slot appears in operands_, 0 for the slots runs keep
+  std::vector<uint32_t> slot_uses_;
+  // what the instructions' params point to
+  std::vector<std::shared_ptr<const void>> params_;
+};
+
+}  // namespace my_ai_training::runtime
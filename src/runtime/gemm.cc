@@ -0,0 +1,669 @@
+#include "runtime/gemm.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "ncnn/cpu.h"
+#include "onnx_ir/assertions.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MY_AI_TRAINING_GEMM_X86 1
+#include <immintrin.h>
+#else
+#define MY_AI_TRAINING_GEMM_X86 0
+#endif
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+// Rows of B in a block, so that a panel of A and one of B stay in the L1
+// cache while a micro-kernel runs; and for int8 GEMMs, rows of A a task
+// packs at once, for the L2 cache, and columns of C a task writes.
+constexpr int64_t kKc = 256;
+constexpr int64_t kKcInt8 = 512;
+constexpr int64_t kMc = 120;
+constexpr int64_t kNc = 512;
+// the largest tile of any micro-kernel
+constexpr int kMaxMr = 8;
+constexpr int kMaxNr = 32;
+static_assert(kGemmRowQuantum % 6 == 0 && kGemmRowQuantum % kMaxMr == 0 &&
+                  kGemmColumnQuantum % kMaxNr == 0,
+              "blocks of C must hold whole micro-kernel tiles");
+
+int64_t roundUp(int64_t x, int64_t n) { return (x + n - 1) / n * n; }
+
+int toInt(int64_t size) {
+  ONNX_ASSERTM(size <= INT_MAX, "a packed GEMM operand of %lld elements",
+               (long long)size);
+  return static_cast<int>(size);
+}
+
+// C[mr x nr] = A * B over 'kc' rows of a panel of A, mr values per row,
+// and one of B, nr values per row; added to C if 'accumulate'.
+using Fp32MicroKernel = void (*)(int64_t kc, const float* a, const float* b,
+                                 float* c, int64_t ldc, bool accumulate);
+
+// As Fp32MicroKernel over 'kc4' groups of 4 rows, each holding 4 values
+// per row of A and 4 per column of B.
+using Int8MicroKernel = void (*)(int64_t kc4, const uint8_t* a,
+                                 const int8_t* b, int32_t* c, int64_t ldc,
+                                 bool accumulate);
+
+struct Fp32Kernel {
+  int mr;
+  int nr;
+  Fp32MicroKernel run;
+};
+
+struct Int8Kernel {
+  int mr;
+  int nr;
+  Int8MicroKernel run;
+};
+
+void fp32Generic(int64_t kc, const float* a, const float* b, float* c,
+                 int64_t ldc, bool accumulate) {
+  constexpr int kMr = 4;
+  constexpr int kNr = 8;
+  float acc[kMr][kNr] = {};
+  for (int64_t p = 0; p < kc; p++) {
+    for (int r = 0; r < kMr; r++) {
+      for (int j = 0; j < kNr; j++) acc[r][j] += a[r] * b[j];
+    }
+    a += kMr;
+    b += kNr;
+  }
+  for (int r = 0; r < kMr; r++) {
+    float* row = c + r * ldc;
+    for (int j = 0; j < kNr; j++) {
+      row[j] = accumulate ? row[j] + acc[r][j] : acc[r][j];
+    }
+  }
+}
+
+void int8Generic(int64_t kc4, const uint8_t* a, const int8_t* b, int32_t* c,
+                 int64_t ldc, bool accumulate) {
+  constexpr int kMr = 4;
+  constexpr int kNr = 8;
+  int32_t acc[kMr][kNr] = {};
+  for (int64_t g = 0; g < kc4; g++) {
+    for (int r = 0; r < kMr; r++) {
+      for (int j = 0; j < kNr; j++) {
+        for (int t = 0; t < 4; t++) {
+          acc[r][j] += int32_t(a[r * 4 + t]) * int32_t(b[j * 4 + t]);
+        }
+      }
+    }
+    a += kMr * 4;
+    b += kNr * 4;
+  }
+  for (int r = 0; r < kMr; r++) {
+    int32_t* row = c + r * ldc;
+    for (int j = 0; j < kNr; j++) {
+      row[j] = accumulate ? row[j] + acc[r][j] : acc[r][j];
+    }
+  }
+}
+
+#if MY_AI_TRAINING_GEMM_X86
+
+// 6 x 16: 12 accumulators of the 16 ymm registers
+__attribute__((target("avx2,fma"))) void fp32Avx2Fma(
+    int64_t kc, const float* a, const float* b, float* c, int64_t ldc,
+    bool accumulate) {
+  constexpr int kMr = 6;
+  __m256 acc[kMr][2];
+#pragma GCC unroll 6
+  for (int r = 0; r < kMr; r++) {
+    acc[r][0] = _mm256_setzero_ps();
+    acc[r][1] = _mm256_setzero_ps();
+  }
+  for (int64_t p = 0; p < kc; p++) {
+    __m256 b0 = _mm256_loadu_ps(b);
+    __m256 b1 = _mm256_loadu_ps(b + 8);
+#pragma GCC unroll 6
+    for (int r = 0; r < kMr; r++) {
+      __m256 ar = _mm256_broadcast_ss(a + r);
+      acc[r][0] = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+    }
+    a += kMr;
+    b += 16;
+  }
+#pragma GCC unroll 6
+  for (int r = 0; r < kMr; r++) {
+    float* row = c + r * ldc;
+    if (accumulate) {
+      acc[r][0] = _mm256_add_ps(acc[r][0], _mm256_loadu_ps(row));
+      acc[r][1] = _mm256_add_ps(acc[r][1], _mm256_loadu_ps(row + 8));
+    }
+    _mm256_storeu_ps(row, acc[r][0]);
+    _mm256_storeu_ps(row + 8, acc[r][1]);
+  }
+}
+
+// 8 x 32: 16 accumulators of the 32 zmm registers
+__attribute__((target("avx512f"))) void fp32Avx512(int64_t kc, const float* a,
+                                                   const float* b, float* c,
+                                                   int64_t ldc,
+                                                   bool accumulate) {
+  constexpr int kMr = 8;
+  __m512 acc[kMr][2];
+#pragma GCC unroll 8
+  for (int r = 0; r < kMr; r++) {
+    acc[r][0] = _mm512_setzero_ps();
+    acc[r][1] = _mm512_setzero_ps();
+  }
+  for (int64_t p = 0; p < kc; p++) {
+    __m512 b0 = _mm512_loadu_ps(b);
+    __m512 b1 = _mm512_loadu_ps(b + 16);
+#pragma GCC unroll 8
+    for (int r = 0; r < kMr; r++) {
+      __m512 ar = _mm512_set1_ps(a[r]);
+      acc[r][0] = _mm512_fmadd_ps(ar, b0, acc[r][0]);
+      acc[r][1] = _mm512_fmadd_ps(ar, b1, acc[r][1]);
+    }
+    a += kMr;
+    b += 32;
+  }
+#pragma GCC unroll 8
+  for (int r = 0; r < kMr; r++) {
+    float* row = c + r * ldc;
+    if (accumulate) {
+      acc[r][0] = _mm512_add_ps(acc[r][0], _mm512_loadu_ps(row));
+      acc[r][1] = _mm512_add_ps(acc[r][1], _mm512_loadu_ps(row + 16));
+    }
+    _mm512_storeu_ps(row, acc[r][0]);
+    _mm512_storeu_ps(row + 16, acc[r][1]);
+  }
+}
+
+// 8 x 32 with vpdpbusd, which adds 4 products of uint8 A and int8 B to
+// each int32 lane without saturating
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) void int8Avx512Vnni(
+    int64_t kc4, const uint8_t* a, const int8_t* b, int32_t* c, int64_t ldc,
+    bool accumulate) {
+  constexpr int kMr = 8;
+  __m512i acc[kMr][2];
+#pragma GCC unroll 8
+  for (int r = 0; r < kMr; r++) {
+    acc[r][0] = _mm512_setzero_si512();
+    acc[r][1] = _mm512_setzero_si512();
+  }
+  for (int64_t g = 0; g < kc4; g++) {
+    __m512i b0 = _mm512_loadu_si512(b);
+    __m512i b1 = _mm512_loadu_si512(b + 64);
+#pragma GCC unroll 8
+    for (int r = 0; r < kMr; r++) {
+      int32_t quad;
+      memcpy(&quad, a + r * 4, 4);
+      __m512i ar = _mm512_set1_epi32(quad);
+      acc[r][0] = _mm512_dpbusd_epi32(acc[r][0], ar, b0);
+      acc[r][1] = _mm512_dpbusd_epi32(acc[r][1], ar, b1);
+    }
+    a += kMr * 4;
+    b += 128;
+  }
+#pragma GCC unroll 8
+  for (int r = 0; r < kMr; r++) {
+    int32_t* row = c + r * ldc;
+    if (accumulate) {
+      acc[r][0] = _mm512_add_epi32(acc[r][0], _mm512_loadu_si512(row));
+      acc[r][1] = _mm512_add_epi32(acc[r][1], _mm512_loadu_si512(row + 16));
+    }
+    _mm512_storeu_si512(row, acc[r][0]);
+    _mm512_storeu_si512(row + 16, acc[r][1]);
+  }
+}
+
+#endif  // MY_AI_TRAINING_GEMM_X86
+
+const Fp32Kernel& fp32KernelOf(GemmIsa isa) {
+  static constexpr Fp32Kernel kGeneric{4, 8, fp32Generic};
+#if MY_AI_TRAINING_GEMM_X86
+  static constexpr Fp32Kernel kAvx2Fma{6, 16, fp32Avx2Fma};
+  static constexpr Fp32Kernel kAvx512{8, 32, fp32Avx512};
+  switch (isa) {
+    case GemmIsa::kAvx2Fma:
+      return kAvx2Fma;
+    case GemmIsa::kAvx512:
+    case GemmIsa::kAvx512Vnni:
+      return kAvx512;
+    default:
+      break;
+  }
+#endif
+  return kGeneric;
+}
+
+const Int8Kernel& int8KernelOf(GemmIsa isa) {
+  static constexpr Int8Kernel kGeneric{4, 8, int8Generic};
+#if MY_AI_TRAINING_GEMM_X86
+  static constexpr Int8Kernel kAvx512Vnni{8, 32, int8Avx512Vnni};
+  if (isa == GemmIsa::kAvx512Vnni) return kAvx512Vnni;
+#endif
+  return kGeneric;
+}
+
+// Packs the mc x kc block of A at 'a' into panels of 'mr' rows, stored
+// column by column and padded with zeros, scaled by 'alpha'.
+void packA(const float* a, int64_t mc, int64_t kc, int64_t row_stride,
+           int64_t col_stride, float alpha, int mr, float* out) {
+  for (int64_t ir = 0; ir < mc; ir += mr) {
+    for (int64_t p = 0; p < kc; p++) {
+      for (int r = 0; r < mr; r++) {
+        *out++ = ir + r < mc
+                     ? alpha * a[(ir + r) * row_stride + p * col_stride]
+                     : 0.f;
+      }
+    }
+  }
+}
+
+int32_t loadInt8(const uint8_t* data, bool is_signed, int64_t offset) {
+  return is_signed ? int32_t(static_cast<int8_t>(data[offset]))
+                   : int32_t(data[offset]);
+}
+
+// As packA() for groups of 4 values along each row, shifted to uint8.
+void packAInt8(const uint8_t* a, bool is_signed, int64_t mc, int64_t kc,
+               int64_t row_stride, int64_t col_stride, int mr,
+               uint8_t* out) {
+  int32_t shift = is_signed ? 128 : 0;
+  for (int64_t ir = 0; ir < mc; ir += mr) {
+    for (int64_t p4 = 0; p4 < kc; p4 += 4) {
+      for (int r = 0; r < mr; r++) {
+        for (int t = 0; t < 4; t++) {
+          int64_t p = p4 + t;
+          *out++ = ir + r < mc && p < kc
+                       ? uint8_t(loadInt8(a, is_signed,
+                                          (ir + r) * row_stride +
+                                              p * col_stride) +
+                                 shift)
+                       : 0;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+bool CpuSupports(GemmIsa isa) {
+  switch (isa) {
+    case GemmIsa::kGeneric:
+      return true;
+    case GemmIsa::kAvx2Fma:
+      return ncnn::cpu_support_x86_avx2() && ncnn::cpu_support_x86_fma();
+    case GemmIsa::kAvx512:
+      return ncnn::cpu_support_x86_avx512();
+    case GemmIsa::kAvx512Vnni:
+      return ncnn::cpu_support_x86_avx512_vnni();
+  }
+  return false;
+}
+
+GemmIsa BestGemmIsa() {
+  static const GemmIsa best = [] {
+    for (GemmIsa isa : {GemmIsa::kAvx512Vnni, GemmIsa::kAvx512,
+                        GemmIsa::kAvx2Fma}) {
+      if (CpuSupports(isa)) return isa;
+    }
+    return GemmIsa::kGeneric;
+  }();
+  return best;
+}
+
+PackedGemmB::PackedGemmB(const float* b, int64_t k, int64_t n,
+                         int64_t row_stride, int64_t col_stride, GemmIsa isa)
+    : k_(k), n_(n), isa_(isa) {
+  ONNX_ASSERTM(CpuSupports(isa), "the CPU lacks GEMM instruction set %d",
+               static_cast<int>(isa));
+  int nr = fp32KernelOf(isa).nr;
+  int64_t n_padded = roundUp(n, nr);
+  if (k * n_padded == 0) return;
+  data_.create(toInt(k * n_padded));
+  pack(b, row_stride, col_stride, 0, n_padded / nr);
+}
+
+PackedGemmB::PackedGemmB(const float* b, int64_t k, int64_t n,
+                         int64_t row_stride, int64_t col_stride,
+                         const KernelContext& ctx)
+    : k_(k), n_(n), isa_(BestGemmIsa()) {
+  int nr = fp32KernelOf(isa_).nr;
+  int64_t panels = roundUp(n, nr) / nr;
+  if (k * panels == 0) return;
+  data_.create(toInt(k * panels * nr), size_t{4}, ctx.allocator());
+  ctx.parallelFor(static_cast<size_t>(panels), [&](size_t begin, size_t end) {
+    pack(b, row_stride, col_stride, static_cast<int64_t>(begin),
+         static_cast<int64_t>(end));
+  });
+}
+
+void PackedGemmB::pack(const float* b, int64_t row_stride,
+                       int64_t col_stride, int64_t begin, int64_t end) {
+  // panels packed together, so that each row of B is read in runs of
+  // several cache lines rather than one stream per row
+  constexpr int64_t kPanels = 8;
+  int nr = fp32KernelOf(isa_).nr;
+  int64_t n_padded = roundUp(n_, nr);
+  float* data = data_;
+  for (int64_t pc = 0; pc < k_; pc += kKc) {
+    int64_t kc = std::min(kKc, k_ - pc);
+    // a block holds kc rows of every panel in turn
+    float* block = data + pc * n_padded;
+    for (int64_t first = begin; first < end; first += kPanels) {
+      int64_t last = std::min(end, first + kPanels);
+      for (int64_t p = 0; p < kc; p++) {
+        const float* row = b + (pc + p) * row_stride;
+        for (int64_t panel = first; panel < last; panel++) {
+          float* out = block + (panel * kc + p) * nr;
+          int64_t jc = panel * nr;
+          for (int j = 0; j < nr; j++) {
+            out[j] = jc + j < n_ ? row[(jc + j) * col_stride] : 0.f;
+          }
+        }
+      }
+    }
+  }
+}
+
+PackedGemmA::PackedGemmA(const float* a, int64_t m, int64_t k,
+                         int64_t row_stride, int64_t col_stride, GemmIsa isa)
+    : m_(m), k_(k), isa_(isa) {
+  ONNX_ASSERTM(CpuSupports(isa), "the CPU lacks GEMM instruction set %d",
+               static_cast<int>(isa));
+  int mr = fp32KernelOf(isa).mr;
+  int64_t m_padded = roundUp(m, mr);
+  if (m_padded * k == 0) return;
+  data_.create(toInt(m_padded * k));
+  float* data = data_;
+  for (int64_t pc = 0; pc < k; pc += kKc) {
+    int64_t kc = std::min(kKc, k - pc);
+    packA(a + pc * col_stride, m, kc, row_stride, col_stride, 1.f, mr,
+          data + pc * m_padded);
+  }
+}
+
+namespace {
+
+// The rows of an unpacked A, packed a block at a time into memory of the
+// task. The rows it holds are kept across tasks while k fits one block,
+// as the column blocks of a row block are consecutive tasks.
+class PackingA {
+ public:
+  PackingA(const float* a, int64_t row_stride, int64_t col_stride,
+           float alpha, int mr, int64_t k, int64_t mc_max)
+      : a_(a),
+        row_stride_(row_stride),
+        col_stride_(col_stride),
+        alpha_(alpha),
+        mr_(mr),
+        k_(k),
+        packed_(mc_max * kKc) {}
+
+  // rows [ic, ic + mc) of columns [pc, pc + kc), in panels of mr rows
+  const float* operator()(int64_t ic, int64_t mc, int64_t pc, int64_t kc) {
+    if (kc < k_ || ic != packed_ic_) {
+      packA(a_ + ic * row_stride_ + pc * col_stride_, mc, kc, row_stride_,
+            col_stride_, alpha_, mr_, packed_.data());
+      packed_ic_ = kc < k_ ? -1 : ic;
+    }
+    return packed_.data();
+  }
+
+ private:
+  const float* a_;
+  int64_t row_stride_;
+  int64_t col_stride_;
+  float alpha_;
+  int mr_;
+  int64_t k_;
+  std::vector<float> packed_;
+  int64_t packed_ic_ = -1;
+};
+
+// C = A * B for the m rows of A, whose packed panels the function objects
+// 'make_panels()' returns, one per task range, give block by block.
+template <typename MakePanels>
+void sgemmBlocks(int64_t m, const PackedGemmB& b, float* c,
+                 int64_t c_row_stride, int64_t c_col_stride, bool accumulate,
+                 const KernelContext& ctx, const GemmBlocking& blocking,
+                 const MakePanels& make_panels) {
+  int64_t mc_max = blocking.mc;
+  int64_t nc_max = blocking.nc;
+  ONNX_ASSERTM(mc_max > 0 && mc_max % kGemmRowQuantum == 0 && nc_max > 0 &&
+                   nc_max % kGemmColumnQuantum == 0,
+               "GEMM blocks of %lld x %lld", (long long)mc_max,
+               (long long)nc_max);
+  int64_t n = b.n();
+  int64_t k = b.k();
+  if (m <= 0 || n <= 0) return;
+  if (k == 0) {
+    if (accumulate) return;
+    for (int64_t i = 0; i < m; i++) {
+      for (int64_t j = 0; j < n; j++) {
+        c[i * c_row_stride + j * c_col_stride] = 0.f;
+      }
+    }
+    return;
+  }
+  const Fp32Kernel& kernel = fp32KernelOf(b.isa());
+  int mr = kernel.mr;
+  int nr = kernel.nr;
+  int64_t n_padded = roundUp(n, nr);
+  int64_t n_blocks = (n + nc_max - 1) / nc_max;
+  int64_t tasks = (m + mc_max - 1) / mc_max * n_blocks;
+  ctx.parallelFor(static_cast<size_t>(tasks), [&](size_t begin, size_t end) {
+    auto panels_of_a = make_panels();
+    float tile[kMaxMr * kMaxNr];
+    for (size_t t = begin; t < end; t++) {
+      int64_t ic = static_cast<int64_t>(t) / n_blocks * mc_max;
+      int64_t jc = static_cast<int64_t>(t) % n_blocks * nc_max;
+      int64_t mc = std::min(mc_max, m - ic);
+      int64_t nc = std::min(nc_max, n - jc);
+      for (int64_t pc = 0; pc < k; pc += kKc) {
+        int64_t kc = std::min(kKc, k - pc);
+        const float* a_block = panels_of_a(ic, mc, pc, kc);
+        const float* b_block = b.data() + pc * n_padded;
+        bool add = accumulate || pc > 0;
+        for (int64_t jr = 0; jr < nc; jr += nr) {
+          const float* b_panel = b_block + (jc + jr) * kc;
+          int64_t cols = std::min<int64_t>(nr, nc - jr);
+          for (int64_t ir = 0; ir < mc; ir += mr) {
+            const float* a_panel = a_block + ir * kc;
+            int64_t rows = std::min<int64_t>(mr, mc - ir);
+            float* out =
+                c + (ic + ir) * c_row_stride + (jc + jr) * c_col_stride;
+            if (rows == mr && cols == nr && c_col_stride == 1) {
+              kernel.run(kc, a_panel, b_panel, out, c_row_stride, add);
+              continue;
+            }
+            // edge tiles and strided columns go through a full tile
+            kernel.run(kc, a_panel, b_panel, tile, nr, false);
+            for (int64_t r = 0; r < rows; r++) {
+              for (int64_t j = 0; j < cols; j++) {
+                float value = tile[r * nr + j];
+                float& y = out[r * c_row_stride + j * c_col_stride];
+                y = add ? y + value : value;
+              }
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+}  // namespace
+
+void Sgemm(int64_t m, const float* a, int64_t a_row_stride,
+           int64_t a_col_stride, float alpha, const PackedGemmB& b, float* c,
+           int64_t c_row_stride, int64_t c_col_stride, bool accumulate,
+           const KernelContext& ctx, const GemmBlocking& blocking) {
+  int mr = fp32KernelOf(b.isa()).mr;
+  int64_t k = b.k();
+  sgemmBlocks(m, b, c, c_row_stride, c_col_stride, accumulate, ctx,
+              blocking, [&] {
+                return PackingA(a, a_row_stride, a_col_stride, alpha, mr, k,
+                                blocking.mc);
+              });
+}
+
+void Sgemm(const PackedGemmA& a, const PackedGemmB& b, float* c,
+           int64_t c_row_stride, int64_t c_col_stride, bool accumulate,
+           const KernelContext& ctx, const GemmBlocking& blocking) {
+  ONNX_ASSERTM(a.isa() == b.isa() && a.k() == b.k(),
+               "A of %lld columns for instruction set %d times B of %lld "
+               "rows for %d",
+               (long long)a.k(), static_cast<int>(a.isa()), (long long)b.k(),
+               static_cast<int>(b.isa()));
+  int64_t m_padded = roundUp(a.m(), fp32KernelOf(a.isa()).mr);
+  // the panels of a row block are consecutive, mc being a multiple of mr
+  auto panels = [&a, m_padded](int64_t ic, int64_t, int64_t pc,
+                               int64_t kc) {
+    return a.data() + pc * m_padded + ic * kc;
+  };
+  sgemmBlocks(a.m(), b, c, c_row_stride, c_col_stride, accumulate, ctx,
+              blocking, [&panels] { return panels; });
+}
+
+PackedGemmBInt8::PackedGemmBInt8(const void* b, bool is_signed, int64_t k,
+                                 int64_t n, int64_t row_stride,
+                                 int64_t col_stride,
+                                 const std::vector<int32_t>& zero_points,
+                                 GemmIsa isa)
+    : k_(k), n_(n), isa_(isa) {
+  ONNX_ASSERTM(CpuSupports(isa), "the CPU lacks GEMM instruction set %d",
+               static_cast<int>(isa));
+  ONNX_ASSERTM(zero_points.size() == 1 ||
+                   zero_points.size() == static_cast<size_t>(n),
+               "B has %lld columns but %zu zero points", (long long)n,
+               zero_points.size());
+  // B - 128 is int8 for uint8 B
+  int32_t shift = is_signed ? 0 : 128;
+  column_sums_.assign(n, 0);
+  column_offsets_.resize(n);
+  for (int64_t j = 0; j < n; j++) {
+    column_offsets_[j] = zero_points[zero_points.size() == 1 ? 0 : j] - shift;
+  }
+  int nr = int8KernelOf(isa).nr;
+  int64_t n_padded = roundUp(n, nr);
+  if (k * n_padded == 0) return;
+  data_.create(toInt(roundUp(k, 4) * n_padded), size_t{1});
+  const uint8_t* bytes = static_cast<const uint8_t*>(b);
+  int8_t* out = data_;
+  for (int64_t pc = 0; pc < k; pc += kKcInt8) {
+    int64_t kc = std::min(kKcInt8, k - pc);
+    for (int64_t jc = 0; jc < n_padded; jc += nr) {
+      for (int64_t p4 = 0; p4 < kc; p4 += 4) {
+        for (int j = 0; j < nr; j++) {
+          for (int t = 0; t < 4; t++) {
+            int64_t p = pc + p4 + t;
+            int64_t col = jc + j;
+            int8_t value = 0;
+            if (p4 + t < kc && col < n) {
+              value = int8_t(loadInt8(bytes, is_signed,
+                                      p * row_stride + col * col_stride) -
+                             shift);
+              column_sums_[col] += value;
+            }
+            *out++ = value;
+          }
+        }
+      }
+    }
+  }
+}
+
+void GemmInt8(int64_t m, const void* a, bool a_signed, int64_t a_row_stride,
+              int64_t a_col_stride, const std::vector<int32_t>& a_zero_points,
+              const PackedGemmBInt8& b, int32_t* c, int64_t ldc,
+              const KernelContext& ctx) {
+  ONNX_ASSERTM(a_zero_points.size() == 1 ||
+                   a_zero_points.size() == static_cast<size_t>(m),
+               "A has %lld rows but %zu zero points", (long long)m,
+               a_zero_points.size());
+  int64_t n = b.n();
+  int64_t k = b.k();
+  if (m <= 0 || n <= 0) return;
+  if (k == 0) {
+    for (int64_t i = 0; i < m; i++) std::fill_n(c + i * ldc, n, 0);
+    return;
+  }
+  const Int8Kernel& kernel = int8KernelOf(b.isa());
+  int mr = kernel.mr;
+  int nr = kernel.nr;
+  int64_t n_padded = roundUp(n, nr);
+  int64_t n_blocks = (n + kNc - 1) / kNc;
+  int64_t tasks = (m + kMc - 1) / kMc * n_blocks;
+  const uint8_t* bytes = static_cast<const uint8_t*>(a);
+  // A + 128 is uint8 for int8 A
+  int32_t shift = a_signed ? 128 : 0;
+  ctx.parallelFor(static_cast<size_t>(tasks), [&](size_t begin, size_t end) {
+    std::vector<uint8_t> packed_a(kMc * kKcInt8);
+    std::vector<int32_t> row_sums(kMc);
+    int32_t tile[kMaxMr * kMaxNr];
+    for (size_t t = begin; t < end; t++) {
+      int64_t ic = static_cast<int64_t>(t) / n_blocks * kMc;
+      int64_t jc = static_cast<int64_t>(t) % n_blocks * kNc;
+      int64_t mc = std::min(kMc, m - ic);
+      int64_t nc = std::min(kNc, n - jc);
+      for (int64_t r = 0; r < mc; r++) {
+        int32_t sum = 0;
+        for (int64_t p = 0; p < k; p++) {
+          sum += loadInt8(bytes, a_signed,
+                          (ic + r) * a_row_stride + p * a_col_stride) +
+                 shift;
+        }
+        row_sums[r] = sum;
+      }
+      for (int64_t pc = 0; pc < k; pc += kKcInt8) {
+        int64_t kc = std::min(kKcInt8, k - pc);
+        int64_t kc4 = roundUp(kc, 4);
+        packAInt8(bytes + ic * a_row_stride + pc * a_col_stride, a_signed,
+                  mc, kc, a_row_stride, a_col_stride, mr, packed_a.data());
+        const int8_t* b_block = b.data() + pc * n_padded;
+        for (int64_t jr = 0; jr < nc; jr += nr) {
+          const int8_t* b_panel = b_block + (jc + jr) * kc4;
+          int64_t cols = std::min<int64_t>(nr, nc - jr);
+          for (int64_t ir = 0; ir < mc; ir += mr) {
+            const uint8_t* a_panel = packed_a.data() + ir * kc4;
+            int64_t rows = std::min<int64_t>(mr, mc - ir);
+            int32_t* out = c + (ic + ir) * ldc + jc + jr;
+            if (rows == mr && cols == nr) {
+              kernel.run(kc4 / 4, a_panel, b_panel, out, ldc, pc > 0);
+              continue;
+            }
+            kernel.run(kc4 / 4, a_panel, b_panel, tile, nr, false);
+            for (int64_t r = 0; r < rows; r++) {
+              for (int64_t j = 0; j < cols; j++) {
+                int32_t value = tile[r * nr + j];
+                out[r * ldc + j] = pc > 0 ? out[r * ldc + j] + value : value;
+              }
+            }
+          }
+        }
+      }
+      // sum (a' - a0) (b' - b0) = sum a' b' - b0 sum a' - a0 sum b'
+      // + k a0 b0, for the shifted a' and b' with a0 and b0 standing for
+      // the zero points
+      for (int64_t r = 0; r < mc; r++) {
+        int32_t a0 = shift + a_zero_points[a_zero_points.size() == 1
+                                               ? 0
+                                               : ic + r];
+        int32_t* row = c + (ic + r) * ldc;
+        for (int64_t col = jc; col < jc + nc; col++) {
+          int32_t b0 = b.columnOffsets()[col];
+          row[col] += -b0 * row_sums[r] - a0 * b.columnSums()[col] +
+                      int32_t(k) * a0 * b0;
+        }
+      }
+    }
+  });
+}
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "ncnn/mat.h"
+#include "runtime/kernel.h"
+
+namespace my_ai_training::runtime {
+
+// The instruction sets of the GEMM micro-kernels. kGeneric is plain C++
+// the compiler vectorizes for the baseline, SSE2 on x86-64; int8 GEMMs
+// only have a kAvx512Vnni kernel besides it.
+enum class GemmIsa { kGeneric, kAvx2Fma, kAvx512, kAvx512Vnni };
+
+bool CpuSupports(GemmIsa isa);
+// the last GemmIsa the CPU supports
+GemmIsa BestGemmIsa();
+
+// The k x n right hand side B of C = A * B, packed the way the
+// micro-kernels of 'isa' stream it, BLIS style: blocks of rows sized for
+// the L1 cache, each cut into panels of as many columns as a micro-kernel
+// writes, stored row by row and padded with zeros. Weights are packed once
+// when a plan is compiled.
+class PackedGemmB {
+ public:
+  // Packs element (i, j) of B from b[i * row_stride + j * col_stride], so
+  // a transposed B swaps the strides.
+  PackedGemmB(const float* b, int64_t k, int64_t n, int64_t row_stride,
+              int64_t col_stride, GemmIsa isa = BestGemmIsa());
+  // Same for a B computed while running, packed on the intra-op pool of
+  // 'ctx' into memory of its allocator.
+  PackedGemmB(const float* b, int64_t k, int64_t n, int64_t row_stride,
+              int64_t col_stride, const KernelContext& ctx);
+
+  int64_t k() const { return k_; }
+  int64_t n() const { return n_; }
+  GemmIsa isa() const { return isa_; }
+  const float* data() const { return data_; }
+
+ private:
+  // the panels [begin, end) of every block of rows
+  void pack(const float* b, int64_t row_stride, int64_t col_stride,
+            int64_t begin, int64_t end);
+
+  int64_t k_;
+  int64_t n_;
+  GemmIsa isa_;
+  ncnn::Mat data_;
+};
+
+// The m x k left hand side A of C = A * B, packed as Sgemm() packs the
+// rows of A each task reads: blocks of columns, each cut into panels of as
+// many rows as a micro-kernel of 'isa' writes, stored column by column.
+// Weights are packed once rather than by every Sgemm() reading them.
+class PackedGemmA {
+ public:
+  // Packs element (i, j) of A from a[i * row_stride + j * col_stride].
+  PackedGemmA(const float* a, int64_t m, int64_t k, int64_t row_stride,
+              int64_t col_stride, GemmIsa isa = BestGemmIsa());
+
+  int64_t m() const { return m_; }
+  int64_t k() const { return k_; }
+  GemmIsa isa() const { return isa_; }
+  const float* data() const { return data_; }
+
+ private:
+  int64_t m_;
+  int64_t k_;
+  GemmIsa isa_;
+  ncnn::Mat data_;
+};
+
+// The blocks of C an Sgemm task computes: 'mc' rows, for the rows of A a
+// task packs to stay in the L2 cache, by 'nc' columns. mc is a multiple of
+// kGemmRowQuantum, so of the rows of every micro-kernel, and nc of
+// kGemmColumnQuantum. The autotuner picks others than the defaults per
+// shape and CPU.
+constexpr int64_t kGemmRowQuantum = 24;
+constexpr int64_t kGemmColumnQuantum = 32;
+struct GemmBlocking {
+  int64_t mc = 120;
+  int64_t nc = 512;
+};
+
+// C = alpha * A * B, plus C if 'accumulate', for the m x k matrix A with
+// element (i, j) at a[i * a_row_stride + j * a_col_stride], and C strided
+// likewise. Blocks of C run on the intra-op pool of 'ctx', each packing
+// the rows of A it reads. C is fastest with contiguous columns, which the
+// micro-kernels store to directly.
+void Sgemm(int64_t m, const float* a, int64_t a_row_stride,
+           int64_t a_col_stride, float alpha, const PackedGemmB& b, float* c,
+           int64_t c_row_stride, int64_t c_col_stride, bool accumulate,
+           const KernelContext& ctx,
+           const GemmBlocking& blocking = GemmBlocking());
+// Same for an A packed beforehand for the instruction set of 'b'.
+void Sgemm(const PackedGemmA& a, const PackedGemmB& b, float* c,
+           int64_t c_row_stride, int64_t c_col_stride, bool accumulate,
+           const KernelContext& ctx,
+           const GemmBlocking& blocking = GemmBlocking());
+
+// Runs fn(i) for the 'count' GEMMs of a batched product, in parallel on
+// the intra-op pool of 'ctx' when there are several; a single one runs its
+// GEMM in parallel instead.
+template <typename F>
+void ForEachGemm(int64_t count, const KernelContext& ctx, F fn) {
+  if (count == 1) {
+    fn(int64_t{0});
+    return;
+  }
+  ctx.parallelFor(static_cast<size_t>(count),
+                  [&fn](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) fn(int64_t(i));
+                  });
+}
+
+// B of an int8 GEMM, packed as for PackedGemmB with groups of 4 rows
+// interleaved for the dot product instructions, and shifted to int8 with
+// the column sums the zero points are corrected with.
+class PackedGemmBInt8 {
+ public:
+  // Packs B of int8 or, if not 'is_signed', uint8 elements as for
+  // PackedGemmB. 'zero_points' holds one per column or one for all.
+  PackedGemmBInt8(const void* b, bool is_signed, int64_t k, int64_t n,
+                  int64_t row_stride, int64_t col_stride,
+                  const std::vector<int32_t>& zero_points,
+                  GemmIsa isa = BestGemmIsa());
+
+  int64_t k() const { return k_; }
+  int64_t n() const { return n_; }
+  GemmIsa isa() const { return isa_; }
+  const int8_t* data() const { return data_; }
+  // the sums of the packed columns, and the values their zeros stand for
+  const std::vector<int32_t>& columnSums() const { return column_sums_; }
+  const std::vector<int32_t>& columnOffsets() const {
+    return column_offsets_;
+  }
+
+ private:
+  int64_t k_;
+  int64_t n_;
+  GemmIsa isa_;
+  ncnn::Mat data_;
+  std::vector<int32_t> column_sums_;
+  std::vector<int32_t> column_offsets_;
+};
+
+// C = (A - a_zero_points) * (B - its zero points) in int32, as Sgemm() for
+// A of int8 or, if not 'a_signed', uint8 elements, and the rows of C 'ldc'
+// apart. 'a_zero_points' holds one per row or one for all.
+void GemmInt8(int64_t m, const void* a, bool a_signed, int64_t a_row_stride,
+              int64_t a_col_stride, const std::vector<int32_t>& a_zero_points,
+              const PackedGemmBInt8& b, int32_t* c, int64_t ldc,
+              const KernelContext& ctx);
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,125 @@
+#include "runtime/kernel.h"
+
+#include <utility>
+
+#include "optimizer/reference_kernels.h"
+#include "runtime/kernels.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+
+ncnn::Mat& KernelContext::createOutput(const Instruction& inst, size_t i,
+                                       std::vector<int64_t> sizes,
+                                       int32_t elem_type) {
+  SlotValue& out = output(inst, i);
+  CreateMat(sizes, ir::elemSizeOf(elem_type), outputInfo(inst, i).elempack,
+            frame_->allocator, &out.mat);
+  out.sizes = std::move(sizes);
+  out.elem_type = elem_type;
+  return out.mat;
+}
+
+ncnn::Mat& KernelContext::createOutputInPlace(const Instruction& inst,
+                                              size_t out, size_t in,
+                                              std::vector<int64_t> sizes,
+                                              int32_t elem_type) {
+  const SlotValue& x = input(inst, in);
+  if (x.sizes != sizes || x.elem_type != elem_type ||
+      x.mat.elempack != outputInfo(inst, out).elempack ||
+      !canOverwriteInput(inst, in)) {
+    return createOutput(inst, out, std::move(sizes), elem_type);
+  }
+  SlotValue& y = output(inst, out);
+  // the input slot lets go of it once this instruction finished
+  y.mat = x.mat;
+  y.sizes = std::move(sizes);
+  y.elem_type = elem_type;
+  return y.mat;
+}
+
+namespace {
+
+// Packing: the input in the elempack of the output slot
+bool runPacking(const Instruction& inst, KernelContext& ctx) {
+  const SlotValue& in = ctx.input(inst, 0);
+  SlotValue& out = ctx.output(inst, 0);
+  int elempack = ctx.outputInfo(inst, 0).elempack;
+  ncnn::convert_packing(in.mat, out.mat, elempack, ctx.allocator());
+  out.sizes = in.sizes;
+  out.elem_type = in.elem_type;
+  return out.mat.elempack == elempack || in.mat.empty();
+}
+
+// a copy of the node in a graph of its own, so the plan does not keep the
+// model's graph alive
+struct ReferenceParams {
+  ir::Graph graph;
+  ir::Node* node = nullptr;
+};
+
+}  // namespace
+
+std::shared_ptr<const void> PrepareReference(const ir::Node& node) {
+  auto params = std::make_shared<ReferenceParams>();
+  std::vector<ir::Value*> inputs;
+  for (size_t i = 0; i < node.inputs().size(); i++) {
+    inputs.push_back(params->graph.addInput());
+  }
+  ir::Node* copy = params->graph.create(node.kind(), inputs,
+                                        node.outputs().size());
+  copy->copyAttributes(node);
+  if (node.has_domain()) copy->setDomain(node.domain());
+  params->node = params->graph.appendNode(copy);
+  return params;
+}
+
+bool RunReference(const Instruction& inst, KernelContext& ctx) {
+  std::vector<ir::Tensor> tensors(inst.num_inputs);
+  std::vector<const ir::Tensor*> inputs(inst.num_inputs, nullptr);
+  for (size_t i = 0; i < inst.num_inputs; i++) {
+    if (!ctx.hasInput(inst, i)) continue;
+    const SlotValue& in = ctx.input(inst, i);
+    MatToTensor(in.mat, in.elem_type, in.sizes, &tensors[i]);
+    inputs[i] = &tensors[i];
+  }
+  std::vector<ir::Tensor> outputs;
+  if (!optimization::EvaluateNode(inst.paramsAs<ReferenceParams>().node,
+                                  inputs, &outputs)) {
+    return false;
+  }
+  for (size_t i = 0; i < outputs.size(); i++) {
+    SlotValue& out = ctx.output(inst, i);
+    TensorToMat(outputs[i], ctx.outputInfo(inst, i).elempack,
+                ctx.allocator(), &out.mat);
+    out.sizes = outputs[i].sizes();
+    out.elem_type = outputs[i].elem_type();
+  }
+  return true;
+}
+
+KernelRegistry& KernelRegistry::global() {
+  static auto* registry = [] {
+    auto* registry = new KernelRegistry();
+    registry->registerKernel(ir::kPacking, Kernel{runPacking, nullptr});
+    // replaced by the native kernels registered after them
+    for (ir::NodeKind kind : optimization::ReferenceKernelKinds()) {
+      registry->registerKernel(kind, Kernel{RunReference, PrepareReference});
+    }
+    RegisterElementwiseKernels(registry);
+    RegisterMatMulKernels(registry);
+    RegisterConvKernels(registry);
+    return registry;
+  }();
+  return *registry;
+}
+
+void KernelRegistry::registerKernel(ir::NodeKind kind, Kernel kernel) {
+  kernels_[kind] = kernel;
+}
+
+const Kernel* KernelRegistry::find(ir::NodeKind kind) const {
+  auto it = kernels_.find(kind);
+  return it == kernels_.end() ? nullptr : &it->second;
+}
+
+}  // namespace my_ai_training::runtime
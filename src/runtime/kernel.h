@@ -0,0 +1,191 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/intra_op_pool.h"
+#include "ncnn/mat.h"
+#include "onnx_ir/ir.h"
+
+namespace my_ai_training::runtime {
+
+// the operand of an omitted optional input
+constexpr uint32_t kNoSlot = std::numeric_limits<uint32_t>::max();
+
+// What the compiler knows about the values a slot holds.
+struct SlotInfo {
+  int32_t elem_type = ir::TensorProto_DataType_UNDEFINED;
+  int elempack = 1;
+  bool has_static_sizes = false;
+  std::vector<int64_t> sizes;
+  // holds a weight of the plan, the same in every frame
+  bool constant = false;
+  // read by one operand of one instruction, and not a graph input or
+  // output, so that instruction may overwrite it
+  bool single_reader = false;
+};
+
+// The value in a slot during a run.
+struct SlotValue {
+  ncnn::Mat mat;
+  // the logical shape, which the Mat only holds with N and C merged
+  std::vector<int64_t> sizes;
+  int32_t elem_type = ir::TensorProto_DataType_UNDEFINED;
+};
+
+// The state of one run of a plan. Slots of constants share the weights of
+// the plan.
+struct Frame {
+  std::vector<SlotValue> slots;
+  ncnn::Allocator* allocator = nullptr;
+  // for the loops inside kernels; null runs them on the calling thread
+  IntraOpPool* intra_op_pool = nullptr;
+};
+
+struct Instruction;
+class KernelContext;
+
+// A kernel computes the outputs of an instruction from its inputs and
+// returns false if it can not, e.g. for inputs of the wrong shape.
+using KernelFn = bool (*)(const Instruction& inst, KernelContext& ctx);
+
+// Resolves what a kernel needs from its node, once when compiling: the
+// attributes, and possibly constant inputs in a kernel specific layout.
+using PrepareFn = std::shared_ptr<const void> (*)(const ir::Node& node);
+
+// One node of the graph, bound to its kernel.
+struct Instruction {
+  KernelFn kernel = nullptr;
+  // from the kernel's PrepareFn, or null
+  const void* params = nullptr;
+  ir::NodeKind op;
+  uint16_t num_inputs = 0;
+  uint16_t num_outputs = 0;
+  // the slots of the inputs, then those of the outputs, in the plan's
+  // operands()
+  uint32_t first_operand = 0;
+  // the slots whose last reader this is, in the plan's releases()
+  uint32_t first_release = 0;
+  uint32_t num_releases = 0;
+
+  template <typename T>
+  const T& paramsAs() const {
+    return *static_cast<const T*>(params);
+  }
+};
+
+class KernelContext {
+ public:
+  KernelContext(const uint32_t* operands, const SlotInfo* infos,
+                Frame* frame)
+      : operands_(operands), infos_(infos), frame_(frame) {}
+
+  bool hasInput(const Instruction& inst, size_t i) const {
+    return i < inst.num_inputs && inputSlot(inst, i) != kNoSlot;
+  }
+  const SlotValue& input(const Instruction& inst, size_t i) const {
+    return frame_->slots[inputSlot(inst, i)];
+  }
+  const SlotInfo& inputInfo(const Instruction& inst, size_t i) const {
+    return infos_[inputSlot(inst, i)];
+  }
+  SlotValue& output(const Instruction& inst, size_t i) const {
+    return frame_->slots[outputSlot(inst, i)];
+  }
+  const SlotInfo& outputInfo(const Instruction& inst, size_t i) const {
+    return infos_[outputSlot(inst, i)];
+  }
+  ncnn::Allocator* allocator() const { return frame_->allocator; }
+
+  // Calls fn(begin, end) on ranges covering [0, n) on the frame's intra-op
+  // pool, e.g. over the channels of a Mat, each range writing its own
+  // part of the outputs.
+  template <typename F>
+  void parallelFor(
+      size_t n, F&& fn,
+      IntraOpPool::Schedule schedule = IntraOpPool::Schedule::kStatic,
+      size_t grain = 1) const {
+    if (frame_->intra_op_pool == nullptr) {
+      if (n > 0) fn(size_t{0}, n);
+      return;
+    }
+    frame_->intra_op_pool->parallelFor(n, std::forward<F>(fn), schedule,
+                                       grain, max_threads_);
+  }
+
+  // This context with its loops on at most 'max_threads' threads of the
+  // pool, or all of them if <= 0, as tuned for a kernel.
+  KernelContext withMaxThreads(int max_threads) const {
+    KernelContext ctx = *this;
+    ctx.max_threads_ = max_threads;
+    return ctx;
+  }
+
+  // Allocates output 'i' for a tensor of 'sizes' and 'elem_type' in the
+  // elempack of its slot.
+  ncnn::Mat& createOutput(const Instruction& inst, size_t i,
+                          std::vector<int64_t> sizes, int32_t elem_type);
+
+  // Whether the kernel may overwrite input 'i': its slot is single_reader
+  // and no other Mat shares its buffer.
+  bool canOverwriteInput(const Instruction& inst, size_t i) const {
+    const ncnn::Mat& m = input(inst, i).mat;
+    return inputInfo(inst, i).single_reader && m.refcount != nullptr &&
+           *m.refcount == 1;
+  }
+
+  // As createOutput(), but output 'out' takes the buffer of input 'in' if
+  // that holds a tensor of the same shape, type and layout and
+  // canOverwriteInput(), for kernels that read each element before they
+  // write the one at its index.
+  ncnn::Mat& createOutputInPlace(const Instruction& inst, size_t out,
+                                 size_t in, std::vector<int64_t> sizes,
+                                 int32_t elem_type);
+
+ private:
+  uint32_t inputSlot(const Instruction& inst, size_t i) const {
+    return operands_[inst.first_operand + i];
+  }
+  uint32_t outputSlot(const Instruction& inst, size_t i) const {
+    return operands_[inst.first_operand + inst.num_inputs + i];
+  }
+
+  const uint32_t* operands_;
+  const SlotInfo* infos_;
+  Frame* frame_;
+  int max_threads_ = 0;
+};
+
+struct Kernel {
+  KernelFn run = nullptr;
+  PrepareFn prepare = nullptr;
+  // reads and writes elempack > 1 without unpacking; the ops of
+  // optimization::PackedLayoutKinds() need it
+  bool runs_packed = false;
+};
+
+// Kernels by op. A kernel takes its inputs in the elempack of their slots
+// and writes its outputs in the elempack of theirs; which ones those are
+// is up to assign_layouts, which packs only optimization::PackedLayoutKinds().
+class KernelRegistry {
+ public:
+  // holds the kernels of src/runtime, and for ops without one of their
+  // own the reference kernels of src/optimizer
+  static KernelRegistry& global();
+
+  // replaces the kernel of the same op
+  void registerKernel(ir::NodeKind kind, Kernel kernel);
+  // nullptr if there is no kernel for 'kind'
+  const Kernel* find(ir::NodeKind kind) const;
+
+ private:
+  std::unordered_map<uint32_t, Kernel> kernels_;
+};
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <memory>
+
+#include "runtime/kernel.h"
+
+namespace my_ai_training::runtime {
+
+// The kernels of src/runtime, by family, which KernelRegistry::global()
+// holds.
+
+// Gemm, MatMul and MatMulInteger, on the GEMMs of gemm.h
+void RegisterMatMulKernels(KernelRegistry* registry);
+// Conv, on the engine of convolution.h
+void RegisterConvKernels(KernelRegistry* registry);
+// Add, Sub, Mul, Div, Pow, PRelu, Neg, Exp, Sigmoid and Tanh in float, on
+// the loops of elementwise.h
+void RegisterElementwiseKernels(KernelRegistry* registry);
+
+// The constant folding kernels of src/optimizer, run on tensor copies of
+// the Mats: slow, but they cover every op of optimization::
+// HasReferenceKernel() in any layout and element type, e.g. for kernels
+// to fall back on.
+std::shared_ptr<const void> PrepareReference(const ir::Node& node);
+bool RunReference(const Instruction& inst, KernelContext& ctx);
+
+}  // namespace my_ai_training::runtime
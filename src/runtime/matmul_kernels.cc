@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "optimizer/fold_constants.h"
+#include "runtime/autotuner.h"
+#include "runtime/gemm.h"
+#include "runtime/kernels.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+constexpr int32_t kFloat = ir::TensorProto_DataType_FLOAT;
+
+bool isInt8(int32_t elem_type) {
+  return elem_type == ir::TensorProto_DataType_INT8 ||
+         elem_type == ir::TensorProto_DataType_UINT8;
+}
+
+// the payload of input 'i' of 'node' if it is a constant matrix
+const ir::Tensor* constantMatrix(const ir::Node& node, size_t i) {
+  if (i >= node.inputs().size()) return nullptr;
+  const ir::Tensor* t = optimization::FindConstant(node.inputs()[i]);
+  if (t == nullptr || t->sizes().size() != 2 ||
+      t->byteSize() != t->expectedByteSize()) {
+    return nullptr;
+  }
+  return t;
+}
+
+// The shapes of a MatMul: its batch dims, broadcast, and the m x k times
+// k x n product of each batch.
+struct MatMulShape {
+  // 1-D operands are promoted to matrices and the extra dim dropped after
+  bool a_vector = false;
+  bool b_vector = false;
+  int64_t m = 0;
+  int64_t k = 0;
+  int64_t n = 0;
+  std::vector<int64_t> a_batch;
+  std::vector<int64_t> b_batch;
+  std::vector<int64_t> batch;
+  int64_t count = 1;
+  std::vector<int64_t> output_sizes;
+
+  // false if the operands do not multiply
+  bool init(std::vector<int64_t> a, std::vector<int64_t> b) {
+    if (a.empty() || b.empty()) return false;
+    a_vector = a.size() == 1;
+    b_vector = b.size() == 1;
+    if (a_vector) a.insert(a.begin(), 1);
+    if (b_vector) b.push_back(1);
+    m = a[a.size() - 2];
+    k = a.back();
+    n = b.back();
+    if (b[b.size() - 2] != k) return false;
+    a_batch.assign(a.begin(), a.end() - 2);
+    b_batch.assign(b.begin(), b.end() - 2);
+    size_t rank = std::max(a_batch.size(), b_batch.size());
+    batch.assign(rank, 1);
+    for (size_t i = 0; i < rank; i++) {
+      int64_t x = extentAt(a_batch, rank, i);
+      int64_t y = extentAt(b_batch, rank, i);
+      if (x != y && x != 1 && y != 1) return false;
+      batch[i] = x == 1 ? y : x;
+      count *= batch[i];
+    }
+    output_sizes = batch;
+    if (!a_vector) output_sizes.push_back(m);
+    if (!b_vector) output_sizes.push_back(n);
+    return true;
+  }
+
+  // which matrix of an operand of 'dims' batch 'i' reads
+  int64_t operandIndex(const std::vector<int64_t>& dims, int64_t i) const {
+    int64_t index = 0;
+    int64_t stride = 1;
+    for (size_t d = batch.size(); d-- > 0;) {
+      int64_t coordinate = i % batch[d];
+      i /= batch[d];
+      int64_t extent = extentAt(dims, batch.size(), d);
+      if (extent != 1) index += coordinate * stride;
+      stride *= extent;
+    }
+    return index;
+  }
+
+  // dim 'i' of 'dims' aligned to the right in 'rank' dims
+  static int64_t extentAt(const std::vector<int64_t>& dims, size_t rank,
+                          size_t i) {
+    size_t offset = rank - dims.size();
+    return i < offset ? 1 : dims[i - offset];
+  }
+};
+
+// the first element of matrix 'index' of 'v', 'rows' x 'cols' each
+const void* matrixOf(const SlotValue& v, bool vector, int64_t index,
+                     int64_t rows, int64_t cols) {
+  return vector ? v.mat.data : ElementData(v.mat, v.sizes, index * rows * cols);
+}
+
+struct GemmParams {
+  float alpha = 1.f;
+  float beta = 1.f;
+  bool trans_a = false;
+  bool trans_b = false;
+  TuningConfig tuning;
+  // B packed when the plan is compiled, if it is a constant
+  std::shared_ptr<const PackedGemmB> packed_b;
+};
+
+std::shared_ptr<const void> prepareGemm(const ir::Node& node) {
+  auto params = std::make_shared<GemmParams>();
+  if (node.hasAttribute(ir::kalpha)) params->alpha = node.f(ir::kalpha);
+  if (node.hasAttribute(ir::kbeta)) params->beta = node.f(ir::kbeta);
+  if (node.hasAttribute(ir::ktransA)) params->trans_a = node.i(ir::ktransA);
+  if (node.hasAttribute(ir::ktransB)) params->trans_b = node.i(ir::ktransB);
+  params->tuning = TuningConfigOf(node);
+  const ir::Tensor* b = constantMatrix(node, 1);
+  if (b != nullptr && b->elem_type() == kFloat) {
+    int64_t rows = b->sizes()[0];
+    int64_t cols = b->sizes()[1];
+    params->packed_b =
+        params->trans_b
+            ? std::make_shared<PackedGemmB>(b->data<float>(), cols, rows, 1,
+                                            cols)
+            : std::make_shared<PackedGemmB>(b->data<float>(), rows, cols,
+                                            cols, 1);
+  }
+  return params;
+}
+
+// Y = beta * C broadcast to m x n, or false if C does not broadcast.
+bool fillBias(const SlotValue& c, float beta, int64_t m, int64_t n,
+              float* y) {
+  if (c.elem_type != kFloat || c.sizes.size() > 2) return false;
+  int64_t rows = c.sizes.size() == 2 ? c.sizes[0] : 1;
+  int64_t cols = c.sizes.empty() ? 1 : c.sizes.back();
+  if ((rows != 1 && rows != m) || (cols != 1 && cols != n)) return false;
+  const float* data = c.mat;
+  int64_t row_stride = rows == 1 ? 0 : cols;
+  int64_t col_stride = cols == 1 ? 0 : 1;
+  for (int64_t i = 0; i < m; i++) {
+    for (int64_t j = 0; j < n; j++) {
+      y[i * n + j] = beta * data[i * row_stride + j * col_stride];
+    }
+  }
+  return true;
+}
+
+// Gemm: Y = alpha * A' * B' + beta * C for A and B of rank 2, possibly
+// transposed, in float
+bool runGemm(const Instruction& inst, KernelContext& ctx) {
+  const GemmParams& params = inst.paramsAs<GemmParams>();
+  const SlotValue& a = ctx.input(inst, 0);
+  if (a.elem_type != kFloat || a.sizes.size() != 2) return false;
+  int64_t m = params.trans_a ? a.sizes[1] : a.sizes[0];
+  int64_t k = params.trans_a ? a.sizes[0] : a.sizes[1];
+  const PackedGemmB* packed_b = params.packed_b.get();
+  std::unique_ptr<PackedGemmB> packed;
+  if (packed_b == nullptr) {
+    const SlotValue& b = ctx.input(inst, 1);
+    if (b.elem_type != kFloat || b.sizes.size() != 2) return false;
+    int64_t rows = b.sizes[0];
+    int64_t cols = b.sizes[1];
+    packed = params.trans_b
+                 ? std::make_unique<PackedGemmB>(b.mat, cols, rows, 1, cols)
+                 : std::make_unique<PackedGemmB>(b.mat, rows, cols, cols, 1);
+    packed_b = packed.get();
+  }
+  if (packed_b->k() != k) return false;
+  int64_t n = packed_b->n();
+  float* y = ctx.createOutput(inst, 0, {m, n}, kFloat);
+  bool accumulate = false;
+  if (ctx.hasInput(inst, 2) && params.beta != 0.f) {
+    if (!fillBias(ctx.input(inst, 2), params.beta, m, n, y)) return false;
+    accumulate = true;
+  }
+  Sgemm(m, a.mat, params.trans_a ? 1 : k, params.trans_a ? m : 1,
+        params.alpha, *packed_b, y, n, 1, accumulate,
+        ctx.withMaxThreads(params.tuning.threads), params.tuning.blocking);
+  return true;
+}
+
+struct MatMulParams {
+  TuningConfig tuning;
+  std::shared_ptr<const PackedGemmB> packed_b;
+};
+
+std::shared_ptr<const void> prepareMatMul(const ir::Node& node) {
+  auto params = std::make_shared<MatMulParams>();
+  params->tuning = TuningConfigOf(node);
+  const ir::Tensor* b = constantMatrix(node, 1);
+  if (b != nullptr && b->elem_type() == kFloat) {
+    int64_t cols = b->sizes()[1];
+    params->packed_b = std::make_shared<PackedGemmB>(
+        b->data<float>(), b->sizes()[0], cols, cols, 1);
+  }
+  return params;
+}
+
+// MatMul: numpy's matmul in float, batches broadcasting
+bool runMatMul(const Instruction& inst, KernelContext& ctx) {
+  const MatMulParams& params = inst.paramsAs<MatMulParams>();
+  const SlotValue& a = ctx.input(inst, 0);
+  const SlotValue& b = ctx.input(inst, 1);
+  MatMulShape shape;
+  if (a.elem_type != kFloat || b.elem_type != kFloat ||
+      !shape.init(a.sizes, b.sizes)) {
+    return false;
+  }
+  ncnn::Mat& y = ctx.createOutput(inst, 0, shape.output_sizes, kFloat);
+  int64_t a_ld = shape.a_vector ? shape.k : RowStride(a.mat, a.sizes);
+  int64_t b_ld = shape.b_vector ? 1 : RowStride(b.mat, b.sizes);
+  // a vector result is contiguous
+  int64_t y_ld = shape.a_vector || shape.b_vector
+                     ? shape.n
+                     : RowStride(y, shape.output_sizes);
+  // B is packed once unless it has batches of its own
+  std::shared_ptr<const PackedGemmB> shared_b = params.packed_b;
+  if (shared_b == nullptr && shape.b_batch.empty()) {
+    shared_b = std::make_shared<PackedGemmB>(
+        static_cast<const float*>(b.mat.data), shape.k, shape.n, b_ld, 1);
+  }
+  KernelContext tuned = ctx.withMaxThreads(params.tuning.threads);
+  ForEachGemm(shape.count, tuned, [&](int64_t i) {
+    std::unique_ptr<PackedGemmB> packed;
+    const PackedGemmB* packed_b = shared_b.get();
+    if (packed_b == nullptr) {
+      int64_t ib = shape.operandIndex(shape.b_batch, i);
+      packed = std::make_unique<PackedGemmB>(
+          static_cast<const float*>(
+              matrixOf(b, shape.b_vector, ib, shape.k, shape.n)),
+          shape.k, shape.n, b_ld, 1);
+      packed_b = packed.get();
+    }
+    int64_t ia = shape.operandIndex(shape.a_batch, i);
+    Sgemm(shape.m,
+          static_cast<const float*>(
+              matrixOf(a, shape.a_vector, ia, shape.m, shape.k)),
+          a_ld, 1, 1.f, *packed_b,
+          static_cast<float*>(
+              ElementData(y, shape.output_sizes, i * shape.m * shape.n)),
+          y_ld, 1, false, tuned, params.tuning.blocking);
+  });
+  return true;
+}
+
+// the int8 or uint8 values at 'data' widened
+std::vector<int32_t> int8Values(const void* data, int64_t count,
+                                bool is_signed) {
+  std::vector<int32_t> values(count);
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (int64_t i = 0; i < count; i++) {
+    values[i] = is_signed ? int32_t(static_cast<int8_t>(bytes[i]))
+                          : int32_t(bytes[i]);
+  }
+  return values;
+}
+
+// The zero points of the operand of 'elem_type' in input 'i', one for all
+// or 'count' of them, or false.
+bool zeroPoints(const Instruction& inst, const KernelContext& ctx, size_t i,
+                int32_t elem_type, int64_t count,
+                std::vector<int32_t>* points) {
+  if (!ctx.hasInput(inst, i)) {
+    points->assign(1, 0);
+    return true;
+  }
+  const SlotValue& zero_point = ctx.input(inst, i);
+  int64_t size = zero_point.sizes.empty() ? 1 : zero_point.sizes[0];
+  if (zero_point.elem_type != elem_type || zero_point.sizes.size() > 1 ||
+      (size != 1 && size != count)) {
+    return false;
+  }
+  *points = int8Values(zero_point.mat.data, size,
+                       elem_type == ir::TensorProto_DataType_INT8);
+  return true;
+}
+
+struct MatMulIntegerParams {
+  std::shared_ptr<const PackedGemmBInt8> packed_b;
+};
+
+std::shared_ptr<const void> prepareMatMulInteger(const ir::Node& node) {
+  auto params = std::make_shared<MatMulIntegerParams>();
+  const ir::Tensor* b = constantMatrix(node, 1);
+  if (b == nullptr || !isInt8(b->elem_type())) return params;
+  bool is_signed = b->elem_type() == ir::TensorProto_DataType_INT8;
+  int64_t cols = b->sizes()[1];
+  std::vector<int32_t> zero_points(1, 0);
+  if (node.inputs().size() > 3 &&
+      node.inputs()[3]->node()->kind() != ir::kUndefined) {
+    const ir::Tensor* t = optimization::FindConstant(node.inputs()[3]);
+    if (t == nullptr || t->elem_type() != b->elem_type() ||
+        (t->numel() != 1 && t->numel() != cols) ||
+        t->byteSize() != t->expectedByteSize()) {
+      return params;
+    }
+    zero_points = int8Values(t->rawData(), t->numel(), is_signed);
+  }
+  params->packed_b = std::make_shared<PackedGemmBInt8>(
+      b->rawData(), is_signed, b->sizes()[0], cols, cols, 1, zero_points);
+  return params;
+}
+
+// MatMulInteger: MatMul of int8 or uint8 operands less their zero points,
+// into int32
+bool runMatMulInteger(const Instruction& inst, KernelContext& ctx) {
+  const SlotValue& a = ctx.input(inst, 0);
+  const SlotValue& b = ctx.input(inst, 1);
+  MatMulShape shape;
+  if (!isInt8(a.elem_type) || !isInt8(b.elem_type) ||
+      !shape.init(a.sizes, b.sizes)) {
+    return false;
+  }
+  bool a_signed = a.elem_type == ir::TensorProto_DataType_INT8;
+  bool b_signed = b.elem_type == ir::TensorProto_DataType_INT8;
+  std::vector<int32_t> a_zero_points;
+  if (!zeroPoints(inst, ctx, 2, a.elem_type, shape.m, &a_zero_points)) {
+    return false;
+  }
+  std::shared_ptr<const PackedGemmBInt8> shared_b =
+      inst.paramsAs<MatMulIntegerParams>().packed_b;
+  std::vector<int32_t> b_zero_points;
+  if (shared_b == nullptr &&
+      !zeroPoints(inst, ctx, 3, b.elem_type, shape.n, &b_zero_points)) {
+    return false;
+  }
+  ncnn::Mat& y = ctx.createOutput(inst, 0, shape.output_sizes,
+                                  ir::TensorProto_DataType_INT32);
+  int64_t a_ld = shape.a_vector ? shape.k : RowStride(a.mat, a.sizes);
+  int64_t b_ld = shape.b_vector ? 1 : RowStride(b.mat, b.sizes);
+  int64_t y_ld = shape.a_vector || shape.b_vector
+                     ? shape.n
+                     : RowStride(y, shape.output_sizes);
+  if (shared_b == nullptr && shape.b_batch.empty()) {
+    shared_b = std::make_shared<PackedGemmBInt8>(
+        b.mat.data, b_signed, shape.k, shape.n, b_ld, 1, b_zero_points);
+  }
+  ForEachGemm(shape.count, ctx, [&](int64_t i) {
+    std::unique_ptr<PackedGemmBInt8> packed;
+    const PackedGemmBInt8* packed_b = shared_b.get();
+    if (packed_b == nullptr) {
+      int64_t ib = shape.operandIndex(shape.b_batch, i);
+      packed = std::make_unique<PackedGemmBInt8>(
+          matrixOf(b, shape.b_vector, ib, shape.k, shape.n), b_signed,
+          shape.k, shape.n, b_ld, 1, b_zero_points);
+      packed_b = packed.get();
+    }
+    int64_t ia = shape.operandIndex(shape.a_batch, i);
+    GemmInt8(shape.m, matrixOf(a, shape.a_vector, ia, shape.m, shape.k),
+             a_signed, a_ld, 1, a_zero_points, *packed_b,
+             static_cast<int32_t*>(ElementData(y, shape.output_sizes,
+                                               i * shape.m * shape.n)),
+             y_ld, ctx);
+  });
+  return true;
+}
+
+}  // namespace
+
+void RegisterMatMulKernels(KernelRegistry* registry) {
+  registry->registerKernel(ir::kGemm, Kernel{runGemm, prepareGemm});
+  registry->registerKernel(ir::kMatMul, Kernel{runMatMul, prepareMatMul});
+  registry->registerKernel(ir::kMatMulInteger,
+                           Kernel{runMatMulInteger, prepareMatMulInteger});
+}
+
+}  // namespace my_ai_training::runtime
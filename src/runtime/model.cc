@@ -0,0 +1,33 @@
+#include "runtime/model.h"
+
+#include <utility>
+
+#include "optimizer/pass_manager.h"
+#include "runtime/autotuner.h"
+
+namespace my_ai_training::runtime {
+
+std::shared_ptr<const Model> Model::Create(std::unique_ptr<ir::Graph> graph,
+                                           const ModelOptions& options) {
+  ONNX_ASSERT(graph != nullptr);
+  optimization::PassManager pipeline =
+      optimization::CreatePipeline(options.passes);
+  if (options.autotuner != nullptr) {
+    pipeline.add(std::make_shared<Autotune>(options.autotuner,
+                                            options.intra_op_pool));
+  }
+  if (!pipeline.passes().empty()) pipeline.run(*graph);
+  std::shared_ptr<Model> model(new Model());
+  model->plan_ = ExecutionPlan::Compile(
+      *graph, options.kernels != nullptr ? *options.kernels
+                                         : KernelRegistry::global());
+  model->graph_ = std::move(graph);
+  return model;
+}
+
+std::shared_ptr<const Model> Model::Load(const std::string& path,
+                                         const ModelOptions& options) {
+  return Create(ir::ImportModel(path, options.import), options);
+}
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/intra_op_pool.h"
+#include "onnx_ir/importer.h"
+#include "onnx_ir/ir.h"
+#include "runtime/execution_plan.h"
+
+namespace my_ai_training::runtime {
+
+class Autotuner;
+
+struct ModelOptions {
+  // registered passes run on the graph before it is compiled, in order
+  std::vector<std::string> passes{
+      "eliminate_dead_code", "eliminate_common_subexpressions",
+      "fold_constants",      "fold_batch_norm",
+      "sink_transposes",     "fuse_operators",
+      "assign_layouts"};
+  // the global registry if null
+  const KernelRegistry* kernels = nullptr;
+  // tunes the kernels of the optimized graph after the passes, if set
+  std::shared_ptr<Autotuner> autotuner;
+  // the pool the sessions run on, which the autotuner measures on
+  IntraOpPool* intra_op_pool = nullptr;
+  ir::ImportOptions import;
+};
+
+// What all runs of a model share, loaded and compiled once: the optimized
+// graph and its plan, whose constant slots hold the weights. A Model is
+// immutable; any number of Sessions on any threads run it at once, each
+// with state of its own.
+class Model {
+ public:
+  // Optimizes 'graph' with the passes of 'options' and compiles it.
+  static std::shared_ptr<const Model> Create(
+      std::unique_ptr<ir::Graph> graph,
+      const ModelOptions& options = ModelOptions());
+  // Imports the ONNX model at 'path', then as Create().
+  static std::shared_ptr<const Model> Load(
+      const std::string& path, const ModelOptions& options = ModelOptions());
+
+  const ir::Graph& graph() const { return *graph_; }
+  const std::shared_ptr<const ExecutionPlan>& plan() const { return plan_; }
+
+ private:
+  Model() = default;
+
+  std::unique_ptr<ir::Graph> graph_;
+  std::shared_ptr<const ExecutionPlan> plan_;
+};
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,132 @@
+#include "runtime/session.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+// what an asynchronous run owns until it finished
+struct RunState {
+  std::shared_ptr<const ExecutionPlan> plan;
+  Frame frame;
+  Session::Callback done;
+};
+
+std::vector<SlotValue> outputsOf(const RunState& state) {
+  std::vector<SlotValue> outputs;
+  for (size_t i = 0; i < state.plan->outputSlots().size(); i++) {
+    outputs.push_back(state.plan->output(state.frame, i));
+  }
+  return outputs;
+}
+
+// Frees 'state', whose frame may hold the last references to the
+// intermediates, before handing its outputs to the callback.
+void finish(std::unique_ptr<RunState> state, std::exception_ptr error) {
+  std::vector<SlotValue> outputs;
+  if (!error) outputs = outputsOf(*state);
+  Session::Callback done = std::move(state->done);
+  state.reset();
+  done(error, std::move(outputs));
+}
+
+}  // namespace
+
+Session::Session(std::shared_ptr<const Model> model, SessionOptions options)
+    : Session(model->plan(), options) {
+  model_ = std::move(model);
+}
+
+Session::Session(std::shared_ptr<const ExecutionPlan> plan,
+                 SessionOptions options)
+    : plan_(std::move(plan)), options_(options) {
+  if (options_.allocator == nullptr) {
+    arena_ = std::make_unique<ncnn::PoolAllocator>();
+  }
+  allocator_ = arena_ ? arena_.get() : options_.allocator;
+}
+
+void Session::run(std::vector<SlotValue> inputs, Callback done) const {
+  auto state = std::make_unique<RunState>();
+  state->plan = plan_;
+  state->done = std::move(done);
+  try {
+    ONNX_ASSERTM(inputs.size() == plan_->inputSlots().size(),
+                 "the graph has %zu inputs, not %zu",
+                 plan_->inputSlots().size(), inputs.size());
+    state->frame = plan_->createFrame(allocator_);
+    state->frame.intra_op_pool = options_.intra_op_pool;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      plan_->setInput(state->frame, i, inputs[i].mat,
+                      std::move(inputs[i].sizes), inputs[i].elem_type);
+    }
+  } catch (...) {
+    finish(std::move(state), std::current_exception());
+    return;
+  }
+  if (options_.inter_op_pool == nullptr) {
+    std::exception_ptr error;
+    try {
+      plan_->run(state->frame);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    finish(std::move(state), error);
+    return;
+  }
+  RunState* raw = state.release();
+  plan_->runAsync(raw->frame, *options_.inter_op_pool,
+                  [raw](std::exception_ptr error) {
+                    finish(std::unique_ptr<RunState>(raw), error);
+                  });
+}
+
+Session::Run Session::run(std::vector<SlotValue> inputs) const {
+  return Run(this, std::move(inputs));
+}
+
+void Session::Run::start() {
+  session_->run(std::move(inputs_), [this](std::exception_ptr error,
+                                           std::vector<SlotValue> outputs) {
+    error_ = error;
+    outputs_ = std::move(outputs);
+    if (state_.exchange(kDone, std::memory_order_acq_rel) == kSuspended) {
+      resume_(resume_address_);
+    }
+  });
+}
+
+std::vector<SlotValue> Session::Run::get() {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+  std::atomic<bool> finished{false};
+  session_->run(std::move(inputs_), [&](std::exception_ptr error,
+                                        std::vector<SlotValue> outputs) {
+    std::lock_guard<std::mutex> guard(mutex);
+    error_ = error;
+    outputs_ = std::move(outputs);
+    done = true;
+    finished.store(true, std::memory_order_release);
+    cv.notify_all();
+  });
+  // a worker of the pool helps with the run rather than blocking it
+  WorkStealingPool* pool = session_->options_.inter_op_pool;
+  if (pool != nullptr && pool->currentWorker() >= 0) {
+    while (!finished.load(std::memory_order_acquire)) {
+      if (!pool->tryRunOne()) std::this_thread::yield();
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&done]() { return done; });
+  }
+  if (error_) std::rethrow_exception(error_);
+  return std::move(outputs_);
+}
+
+}  // namespace my_ai_training::runtime
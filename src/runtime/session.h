@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define MY_AI_TRAINING_HAS_COROUTINES 1
+#else
+#define MY_AI_TRAINING_HAS_COROUTINES 0
+#endif
+
+#include "common/intra_op_pool.h"
+#include "common/work_stealing_pool.h"
+#include "runtime/execution_plan.h"
+#include "runtime/model.h"
+
+namespace my_ai_training::runtime {
+
+struct SessionOptions {
+  // where runs execute; without one they run on the calling thread
+  WorkStealingPool* inter_op_pool = nullptr;
+  // for the loops inside kernels, if set
+  IntraOpPool* intra_op_pool = nullptr;
+  // for the activations and outputs of runs; null gives the session an
+  // arena of its own
+  ncnn::Allocator* allocator = nullptr;
+};
+
+// Runs a compiled plan for its callers, blocking or not. An asynchronous
+// run holds no thread while it waits: its instructions are tasks on the
+// inter-op pool, and the worker running the last one hands the outputs
+// over, so any number of runs can be in flight at once.
+//
+//   std::vector<SlotValue> outputs = co_await session.run(inputs);
+//
+// needs a C++20 build; session.run(inputs).get() blocks instead, and
+// session.run(inputs, callback) calls back.
+//
+// Sessions are cheap: they share the weights and plan of their Model and
+// only own their arena, a PoolAllocator keeping the buffers runs freed for
+// the next ones. Outputs live in the arena too, so they must be released
+// before the session.
+class Session {
+ public:
+  // 'error' is null if the run succeeded
+  using Callback = std::function<void(std::exception_ptr error,
+                                      std::vector<SlotValue> outputs)>;
+
+  class Run;
+
+  explicit Session(std::shared_ptr<const Model> model,
+                   SessionOptions options = SessionOptions());
+  // for a plan compiled without a Model
+  explicit Session(std::shared_ptr<const ExecutionPlan> plan,
+                   SessionOptions options = SessionOptions());
+
+  Session(const Session&) = delete;
+  Session& operator=(const Session&) = delete;
+
+  const ExecutionPlan& plan() const { return *plan_; }
+  // the allocator of the activations
+  ncnn::Allocator* allocator() const { return allocator_; }
+
+  // Starts a run on one value per graph input, as for
+  // ExecutionPlan::setInput(), and returns at once. 'done' is called on
+  // the worker that finished it, or on this thread without an inter-op
+  // pool or if the inputs are invalid.
+  void run(std::vector<SlotValue> inputs, Callback done) const;
+
+  // A run starting when it is awaited, or when get() is called.
+  Run run(std::vector<SlotValue> inputs) const;
+
+ private:
+  // null for a session of a plan
+  std::shared_ptr<const Model> model_;
+  std::shared_ptr<const ExecutionPlan> plan_;
+  SessionOptions options_;
+  std::unique_ptr<ncnn::PoolAllocator> arena_;
+  ncnn::Allocator* allocator_;
+};
+
+class Session::Run {
+ public:
+  Run(const Session* session, std::vector<SlotValue> inputs)
+      : session_(session), inputs_(std::move(inputs)) {}
+
+  Run(const Run&) = delete;
+  Run& operator=(const Run&) = delete;
+
+  // runs and waits for the outputs; throws the error of the run
+  std::vector<SlotValue> get();
+
+#if MY_AI_TRAINING_HAS_COROUTINES
+  bool await_ready() const noexcept { return false; }
+
+  // suspends unless the run finished before this returns, and resumes on
+  // the worker finishing it otherwise
+  bool await_suspend(std::coroutine_handle<> handle) {
+    resume_ = [](void* address) {
+      std::coroutine_handle<>::from_address(address).resume();
+    };
+    resume_address_ = handle.address();
+    start();
+    return state_.exchange(kSuspended, std::memory_order_acq_rel) != kDone;
+  }
+
+  std::vector<SlotValue> await_resume() {
+    if (error_) std::rethrow_exception(error_);
+    return std::move(outputs_);
+  }
+#endif
+
+ private:
+  enum State { kStarting, kSuspended, kDone };
+
+  void start();
+
+  const Session* session_;
+  std::vector<SlotValue> inputs_;
+  std::exception_ptr error_;
+  std::vector<SlotValue> outputs_;
+  std::atomic<int> state_{kStarting};
+  // the awaiting coroutine, type erased so the layout of Run does not
+  // depend on the language version of the including file
+  void (*resume_)(void* address) = nullptr;
+  void* resume_address_ = nullptr;
+};
+
+}  // namespace my_ai_training::runtime
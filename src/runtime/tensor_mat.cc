@@ -0,0 +1,173 @@
+#include "runtime/tensor_mat.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include "onnx_ir/assertions.h"
+
+namespace my_ai_training::runtime {
+
+namespace {
+
+int toInt(int64_t extent) {
+  ONNX_ASSERTM(extent >= 0 && extent <= INT_MAX,
+               "extent %lld does not fit a Mat", (long long)extent);
+  return static_cast<int>(extent);
+}
+
+// bytes of one channel of an unpacked Mat, which is one block below 3 dims
+size_t planeBytes(const ncnn::Mat& m) {
+  return static_cast<size_t>(m.w) * m.h * m.d * m.elemsize;
+}
+
+}  // namespace
+
+MatShape MatShapeOf(const std::vector<int64_t>& sizes) {
+  MatShape shape;
+  size_t rank = sizes.size();
+  if (rank == 1) {
+    shape.w = toInt(sizes[0]);
+  } else if (rank == 2) {
+    shape.dims = 2;
+    shape.w = toInt(sizes[1]);
+    shape.h = toInt(sizes[0]);
+  } else if (rank >= 3 && rank <= 5) {
+    shape.dims = rank == 5 ? 4 : 3;
+    shape.c = toInt(sizes[0] * sizes[1]);
+    shape.w = toInt(sizes[rank - 1]);
+    if (rank >= 4) shape.h = toInt(sizes[rank - 2]);
+    if (rank == 5) shape.d = toInt(sizes[2]);
+  } else if (rank > 5) {
+    int64_t numel = 1;
+    for (int64_t extent : sizes) numel *= extent;
+    shape.w = toInt(numel);
+  }
+  return shape;
+}
+
+bool CanPack(const std::vector<int64_t>& sizes, int elempack) {
+  if (elempack == 1) return true;
+  return sizes.size() >= 3 && sizes.size() <= 5 && elempack > 0 &&
+         sizes[1] % elempack == 0;
+}
+
+void CreateMat(const std::vector<int64_t>& sizes, size_t elem_size,
+               int elempack, ncnn::Allocator* allocator, ncnn::Mat* m) {
+  ONNX_ASSERTM(CanPack(sizes, elempack),
+               "a tensor of rank %zu can not be stored in elempack %d",
+               sizes.size(), elempack);
+  MatShape shape = MatShapeOf(sizes);
+  size_t elemsize = elem_size * elempack;
+  switch (shape.dims) {
+    case 1:
+      m->create(shape.w, elemsize, 1, allocator);
+      break;
+    case 2:
+      m->create(shape.w, shape.h, elemsize, 1, allocator);
+      break;
+    case 3:
+      m->create(shape.w, shape.h, shape.c / elempack, elemsize, elempack,
+                allocator);
+      break;
+    default:
+      m->create(shape.w, shape.h, shape.d, shape.c / elempack, elemsize,
+                elempack, allocator);
+      break;
+  }
+}
+
+void TensorToMat(const ir::Tensor& t, int elempack,
+                 ncnn::Allocator* allocator, ncnn::Mat* m) {
+  size_t elem_size = ir::elemSizeOf(t.elem_type());
+  ONNX_ASSERTM(elem_size > 0, "tensors of type %d have no Mat layout",
+               t.elem_type());
+  ONNX_ASSERTM(t.byteSize() == t.expectedByteSize(),
+               "tensor %s has no payload of its size", t.name().c_str());
+  ncnn::Mat unpacked;
+  CreateMat(t.sizes(), elem_size, 1, allocator, &unpacked);
+  const unsigned char* data = static_cast<const unsigned char*>(t.rawData());
+  if (unpacked.dims < 3) {
+    if (t.byteSize() > 0) memcpy(unpacked.data, data, t.byteSize());
+  } else {
+    size_t plane = planeBytes(unpacked);
+    for (int q = 0; q < unpacked.c; q++) {
+      memcpy(unpacked.channel(q).data, data + plane * q, plane);
+    }
+  }
+  ncnn::convert_packing(unpacked, *m, elempack, allocator);
+}
+
+void MatToTensor(const ncnn::Mat& m, int32_t elem_type,
+                 const std::vector<int64_t>& sizes, ir::Tensor* t) {
+  ncnn::Mat unpacked;
+  ncnn::convert_packing(m, unpacked, 1);
+  *t = ir::Tensor(elem_type, sizes);
+  unsigned char* data = static_cast<unsigned char*>(t->allocate());
+  if (t->byteSize() == 0) return;
+  ONNX_ASSERTM(unpacked.total() * unpacked.elemsize >= t->byteSize(),
+               "Mat holds less than a tensor of %zu bytes", t->byteSize());
+  if (unpacked.dims < 3) {
+    memcpy(data, unpacked.data, t->byteSize());
+  } else {
+    size_t plane = planeBytes(unpacked);
+    for (int q = 0; q < unpacked.c; q++) {
+      memcpy(data + plane * q, unpacked.channel(q).data, plane);
+    }
+  }
+}
+
+ncnn::Mat SliceDim0(const ncnn::Mat& m, const std::vector<int64_t>& sizes,
+                    int64_t begin, int64_t count) {
+  ONNX_ASSERTM(!sizes.empty() && m.elempack == 1,
+               "only unpacked Mats of rank 1 and more are sliced");
+  ONNX_ASSERT(begin >= 0 && count >= 0 && begin + count <= sizes[0]);
+  size_t rank = sizes.size();
+  if (rank == 2) return m.row_range(toInt(begin), toInt(count));
+  if (rank >= 3 && rank <= 5) {
+    return m.channel_range(toInt(begin * sizes[1]), toInt(count * sizes[1]));
+  }
+  int64_t item = 1;
+  for (size_t i = 1; i < rank; i++) item *= sizes[i];
+  return m.range(toInt(begin * item), toInt(count * item));
+}
+
+void* ElementData(const ncnn::Mat& m, const std::vector<int64_t>& sizes,
+                  int64_t index) {
+  ONNX_ASSERTM(m.elempack == 1, "only unpacked Mats are indexed");
+  unsigned char* data = static_cast<unsigned char*>(m.data);
+  size_t rank = sizes.size();
+  if (rank >= 3 && rank <= 5) {
+    int64_t plane = 1;
+    for (size_t i = 2; i < rank; i++) plane *= sizes[i];
+    if (plane > 0) {
+      ncnn::Mat channel = m.channel(toInt(index / plane));
+      data = static_cast<unsigned char*>(channel.data);
+      index %= plane;
+    }
+  }
+  return data + index * static_cast<int64_t>(m.elemsize);
+}
+
+int64_t RowStride(const ncnn::Mat& m, const std::vector<int64_t>& sizes) {
+  // a rank 3 tensor holds a row per channel
+  if (sizes.size() == 3) return static_cast<int64_t>(m.cstep);
+  return sizes.empty() ? 1 : sizes.back();
+}
+
+void CopyMat(const ncnn::Mat& src, const ncnn::Mat& dst) {
+  ONNX_ASSERTM(src.dims == dst.dims && src.w == dst.w && src.h == dst.h &&
+                   src.d == dst.d && src.c == dst.c &&
+                   src.elemsize == dst.elemsize && src.elempack == 1 &&
+                   dst.elempack == 1,
+               "Mats of different shapes");
+  if (src.dims < 3) {
+    memcpy(dst.data, src.data, planeBytes(src));
+    return;
+  }
+  size_t plane = planeBytes(src);
+  for (int q = 0; q < src.c; q++) {
+    memcpy(dst.channel(q).data, src.channel(q).data, plane);
+  }
+}
+
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "ncnn/mat.h"
+#include "onnx_ir/tensor.h"
+
+namespace my_ai_training::runtime {
+
+// How a tensor of logical 'sizes' is laid out in an ncnn::Mat. Tensors of
+// rank 3 to 5 are [N, C, spatial...]: N * C goes to the channels, which a
+// packed elempack interleaves, and the spatial dims to d, h and w. Lower
+// ranks fill w, then h; higher ranks are flattened into w. Shapes this does
+// not pack only take elempack 1.
+struct MatShape {
+  int dims = 1;
+  int w = 1;
+  int h = 1;
+  int d = 1;
+  // channels before packing
+  int c = 1;
+};
+
+MatShape MatShapeOf(const std::vector<int64_t>& sizes);
+
+// whether 'sizes' can be stored with 'elempack'
+bool CanPack(const std::vector<int64_t>& sizes, int elempack);
+
+// Allocates 'm' for a tensor of 'sizes' with scalars of 'elem_size' bytes,
+// keeping its buffer when it already has that shape.
+void CreateMat(const std::vector<int64_t>& sizes, size_t elem_size,
+               int elempack, ncnn::Allocator* allocator, ncnn::Mat* m);
+
+// Copies the payload of 't' into 'm', stored in 'elempack'.
+void TensorToMat(const ir::Tensor& t, int elempack,
+                 ncnn::Allocator* allocator, ncnn::Mat* m);
+
+// Copies 'm', holding a tensor of 'sizes' and 'elem_type', into 't'.
+void MatToTensor(const ncnn::Mat& m, int32_t elem_type,
+                 const std::vector<int64_t>& sizes, ir::Tensor* t);
+
+// A view of items [begin, begin + count) along dim 0 of the tensor of
+// 'sizes' in the unpacked 'm': a range of its channels, rows or elements.
+// It shares the data of 'm' without holding a reference to it.
+ncnn::Mat SliceDim0(const ncnn::Mat& m, const std::vector<int64_t>& sizes,
+                    int64_t begin, int64_t count);
+
+// The element at 'index' in the row-major order of a tensor of 'sizes' in
+// the unpacked 'm'. Runs along the last dim are contiguous, but rows may
+// be further apart than its extent: RowStride() elements.
+void* ElementData(const ncnn::Mat& m, const std::vector<int64_t>& sizes,
+                  int64_t index);
+int64_t RowStride(const ncnn::Mat& m, const std::vector<int64_t>& sizes);
+
+// Copies the payload of the unpacked 'src' into 'dst' of the same shape,
+// e.g. a view from SliceDim0().
+void CopyMat(const ncnn::Mat& src, const ncnn::Mat& dst);
+
+}  // namespace my_ai_training::runtime
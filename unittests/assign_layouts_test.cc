@@ -0,0 +1,156 @@
+#include "optimizer/assign_layouts.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "graph_helpers.h"
+
+namespace my_ai_training::optimization {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+
+using namespace my_ai_training::test;  // NOLINT
+
+// append() with an output of 'sizes'
+Node* appendShaped(Graph& g, ir::NodeKind kind, std::vector<Value*> inputs,
+                   std::vector<int64_t> sizes) {
+  Node* n = append(g, kind, std::move(inputs));
+  n->output()->setSizes(
+      std::vector<ir::Dimension>(sizes.begin(), sizes.end()));
+  return n;
+}
+
+size_t countPacking(const Graph& g) {
+  size_t count = 0;
+  for (const Node* n : g.nodes()) count += n->kind() == ir::kPacking;
+  return count;
+}
+
+size_t assign(Graph& g, int max_elempack) {
+  AnalysisManager analyses;
+  return AssignLayouts(max_elempack).runPass(g, analyses).num_changes;
+}
+
+TEST(AssignLayoutsTest, PreferredElempack) {
+  EXPECT_EQ(16, PreferredElempack(64, 16));
+  EXPECT_EQ(8, PreferredElempack(24, 16));
+  EXPECT_EQ(4, PreferredElempack(12, 8));
+  EXPECT_EQ(1, PreferredElempack(6, 16));
+  EXPECT_EQ(4, PreferredElempack(64, 4));
+  EXPECT_EQ(1, PreferredElempack(64, 1));
+  EXPECT_EQ(1, PreferredElempack(-1, 16));
+}
+
+TEST(AssignLayoutsTest, ConvBlocksRunPacked) {
+  Graph g;
+  Value* x = input(g, {1, 16, 8, 8});
+  Value* w = input(g, {16, 1, 3, 3});
+  Node* conv = appendShaped(g, ir::kConv, {x, w}, {1, 16, 8, 8});
+  conv->i_(ir::kgroup, 16);
+  Node* sigmoid =
+      appendShaped(g, ir::kSigmoid, {conv->output()}, {1, 16, 8, 8});
+  sigmoid->output()->setUniqueName("features");
+  Node* add = appendShaped(g, ir::kAdd, {sigmoid->output(), sigmoid->output()},
+                           {1, 16, 8, 8});
+  // no packed Relu kernel
+  Node* relu = appendShaped(g, ir::kRelu, {add->output()}, {1, 16, 8, 8});
+  Node* flatten = appendShaped(g, ir::kFlatten, {relu->output()}, {1, 1024});
+  g.registerOutput(flatten->output());
+  g.registerOutput(sigmoid->output());
+
+  EXPECT_EQ(5u, assign(g, 8));
+  EXPECT_EQ(1, Elempack(x));
+  for (const Node* n : {conv, sigmoid, add}) {
+    EXPECT_EQ(8, Elempack(n->output()));
+  }
+  // the Conv reads its input and weights as they are
+  EXPECT_EQ(x, conv->input(0));
+  EXPECT_EQ(w, conv->input(1));
+  EXPECT_EQ(sigmoid->output(), add->input(0));
+
+  // the Relu and the graph output read unpacked copies
+  EXPECT_EQ(2u, countPacking(g));
+  Node* unpack = relu->input()->node();
+  EXPECT_EQ(ir::kPacking, unpack->kind());
+  EXPECT_EQ(add->output(), unpack->input());
+  EXPECT_EQ(1, Elempack(relu->output()));
+  EXPECT_EQ(relu->output(), flatten->input());
+  Value* features = g.outputs()[1];
+  EXPECT_EQ(ir::kPacking, features->node()->kind());
+  EXPECT_EQ(1, Elempack(features));
+  EXPECT_EQ("features", features->uniqueName());
+  EXPECT_EQ(sigmoid->output(), features->node()->input());
+  EXPECT_EQ(4u, features->sizes().size());
+
+  // already assigned
+  EXPECT_EQ(0u, assign(g, 8));
+}
+
+TEST(AssignLayoutsTest, OtherConvsRunUnpacked) {
+  // the GEMM and Winograd convolutions have no packed kernels
+  Graph g;
+  Value* x = input(g, {1, 4, 8, 8});
+  Node* dense = appendShaped(g, ir::kConv, {x, input(g, {16, 4, 3, 3})},
+                             {1, 16, 8, 8});
+  Node* grouped = appendShaped(
+      g, ir::kConv, {dense->output(), input(g, {16, 4, 1, 1})},
+      {1, 16, 8, 8});
+  grouped->i_(ir::kgroup, 4);
+  Node* depthwise = appendShaped(
+      g, ir::kConv, {grouped->output(), input(g, {16, 1, 3, 3})},
+      {1, 16, 8, 8});
+  depthwise->i_(ir::kgroup, 16);
+  g.registerOutput(depthwise->output());
+
+  EXPECT_EQ(2u, assign(g, 16));
+  EXPECT_EQ(1, Elempack(dense->output()));
+  EXPECT_EQ(1, Elempack(grouped->output()));
+  EXPECT_EQ(dense->output(), grouped->input(0));
+  EXPECT_EQ(grouped->output(), depthwise->input(0));
+  EXPECT_EQ(16, Elempack(depthwise->output()));
+  EXPECT_EQ(1u, countPacking(g));
+}
+
+TEST(AssignLayoutsTest, SharesConversions) {
+  Graph g;
+  Node* a = appendShaped(
+      g, ir::kConv, {input(g, {1, 16, 8, 8}), input(g, {16, 1, 3, 3})},
+      {1, 16, 8, 8});
+  a->i_(ir::kgroup, 16);
+  Node* b = appendShaped(
+      g, ir::kConv, {input(g, {1, 8, 8, 8}), input(g, {8, 1, 3, 3})},
+      {1, 8, 8, 8});
+  b->i_(ir::kgroup, 8);
+  // two readers needing elempack 1 share one conversion
+  Node* t1 = append(g, ir::kTranspose, {a->output()});
+  Node* t2 = append(g, ir::kTranspose, {a->output()});
+  Node* concat = appendShaped(g, ir::kConcat, {a->output(), b->output()},
+                              {1, 24, 8, 8});
+  concat->i_(ir::kaxis, -3);
+  // and broadcasting runs unpacked
+  Node* add = append(g, ir::kAdd, {b->output(), input(g, {1, 8, 1, 1})});
+  g.registerOutput(t1->output());
+  g.registerOutput(t2->output());
+  g.registerOutput(concat->output());
+  g.registerOutput(add->output());
+
+  assign(g, 16);
+  EXPECT_EQ(16, Elempack(a->output()));
+  EXPECT_EQ(8, Elempack(b->output()));
+  EXPECT_EQ(1, Elempack(concat->output()));
+  EXPECT_EQ(t1->input(), t2->input());
+  EXPECT_EQ(t1->input(), concat->input(0));
+  EXPECT_EQ(1, Elempack(t1->input()));
+  EXPECT_EQ(a->output(), t1->input()->node()->input());
+  EXPECT_EQ(concat->input(1), add->input(0));
+  EXPECT_EQ(1, Elempack(add->input(0)));
+  EXPECT_EQ(2u, countPacking(g));
+}
+
+}  // namespace
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,248 @@
+#include "runtime/autotuner.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "graph_helpers.h"
+#include "runtime/convolution.h"
+#include "runtime/execution_plan.h"
+#include "runtime/model.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+std::vector<std::string> lines(const std::string& path) {
+  std::ifstream file(path);
+  std::vector<std::string> result;
+  std::string line;
+  while (std::getline(file, line)) result.push_back(line);
+  return result;
+}
+
+TuningConfig config(int algorithm, int64_t mc, int64_t nc, int threads) {
+  TuningConfig c;
+  c.algorithm = algorithm;
+  c.blocking.mc = mc;
+  c.blocking.nc = nc;
+  c.threads = threads;
+  return c;
+}
+
+TEST(AutotunerTest, CacheKeepsOtherCpuModels) {
+  std::string path = ::testing::TempDir() + "/autotuner_test.cache";
+  std::remove(path.c_str());
+  {
+    Autotuner tuner(path, "cpu a");
+    EXPECT_EQ(0u, tuner.size());
+    tuner.record("Sgemm m1 k2 n3 avx2_fma", config(-1, 48, 128, 1));
+    EXPECT_TRUE(tuner.save());
+  }
+  {
+    Autotuner tuner(path, "cpu b");
+    EXPECT_EQ(0u, tuner.size());
+    tuner.record("Sgemm m1 k2 n3 avx2_fma", config(-1, 240, 512, 0));
+    EXPECT_TRUE(tuner.save());
+  }
+  // a damaged line is skipped
+  std::ofstream(path, std::ios::app) << "cpu a\tSgemm m5\t-1 7 128 0\n";
+
+  Autotuner a(path, "cpu a");
+  EXPECT_EQ(1u, a.size());
+  TuningConfig found;
+  ASSERT_TRUE(a.find("Sgemm m1 k2 n3 avx2_fma", &found));
+  EXPECT_EQ(48, found.blocking.mc);
+  EXPECT_EQ(128, found.blocking.nc);
+  EXPECT_EQ(1, found.threads);
+  EXPECT_FALSE(a.find("Sgemm m5", &found));
+
+  Autotuner b(path, "cpu b");
+  ASSERT_TRUE(b.find("Sgemm m1 k2 n3 avx2_fma", &found));
+  EXPECT_EQ(240, found.blocking.mc);
+  EXPECT_EQ(0, found.threads);
+
+  // saving one model rewrites the lines of the other as they were
+  a.record("Sgemm m4 k4 n4 avx2_fma", config(-1, 120, 512, 0));
+  EXPECT_TRUE(a.save());
+  std::vector<std::string> saved = lines(path);
+  ASSERT_EQ(4u, saved.size());
+  EXPECT_EQ("cpu b\tSgemm m1 k2 n3 avx2_fma\t-1 240 512 0", saved[1]);
+  EXPECT_EQ(2u, Autotuner(path, "cpu a").size());
+  std::remove(path.c_str());
+}
+
+TEST(AutotunerTest, FastestRunsEachCandidate) {
+  std::vector<TuningConfig> candidates{config(0, 120, 512, 0),
+                                       config(1, 120, 512, 0)};
+  std::vector<int> calls(2, 0);
+  TuningConfig best = Autotuner::Fastest(
+      candidates,
+      [&](const TuningConfig& c) {
+        return std::function<void()>([&calls, c] {
+          calls[c.algorithm]++;
+          if (c.algorithm == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+          }
+        });
+      },
+      2);
+  EXPECT_EQ(1, best.algorithm);
+  // one to warm up and the timed ones
+  EXPECT_EQ(std::vector<int>({3, 3}), calls);
+
+  // a single candidate is not measured
+  best = Autotuner::Fastest({candidates[0]}, [&](const TuningConfig&) {
+    return std::function<void()>([] { FAIL(); });
+  });
+  EXPECT_EQ(0, best.algorithm);
+}
+
+TEST(AutotunerTest, TuningConfigOfDefaults) {
+  Graph g;
+  Value* a = g.addInput();
+  std::vector<Value*> inputs{a, g.addInput()};
+  Node* n = g.appendNode(g.create(ir::kMatMul, inputs, 1));
+  TuningConfig defaults = TuningConfigOf(*n);
+  EXPECT_EQ(-1, defaults.algorithm);
+  EXPECT_EQ(GemmBlocking().mc, defaults.blocking.mc);
+  EXPECT_EQ(GemmBlocking().nc, defaults.blocking.nc);
+  EXPECT_EQ(0, defaults.threads);
+
+  n->i_(ir::kgemm_mc, 48);
+  n->i_(ir::kgemm_nc, 128);
+  n->i_(ir::knum_threads, 1);
+  TuningConfig tuned = TuningConfigOf(*n);
+  EXPECT_EQ(48, tuned.blocking.mc);
+  EXPECT_EQ(128, tuned.blocking.nc);
+  EXPECT_EQ(1, tuned.threads);
+
+  // a blocking Sgemm would reject falls back to the default one
+  n->i_(ir::kgemm_mc, 50);
+  EXPECT_EQ(GemmBlocking().mc, TuningConfigOf(*n).blocking.mc);
+  EXPECT_EQ(GemmBlocking().nc, TuningConfigOf(*n).blocking.nc);
+}
+
+// a 3x3 Conv of x [1, 8, 16, 16] and a Gemm of a [32, 64]
+std::unique_ptr<Graph> graph() {
+  auto g = std::make_unique<Graph>();
+  Value* x = floatInput(*g, {1, 8, 16, 16});
+  Value* a = floatInput(*g, {32, 64});
+  ir::Tensor w = floats({8, 8, 3, 3}, 1);
+  std::vector<Value*> conv_inputs{x, g->addInitializerAndCreateValue(w)};
+  Node* conv = g->appendNode(g->create(ir::kConv, conv_inputs, 1));
+  conv->is_(ir::kpads, {1, 1, 1, 1});
+  ir::Tensor b = floats({64, 48}, 2);
+  std::vector<Value*> gemm_inputs{a, g->addInitializerAndCreateValue(b)};
+  Node* gemm = g->appendNode(g->create(ir::kGemm, gemm_inputs, 1));
+  g->registerOutput(conv->output());
+  g->registerOutput(gemm->output());
+  return g;
+}
+
+std::vector<ir::Tensor> run(const ExecutionPlan& plan) {
+  std::vector<ir::Tensor> inputs{floats({1, 8, 16, 16}, 3),
+                                 floats({32, 64}, 4)};
+  Frame frame = plan.createFrame();
+  for (size_t i = 0; i < inputs.size(); i++) {
+    ncnn::Mat mat;
+    TensorToMat(inputs[i], 1, nullptr, &mat);
+    plan.setInput(frame, i, mat, inputs[i].sizes());
+  }
+  plan.run(frame);
+  std::vector<ir::Tensor> outputs(2);
+  for (size_t i = 0; i < outputs.size(); i++) {
+    const SlotValue& out = plan.output(frame, i);
+    MatToTensor(out.mat, out.elem_type, out.sizes, &outputs[i]);
+  }
+  return outputs;
+}
+
+TEST(AutotunerTest, TunesConvAndGemm) {
+  std::string path = ::testing::TempDir() + "/autotuner_test_pass.cache";
+  std::remove(path.c_str());
+  ModelOptions options;
+  options.passes.clear();
+  options.autotuner = std::make_shared<Autotuner>(path);
+  std::shared_ptr<const Model> model = Model::Create(graph(), options);
+  EXPECT_EQ(2u, options.autotuner->size());
+  const Node* conv = nullptr;
+  const Node* gemm = nullptr;
+  for (const Node* n : model->graph().nodes()) {
+    if (n->kind() == ir::kConv) conv = n;
+    if (n->kind() == ir::kGemm) gemm = n;
+  }
+  ASSERT_NE(nullptr, conv);
+  ASSERT_NE(nullptr, gemm);
+  ASSERT_TRUE(conv->hasAttribute(ir::kconv_algorithm));
+  ConvGeometry geometry;
+  ASSERT_TRUE(
+      ConvGeometryOf(ConvAttributesOf(*conv), {8, 8, 3, 3}, &geometry));
+  EXPECT_TRUE(ConvSupports(
+      static_cast<ConvAlgorithm>(conv->i(ir::kconv_algorithm)), geometry));
+  EXPECT_FALSE(gemm->hasAttribute(ir::kconv_algorithm));
+  EXPECT_TRUE(gemm->hasAttribute(ir::kgemm_mc));
+  EXPECT_TRUE(gemm->hasAttribute(ir::knum_threads));
+
+  // the tuned kernels compute what the default ones do
+  std::vector<ir::Tensor> tuned = run(*model->plan());
+  std::vector<ir::Tensor> expected = run(*ExecutionPlan::Compile(*graph()));
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(expected[i].sizes(), tuned[i].sizes());
+    for (int64_t j = 0; j < expected[i].numel(); j++) {
+      EXPECT_NEAR(expected[i].data<float>()[j], tuned[i].data<float>()[j],
+                  1e-3)
+          << i << ", " << j;
+    }
+  }
+
+  // a later load reuses the cached results and sets the same attributes:
+  // four of the Conv and three of the Gemm
+  auto reloaded = std::make_shared<Autotuner>(path);
+  EXPECT_EQ(2u, reloaded->size());
+  std::unique_ptr<Graph> g = graph();
+  optimization::AnalysisManager analyses;
+  Autotune pass(reloaded);
+  EXPECT_EQ(7u, pass.runPass(*g, analyses).num_changes);
+  EXPECT_EQ(2u, reloaded->size());
+  for (const Node* n : g->nodes()) {
+    if (n->kind() != ir::kConv) continue;
+    EXPECT_EQ(conv->i(ir::kconv_algorithm), n->i(ir::kconv_algorithm));
+  }
+  EXPECT_EQ(0u, pass.runPass(*g, analyses).num_changes);
+  std::remove(path.c_str());
+}
+
+TEST(AutotunerTest, BatchedMatMulKeysHoldTheBatch) {
+  std::string path = ::testing::TempDir() + "/autotuner_test_batch.cache";
+  std::remove(path.c_str());
+  auto g = std::make_unique<Graph>();
+  Value* a = floatInput(*g, {4, 32, 64});
+  ir::Tensor b = floats({64, 48}, 1);
+  std::vector<Value*> inputs{a, g->addInitializerAndCreateValue(b)};
+  Node* matmul = g->appendNode(g->create(ir::kMatMul, inputs, 1));
+  g->registerOutput(matmul->output());
+  auto tuner = std::make_shared<Autotuner>(path, "cpu");
+  optimization::AnalysisManager analyses;
+  Autotune(tuner).runPass(*g, analyses);
+
+  std::vector<std::string> saved = lines(path);
+  ASSERT_EQ(2u, saved.size());
+  EXPECT_EQ(0u, saved[1].find("cpu\tSgemm b4 m32 k64 n48 ")) << saved[1];
+  std::remove(path.c_str());
+}
+
+}  // namespace
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,143 @@
+#include "runtime/batching_server.h"
+
+#include <gtest/gtest.h>
+
+#include <future>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+
+// y = x * 2 + 1 on x of [N, item...]
+std::shared_ptr<const ExecutionPlan> affinePlan(
+    std::vector<int64_t> item,
+    const KernelRegistry& kernels = KernelRegistry::global()) {
+  Graph g;
+  Value* x = g.addInput();
+  x->setElemType(ir::TensorProto_DataType_FLOAT);
+  std::vector<ir::Dimension> sizes{ir::Dimension(std::string("N"))};
+  sizes.insert(sizes.end(), item.begin(), item.end());
+  x->setSizes(sizes);
+  auto scalar = [&g](float value) {
+    ir::Tensor t(ir::TensorProto_DataType_FLOAT, {});
+    t.setRawData(&value, sizeof(value));
+    return g.addInitializerAndCreateValue(t);
+  };
+  std::vector<Value*> mul_inputs{x, scalar(2)};
+  Node* mul = g.appendNode(g.create(ir::kMul, mul_inputs, 1));
+  std::vector<Value*> add_inputs{mul->output(), scalar(1)};
+  Node* add = g.appendNode(g.create(ir::kAdd, add_inputs, 1));
+  g.registerOutput(add->output());
+  return ExecutionPlan::Compile(g, kernels);
+}
+
+// a request of 'items' items, every element of item i being 'first' + i
+std::vector<SlotValue> request(std::vector<int64_t> sizes, float first) {
+  ir::Tensor t(ir::TensorProto_DataType_FLOAT, sizes);
+  float* data = static_cast<float*>(t.allocate());
+  int64_t item = t.numel() / sizes[0];
+  for (int64_t i = 0; i < t.numel(); i++) data[i] = first + i / item;
+  SlotValue value;
+  TensorToMat(t, 1, nullptr, &value.mat);
+  value.sizes = sizes;
+  return {value};
+}
+
+std::vector<float> values(const SlotValue& value) {
+  ir::Tensor t;
+  MatToTensor(value.mat, value.elem_type, value.sizes, &t);
+  return std::vector<float>(t.data<float>(), t.data<float>() + t.numel());
+}
+
+TEST(BatchingServerTest, CoalescesRequests) {
+  BatchingOptions options;
+  options.max_batch_size = 4;
+  options.max_latency = std::chrono::milliseconds(200);
+  options.num_runners = 1;
+  BatchingServer server(affinePlan({3}), options);
+  std::vector<std::future<BatchResult>> futures;
+  for (int r = 0; r < 8; r++) {
+    futures.push_back(server.submit(request({1, 3}, r)));
+  }
+  std::map<const void*, int> batches;
+  std::vector<BatchResult> results;
+  for (int r = 0; r < 8; r++) {
+    results.push_back(futures[r].get());
+    const BatchResult& result = results.back();
+    ASSERT_EQ(1u, result.outputs.size());
+    EXPECT_EQ(std::vector<int64_t>({1, 3}), result.outputs[0].sizes);
+    float y = r * 2 + 1;
+    EXPECT_EQ(std::vector<float>({y, y, y}), values(result.outputs[0]));
+    batches[result.batch.get()]++;
+  }
+  // full batches start before the latency runs out
+  EXPECT_EQ(2u, batches.size());
+  for (const auto& batch : batches) EXPECT_EQ(4, batch.second);
+}
+
+TEST(BatchingServerTest, WaitsForTheFrontRequest) {
+  BatchingOptions options;
+  options.max_latency = std::chrono::milliseconds(300);
+  BatchingServer server(affinePlan({3}), options);
+  // b cannot join a, so it is the front request once a starts at 300ms;
+  // c arrives before b waited its own 300ms
+  auto a = server.submit(request({1, 4}, 0));
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  auto b = server.submit(request({1, 3}, 10));
+  std::this_thread::sleep_for(std::chrono::milliseconds(225));
+  auto c = server.submit(request({1, 3}, 20));
+  BatchResult rb = b.get();
+  BatchResult rc = c.get();
+  EXPECT_NE(a.get().batch, rb.batch);
+  EXPECT_EQ(rb.batch, rc.batch);
+}
+
+TEST(BatchingServerTest, SlicesChannels) {
+  BatchingOptions options;
+  options.max_latency = std::chrono::milliseconds(50);
+  BatchingServer server(affinePlan({2, 1, 2}), options);
+  // two requests of two items and one of three, over the 8 item limit
+  auto a = server.submit(request({2, 2, 1, 2}, 0));
+  auto b = server.submit(request({3, 2, 1, 2}, 10));
+  auto c = server.submit(request({2, 2, 1, 2}, 20));
+  // item shapes that differ run apart
+  auto d = server.submit(request({1, 2, 2, 2}, 30));
+  BatchResult ra = a.get();
+  EXPECT_EQ(std::vector<int64_t>({2, 2, 1, 2}), ra.outputs[0].sizes);
+  EXPECT_EQ(std::vector<float>({1, 1, 1, 1, 3, 3, 3, 3}),
+            values(ra.outputs[0]));
+  BatchResult rb = b.get();
+  EXPECT_EQ(std::vector<int64_t>({3, 2, 1, 2}), rb.outputs[0].sizes);
+  EXPECT_EQ(25, values(rb.outputs[0]).back());
+  EXPECT_EQ(41, values(c.get().outputs[0])[0]);
+  EXPECT_EQ(std::vector<float>(8, 61), values(d.get().outputs[0]));
+}
+
+TEST(BatchingServerTest, Errors) {
+  KernelRegistry kernels = KernelRegistry::global();
+  BatchingServer good(affinePlan({3}));
+  EXPECT_THROW(good.submit({}), ir::assert_error);
+  EXPECT_THROW(good.submit(std::vector<SlotValue>(2)), ir::assert_error);
+  // a scalar has no batch
+  EXPECT_THROW(good.submit(std::vector<SlotValue>(1)), ir::assert_error);
+
+  kernels.registerKernel(
+      ir::kAdd,
+      Kernel{[](const Instruction&, KernelContext&) { return false; },
+             nullptr});
+  BatchingServer bad(affinePlan({3}, kernels));
+  auto result = bad.submit(request({1, 3}, 0));
+  EXPECT_THROW(result.get(), ir::assert_error);
+}
+
+}  // namespace
+}  // namespace my_ai_training::runtime
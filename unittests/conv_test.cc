@@ -0,0 +1,322 @@
+#include "runtime/convolution.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "graph_helpers.h"
+#include "optimizer/fuse_operators.h"
+#include "runtime/execution_plan.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+// Y of the resolved 'g', in double, for x of [batch, channels, h, w]
+std::vector<double> directConv(const ConvGeometry& g,
+                               const std::vector<float>& x,
+                               const std::vector<float>& w,
+                               const std::vector<float>& bias, int64_t batch,
+                               int64_t height, int64_t width) {
+  int64_t out_h = g.outputHeight(height), out_w = g.outputWidth(width);
+  int64_t group_channels = g.channels / g.groups;
+  int64_t group_outputs = g.outputs / g.groups;
+  std::vector<double> y(batch * g.outputs * out_h * out_w);
+  for (int64_t n = 0; n < batch; n++) {
+    for (int64_t m = 0; m < g.outputs; m++) {
+      int64_t first = m / group_outputs * group_channels;
+      for (int64_t oy = 0; oy < out_h; oy++) {
+        for (int64_t ox = 0; ox < out_w; ox++) {
+          double sum = bias[m];
+          for (int64_t c = 0; c < group_channels; c++) {
+            for (int64_t ky = 0; ky < g.kernel_h; ky++) {
+              for (int64_t kx = 0; kx < g.kernel_w; kx++) {
+                int64_t iy = oy * g.stride_h - g.pad_top + ky * g.dilation_h;
+                int64_t ix =
+                    ox * g.stride_w - g.pad_left + kx * g.dilation_w;
+                if (iy < 0 || iy >= height || ix < 0 || ix >= width) {
+                  continue;
+                }
+                sum += double(x[((n * g.channels + first + c) * height +
+                                 iy) * width + ix]) *
+                       w[((m * group_channels + c) * g.kernel_h + ky) *
+                             g.kernel_w + kx];
+              }
+            }
+          }
+          y[((n * g.outputs + m) * out_h + oy) * out_w + ox] = sum;
+        }
+      }
+    }
+  }
+  return y;
+}
+
+struct ConvCase {
+  ConvGeometry geometry;
+  int64_t batch, height, width;
+};
+
+ConvGeometry geometry(int64_t channels, int64_t outputs, int64_t kernel,
+                      int64_t stride = 1, int64_t pad = 0,
+                      int64_t groups = 1) {
+  ConvGeometry g;
+  g.channels = channels;
+  g.outputs = outputs;
+  g.groups = groups;
+  g.kernel_h = g.kernel_w = kernel;
+  g.stride_h = g.stride_w = stride;
+  g.pad_top = g.pad_left = g.pad_bottom = g.pad_right = pad;
+  return g;
+}
+
+std::vector<ConvCase> cases() {
+  std::vector<ConvCase> all;
+  all.push_back({geometry(8, 16, 3, 1, 1), 2, 13, 11});
+  all.push_back({geometry(9, 10, 3, 1, 0), 1, 20, 19});
+  all.push_back({geometry(5, 7, 1), 2, 6, 9});
+  all.push_back({geometry(6, 4, 3, 2, 1, 2), 1, 9, 8});
+  all.push_back({geometry(8, 8, 3, 1, 1, 8), 2, 7, 6});
+  all.push_back({geometry(16, 16, 5, 2, 2, 16), 1, 9, 9});
+  // dilated, asymmetric pads
+  ConvGeometry dilated = geometry(3, 5, 3);
+  dilated.dilation_h = 2;
+  dilated.pad_top = 2;
+  dilated.pad_right = 1;
+  all.push_back({dilated, 1, 8, 7});
+  // 1-D
+  ConvGeometry line = geometry(4, 6, 1);
+  line.kernel_w = 3;
+  line.stride_w = 2;
+  line.auto_pad = "SAME_UPPER";
+  all.push_back({line, 2, 1, 9});
+  ConvGeometry lower = geometry(8, 8, 3, 1, 0, 8);
+  lower.auto_pad = "SAME_LOWER";
+  lower.stride_h = 2;
+  all.push_back({lower, 1, 6, 6});
+  return all;
+}
+
+TEST(ConvTest, SamePads) {
+  ConvGeometry g = geometry(1, 1, 4, 2);
+  g.auto_pad = "SAME_UPPER";
+  ConvGeometry upper = g.resolved(7, 8);
+  // ceil(7 / 2) = 4 outputs need 2 * 3 + 4 - 7 = 3 pads, the extra one last
+  EXPECT_EQ(1, upper.pad_top);
+  EXPECT_EQ(2, upper.pad_bottom);
+  EXPECT_EQ(1, upper.pad_left);
+  EXPECT_EQ(1, upper.pad_right);
+  EXPECT_EQ(4, upper.outputHeight(7));
+  g.auto_pad = "SAME_LOWER";
+  EXPECT_EQ(2, g.resolved(7, 8).pad_top);
+  g.auto_pad = "VALID";
+  EXPECT_EQ(0, g.resolved(7, 8).pad_bottom);
+  EXPECT_EQ(-1, upper.outputWidth(-1));
+}
+
+TEST(ConvTest, DefaultAlgorithms) {
+  EXPECT_EQ(ConvAlgorithm::kDepthwise,
+            DefaultConvAlgorithm(geometry(8, 8, 3, 1, 1, 8), -1, -1));
+  EXPECT_EQ(ConvAlgorithm::kGemm1x1,
+            DefaultConvAlgorithm(geometry(8, 8, 1), -1, -1));
+  EXPECT_EQ(ConvAlgorithm::kIm2col,
+            DefaultConvAlgorithm(geometry(8, 8, 1, 2), -1, -1));
+  EXPECT_EQ(ConvAlgorithm::kWinograd43,
+            DefaultConvAlgorithm(geometry(8, 8, 3, 1, 1), -1, -1));
+  EXPECT_EQ(ConvAlgorithm::kWinograd63,
+            DefaultConvAlgorithm(geometry(8, 8, 3, 1, 1), 16, 16));
+  EXPECT_EQ(ConvAlgorithm::kIm2col,
+            DefaultConvAlgorithm(geometry(3, 8, 3, 1, 1), 16, 16));
+}
+
+TEST(ConvTest, AlgorithmsMatchDirectConvolution) {
+  IntraOpPool pool;
+  Frame frame;
+  frame.intra_op_pool = &pool;
+  KernelContext ctx(nullptr, nullptr, &frame);
+  std::vector<ConvAlgorithm> algorithms{
+      ConvAlgorithm::kDepthwise, ConvAlgorithm::kGemm1x1,
+      ConvAlgorithm::kIm2col, ConvAlgorithm::kWinograd43,
+      ConvAlgorithm::kWinograd63};
+  for (const ConvCase& c : cases()) {
+    const ConvGeometry& g = c.geometry;
+    std::vector<float> x =
+        pattern(c.batch * g.channels * c.height * c.width, 1);
+    std::vector<float> w = pattern(
+        g.outputs * g.channels / g.groups * g.kernel_h * g.kernel_w, 2);
+    std::vector<float> bias = pattern(g.outputs, 3);
+    ConvGeometry resolved = g.resolved(c.height, c.width);
+    std::vector<double> expected =
+        directConv(resolved, x, w, bias, c.batch, c.height, c.width);
+    int64_t out_h = resolved.outputHeight(c.height);
+    int64_t out_w = resolved.outputWidth(c.width);
+    for (ConvAlgorithm algorithm : algorithms) {
+      if (!ConvSupports(algorithm, g)) continue;
+      for (int elempack : {1, 4, 8}) {
+        if (g.channels % elempack != 0 ||
+            (elempack > 1 && algorithm != ConvAlgorithm::kDepthwise)) {
+          continue;
+        }
+        SCOPED_TRACE(testing::Message()
+                     << "channels " << g.channels << " outputs "
+                     << g.outputs << " kernel " << g.kernel_h << "x"
+                     << g.kernel_w << " algorithm "
+                     << static_cast<int>(algorithm) << " elempack "
+                     << elempack);
+        ConvWeights weights(g, algorithm, w.data(), bias.data(), elempack);
+        ASSERT_EQ(elempack, weights.elempack());
+        ncnn::Mat input, packed_input, output, packed_output;
+        input.create(static_cast<int>(c.width), static_cast<int>(c.height),
+                     static_cast<int>(c.batch * g.channels));
+        for (int64_t q = 0; q < c.batch * g.channels; q++) {
+          std::copy_n(x.data() + q * c.height * c.width,
+                      c.height * c.width,
+                      static_cast<float*>(input.channel(int(q))));
+        }
+        ncnn::convert_packing(input, packed_input, elempack);
+        packed_output.create(
+            static_cast<int>(out_w), static_cast<int>(out_h),
+            static_cast<int>(c.batch * g.outputs / elempack),
+            sizeof(float) * elempack, elempack);
+        weights.run(packed_input, c.batch, c.height, c.width,
+                    &packed_output, ctx);
+        ncnn::convert_packing(packed_output, output, 1);
+        // Winograd trades some precision for its fewer products
+        double tolerance = algorithm == ConvAlgorithm::kWinograd63 ? 1e-3
+                           : algorithm == ConvAlgorithm::kWinograd43
+                               ? 1e-4
+                               : 1e-5;
+        for (int64_t q = 0; q < c.batch * g.outputs; q++) {
+          const float* y = output.channel(int(q));
+          for (int64_t i = 0; i < out_h * out_w; i++) {
+            double want = expected[q * out_h * out_w + i];
+            ASSERT_NEAR(want, y[i], tolerance * (1 + std::fabs(want)))
+                << q << ", " << i;
+          }
+        }
+      }
+    }
+  }
+}
+
+ir::Tensor run(const ExecutionPlan& plan,
+               const std::vector<ir::Tensor>& inputs) {
+  Frame frame = plan.createFrame();
+  for (size_t i = 0; i < inputs.size(); i++) {
+    ncnn::Mat mat;
+    TensorToMat(inputs[i], 1, nullptr, &mat);
+    plan.setInput(frame, i, mat, inputs[i].sizes());
+  }
+  plan.run(frame);
+  const SlotValue& out = plan.output(frame, 0);
+  ir::Tensor result;
+  MatToTensor(out.mat, out.elem_type, out.sizes, &result);
+  return result;
+}
+
+void expectNear(const std::vector<double>& expected, const ir::Tensor& y,
+                double tolerance) {
+  ASSERT_EQ(static_cast<int64_t>(expected.size()), y.numel());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_NEAR(expected[i], y.data<float>()[i], tolerance) << i;
+  }
+}
+
+TEST(ConvTest, ConvKernelWithConstantWeights) {
+  // 3x3 of 8 to 8 channels and 16 x 16 outputs: Winograd F(6x6, 3x3)
+  Graph g;
+  Value* x = floatInput(g, {1, 8, 16, 16});
+  ir::Tensor w = floats({8, 8, 3, 3}, 1);
+  ir::Tensor b = floats({8}, 2);
+  Node* conv = append(g, ir::kConv,
+                      {x, g.addInitializerAndCreateValue(w),
+                       g.addInitializerAndCreateValue(b)});
+  conv->is_(ir::kpads, {1, 1, 1, 1});
+  conv->output()->setElemType(ir::TensorProto_DataType_FLOAT);
+  conv->output()->setSizes(std::vector<ir::Dimension>{1, 8, 16, 16});
+  g.registerOutput(conv->output());
+  ir::Tensor input = floats({1, 8, 16, 16}, 3);
+  ir::Tensor y = run(*ExecutionPlan::Compile(g), {input});
+  ASSERT_EQ(std::vector<int64_t>({1, 8, 16, 16}), y.sizes());
+  ConvGeometry geom = geometry(8, 8, 3, 1, 1);
+  std::vector<float> bias(b.data<float>(), b.data<float>() + 8);
+  expectNear(directConv(geom,
+                        std::vector<float>(input.data<float>(),
+                                           input.data<float>() +
+                                               input.numel()),
+                        std::vector<float>(w.data<float>(),
+                                           w.data<float>() + w.numel()),
+                        bias, 1, 16, 16),
+             y, 1e-3);
+}
+
+TEST(ConvTest, ConvKernelWithWeightInputs) {
+  // 1-D, strided, weights fed at run time without a bias
+  Graph g;
+  Value* x = floatInput(g, {2, 4, 10});
+  Value* w = floatInput(g, {6, 2, 3});
+  Node* conv = append(g, ir::kConv, {x, w});
+  conv->i_(ir::kgroup, 2);
+  conv->is_(ir::kstrides, {2});
+  conv->is_(ir::kpads, {1, 0});
+  g.registerOutput(conv->output());
+  ir::Tensor input = floats({2, 4, 10}, 1);
+  ir::Tensor weights = floats({6, 2, 3}, 2);
+  ir::Tensor y = run(*ExecutionPlan::Compile(g), {input, weights});
+  ASSERT_EQ(std::vector<int64_t>({2, 6, 5}), y.sizes());
+  ConvGeometry geom = geometry(4, 6, 1, 1, 0, 2);
+  geom.kernel_w = 3;
+  geom.stride_w = 2;
+  geom.pad_left = 1;
+  expectNear(directConv(geom,
+                        std::vector<float>(input.data<float>(),
+                                           input.data<float>() +
+                                               input.numel()),
+                        std::vector<float>(weights.data<float>(),
+                                           weights.data<float>() +
+                                               weights.numel()),
+                        std::vector<float>(6, 0.f), 2, 1, 10),
+             y, 1e-5);
+}
+
+TEST(ConvTest, FusedDepthwiseConvRunsPacked) {
+  // a depthwise Conv and an Add fused and run in elempack 4, its weights
+  // constants of the graph read through the group's inputs
+  Graph g;
+  Value* x = floatInput(g, {1, 8, 5, 6});
+  ir::Tensor w = floats({8, 1, 3, 3}, 1);
+  Node* conv =
+      append(g, ir::kConv, {x, g.addInitializerAndCreateValue(w)});
+  conv->i_(ir::kgroup, 8);
+  conv->is_(ir::kpads, {1, 1, 1, 1});
+  ir::Tensor one(ir::TensorProto_DataType_FLOAT, {});
+  float value = 1;
+  one.setRawData(&value, sizeof(value));
+  Node* add = append(g, ir::kAdd,
+                     {conv->output(), g.addInitializerAndCreateValue(one)});
+  Node* group = optimization::CreateFusionGroup({conv, add});
+  group->i_(ir::kelempack, 4);
+  Node* unpack = append(g, ir::kPacking, {group->output()});
+  unpack->i_(ir::kelempack, 1);
+  g.registerOutput(unpack->output());
+  auto plan = ExecutionPlan::Compile(g);
+  ir::Tensor input = floats({1, 8, 5, 6}, 2);
+  std::vector<double> expected = directConv(
+      geometry(8, 8, 3, 1, 1, 8),
+      std::vector<float>(input.data<float>(),
+                         input.data<float>() + input.numel()),
+      std::vector<float>(w.data<float>(), w.data<float>() + w.numel()),
+      std::vector<float>(8, 1.f), 1, 5, 6);
+  // twice, the second with the weights of the first
+  expectNear(expected, run(*plan, {input}), 1e-5);
+  expectNear(expected, run(*plan, {input}), 1e-5);
+}
+
+}  // namespace
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,303 @@
+#include "runtime/elementwise.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "common/work_stealing_pool.h"
+#include "graph_helpers.h"
+#include "optimizer/reference_kernels.h"
+#include "runtime/execution_plan.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+void expectRelative(double want, float got, double tolerance) {
+  EXPECT_LE(std::fabs(got - want), tolerance * std::fabs(want))
+      << want << " vs " << got;
+}
+
+TEST(ElementwiseTest, VectorFunctions) {
+  // an odd count, for the tails of the vector loops
+  std::vector<float> x;
+  for (int i = 0; i < 1003; i++) x.push_back(-80.f + 0.16f * i);
+  for (float v : {1e-6f, -3e-3f, 0.3f, -0.624f, 0.626f}) x.push_back(v);
+  std::vector<float> y(x.size());
+
+  VectorExp(x.data(), y.data(), x.size());
+  for (size_t i = 0; i < x.size(); i++) {
+    expectRelative(std::exp(double(x[i])), y[i], 2e-6);
+  }
+  VectorSigmoid(x.data(), y.data(), x.size());
+  for (size_t i = 0; i < x.size(); i++) {
+    expectRelative(1 / (1 + std::exp(-double(x[i]))), y[i], 2e-6);
+  }
+  // in place
+  y = x;
+  VectorTanh(y.data(), y.data(), y.size());
+  for (size_t i = 0; i < x.size(); i++) {
+    expectRelative(std::tanh(double(x[i])), y[i], 2e-6);
+  }
+
+  const float inf = std::numeric_limits<float>::infinity();
+  std::vector<float> special{inf, -inf, 89.f, -120.f,
+                             std::numeric_limits<float>::quiet_NaN()};
+  VectorExp(special.data(), y.data(), special.size());
+  EXPECT_EQ(inf, y[0]);
+  EXPECT_EQ(0.f, y[1]);
+  EXPECT_EQ(inf, y[2]);
+  EXPECT_EQ(0.f, y[3]);
+  EXPECT_TRUE(std::isnan(y[4]));
+  VectorSigmoid(special.data(), y.data(), special.size());
+  EXPECT_EQ(1.f, y[0]);
+  EXPECT_EQ(0.f, y[1]);
+  EXPECT_TRUE(std::isnan(y[4]));
+  VectorTanh(special.data(), y.data(), special.size());
+  EXPECT_EQ(1.f, y[0]);
+  EXPECT_EQ(-1.f, y[1]);
+  EXPECT_EQ(-1.f, y[3]);
+  EXPECT_TRUE(std::isnan(y[4]));
+}
+
+TEST(ElementwiseTest, BroadcastRuns) {
+  Broadcast b;
+  // per channel: runs of the planes
+  ASSERT_TRUE(b.init({2, 3, 4, 5}, {1, 3, 1, 1}));
+  EXPECT_EQ(std::vector<int64_t>({2, 3, 4, 5}), b.sizes());
+  EXPECT_EQ(6, b.rows());
+  EXPECT_EQ(20, b.rowSize());
+  EXPECT_TRUE(b.advances(0));
+  EXPECT_FALSE(b.advances(1));
+  EXPECT_EQ(80, b.operandIndex(0, 4));
+  EXPECT_EQ(1, b.operandIndex(1, 4));
+
+  // a rank 3 operand holds its channel planes along its last dim only
+  ASSERT_TRUE(b.init({2, 3, 4, 5}, {3, 1, 1}));
+  EXPECT_EQ(24, b.rows());
+  EXPECT_EQ(5, b.rowSize());
+  EXPECT_EQ(1, b.operandIndex(1, 4));
+  EXPECT_EQ(2, b.operandIndex(1, 11));
+
+  // matrices are contiguous, so runs end where an operand changes
+  ASSERT_TRUE(b.init({4, 1}, {1, 5}));
+  EXPECT_EQ(std::vector<int64_t>({4, 5}), b.sizes());
+  EXPECT_EQ(4, b.rows());
+  EXPECT_EQ(5, b.rowSize());
+  EXPECT_FALSE(b.advances(0));
+  EXPECT_TRUE(b.advances(1));
+  EXPECT_EQ(3, b.operandIndex(0, 3));
+  EXPECT_EQ(0, b.operandIndex(1, 3));
+  ASSERT_TRUE(b.init({6, 7}, {6, 7}));
+  EXPECT_EQ(1, b.rows());
+  EXPECT_EQ(42, b.rowSize());
+
+  ASSERT_TRUE(b.init({}, {}));
+  EXPECT_EQ(1, b.rows());
+  EXPECT_EQ(1, b.rowSize());
+  EXPECT_FALSE(b.init({3}, {4}));
+}
+
+// positive, for the bases of Pow
+ir::Tensor positive(std::vector<int64_t> sizes, int seed) {
+  return floats(std::move(sizes), seed, 1.5f);
+}
+
+std::vector<ir::Tensor> run(const ExecutionPlan& plan,
+                            const std::vector<ir::Tensor>& inputs,
+                            ncnn::Allocator* allocator = nullptr,
+                            WorkStealingPool* pool = nullptr) {
+  Frame frame = plan.createFrame(allocator);
+  for (size_t i = 0; i < inputs.size(); i++) {
+    ncnn::Mat mat;
+    TensorToMat(inputs[i], 1, nullptr, &mat);
+    plan.setInput(frame, i, mat, inputs[i].sizes());
+  }
+  if (pool != nullptr) {
+    plan.run(frame, *pool);
+  } else {
+    plan.run(frame);
+  }
+  std::vector<ir::Tensor> outputs(plan.outputSlots().size());
+  for (size_t i = 0; i < outputs.size(); i++) {
+    const SlotValue& out = plan.output(frame, i);
+    MatToTensor(out.mat, out.elem_type, out.sizes, &outputs[i]);
+  }
+  return outputs;
+}
+
+void expectNear(const ir::Tensor& expected, const ir::Tensor& y,
+                double tolerance) {
+  ASSERT_EQ(expected.sizes(), y.sizes());
+  for (int64_t i = 0; i < y.numel(); i++) {
+    EXPECT_NEAR(expected.data<float>()[i], y.data<float>()[i], tolerance)
+        << i;
+  }
+}
+
+TEST(ElementwiseTest, BinaryOpsBroadcast) {
+  std::vector<std::pair<std::vector<int64_t>, std::vector<int64_t>>> shapes{
+      {{2, 3, 4, 5}, {2, 3, 4, 5}}, {{2, 3, 4, 5}, {1, 3, 1, 1}},
+      {{3, 1, 1}, {2, 3, 4, 5}},    {{2, 3, 4, 5}, {5}},
+      {{2, 3, 4, 5}, {}},           {{4, 1}, {1, 5}},
+      {{2, 1, 3}, {4, 1}},          {{2, 3, 2, 4, 5}, {3, 1, 4, 1}}};
+  for (ir::NodeKind kind :
+       {ir::kAdd, ir::kSub, ir::kMul, ir::kDiv, ir::kPow}) {
+    for (const auto& [a_sizes, b_sizes] : shapes) {
+      Graph g;
+      Node* n = append(g, kind, {floatInput(g), floatInput(g)});
+      g.registerOutput(n->output());
+      ir::Tensor a = positive(a_sizes, 1), b = positive(b_sizes, 2);
+      std::vector<ir::Tensor> expected;
+      ASSERT_TRUE(optimization::EvaluateNode(n, {&a, &b}, &expected));
+      std::vector<ir::Tensor> y = run(*ExecutionPlan::Compile(g), {a, b});
+      SCOPED_TRACE(kind.toString());
+      expectNear(expected[0], y[0], 1e-4);
+    }
+  }
+}
+
+TEST(ElementwiseTest, NonFloatTypesRunReferenceKernels) {
+  Graph g;
+  Value* a = g.addInput();
+  Value* b = g.addInput();
+  a->setElemType(ir::TensorProto_DataType_INT64);
+  b->setElemType(ir::TensorProto_DataType_INT64);
+  Node* add = append(g, ir::kAdd, {a, b});
+  g.registerOutput(add->output());
+  ir::Tensor x(ir::TensorProto_DataType_INT64, {3});
+  ir::Tensor y(ir::TensorProto_DataType_INT64, {});
+  std::vector<int64_t> xs{1, 2, 3};
+  int64_t ys = 10;
+  x.setRawData(xs.data(), sizeof(int64_t) * 3);
+  y.setRawData(&ys, sizeof(int64_t));
+  ir::Tensor sum = run(*ExecutionPlan::Compile(g), {x, y})[0];
+  ASSERT_EQ(ir::TensorProto_DataType_INT64, sum.elem_type());
+  EXPECT_EQ(std::vector<int64_t>({11, 12, 13}),
+            std::vector<int64_t>(sum.data<int64_t>(),
+                                 sum.data<int64_t>() + 3));
+}
+
+TEST(ElementwiseTest, PRelu) {
+  Graph g;
+  Node* prelu = append(g, ir::kPRelu, {floatInput(g), floatInput(g)});
+  g.registerOutput(prelu->output());
+  ir::Tensor x = floats({2, 3, 2, 2}, 1);
+  ir::Tensor slope = positive({3, 1, 1}, 2);
+  ir::Tensor y = run(*ExecutionPlan::Compile(g), {x, slope})[0];
+  ASSERT_EQ(x.sizes(), y.sizes());
+  for (int64_t i = 0; i < x.numel(); i++) {
+    float v = x.data<float>()[i];
+    float s = slope.data<float>()[i / 4 % 3];
+    EXPECT_FLOAT_EQ(v < 0 ? v * s : v, y.data<float>()[i]) << i;
+  }
+}
+
+// counts the buffers the kernels allocate
+class CountingAllocator : public ncnn::Allocator {
+ public:
+  void* fastMalloc(size_t size) override {
+    allocations++;
+    return ncnn::fastMalloc(size);
+  }
+  void fastFree(void* ptr) override { ncnn::fastFree(ptr); }
+
+  std::atomic<int> allocations{0};
+};
+
+TEST(ElementwiseTest, ActivationsRunInPlace) {
+  // Neg allocates, as it must not write over the graph input; the others
+  // write over the result before them, which only they read
+  Graph g;
+  Value* x = floatInput(g);
+  Node* neg = append(g, ir::kNeg, {x});
+  Node* sigmoid = append(g, ir::kSigmoid, {neg->output()});
+  Node* tanh = append(g, ir::kTanh, {sigmoid->output()});
+  Node* exp = append(g, ir::kExp, {tanh->output()});
+  g.registerOutput(exp->output());
+  auto plan = ExecutionPlan::Compile(g);
+  ir::Tensor input = positive({1, 8, 16, 16}, 1);
+  CountingAllocator allocator;
+  Frame frame = plan->createFrame(&allocator);
+  ncnn::Mat mat;
+  TensorToMat(input, 1, nullptr, &mat);
+  plan->setInput(frame, 0, mat, input.sizes());
+  plan->run(frame);
+  EXPECT_EQ(1, allocator.allocations.load());
+  ir::Tensor y, unchanged;
+  const SlotValue& out = plan->output(frame, 0);
+  MatToTensor(out.mat, out.elem_type, out.sizes, &y);
+  MatToTensor(mat, ir::TensorProto_DataType_FLOAT, input.sizes(),
+              &unchanged);
+  expectNear(input, unchanged, 0);
+  for (int64_t i = 0; i < input.numel(); i++) {
+    double v = input.data<float>()[i];
+    EXPECT_NEAR(std::exp(std::tanh(1 / (1 + std::exp(v)))),
+                y.data<float>()[i], 1e-5);
+  }
+}
+
+TEST(ElementwiseTest, SharedResultsAreNotOverwritten) {
+  // t has two readers, which may run at the same time
+  Graph g;
+  Value* x = floatInput(g);
+  Node* t = append(g, ir::kNeg, {x});
+  Node* sigmoid = append(g, ir::kSigmoid, {t->output()});
+  Node* tanh = append(g, ir::kTanh, {t->output()});
+  Node* sum = append(g, ir::kAdd, {sigmoid->output(), tanh->output()});
+  g.registerOutput(sum->output());
+  auto plan = ExecutionPlan::Compile(g);
+  ir::Tensor input = positive({2, 4, 8, 8}, 1);
+  WorkStealingPool pool(2);
+  for (bool parallel : {false, true}) {
+    CountingAllocator allocator;
+    ir::Tensor y =
+        run(*plan, {input}, &allocator, parallel ? &pool : nullptr)[0];
+    // Neg, Sigmoid and Tanh; Add writes over one of the last two
+    EXPECT_EQ(3, allocator.allocations.load());
+    for (int64_t i = 0; i < input.numel(); i++) {
+      double v = -input.data<float>()[i];
+      EXPECT_NEAR(1 / (1 + std::exp(-v)) + std::tanh(v), y.data<float>()[i],
+                  1e-5);
+    }
+  }
+}
+
+TEST(ElementwiseTest, PackedOpsWithScalars) {
+  // Sigmoid and Add in elempack 4 between Packing nodes, with a scalar
+  Graph g;
+  Value* x = floatInput(g);
+  Node* pack = append(g, ir::kPacking, {x});
+  pack->i_(ir::kelempack, 4);
+  Node* sigmoid = append(g, ir::kSigmoid, {pack->output()});
+  sigmoid->i_(ir::kelempack, 4);
+  Node* add = append(g, ir::kAdd, {sigmoid->output(), pack->output()});
+  add->i_(ir::kelempack, 4);
+  ir::Tensor half(ir::TensorProto_DataType_FLOAT, {});
+  float value = 0.5f;
+  half.setRawData(&value, sizeof(value));
+  Node* mul = append(g, ir::kMul,
+                     {add->output(), g.addInitializerAndCreateValue(half)});
+  mul->i_(ir::kelempack, 4);
+  Node* unpack = append(g, ir::kPacking, {mul->output()});
+  g.registerOutput(unpack->output());
+  ir::Tensor input = positive({2, 8, 3, 5}, 1);
+  ir::Tensor y = run(*ExecutionPlan::Compile(g), {input})[0];
+  ASSERT_EQ(input.sizes(), y.sizes());
+  for (int64_t i = 0; i < input.numel(); i++) {
+    double v = input.data<float>()[i];
+    EXPECT_NEAR((1 / (1 + std::exp(-v)) + v) * 0.5, y.data<float>()[i],
+                1e-5);
+  }
+}
+
+}  // namespace
+}  // namespace my_ai_training::runtime
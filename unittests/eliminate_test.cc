@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "graph_helpers.h"
+#include "optimizer/eliminate_common_subexpressions.h"
+#include "optimizer/eliminate_dead_code.h"
+#include "optimizer/pass_manager.h"
+
+namespace my_ai_training::optimization {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+Node* constant(Graph& g, int64_t value) {
+  Node* n = append(g, ir::kConstant, {});
+  ir::Tensor t(ir::TensorProto_DataType_INT64, {});
+  *static_cast<int64_t*>(t.allocate()) = value;
+  n->t_(ir::kvalue, t);
+  return n;
+}
+
+// Shape(x) -> Gather(., index) -> Unsqueeze, the way exporters emit it
+// for every reshape reading a dim of 'x'
+Node* dimChain(Graph& g, Value* x, int64_t index) {
+  Node* shape = append(g, ir::kShape, {x});
+  Node* gather =
+      append(g, ir::kGather, {shape->output(), constant(g, index)->output()});
+  gather->i_(ir::kaxis, 0);
+  Node* unsqueeze = append(g, ir::kUnsqueeze, {gather->output()});
+  unsqueeze->is_(ir::kaxes, {0});
+  return unsqueeze;
+}
+
+size_t numNodes(const Graph& g) {
+  size_t count = 0;
+  for (const Node* n : g.nodes()) {
+    (void)n;
+    count++;
+  }
+  return count;
+}
+
+TEST(EliminateTest, CollapsesDuplicatedChains) {
+  Graph g;
+  Value* x = g.addInput();
+  Node* a = dimChain(g, x, 0);
+  Node* b = dimChain(g, x, 0);
+  Node* c = dimChain(g, x, 1);
+  Node* concat =
+      append(g, ir::kConcat, {a->output(), b->output(), c->output()});
+  concat->i_(ir::kaxis, 0);
+  g.registerOutput(concat->output());
+  ASSERT_EQ(13u, numNodes(g));
+
+  AnalysisManager analyses;
+  PassResult result = EliminateCommonSubexpressions().runPass(g, analyses);
+  // b's four nodes, and c's Shape
+  EXPECT_EQ(5u, result.num_changes);
+  EXPECT_EQ(GraphState::kStructure, result.mutated);
+  EXPECT_EQ(8u, numNodes(g));
+  EXPECT_EQ(a->output(), concat->inputs()[0]);
+  EXPECT_EQ(a->output(), concat->inputs()[1]);
+  EXPECT_NE(a->output(), concat->inputs()[2]);
+  // c's Gather reads a's Shape, with its own index
+  Node* gather = concat->inputs()[2]->node()->input()->node();
+  EXPECT_EQ(a->input()->node()->input(0)->node(), gather->input(0)->node());
+
+  analyses.invalidate(result.mutated);
+  EXPECT_EQ(0u, EliminateCommonSubexpressions().runPass(g, analyses)
+                    .num_changes);
+}
+
+TEST(EliminateTest, RemovesDeadChains) {
+  Graph g;
+  Value* x = g.addInput();
+  Node* live = dimChain(g, x, 0);
+  dimChain(g, x, 1);
+  Node* dead_relu = append(g, ir::kRelu, {x});
+  append(g, ir::kNeg, {dead_relu->output()});
+  g.registerOutput(live->output());
+
+  ir::Tensor unused(ir::TensorProto_DataType_FLOAT, {2});
+  unused.allocate();
+  unused.setName("unused");
+  g.addInitializerAndCreateValue(unused);
+
+  AnalysisManager analyses;
+  PassResult result = EliminateDeadCode().runPass(g, analyses);
+  EXPECT_EQ(7u, result.num_changes);
+  EXPECT_EQ(4u, numNodes(g));
+  EXPECT_TRUE(g.initializers().empty());
+  for (Node* n : g.nodes()) EXPECT_TRUE(n->hasUses());
+}
+
+TEST(EliminateTest, KeepsOutputNames) {
+  Graph g;
+  Value* x = g.addInput();
+  Node* first = append(g, ir::kRelu, {x});
+  Node* second = append(g, ir::kRelu, {x});
+  second->output()->setUniqueName("y");
+  Node* neg = append(g, ir::kNeg, {first->output()});
+  g.registerOutput(neg->output());
+  g.registerOutput(second->output());
+
+  AnalysisManager analyses;
+  EXPECT_EQ(1u,
+            EliminateCommonSubexpressions().runPass(g, analyses).num_changes);
+  EXPECT_EQ(first->output(), g.outputs()[1]);
+  EXPECT_EQ("y", first->output()->uniqueName());
+
+  // both are outputs: merging would leave one of the names without a value
+  Graph h;
+  Value* z = h.addInput();
+  h.registerOutput(append(h, ir::kRelu, {z})->output());
+  h.registerOutput(append(h, ir::kRelu, {z})->output());
+  AnalysisManager h_analyses;
+  EXPECT_EQ(0u,
+            EliminateCommonSubexpressions().runPass(h, h_analyses).num_changes);
+}
+
+TEST(EliminateTest, DoesNotMergeRandomOps) {
+  Graph g;
+  Value* x = g.addInput();
+  Node* a = append(g, ir::kRandomUniformLike, {x});
+  Node* b = append(g, ir::kRandomUniformLike, {x});
+  g.registerOutput(append(g, ir::kAdd, {a->output(), b->output()})->output());
+  AnalysisManager analyses;
+  EXPECT_EQ(0u,
+            EliminateCommonSubexpressions().runPass(g, analyses).num_changes);
+  EXPECT_EQ(3u, numNodes(g));
+}
+
+TEST(EliminateTest, Subgraphs) {
+  Graph g;
+  Value* cond = g.addInput();
+  cond->setUniqueName("cond");
+  Node* r1 = append(g, ir::kRelu, {cond});
+  r1->output()->setUniqueName("r1");
+  Node* r2 = append(g, ir::kRelu, {cond});
+  r2->output()->setUniqueName("r2");
+  Node* dead = append(g, ir::kNeg, {cond});
+  dead->output()->setUniqueName("dead");
+
+  // reads r2 by name; keeps 'dead' alive until its reader goes
+  auto branch = std::make_shared<Graph>();
+  Node* captured = branch->appendNode(branch->create(ir::kCaptured, 1));
+  captured->output()->setUniqueName("r2");
+  Node* unused = branch->appendNode(branch->create(ir::kCaptured, 1));
+  unused->output()->setUniqueName("dead");
+  append(*branch, ir::kTanh, {unused->output()});
+  Node* n1 = append(*branch, ir::kNeg, {captured->output()});
+  Node* n2 = append(*branch, ir::kNeg, {captured->output()});
+  branch->registerOutput(
+      append(*branch, ir::kAdd, {n1->output(), n2->output()})->output());
+
+  Node* if_node = append(g, ir::kIf, {cond});
+  if_node->g_(ir::kthen_branch, branch);
+  if_node->g_(ir::kelse_branch, branch);
+  g.registerOutput(if_node->output());
+  g.registerOutput(r1->output());
+
+  PassManager manager = CreatePipeline(
+      {"eliminate_common_subexpressions", "eliminate_dead_code"});
+  manager.setMaxRounds(4);
+  AnalysisManager analyses;
+  manager.run(g, analyses);
+
+  // the branch is shared by both attributes, so it is cleaned up once and
+  // its duplicate Neg found once
+  EXPECT_EQ(3u, numNodes(*branch));
+  // r2 is captured, so it stays although it duplicates r1; 'dead' lost its
+  // last reader in the branch
+  EXPECT_EQ(3u, numNodes(g));
+  for (Node* n : g.nodes()) EXPECT_NE(ir::kNeg, n->kind());
+}
+
+}  // namespace
+}  // namespace my_ai_training::optimization
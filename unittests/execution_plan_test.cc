@@ -0,0 +1,289 @@
+#include "runtime/execution_plan.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "graph_helpers.h"
+#include "optimizer/assign_layouts.h"
+#include "optimizer/fuse_operators.h"
+#include "optimizer/reference_kernels.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+TEST(MatTest, ConvertPacking) {
+  // 8 channels of 2x3, channel q holding q * 10 + i
+  ncnn::Mat m(3, 2, 8);
+  for (int q = 0; q < m.c; q++) {
+    float* ptr = m.channel(q);
+    for (int i = 0; i < 6; i++) ptr[i] = q * 10 + i;
+  }
+  ncnn::Mat packed;
+  ncnn::convert_packing(m, packed, 4);
+  EXPECT_EQ(4, packed.elempack);
+  EXPECT_EQ(2, packed.c);
+  EXPECT_EQ(16u, packed.elemsize);
+  // element 1 of channel group 1 is channels 4 to 7 at position 1
+  const float* group = packed.channel(1);
+  EXPECT_EQ(std::vector<float>({41, 51, 61, 71}),
+            std::vector<float>(group + 4, group + 8));
+
+  ncnn::Mat unpacked;
+  ncnn::convert_packing(packed, unpacked, 1);
+  for (int q = 0; q < 8; q++) {
+    const float* ptr = unpacked.channel(q);
+    EXPECT_EQ(q * 10 + 5, ptr[5]);
+  }
+  // does not divide: shared as it is
+  ncnn::Mat same;
+  ncnn::convert_packing(m, same, 16);
+  EXPECT_EQ(m.data, same.data);
+
+  // 3 dim Mats have aligned channels, a flat reshape gathers them
+  ncnn::Mat flat = m.reshape(48);
+  EXPECT_EQ(1, flat.dims);
+  EXPECT_EQ(13, flat[9]);
+}
+
+Value* floats(Graph& g, std::vector<int64_t> sizes,
+              std::vector<float> values) {
+  ir::Tensor t(ir::TensorProto_DataType_FLOAT, std::move(sizes));
+  t.setRawData(values.data(), values.size() * sizeof(float));
+  return g.addInitializerAndCreateValue(t);
+}
+
+ir::Tensor run(const ExecutionPlan& plan, const ir::Tensor& x) {
+  Frame frame = plan.createFrame();
+  ncnn::Mat mat;
+  TensorToMat(x, 1, nullptr, &mat);
+  plan.setInput(frame, 0, mat, x.sizes());
+  plan.run(frame);
+  const SlotValue& out = plan.output(frame, 0);
+  ir::Tensor result;
+  MatToTensor(out.mat, out.elem_type, out.sizes, &result);
+  return result;
+}
+
+ir::Tensor iota(std::vector<int64_t> sizes) {
+  ir::Tensor t(ir::TensorProto_DataType_FLOAT, std::move(sizes));
+  float* data = static_cast<float*>(t.allocate());
+  for (int64_t i = 0; i < t.numel(); i++) data[i] = static_cast<float>(i);
+  return t;
+}
+
+TEST(ExecutionPlanTest, RunsPackedSlots) {
+  // ((x + 1) packed by 4) * 2, unpacked, flattened
+  Graph g;
+  Value* x = floatInput(g, {1, 8, 1, 2});
+  Node* add = append(g, ir::kAdd, {x, floats(g, {}, {1})});
+  Node* pack = append(g, ir::kPacking, {add->output()});
+  pack->i_(ir::kelempack, 4);
+  Node* mul = append(g, ir::kMul, {pack->output(), floats(g, {}, {2})});
+  mul->i_(ir::kelempack, 4);
+  Node* unpack = append(g, ir::kPacking, {mul->output()});
+  unpack->i_(ir::kelempack, 1);
+  ir::Tensor shape(ir::TensorProto_DataType_INT64, {1});
+  int64_t flat = -1;
+  shape.setRawData(&flat, sizeof(flat));
+  Value* flat_shape = g.addInitializerAndCreateValue(shape);
+  Node* reshape = append(g, ir::kReshape, {unpack->output(), flat_shape});
+  g.registerOutput(reshape->output());
+
+  auto plan = ExecutionPlan::Compile(g);
+  ASSERT_EQ(5u, plan->instructions().size());
+  EXPECT_EQ(ir::kMul, plan->instructions()[2].op);
+  // each instruction's operands follow the previous one's
+  EXPECT_EQ(3u, plan->instructions()[1].first_operand);
+  const Instruction& mul_inst = plan->instructions()[2];
+  uint32_t mul_out = plan->operands()[mul_inst.first_operand + 2];
+  EXPECT_EQ(4, plan->slots()[mul_out].elempack);
+  EXPECT_EQ(1u, plan->inputSlots().size());
+
+  Frame frame = plan->createFrame();
+  ir::Tensor input = iota({1, 8, 1, 2});
+  ncnn::Mat mat;
+  TensorToMat(input, 1, nullptr, &mat);
+  plan->setInput(frame, 0, mat, input.sizes());
+  plan->run(frame);
+  // intermediates are freed after their last reader
+  EXPECT_TRUE(frame.slots[mul_out].mat.empty());
+  const SlotValue& out = plan->output(frame, 0);
+  EXPECT_EQ(std::vector<int64_t>({16}), out.sizes);
+  ir::Tensor result;
+  MatToTensor(out.mat, out.elem_type, out.sizes, &result);
+  for (int i = 0; i < 16; i++) {
+    EXPECT_EQ((i + 1) * 2, result.data<float>()[i]);
+  }
+  // the same plan runs again in a new frame
+  EXPECT_EQ(2, run(*plan, input).data<float>()[0]);
+}
+
+TEST(ExecutionPlanTest, InlinesFusionGroups) {
+  Graph g;
+  Value* x = floatInput(g, {2, 3});
+  Node* sub = append(g, ir::kSub, {x, floats(g, {3}, {1, 2, 3})});
+  Node* mul = append(g, ir::kMul, {sub->output(), sub->output()});
+  g.registerOutput(mul->output());
+  optimization::CreateFusionGroup({sub, mul});
+
+  auto plan = ExecutionPlan::Compile(g);
+  ASSERT_EQ(2u, plan->instructions().size());
+  ir::Tensor result = run(*plan, iota({2, 3}));
+  EXPECT_EQ(std::vector<float>({1, 1, 1, 4, 4, 4}),
+            std::vector<float>(result.data<float>(),
+                               result.data<float>() + 6));
+}
+
+TEST(ExecutionPlanTest, RunsBranchesInParallel) {
+  // eight independent Adds of x, concatenated
+  Graph g;
+  Value* x = floatInput(g, {2, 3});
+  std::vector<Value*> branches;
+  for (int k = 0; k < 8; k++) {
+    Value* c = floats(g, {}, {static_cast<float>(k)});
+    Node* add = append(g, ir::kAdd, {x, c});
+    Node* mul = append(g, ir::kMul, {add->output(), add->output()});
+    branches.push_back(mul->output());
+  }
+  Node* concat = append(g, ir::kConcat, branches);
+  concat->i_(ir::kaxis, 0);
+  g.registerOutput(concat->output());
+
+  auto plan = ExecutionPlan::Compile(g);
+  ASSERT_EQ(17u, plan->instructions().size());
+  EXPECT_EQ(0u, plan->numDependencies(0));
+  EXPECT_EQ(1u, plan->numDependencies(1));
+  EXPECT_EQ(8u, plan->numDependencies(16));
+  // the Mul reads its input twice but depends on the Add once
+  ASSERT_EQ(1, plan->dependentsEnd(0) - plan->dependentsBegin(0));
+  EXPECT_EQ(1u, *plan->dependentsBegin(0));
+
+  ir::Tensor input = iota({2, 3});
+  ir::Tensor expected = run(*plan, input);
+  WorkStealingPool pool(4);
+  for (int round = 0; round < 20; round++) {
+    Frame frame = plan->createFrame();
+    ncnn::Mat mat;
+    TensorToMat(input, 1, nullptr, &mat);
+    plan->setInput(frame, 0, mat, input.sizes());
+    plan->run(frame, pool);
+    // the intermediates were released
+    for (int k = 0; k < 16; k++) {
+      const Instruction& inst = plan->instructions()[k];
+      EXPECT_TRUE(frame.slots[plan->operands()[inst.first_operand + 2]]
+                      .mat.empty());
+    }
+    const SlotValue& out = plan->output(frame, 0);
+    ir::Tensor result;
+    MatToTensor(out.mat, out.elem_type, out.sizes, &result);
+    ASSERT_EQ(expected.sizes(), result.sizes());
+    EXPECT_EQ(0, memcmp(expected.data<float>(), result.data<float>(),
+                        expected.byteSize()));
+  }
+}
+
+TEST(ExecutionPlanTest, KernelsSplitChannels) {
+  Graph g;
+  Node* neg = append(g, ir::kNeg, {floatInput(g, {1, 8, 2, 2})});
+  g.registerOutput(neg->output());
+  KernelRegistry kernels;
+  kernels.registerKernel(
+      ir::kNeg, Kernel{[](const Instruction& inst, KernelContext& ctx) {
+                         const SlotValue& in = ctx.input(inst, 0);
+                         ncnn::Mat& out = ctx.createOutput(
+                             inst, 0, in.sizes, in.elem_type);
+                         ctx.parallelFor(out.c, [&](size_t b, size_t e) {
+                           for (size_t q = b; q < e; q++) {
+                             const float* x = in.mat.channel(int(q));
+                             float* y = out.channel(int(q));
+                             for (int i = 0; i < out.w * out.h; i++) {
+                               y[i] = -x[i];
+                             }
+                           }
+                         });
+                         return true;
+                       },
+                       nullptr});
+  auto plan = ExecutionPlan::Compile(g, kernels);
+  IntraOpPool pool;
+  Frame frame = plan->createFrame();
+  frame.intra_op_pool = &pool;
+  ir::Tensor input = iota({1, 8, 2, 2});
+  ncnn::Mat mat;
+  TensorToMat(input, 1, nullptr, &mat);
+  plan->setInput(frame, 0, mat, input.sizes());
+  plan->run(frame);
+  const SlotValue& out = plan->output(frame, 0);
+  ir::Tensor result;
+  MatToTensor(out.mat, out.elem_type, out.sizes, &result);
+  for (int i = 0; i < 32; i++) EXPECT_EQ(-i, result.data<float>()[i]);
+}
+
+TEST(ExecutionPlanTest, PackedLayoutsHavePackedKernels) {
+  // assign_layouts packs only the ops whose kernels run packed
+  for (ir::NodeKind kind : optimization::PackedLayoutKinds()) {
+    const Kernel* kernel = KernelRegistry::global().find(kind);
+    ASSERT_NE(nullptr, kernel) << kind.toString();
+    EXPECT_TRUE(kernel->runs_packed) << kind.toString();
+  }
+  EXPECT_FALSE(KernelRegistry::global().find(ir::kConcat)->runs_packed);
+}
+
+TEST(ExecutionPlanTest, NeedsKernels) {
+  // every op the reference kernels cover has a kernel
+  for (ir::NodeKind kind : optimization::ReferenceKernelKinds()) {
+    EXPECT_NE(nullptr, KernelRegistry::global().find(kind))
+        << kind.toString();
+  }
+
+  Graph g;
+  Node* relu = append(g, ir::kRelu, {floatInput(g, {4})});
+  g.registerOutput(relu->output());
+  EXPECT_THROW(ExecutionPlan::Compile(g), ir::assert_error);
+
+  // a kernel of another registry
+  KernelRegistry kernels;
+  kernels.registerKernel(
+      ir::kRelu, Kernel{[](const Instruction& inst, KernelContext& ctx) {
+                          const SlotValue& in = ctx.input(inst, 0);
+                          ncnn::Mat& out = ctx.createOutput(
+                              inst, 0, in.sizes, in.elem_type);
+                          for (int i = 0; i < in.mat.w; i++) {
+                            out[i] = in.mat[i] > 0 ? in.mat[i] : 0;
+                          }
+                          return true;
+                        },
+                        nullptr});
+  auto plan = ExecutionPlan::Compile(g, kernels);
+  ir::Tensor x(ir::TensorProto_DataType_FLOAT, {4});
+  std::vector<float> values{-1, 2, -3, 4};
+  x.setRawData(values.data(), 16);
+  ir::Tensor result = run(*plan, x);
+  EXPECT_EQ(std::vector<float>({0, 2, 0, 4}),
+            std::vector<float>(result.data<float>(),
+                               result.data<float>() + 4));
+
+  // a failing kernel, run in parallel, throws after the run
+  kernels.registerKernel(
+      ir::kRelu,
+      Kernel{[](const Instruction&, KernelContext&) { return false; },
+             nullptr});
+  plan = ExecutionPlan::Compile(g, kernels);
+  WorkStealingPool pool(2);
+  Frame frame = plan->createFrame();
+  ncnn::Mat mat;
+  TensorToMat(x, 1, nullptr, &mat);
+  plan->setInput(frame, 0, mat, x.sizes());
+  EXPECT_THROW(plan->run(frame, pool), ir::assert_error);
+}
+
+}  // namespace
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,101 @@
+#include "onnx_ir/external_data.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "onnx_ir/ir.h"
+
+namespace my_ai_training::ir {
+namespace {
+
+class ExternalDataTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = ::testing::TempDir();
+    path_ = dir_ + "/external_data_test.bin";
+    FILE* fp = std::fopen(path_.c_str(), "wb");
+    ASSERT_NE(nullptr, fp);
+    // [0, 16): header bytes, [16, 48): 8 floats
+    std::vector<char> header(16, 'x');
+    std::fwrite(header.data(), 1, header.size(), fp);
+    for (int i = 0; i < 8; i++) values_.push_back(0.5f * i);
+    std::fwrite(values_.data(), sizeof(float), values_.size(), fp);
+    std::fclose(fp);
+  }
+
+  void TearDown() override { std::remove(path_.c_str()); }
+
+  std::string dir_;
+  std::string path_;
+  std::vector<float> values_;
+};
+
+TEST_F(ExternalDataTest, MapOnce) {
+  auto store = ExternalDataStore::create(dir_);
+  auto a = store->map("external_data_test.bin");
+  auto b = store->map("external_data_test.bin");
+  EXPECT_EQ(a.get(), b.get());
+  EXPECT_EQ(16u + 8 * sizeof(float), a->size());
+}
+
+TEST_F(ExternalDataTest, LoadAliasesMapping) {
+  auto store = ExternalDataStore::create(dir_);
+  ExternalDataInfo info{"external_data_test.bin", 16, 32};
+  auto buffer = store->load(info);
+  auto file = store->map(info.location);
+  EXPECT_EQ(file->data() + 16, buffer->data());
+  EXPECT_FALSE(buffer->isOwned());
+
+  ExternalDataInfo to_end{"external_data_test.bin", 16, -1};
+  EXPECT_EQ(32u, store->load(to_end)->size());
+
+  ExternalDataInfo too_long{"external_data_test.bin", 16, 64};
+  EXPECT_THROW(store->load(too_long), assert_error);
+}
+
+TEST_F(ExternalDataTest, GraphInitializerIsLazy) {
+  Graph g;
+  g.setExternalDataStore(ExternalDataStore::create(dir_));
+  Value* w = g.addExternalInitializerAndCreateValue(
+      "w", TensorProto_DataType_FLOAT, {2, 4},
+      {"external_data_test.bin", 16, 32});
+  EXPECT_EQ("w", w->uniqueName());
+
+  const Tensor& t = *g.getInitializer("w");
+  EXPECT_FALSE(t.buffer()->isResolved());
+  const float* data = t.data<float>();
+  EXPECT_TRUE(t.buffer()->isResolved());
+  for (size_t i = 0; i < values_.size(); i++) {
+    EXPECT_EQ(values_[i], data[i]);
+  }
+
+  // writes detach from the mapping, the file is untouched
+  Tensor copy = t;
+  copy.mutableData<float>()[0] = 100.f;
+  EXPECT_EQ(0.f, t.data<float>()[0]);
+  EXPECT_EQ(data, t.data<float>());
+}
+
+TEST_F(ExternalDataTest, MissingFileFailsOnAccess) {
+  Graph g;
+  g.setExternalDataStore(ExternalDataStore::create(dir_));
+  g.addExternalInitializerAndCreateValue("w", TensorProto_DataType_FLOAT, {4},
+                                         {"does_not_exist.bin", 0, 16});
+  EXPECT_THROW(g.getInitializer("w")->rawData(), assert_error);
+}
+
+TEST_F(ExternalDataTest, LocationsStayInTheModelDirectory) {
+  auto store = ExternalDataStore::create(dir_);
+  EXPECT_THROW(store->map(path_), assert_error);
+  EXPECT_THROW(store->map("/etc/passwd"), assert_error);
+  EXPECT_THROW(store->map("../external_data_test.bin"), assert_error);
+  EXPECT_THROW(store->map("a/../../external_data_test.bin"), assert_error);
+  EXPECT_THROW(store->map("a\\..\\b.bin"), assert_error);
+  EXPECT_EQ(32u + 16, store->map("./external_data_test.bin")->size());
+}
+
+}  // namespace
+}  // namespace my_ai_training::ir
@@ -0,0 +1,134 @@
+#include "optimizer/fold_batch_norm.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "optimizer/fold_constants.h"
+
+namespace my_ai_training::optimization {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+
+Value* initializer(Graph& g, std::vector<int64_t> sizes,
+                   std::vector<float> values) {
+  ir::Tensor t(ir::TensorProto_DataType_FLOAT, std::move(sizes));
+  t.setRawData(values.data(), values.size() * sizeof(float));
+  return g.addInitializerAndCreateValue(t);
+}
+
+std::vector<float> payload(const Value* v) {
+  const ir::Tensor* t = FindConstant(v);
+  EXPECT_NE(nullptr, t);
+  if (t == nullptr) return {};
+  return std::vector<float>(t->data<float>(), t->data<float>() + t->numel());
+}
+
+// BatchNormalization(x) with scale / sqrt(var + eps) = {2, 0.5} and
+// shift = beta - mean * that = {1, -1}
+Node* batchNorm(Graph& g, Value* x) {
+  Node* bn = g.create(ir::kBatchNormalization,
+                      {x, initializer(g, {2}, {2, 1}),
+                       initializer(g, {2}, {3, 0}), initializer(g, {2}, {1, 2}),
+                       initializer(g, {2}, {0.75f, 3.75f})},
+                      1);
+  bn->f_(ir::kepsilon, 0.25);
+  return g.appendNode(bn);
+}
+
+void expectNear(const std::vector<float>& expected,
+                const std::vector<float>& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_NEAR(expected[i], actual[i], 1e-6) << "at " << i;
+  }
+}
+
+TEST(FoldBatchNormTest, Conv) {
+  Graph g;
+  Value* x = g.addInput();
+  Node* conv = g.appendNode(g.create(
+      ir::kConv, {x, initializer(g, {2, 1, 1, 2}, {1, 2, 3, 4})}, 1));
+  Node* bn = batchNorm(g, conv->output());
+  bn->output()->setUniqueName("y");
+  g.registerOutput(bn->output());
+
+  AnalysisManager analyses;
+  EXPECT_EQ(1u, FoldBatchNorm().runPass(g, analyses).num_changes);
+  EXPECT_EQ(conv->output(), g.outputs()[0]);
+  EXPECT_EQ("y", conv->output()->uniqueName());
+  ASSERT_EQ(3u, conv->inputs().size());
+  expectNear({2, 4, 1.5, 2}, payload(conv->inputs()[1]));
+  expectNear({1, -1}, payload(conv->inputs()[2]));
+}
+
+TEST(FoldBatchNormTest, GroupedConvTranspose) {
+  Graph g;
+  Value* x = g.addInput();
+  // 4 input channels in 2 groups, one output channel per group
+  Node* deconv = g.appendNode(g.create(
+      ir::kConvTranspose,
+      {x, initializer(g, {4, 1, 1, 1}, {1, 2, 3, 4}),
+       initializer(g, {2}, {10, 20})},
+      1));
+  deconv->i_(ir::kgroup, 2);
+  g.registerOutput(batchNorm(g, deconv->output())->output());
+
+  AnalysisManager analyses;
+  EXPECT_EQ(1u, FoldBatchNorm().runPass(g, analyses).num_changes);
+  expectNear({2, 4, 1.5, 2}, payload(deconv->inputs()[1]));
+  expectNear({21, 9}, payload(deconv->inputs()[2]));
+}
+
+TEST(FoldBatchNormTest, Gemm) {
+  Graph g;
+  Value* a = g.addInput();
+  // B^T is [2, 3]: scaled by row
+  Node* gemm = g.appendNode(g.create(
+      ir::kGemm,
+      {a, initializer(g, {2, 3}, {1, 2, 3, 4, 5, 6}),
+       initializer(g, {2}, {4, 8})},
+      1));
+  gemm->i_(ir::ktransB, 1);
+  gemm->f_(ir::kbeta, 0.5);
+  g.registerOutput(batchNorm(g, gemm->output())->output());
+
+  AnalysisManager analyses;
+  EXPECT_EQ(1u, FoldBatchNorm().runPass(g, analyses).num_changes);
+  expectNear({2, 4, 6, 2, 2.5, 3}, payload(gemm->inputs()[1]));
+  expectNear({5, 1}, payload(gemm->inputs()[2]));
+  EXPECT_EQ(1.0, gemm->f(ir::kbeta));
+}
+
+TEST(FoldBatchNormTest, LeavesSharedOutputsAlone) {
+  Graph g;
+  Value* x = g.addInput();
+  Node* conv = g.appendNode(g.create(
+      ir::kConv, {x, initializer(g, {2, 1, 1, 2}, {1, 2, 3, 4})}, 1));
+  g.registerOutput(batchNorm(g, conv->output())->output());
+  g.registerOutput(conv->output());
+
+  // a weight the runtime may replace is no constant either
+  Graph h;
+  Value* y = h.addInput();
+  Value* w = h.addInput();
+  w->setUniqueName("w");
+  ir::Tensor t(ir::TensorProto_DataType_FLOAT, {2, 1, 1, 1});
+  t.allocate();
+  t.setName("w");
+  h.addInitializerAndCreateValue(t);
+  Node* conv2 = h.appendNode(h.create(ir::kConv, {y, w}, 1));
+  h.registerOutput(batchNorm(h, conv2->output())->output());
+
+  AnalysisManager analyses;
+  EXPECT_EQ(0u, FoldBatchNorm().runPass(g, analyses).num_changes);
+  EXPECT_EQ(0u, FoldBatchNorm().runPass(h, analyses).num_changes);
+}
+
+}  // namespace
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,259 @@
+#include "optimizer/fold_constants.h"
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "graph_helpers.h"
+#include "optimizer/pass_manager.h"
+#include "optimizer/reference_kernels.h"
+
+namespace my_ai_training::optimization {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Tensor;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+template <typename T>
+Tensor makeTensor(int32_t elem_type, std::vector<int64_t> sizes,
+                  std::vector<T> values) {
+  Tensor t(elem_type, std::move(sizes));
+  EXPECT_EQ(static_cast<size_t>(t.numel()), values.size());
+  t.setRawData(values.data(), values.size() * sizeof(T));
+  return t;
+}
+
+Tensor floats(std::vector<int64_t> sizes, std::vector<float> values) {
+  return makeTensor(ir::TensorProto_DataType_FLOAT, std::move(sizes),
+                    std::move(values));
+}
+
+Tensor ints(std::vector<int64_t> sizes, std::vector<int64_t> values) {
+  return makeTensor(ir::TensorProto_DataType_INT64, std::move(sizes),
+                    std::move(values));
+}
+
+template <typename T>
+std::vector<T> values(const Tensor& t) {
+  return std::vector<T>(t.data<T>(), t.data<T>() + t.numel());
+}
+
+// Makes nodes with placeholder inputs and evaluates them on given payloads.
+class Evaluator {
+ public:
+  Node* node(ir::NodeKind kind, size_t num_inputs) {
+    std::vector<Value*> inputs;
+    for (size_t i = 0; i < num_inputs; i++) inputs.push_back(g_.addInput());
+    return g_.appendNode(g_.create(kind, inputs, 1));
+  }
+
+  bool run(Node* n, std::vector<const Tensor*> inputs) {
+    return EvaluateNode(n, inputs, &outputs_);
+  }
+  const Tensor& output() const { return outputs_.at(0); }
+
+ private:
+  Graph g_;
+  std::vector<Tensor> outputs_;
+};
+
+TEST(ReferenceKernelsTest, Binary) {
+  Evaluator e;
+  Tensor a = floats({2, 3}, {1, 2, 3, 4, 5, 6});
+  Tensor row = floats({3}, {10, 20, 30});
+  Tensor col = floats({2, 1}, {2, 4});
+
+  ASSERT_TRUE(e.run(e.node(ir::kAdd, 2), {&a, &row}));
+  EXPECT_EQ(std::vector<int64_t>({2, 3}), e.output().sizes());
+  EXPECT_EQ(std::vector<float>({11, 22, 33, 14, 25, 36}),
+            values<float>(e.output()));
+
+  ASSERT_TRUE(e.run(e.node(ir::kDiv, 2), {&a, &col}));
+  EXPECT_EQ(std::vector<float>({0.5, 1, 1.5, 1, 1.25, 1.5}),
+            values<float>(e.output()));
+
+  // [3] x [2, 1] broadcasts both ways
+  ASSERT_TRUE(e.run(e.node(ir::kMul, 2), {&row, &col}));
+  EXPECT_EQ(std::vector<float>({20, 40, 60, 40, 80, 120}),
+            values<float>(e.output()));
+
+  Tensor base = ints({3}, {2, -3, 7});
+  Tensor exponent = ints({}, {3});
+  ASSERT_TRUE(e.run(e.node(ir::kPow, 2), {&base, &exponent}));
+  EXPECT_EQ(std::vector<int64_t>({8, -27, 343}), values<int64_t>(e.output()));
+
+  Tensor zero = ints({}, {0});
+  EXPECT_FALSE(e.run(e.node(ir::kDiv, 2), {&base, &zero}));
+  EXPECT_FALSE(e.run(e.node(ir::kAdd, 2), {&a, &base}));  // mixed types
+  Tensor bad = floats({2}, {1, 2});
+  EXPECT_FALSE(e.run(e.node(ir::kSub, 2), {&a, &bad}));
+}
+
+TEST(ReferenceKernelsTest, Cast) {
+  Evaluator e;
+  Node* to_int = e.node(ir::kCast, 1);
+  to_int->i_(ir::kto, ir::TensorProto_DataType_INT32);
+  Tensor x = floats({3}, {1.9f, -2.5f, 0});
+  ASSERT_TRUE(e.run(to_int, {&x}));
+  EXPECT_EQ(ir::TensorProto_DataType_INT32, e.output().elem_type());
+  EXPECT_EQ(std::vector<int32_t>({1, -2, 0}), values<int32_t>(e.output()));
+
+  Node* to_bool = e.node(ir::kCast, 1);
+  to_bool->i_(ir::kto, ir::TensorProto_DataType_BOOL);
+  ASSERT_TRUE(e.run(to_bool, {&x}));
+  EXPECT_EQ(std::vector<bool>({true, true, false}), values<bool>(e.output()));
+
+  Tensor huge = floats({1}, {1e20f});
+  EXPECT_FALSE(e.run(to_int, {&huge}));
+}
+
+TEST(ReferenceKernelsTest, DataMovement) {
+  Evaluator e;
+  Tensor x = floats({2, 3}, {0, 1, 2, 3, 4, 5});
+
+  Tensor shape = ints({2}, {0, -1});
+  Tensor flat = ints({1}, {-1});
+  ASSERT_TRUE(e.run(e.node(ir::kReshape, 2), {&x, &flat}));
+  EXPECT_EQ(std::vector<int64_t>({6}), e.output().sizes());
+  // the payload is shared, not copied
+  EXPECT_EQ(x.rawData(), e.output().rawData());
+  Tensor x3 = floats({2, 3, 1}, {0, 1, 2, 3, 4, 5});
+  ASSERT_TRUE(e.run(e.node(ir::kReshape, 2), {&x3, &shape}));
+  EXPECT_EQ(std::vector<int64_t>({2, 3}), e.output().sizes());
+
+  Node* transpose = e.node(ir::kTranspose, 1);
+  ASSERT_TRUE(e.run(transpose, {&x}));
+  EXPECT_EQ(std::vector<int64_t>({3, 2}), e.output().sizes());
+  EXPECT_EQ(std::vector<float>({0, 3, 1, 4, 2, 5}),
+            values<float>(e.output()));
+
+  Node* concat = e.node(ir::kConcat, 2);
+  concat->i_(ir::kaxis, -1);
+  Tensor y = floats({2, 1}, {9, 8});
+  ASSERT_TRUE(e.run(concat, {&x, &y}));
+  EXPECT_EQ(std::vector<float>({0, 1, 2, 9, 3, 4, 5, 8}),
+            values<float>(e.output()));
+
+  // x[:, ::-2] and x[1:, 1:100]
+  Tensor starts = ints({1}, {-1}), ends = ints({1}, {-100});
+  Tensor axes = ints({1}, {1}), steps = ints({1}, {-2});
+  ASSERT_TRUE(
+      e.run(e.node(ir::kSlice, 5), {&x, &starts, &ends, &axes, &steps}));
+  EXPECT_EQ(std::vector<int64_t>({2, 2}), e.output().sizes());
+  EXPECT_EQ(std::vector<float>({2, 0, 5, 3}), values<float>(e.output()));
+  Tensor starts2 = ints({2}, {1, 1}), ends2 = ints({2}, {2, 100});
+  ASSERT_TRUE(e.run(e.node(ir::kSlice, 3), {&x, &starts2, &ends2}));
+  EXPECT_EQ(std::vector<float>({4, 5}), values<float>(e.output()));
+  // the extreme steps take one element
+  const int64_t kMax = std::numeric_limits<int64_t>::max();
+  const int64_t kMin = std::numeric_limits<int64_t>::min();
+  Tensor from1 = ints({1}, {1}), to_end = ints({1}, {kMax});
+  Tensor step_max = ints({1}, {kMax});
+  ASSERT_TRUE(e.run(e.node(ir::kSlice, 5),
+                    {&x, &from1, &to_end, &axes, &step_max}));
+  EXPECT_EQ(std::vector<float>({1, 4}), values<float>(e.output()));
+  Tensor to_begin = ints({1}, {kMin}), step_min = ints({1}, {kMin});
+  ASSERT_TRUE(e.run(e.node(ir::kSlice, 5),
+                    {&x, &starts, &to_begin, &axes, &step_min}));
+  EXPECT_EQ(std::vector<float>({2, 5}), values<float>(e.output()));
+  // backward over an empty dim
+  Tensor empty = floats({2, 0}, {});
+  ASSERT_TRUE(
+      e.run(e.node(ir::kSlice, 5), {&empty, &starts, &ends, &axes, &steps}));
+  EXPECT_EQ(std::vector<int64_t>({2, 0}), e.output().sizes());
+
+  Node* squeeze = e.node(ir::kSqueeze, 1);
+  ASSERT_TRUE(e.run(squeeze, {&x3}));
+  EXPECT_EQ(std::vector<int64_t>({2, 3}), e.output().sizes());
+  Tensor unsqueeze_axes = ints({2}, {0, -1});
+  ASSERT_TRUE(e.run(e.node(ir::kUnsqueeze, 2), {&x, &unsqueeze_axes}));
+  EXPECT_EQ(std::vector<int64_t>({1, 2, 3, 1}), e.output().sizes());
+
+  Tensor target = ints({3}, {2, 2, 3});
+  Tensor row = floats({3}, {1, 2, 3});
+  ASSERT_TRUE(e.run(e.node(ir::kExpand, 2), {&row, &target}));
+  EXPECT_EQ(std::vector<int64_t>({2, 2, 3}), e.output().sizes());
+  EXPECT_EQ(std::vector<float>({1, 2, 3, 1, 2, 3, 1, 2, 3, 1, 2, 3}),
+            values<float>(e.output()));
+}
+
+Value* constant(Graph& g, const Tensor& t) {
+  Node* n = g.appendNode(g.create(ir::kConstant, {}, 1));
+  n->t_(ir::kvalue, t);
+  return n->output();
+}
+
+size_t numNodes(const Graph& g) {
+  size_t count = 0;
+  for (const Node* n : g.nodes()) count += n != nullptr;
+  return count;
+}
+
+TEST(FoldConstantsTest, FoldsConstantSubgraphs) {
+  Graph g;
+  Value* x = g.addInput();
+  x->setUniqueName("x");
+  Tensor weight = floats({3, 2}, {1, 2, 3, 4, 5, 6});
+  weight.setName("weight");
+  Value* w = g.addInitializerAndCreateValue(weight);
+  // Transpose(weight) * 2 + x, and Reshape(x, Concat(shape pieces))
+  Node* wt = append(g, ir::kTranspose, {w});
+  Node* scaled =
+      append(g, ir::kMul, {wt->output(), constant(g, floats({}, {2}))});
+  Node* add = append(g, ir::kAdd, {scaled->output(), x});
+  Node* shape = append(g, ir::kConcat, {constant(g, ints({1}, {-1})),
+                                        constant(g, ints({1}, {3}))});
+  shape->i_(ir::kaxis, 0);
+  Node* reshape = append(g, ir::kReshape, {add->output(), shape->output()});
+  g.registerOutput(reshape->output());
+  g.registerOutput(scaled->output());
+  scaled->output()->setUniqueName("scaled");
+
+  PassManager manager =
+      CreatePipeline({"fold_constants", "eliminate_dead_code"});
+  EXPECT_EQ(7u, manager.run(g));
+  // Transpose, Mul and Concat folded, the constants they read removed
+  EXPECT_EQ(2u, numNodes(g));
+  EXPECT_EQ(add, reshape->input(0)->node());
+  ASSERT_TRUE(g.isInitializerValue(add->input(0)));
+  ASSERT_TRUE(g.isInitializerValue(reshape->input(1)));
+
+  // the folded graph output keeps its name, on a matching initializer
+  EXPECT_EQ(add->input(0), g.outputs()[1]);
+  EXPECT_EQ("scaled", add->input(0)->uniqueName());
+  auto it = g.getInitializer("scaled");
+  ASSERT_NE(g.initializers().end(), it);
+  EXPECT_EQ(std::vector<int64_t>({2, 3}), it->sizes());
+  EXPECT_EQ(std::vector<float>({2, 6, 10, 4, 8, 12}), values<float>(*it));
+  EXPECT_EQ(2u, g.initializers().size());  // 'weight' is dead
+  EXPECT_EQ(2u, add->input(0)->sizes().size());
+}
+
+TEST(FoldConstantsTest, LeavesRuntimeValuesAlone) {
+  Graph g;
+  // an initializer that is also an input only provides a default
+  Tensor bias = floats({1}, {1});
+  bias.setName("bias");
+  Value* input = g.addInput();
+  input->setUniqueName("bias");
+  g.addInitializerAndCreateValue(bias);
+  Node* add = append(g, ir::kAdd, {input, constant(g, floats({1}, {1}))});
+  g.registerOutput(add->output());
+  // above the size limit
+  Node* big = append(g, ir::kExpand, {constant(g, floats({}, {0})),
+                                      constant(g, ints({1}, {1024}))});
+  g.registerOutput(big->output());
+
+  AnalysisManager analyses;
+  EXPECT_EQ(0u, FoldConstants(1024).runPass(g, analyses).num_changes);
+  EXPECT_EQ(1u, FoldConstants(4096).runPass(g, analyses).num_changes);
+}
+
+}  // namespace
+}  // namespace my_ai_training::optimization
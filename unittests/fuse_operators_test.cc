@@ -0,0 +1,147 @@
+#include "optimizer/fuse_operators.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "graph_helpers.h"
+
+namespace my_ai_training::optimization {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+std::vector<ir::NodeKind> kinds(const Graph& g) {
+  std::vector<ir::NodeKind> result;
+  for (const Node* n : g.nodes()) result.push_back(n->kind());
+  return result;
+}
+
+PassResult fuse(Graph& g) {
+  AnalysisManager analyses;
+  return FuseOperators().runPass(g, analyses);
+}
+
+TEST(FuseOperatorsTest, ConvBatchNormRelu) {
+  Graph g;
+  Value* x = namedInput(g, "x");
+  Value* w = namedInput(g, "w");
+  Node* conv = append(g, ir::kConv, {x, w});
+  conv->is_(ir::kstrides, {2, 2});
+  std::vector<Value*> bn_inputs{conv->output()};
+  for (const char* name : {"scale", "bias", "mean", "var"}) {
+    bn_inputs.push_back(namedInput(g, name));
+  }
+  Node* bn = append(g, ir::kBatchNormalization, bn_inputs);
+  Node* relu = append(g, ir::kRelu, {bn->output()});
+  relu->output()->setUniqueName("y");
+  relu->output()->setElemType(ir::TensorProto_DataType_FLOAT);
+  g.registerOutput(relu->output());
+
+  EXPECT_EQ(1u, fuse(g).num_changes);
+  ASSERT_EQ(std::vector<ir::NodeKind>({ir::kFusionGroup}), kinds(g));
+  Node* group = g.outputs()[0]->node();
+  EXPECT_EQ(std::vector<Value*>({x, w, bn_inputs[1], bn_inputs[2],
+                                 bn_inputs[3], bn_inputs[4]}),
+            group->inputs().vec());
+  EXPECT_EQ("y", group->output()->uniqueName());
+  EXPECT_EQ(ir::TensorProto_DataType_FLOAT, group->output()->elemType());
+
+  const Graph& sub = *group->g(ir::kSubgraph);
+  EXPECT_EQ(std::vector<ir::NodeKind>(
+                {ir::kConv, ir::kBatchNormalization, ir::kRelu}),
+            kinds(sub));
+  EXPECT_EQ(6u, sub.inputs().size());
+  ASSERT_EQ(1u, sub.outputs().size());
+  const Node* inner_bn = sub.outputs()[0]->node()->input()->node();
+  const Node* inner_conv = inner_bn->input(0)->node();
+  EXPECT_EQ(ir::kConv, inner_conv->kind());
+  EXPECT_EQ(std::vector<int64_t>({2, 2}), inner_conv->is(ir::kstrides));
+  EXPECT_EQ(sub.inputs()[0], inner_conv->inputs()[0]);
+}
+
+TEST(FuseOperatorsTest, GemmAndMatMul) {
+  Graph g;
+  Value* x = namedInput(g, "x");
+  Value* w = namedInput(g, "w");
+  ir::Tensor bias(ir::TensorProto_DataType_FLOAT, {4});
+  bias.allocate();
+  bias.setName("bias");
+  Value* b = g.addInitializerAndCreateValue(bias);
+
+  // Gemm + constant bias + Tanh
+  Node* gemm = append(g, ir::kGemm, {x, w});
+  Node* gemm_add = append(g, ir::kAdd, {b, gemm->output()});
+  Node* tanh = append(g, ir::kTanh, {gemm_add->output()});
+  // MatMul + Add of a runtime value, no activation after
+  Node* matmul = append(g, ir::kMatMul, {tanh->output(), w});
+  Node* matmul_add = append(g, ir::kAdd, {matmul->output(), x});
+  // Gemm + Add of a runtime value: only the Gemm would be left
+  Node* lone = append(g, ir::kGemm, {matmul_add->output(), w});
+  Node* lone_add = append(g, ir::kAdd, {lone->output(), x});
+  g.registerOutput(lone_add->output());
+
+  EXPECT_EQ(2u, fuse(g).num_changes);
+  EXPECT_EQ(std::vector<ir::NodeKind>({ir::kFusionGroup, ir::kFusionGroup,
+                                       ir::kGemm, ir::kAdd}),
+            kinds(g));
+  Node* first = lone->input(0)->node()->input(0)->node();
+  EXPECT_EQ(std::vector<ir::NodeKind>({ir::kGemm, ir::kAdd, ir::kTanh}),
+            kinds(*first->g(ir::kSubgraph)));
+  EXPECT_EQ(std::vector<Value*>({x, w, b}), first->inputs().vec());
+}
+
+TEST(FuseOperatorsTest, ElementwiseChains) {
+  Graph g;
+  Value* x = namedInput(g, "x");
+  // x * sigmoid(x), then tanh of it, read twice
+  Node* sigmoid = append(g, ir::kSigmoid, {x});
+  Node* mul = append(g, ir::kMul, {x, sigmoid->output()});
+  Node* tanh = append(g, ir::kTanh, {mul->output()});
+  Node* a = append(g, ir::kAdd, {tanh->output(), x});
+  Node* b = append(g, ir::kMul, {tanh->output(), x});
+  Node* relu = append(g, ir::kRelu, {b->output()});
+  g.registerOutput(a->output());
+  g.registerOutput(relu->output());
+
+  EXPECT_EQ(1u, fuse(g).num_changes);
+  EXPECT_EQ(std::vector<ir::NodeKind>(
+                {ir::kFusionGroup, ir::kAdd, ir::kMul, ir::kRelu}),
+            kinds(g));
+  EXPECT_EQ(std::vector<ir::NodeKind>({ir::kSigmoid, ir::kMul, ir::kTanh}),
+            kinds(*a->input(0)->node()->g(ir::kSubgraph)));
+  // fused groups are not fused again
+  EXPECT_EQ(0u, fuse(g).num_changes);
+}
+
+TEST(FuseOperatorsTest, CapturedOutputsEndChains) {
+  Graph g;
+  Value* cond = namedInput(g, "cond");
+  Value* x = namedInput(g, "x");
+  Node* add = append(g, ir::kAdd, {x, x});
+  Node* sigmoid = append(g, ir::kSigmoid, {add->output()});
+  sigmoid->output()->setUniqueName("s");
+
+  // reads s by name
+  auto branch = std::make_shared<Graph>();
+  Node* captured = branch->appendNode(branch->create(ir::kCaptured, 1));
+  captured->output()->setUniqueName("s");
+  branch->registerOutput(
+      append(*branch, ir::kNeg, {captured->output()})->output());
+  Node* if_node = append(g, ir::kIf, {cond});
+  if_node->g_(ir::kthen_branch, branch);
+  if_node->g_(ir::kelse_branch, branch);
+  g.registerOutput(if_node->output());
+
+  EXPECT_EQ(0u, fuse(g).num_changes);
+  EXPECT_EQ(std::vector<ir::NodeKind>({ir::kAdd, ir::kSigmoid, ir::kIf}),
+            kinds(g));
+}
+
+}  // namespace
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,284 @@
+#include "runtime/gemm.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "graph_helpers.h"
+#include "runtime/execution_plan.h"
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+std::vector<GemmIsa> supportedIsas() {
+  std::vector<GemmIsa> isas;
+  for (GemmIsa isa : {GemmIsa::kGeneric, GemmIsa::kAvx2Fma, GemmIsa::kAvx512,
+                      GemmIsa::kAvx512Vnni}) {
+    if (CpuSupports(isa)) isas.push_back(isa);
+  }
+  return isas;
+}
+
+struct GemmCase {
+  int64_t m, n, k;
+};
+
+TEST(GemmTest, MatchesNaiveProduct) {
+  // edge tiles, and blocks of every loop: k > kKc, m > kMc, n > kNc
+  std::vector<GemmCase> cases{
+      {1, 1, 1}, {7, 13, 5}, {130, 70, 300}, {9, 600, 17}, {4, 3, 0}};
+  IntraOpPool pool;
+  Frame frame;
+  frame.intra_op_pool = &pool;
+  KernelContext ctx(nullptr, nullptr, &frame);
+  for (GemmIsa isa : supportedIsas()) {
+    for (const GemmCase& shape : cases) {
+      SCOPED_TRACE(testing::Message() << "isa " << static_cast<int>(isa)
+                                      << " m " << shape.m << " n " << shape.n
+                                      << " k " << shape.k);
+      int64_t m = shape.m, n = shape.n, k = shape.k;
+      // A transposed, k x m in memory
+      std::vector<float> a = pattern(m * k, 1);
+      std::vector<float> b = pattern(k * n, 2);
+      std::vector<float> c(m * n, 1.f);
+      PackedGemmB packed(b.data(), k, n, n, 1, isa);
+      Sgemm(m, a.data(), 1, m, 2.f, packed, c.data(), n, 1, true, ctx);
+      for (int64_t i = 0; i < m; i++) {
+        for (int64_t j = 0; j < n; j++) {
+          float expected = 1.f;
+          for (int64_t p = 0; p < k; p++) {
+            expected += 2.f * a[p * m + i] * b[p * n + j];
+          }
+          ASSERT_EQ(expected, c[i * n + j]) << i << ", " << j;
+        }
+      }
+    }
+  }
+}
+
+TEST(GemmTest, PackedAMatchesNaiveProduct) {
+  std::vector<GemmCase> cases{{1, 1, 1}, {7, 13, 5}, {130, 70, 300}};
+  IntraOpPool pool;
+  Frame frame;
+  frame.intra_op_pool = &pool;
+  KernelContext ctx(nullptr, nullptr, &frame);
+  for (GemmIsa isa : supportedIsas()) {
+    for (const GemmCase& shape : cases) {
+      // the default blocks, and ones of a single micro-kernel tile
+      for (GemmBlocking blocking : {GemmBlocking(), GemmBlocking{24, 32}}) {
+        SCOPED_TRACE(testing::Message()
+                     << "isa " << static_cast<int>(isa) << " m " << shape.m
+                     << " n " << shape.n << " k " << shape.k << " mc "
+                     << blocking.mc);
+        int64_t m = shape.m, n = shape.n, k = shape.k;
+        std::vector<float> a = pattern(m * k, 1);
+        std::vector<float> b = pattern(k * n, 2);
+        std::vector<float> c(m * n, 1.f);
+        PackedGemmA packed_a(a.data(), m, k, k, 1, isa);
+        PackedGemmB packed_b(b.data(), k, n, n, 1, isa);
+        Sgemm(packed_a, packed_b, c.data(), n, 1, true, ctx, blocking);
+        for (int64_t i = 0; i < m; i++) {
+          for (int64_t j = 0; j < n; j++) {
+            float expected = 1.f;
+            for (int64_t p = 0; p < k; p++) {
+              expected += a[i * k + p] * b[p * n + j];
+            }
+            ASSERT_EQ(expected, c[i * n + j]) << i << ", " << j;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(GemmTest, Int8MatchesNaiveProduct) {
+  std::vector<GemmCase> cases{{1, 1, 1}, {9, 35, 7}, {130, 40, 600}};
+  Frame frame;
+  KernelContext ctx(nullptr, nullptr, &frame);
+  for (GemmIsa isa : supportedIsas()) {
+    for (const GemmCase& shape : cases) {
+      for (int signs = 0; signs < 4; signs++) {
+        bool a_signed = signs & 1, b_signed = signs & 2;
+        SCOPED_TRACE(testing::Message()
+                     << "isa " << static_cast<int>(isa) << " m " << shape.m
+                     << " k " << shape.k << " signs " << signs);
+        int64_t m = shape.m, n = shape.n, k = shape.k;
+        std::vector<uint8_t> a(m * k), b(k * n);
+        for (size_t i = 0; i < a.size(); i++) a[i] = uint8_t(i * 37 + 11);
+        for (size_t i = 0; i < b.size(); i++) b[i] = uint8_t(i * 53 + 3);
+        auto value = [](uint8_t byte, bool is_signed) {
+          return is_signed ? int32_t(static_cast<int8_t>(byte))
+                           : int32_t(byte);
+        };
+        // per row and per column zero points
+        std::vector<int32_t> a_zero(m), b_zero(n);
+        for (int64_t i = 0; i < m; i++) a_zero[i] = int32_t(i % 5) - 2;
+        for (int64_t j = 0; j < n; j++) b_zero[j] = int32_t(j % 3) + 1;
+        PackedGemmBInt8 packed(b.data(), b_signed, k, n, n, 1, b_zero, isa);
+        std::vector<int32_t> c(m * n);
+        GemmInt8(m, a.data(), a_signed, k, 1, a_zero, packed, c.data(), n,
+                 ctx);
+        for (int64_t i = 0; i < m; i++) {
+          for (int64_t j = 0; j < n; j++) {
+            int32_t expected = 0;
+            for (int64_t p = 0; p < k; p++) {
+              expected += (value(a[i * k + p], a_signed) - a_zero[i]) *
+                          (value(b[p * n + j], b_signed) - b_zero[j]);
+            }
+            ASSERT_EQ(expected, c[i * n + j]) << i << ", " << j;
+          }
+        }
+      }
+    }
+  }
+}
+
+// runs the compiled 'g' on 'inputs' and returns its output
+ir::Tensor run(const Graph& g, const std::vector<ir::Tensor>& inputs) {
+  auto plan = ExecutionPlan::Compile(g);
+  Frame frame = plan->createFrame();
+  for (size_t i = 0; i < inputs.size(); i++) {
+    ncnn::Mat mat;
+    TensorToMat(inputs[i], 1, nullptr, &mat);
+    plan->setInput(frame, i, mat, inputs[i].sizes());
+  }
+  plan->run(frame);
+  const SlotValue& out = plan->output(frame, 0);
+  ir::Tensor result;
+  MatToTensor(out.mat, out.elem_type, out.sizes, &result);
+  return result;
+}
+
+float at(const ir::Tensor& t, std::vector<int64_t> index) {
+  int64_t offset = 0;
+  for (size_t d = 0; d < index.size(); d++) {
+    offset = offset * t.sizes()[d] + index[d];
+  }
+  return t.data<float>()[offset];
+}
+
+TEST(GemmTest, GemmKernel) {
+  // Y = 0.5 * A * B^T + 2 * C for a constant B of [3, 4] and C of [3]
+  Graph g;
+  Value* a = input(g, {5, 4}, ir::TensorProto_DataType_FLOAT);
+  ir::Tensor b = floats({3, 4}, 1);
+  ir::Tensor c = floats({3}, 2);
+  Node* gemm = append(g, ir::kGemm,
+                      {a, g.addInitializerAndCreateValue(b),
+                       g.addInitializerAndCreateValue(c)});
+  gemm->f_(ir::kalpha, 0.5);
+  gemm->f_(ir::kbeta, 2);
+  gemm->i_(ir::ktransB, 1);
+  g.registerOutput(gemm->output());
+  ir::Tensor x = floats({5, 4}, 3);
+  ir::Tensor y = run(g, {x});
+  ASSERT_EQ(std::vector<int64_t>({5, 3}), y.sizes());
+  for (int64_t i = 0; i < 5; i++) {
+    for (int64_t j = 0; j < 3; j++) {
+      float expected = 2 * c.data<float>()[j];
+      for (int64_t p = 0; p < 4; p++) {
+        expected += 0.5f * at(x, {i, p}) * at(b, {j, p});
+      }
+      EXPECT_EQ(expected, at(y, {i, j}));
+    }
+  }
+}
+
+TEST(GemmTest, MatMulKernelBroadcastsBatches) {
+  // [2, 1, 3, 5] x [4, 5, 6], both inputs
+  Graph g;
+  Value* a = input(g, {2, 1, 3, 5}, ir::TensorProto_DataType_FLOAT);
+  Value* b = input(g, {4, 5, 6}, ir::TensorProto_DataType_FLOAT);
+  g.registerOutput(append(g, ir::kMatMul, {a, b})->output());
+  ir::Tensor x = floats({2, 1, 3, 5}, 1);
+  ir::Tensor w = floats({4, 5, 6}, 2);
+  ir::Tensor y = run(g, {x, w});
+  ASSERT_EQ(std::vector<int64_t>({2, 4, 3, 6}), y.sizes());
+  for (int64_t n = 0; n < 2; n++) {
+    for (int64_t h = 0; h < 4; h++) {
+      for (int64_t i = 0; i < 3; i++) {
+        for (int64_t j = 0; j < 6; j++) {
+          float expected = 0;
+          for (int64_t p = 0; p < 5; p++) {
+            expected += at(x, {n, 0, i, p}) * at(w, {h, p, j});
+          }
+          EXPECT_EQ(expected, at(y, {n, h, i, j}));
+        }
+      }
+    }
+  }
+}
+
+TEST(GemmTest, MatMulKernelTakesConstantsAndVectors) {
+  // [2, 3, 5] (rows a channel each) x a constant [5, 4], then x [4]
+  Graph g;
+  Value* a = input(g, {2, 3, 5}, ir::TensorProto_DataType_FLOAT);
+  ir::Tensor w = floats({5, 4}, 1);
+  ir::Tensor v = floats({4}, 2);
+  Node* mm = append(g, ir::kMatMul, {a, g.addInitializerAndCreateValue(w)});
+  Node* mv = append(g, ir::kMatMul,
+                    {mm->output(), g.addInitializerAndCreateValue(v)});
+  g.registerOutput(mv->output());
+  ir::Tensor x = floats({2, 3, 5}, 3);
+  ir::Tensor y = run(g, {x});
+  ASSERT_EQ(std::vector<int64_t>({2, 3}), y.sizes());
+  for (int64_t n = 0; n < 2; n++) {
+    for (int64_t i = 0; i < 3; i++) {
+      float expected = 0;
+      for (int64_t j = 0; j < 4; j++) {
+        float product = 0;
+        for (int64_t p = 0; p < 5; p++) {
+          product += at(x, {n, i, p}) * at(w, {p, j});
+        }
+        expected += product * v.data<float>()[j];
+      }
+      EXPECT_EQ(expected, at(y, {n, i}));
+    }
+  }
+}
+
+TEST(GemmTest, MatMulIntegerKernel) {
+  // uint8 A of [2, 3] with zero point 3 times a constant int8 B of [3, 2]
+  // with zero point -1
+  Graph g;
+  Value* a = input(g, {2, 3}, ir::TensorProto_DataType_UINT8);
+  ir::Tensor b(ir::TensorProto_DataType_INT8, {3, 2});
+  std::vector<int8_t> b_values{1, -2, 3, -4, 5, -6};
+  b.setRawData(b_values.data(), b_values.size());
+  ir::Tensor a_zero(ir::TensorProto_DataType_UINT8, {});
+  uint8_t three = 3;
+  a_zero.setRawData(&three, 1);
+  ir::Tensor b_zero(ir::TensorProto_DataType_INT8, {});
+  int8_t minus_one = -1;
+  b_zero.setRawData(&minus_one, 1);
+  Node* mm = append(g, ir::kMatMulInteger,
+                    {a, g.addInitializerAndCreateValue(b),
+                     g.addInitializerAndCreateValue(a_zero),
+                     g.addInitializerAndCreateValue(b_zero)});
+  g.registerOutput(mm->output());
+  ir::Tensor x(ir::TensorProto_DataType_UINT8, {2, 3});
+  std::vector<uint8_t> x_values{0, 10, 200, 255, 3, 4};
+  x.setRawData(x_values.data(), x_values.size());
+  ir::Tensor y = run(g, {x});
+  ASSERT_EQ(ir::TensorProto_DataType_INT32, y.elem_type());
+  ASSERT_EQ(std::vector<int64_t>({2, 2}), y.sizes());
+  for (int64_t i = 0; i < 2; i++) {
+    for (int64_t j = 0; j < 2; j++) {
+      int32_t expected = 0;
+      for (int64_t p = 0; p < 3; p++) {
+        expected += (x_values[i * 3 + p] - 3) * (b_values[p * 2 + j] + 1);
+      }
+      EXPECT_EQ(expected, y.data<int32_t>()[i * 2 + j]);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace my_ai_training::runtime
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "onnx_ir/ir.h"
+
+// Helpers the tests build in-memory graphs and their tensors with.
+namespace my_ai_training::test {
+
+// a node of 'kind' reading 'inputs', appended to 'g'
+inline ir::Node* append(ir::Graph& g, ir::NodeKind kind,
+                        std::vector<ir::Value*> inputs,
+                        size_t num_outputs = 1) {
+  return g.appendNode(g.create(kind, inputs, num_outputs));
+}
+
+// a graph input of 'sizes', and of 'elem_type' unless UNDEFINED
+inline ir::Value* input(
+    ir::Graph& g, std::vector<int64_t> sizes,
+    int32_t elem_type = ir::TensorProto_DataType_UNDEFINED) {
+  ir::Value* v = g.addInput();
+  v->setSizes(std::vector<ir::Dimension>(sizes.begin(), sizes.end()));
+  if (elem_type != ir::TensorProto_DataType_UNDEFINED) {
+    v->setElemType(elem_type);
+  }
+  return v;
+}
+
+// a graph input named 'name', of unknown type and sizes
+inline ir::Value* namedInput(ir::Graph& g, const std::string& name) {
+  ir::Value* v = g.addInput();
+  v->setUniqueName(name);
+  return v;
+}
+
+// a float graph input of unknown sizes
+inline ir::Value* floatInput(ir::Graph& g) {
+  ir::Value* v = g.addInput();
+  v->setElemType(ir::TensorProto_DataType_FLOAT);
+  return v;
+}
+
+inline ir::Value* floatInput(ir::Graph& g, std::vector<int64_t> sizes) {
+  return input(g, std::move(sizes), ir::TensorProto_DataType_FLOAT);
+}
+
+// 'size' quarters in [-5/4, 5/4], varying with 'seed', so that sums of
+// their products are exact in float
+inline std::vector<float> pattern(int64_t size, int seed) {
+  std::vector<float> values(size);
+  for (int64_t i = 0; i < size; i++) {
+    values[i] = static_cast<float>((i * 7 + seed) % 11 - 5) / 4;
+  }
+  return values;
+}
+
+// a float tensor of 'sizes' holding pattern(), plus 'offset'
+inline ir::Tensor floats(std::vector<int64_t> sizes, int seed,
+                         float offset = 0.f) {
+  ir::Tensor t(ir::TensorProto_DataType_FLOAT, std::move(sizes));
+  std::vector<float> values = pattern(t.numel(), seed);
+  for (float& value : values) value += offset;
+  t.setRawData(values.data(), values.size() * sizeof(float));
+  return t;
+}
+
+}  // namespace my_ai_training::test
@@ -0,0 +1,367 @@
+#include "onnx_ir/importer.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "proto_writer.h"
+
+namespace my_ai_training::ir {
+namespace {
+
+using namespace my_ai_training::test;  // NOLINT
+
+std::unique_ptr<Graph> importString(const std::string& bytes) {
+  auto owner = std::make_shared<std::string>(bytes);
+  return ImportModelFromBuffer(owner->data(), owner->size(), owner);
+}
+
+std::vector<Node*> nodesOf(Graph& g) { return {g.begin(), g.end()}; }
+
+TEST(ImporterTest, SimpleGraph) {
+  std::vector<float> w = {1, 2, 3, 4, 5, 6};
+  GraphProtoBuilder b;
+  b.name = "main";
+  b.inputs.push_back(valueInfo("x", TensorProto_DataType_FLOAT, {-1, 3}));
+  b.initializers.push_back(tensorProto("w", TensorProto_DataType_FLOAT,
+                                       {3, 2}, w.data(),
+                                       w.size() * sizeof(float)));
+  b.initializers.push_back(floatTensorProto("b", {2}, {0.5f, -0.5f}));
+  b.nodes.push_back(nodeProto("MatMul", {"x", "w"}, {"y"}));
+  b.nodes.push_back(nodeProto("Add", {"y", "b"}, {"z"}));
+  b.outputs.push_back(valueInfo("z", TensorProto_DataType_FLOAT, {-1, 2}));
+  auto bytes = std::make_shared<std::string>(modelProto(b.build(), 13));
+
+  auto g = ImportModelFromBuffer(bytes->data(), bytes->size(), bytes);
+  EXPECT_EQ("main", g->name());
+  ASSERT_EQ(1u, g->opset_versions().size());
+  EXPECT_EQ(13, g->opset_versions()[0].version());
+
+  ASSERT_EQ(1u, g->inputs().size());
+  Value* x = g->inputs()[0];
+  EXPECT_EQ("x", x->uniqueName());
+  EXPECT_EQ(TensorProto_DataType_FLOAT, x->elemType());
+  ASSERT_EQ(2u, x->sizes().size());
+  EXPECT_TRUE(x->sizes()[0].is_param());
+  EXPECT_STREQ("N0", x->sizes()[0].param().toString());
+  EXPECT_EQ(3, x->sizes()[1].dim());
+
+  auto nodes = nodesOf(*g);
+  ASSERT_EQ(2u, nodes.size());
+  EXPECT_EQ(kMatMul, nodes[0]->kind());
+  EXPECT_EQ(kAdd, nodes[1]->kind());
+  EXPECT_EQ(x, nodes[0]->inputs()[0]);
+  EXPECT_EQ("w", nodes[0]->inputs()[1]->uniqueName());
+  EXPECT_EQ(nodes[0]->output(), nodes[1]->inputs()[0]);
+  EXPECT_EQ(nodes[1]->output(), g->outputs()[0]);
+  EXPECT_EQ("z", g->outputs()[0]->uniqueName());
+
+  // raw_data is borrowed from the model bytes, float_data is converted
+  auto weight = g->getInitializer("w");
+  ASSERT_NE(g->initializers().end(), weight);
+  EXPECT_TRUE(weight->isBorrowed());
+  const char* begin = bytes->data();
+  const char* raw = static_cast<const char*>(weight->rawData());
+  EXPECT_TRUE(raw >= begin && raw < begin + bytes->size());
+  EXPECT_EQ(6.f, weight->data<float>()[5]);
+  auto bias = g->getInitializer("b");
+  ASSERT_NE(g->initializers().end(), bias);
+  EXPECT_EQ(-0.5f, bias->data<float>()[1]);
+
+  // the borrowed payload outlives the caller's reference to the bytes
+  bytes.reset();
+  EXPECT_EQ(1.f, g->getInitializer("w")->data<float>()[0]);
+}
+
+TEST(ImporterTest, Attributes) {
+  GraphProtoBuilder b;
+  b.inputs.push_back(valueInfo("x", TensorProto_DataType_FLOAT, {2, 3}));
+  b.nodes.push_back(nodeProto("Transpose", {"x"}, {"t"},
+                              {intsAttr("perm", {1, 0})}));
+  b.nodes.push_back(nodeProto("Softmax", {"t"}, {"s"},
+                              {intAttr("axis", -1), floatAttr("alpha", 2.5f)}));
+  b.outputs.push_back(valueInfo("s", TensorProto_DataType_FLOAT, {3, 2}));
+  auto g = importString(modelProto(b.build()));
+
+  auto nodes = nodesOf(*g);
+  ASSERT_EQ(2u, nodes.size());
+  EXPECT_EQ(std::vector<int64_t>({1, 0}), nodes[0]->is(kperm));
+  EXPECT_EQ(AttributeKind::is, nodes[0]->kindOf(kperm));
+  EXPECT_EQ(-1, nodes[1]->i(kaxis));
+  EXPECT_DOUBLE_EQ(2.5, nodes[1]->f(kalpha));
+  EXPECT_FALSE(nodes[1]->hasAttribute(kperm));
+}
+
+TEST(ImporterTest, SubgraphCapturesOuterValues) {
+  GraphProtoBuilder then_branch;
+  then_branch.name = "then";
+  then_branch.nodes.push_back(nodeProto("Neg", {"y"}, {"then_out"}));
+  then_branch.outputs.push_back(
+      valueInfo("then_out", TensorProto_DataType_FLOAT, {2}));
+  GraphProtoBuilder else_branch;
+  else_branch.name = "else";
+  else_branch.nodes.push_back(nodeProto("Identity", {"y"}, {"else_out"}));
+  else_branch.outputs.push_back(
+      valueInfo("else_out", TensorProto_DataType_FLOAT, {2}));
+
+  GraphProtoBuilder b;
+  b.inputs.push_back(valueInfo("cond", TensorProto_DataType_BOOL, {}));
+  b.inputs.push_back(valueInfo("x", TensorProto_DataType_FLOAT, {2}));
+  b.nodes.push_back(nodeProto("Tanh", {"x"}, {"y"}));
+  b.nodes.push_back(nodeProto("If", {"cond"}, {"out"},
+                              {graphAttr("then_branch", then_branch.build()),
+                               graphAttr("else_branch", else_branch.build())}));
+  b.outputs.push_back(valueInfo("out", TensorProto_DataType_FLOAT, {2}));
+  auto g = importString(modelProto(b.build()));
+
+  auto nodes = nodesOf(*g);
+  ASSERT_EQ(2u, nodes.size());
+  Node* if_node = nodes[1];
+  ASSERT_EQ(kIf, if_node->kind());
+  const auto& then_graph = if_node->g(kthen_branch);
+  auto then_nodes = nodesOf(*then_graph);
+  ASSERT_EQ(2u, then_nodes.size());
+  EXPECT_EQ(kCaptured, then_nodes[0]->kind());
+  EXPECT_EQ("y", then_nodes[0]->output()->uniqueName());
+  EXPECT_EQ(then_nodes[0]->output(), then_nodes[1]->input());
+
+  // 'y' has no use in the main graph besides the two branches
+  Value* y = nodes[0]->output();
+  EXPECT_EQ(2u, y->uses().size());
+  EXPECT_TRUE(nodes[0]->hasUses());
+}
+
+TEST(ImporterTest, OptionalInputsAndOutOfOrderNodes) {
+  GraphProtoBuilder b;
+  b.inputs.push_back(valueInfo("x", TensorProto_DataType_FLOAT, {4}));
+  // consumer listed before its producer
+  b.nodes.push_back(nodeProto("Clip", {"n", "", "hi"}, {"c"}));
+  b.nodes.push_back(nodeProto("Neg", {"x"}, {"n"}));
+  b.initializers.push_back(floatTensorProto("hi", {}, {6.f}));
+  b.outputs.push_back(valueInfo("c", TensorProto_DataType_FLOAT, {4}));
+  auto g = importString(modelProto(b.build()));
+
+  // nodes are appended in topological order
+  auto nodes = nodesOf(*g);
+  ASSERT_EQ(3u, nodes.size());
+  EXPECT_EQ(kNeg, nodes[0]->kind());
+  EXPECT_EQ(kUndefined, nodes[1]->kind());
+  Node* clip = nodes[2];
+  ASSERT_EQ(3u, clip->inputs().size());
+  EXPECT_EQ(nodes[0]->output(), clip->inputs()[0]);
+  EXPECT_EQ(nodes[1]->output(), clip->inputs()[1]);
+  EXPECT_EQ("hi", clip->inputs()[2]->uniqueName());
+}
+
+TEST(ImporterTest, NestedSubgraphCaptures) {
+  // 'x' is only used two levels down
+  GraphProtoBuilder inner;
+  inner.nodes.push_back(nodeProto("Add", {"x", "y"}, {"inner_out"}));
+  inner.outputs.push_back(
+      valueInfo("inner_out", TensorProto_DataType_FLOAT, {2}));
+  GraphProtoBuilder outer;
+  outer.nodes.push_back(nodeProto("Identity", {"y"}, {"outer_y"}));
+  outer.nodes.push_back(nodeProto("If", {"cond"}, {"outer_out"},
+                                  {graphAttr("then_branch", inner.build()),
+                                   graphAttr("else_branch", inner.build())}));
+  outer.outputs.push_back(
+      valueInfo("outer_out", TensorProto_DataType_FLOAT, {2}));
+
+  GraphProtoBuilder b;
+  b.inputs.push_back(valueInfo("cond", TensorProto_DataType_BOOL, {}));
+  b.inputs.push_back(valueInfo("x", TensorProto_DataType_FLOAT, {2}));
+  // the If consuming 'y' through its subgraphs comes first
+  b.nodes.push_back(nodeProto("If", {"cond"}, {"out"},
+                              {graphAttr("then_branch", outer.build()),
+                               graphAttr("else_branch", outer.build())}));
+  b.nodes.push_back(nodeProto("Tanh", {"x"}, {"y"}));
+  b.outputs.push_back(valueInfo("out", TensorProto_DataType_FLOAT, {2}));
+  auto g = importString(modelProto(b.build()));
+
+  auto nodes = nodesOf(*g);
+  ASSERT_EQ(2u, nodes.size());
+  EXPECT_EQ(kTanh, nodes[0]->kind());
+  EXPECT_EQ(kIf, nodes[1]->kind());
+  // captures of 'cond' and 'y', then Identity and If
+  auto outer_nodes = nodesOf(*nodes[1]->g(kthen_branch));
+  ASSERT_EQ(4u, outer_nodes.size());
+  EXPECT_EQ(kCaptured, outer_nodes[0]->kind());
+  EXPECT_EQ("cond", outer_nodes[0]->output()->uniqueName());
+  EXPECT_EQ(TensorProto_DataType_BOOL, outer_nodes[0]->output()->elemType());
+  EXPECT_EQ(kCaptured, outer_nodes[1]->kind());
+  EXPECT_EQ("y", outer_nodes[1]->output()->uniqueName());
+  // captures of 'y' and 'x', then Add
+  auto inner_nodes = nodesOf(*outer_nodes[3]->g(kelse_branch));
+  ASSERT_EQ(3u, inner_nodes.size());
+  EXPECT_EQ(kCaptured, inner_nodes[1]->kind());
+  EXPECT_EQ("x", inner_nodes[1]->output()->uniqueName());
+  EXPECT_EQ(TensorProto_DataType_FLOAT, inner_nodes[1]->output()->elemType());
+  EXPECT_EQ(1u, inner_nodes[1]->output()->sizes().size());
+}
+
+TEST(ImporterTest, ParallelImportMatchesSerial) {
+  // a chain of nodes, each with an initializer and a subgraph
+  const int kChainLength = 300;
+  GraphProtoBuilder b;
+  b.inputs.push_back(valueInfo("cond", TensorProto_DataType_BOOL, {}));
+  b.inputs.push_back(valueInfo("v0", TensorProto_DataType_FLOAT, {4}));
+  for (int i = 0; i < kChainLength; i++) {
+    std::string in = "v" + std::to_string(i);
+    std::string out = "v" + std::to_string(i + 1);
+    std::string w = "w" + std::to_string(i);
+    b.initializers.push_back(floatTensorProto(w, {4}, {1.f, 2.f, 3.f, 4.f}));
+    if (i % 10 == 0) {
+      GraphProtoBuilder branch;
+      branch.nodes.push_back(nodeProto("Neg", {in}, {"r"}));
+      branch.outputs.push_back(valueInfo("r", TensorProto_DataType_FLOAT, {4}));
+      b.nodes.push_back(nodeProto("If", {"cond"}, {out},
+                                  {graphAttr("then_branch", branch.build()),
+                                   graphAttr("else_branch", branch.build())}));
+    } else {
+      b.nodes.push_back(nodeProto("Add", {in, w}, {out}));
+    }
+  }
+  b.outputs.push_back(valueInfo("v" + std::to_string(kChainLength),
+                                TensorProto_DataType_FLOAT, {4}));
+  auto owner = std::make_shared<std::string>(modelProto(b.build()));
+
+  auto serial = ImportModelFromBuffer(owner->data(), owner->size(), owner);
+  ThreadPool pool(4);
+  ImportOptions options;
+  options.pool = &pool;
+  options.protos_per_task = 7;
+  auto parallel = ImportModelFromBuffer(owner->data(), owner->size(), owner,
+                                        "", options);
+
+  auto serial_nodes = nodesOf(*serial);
+  auto parallel_nodes = nodesOf(*parallel);
+  ASSERT_EQ(serial_nodes.size(), parallel_nodes.size());
+  for (size_t i = 0; i < serial_nodes.size(); i++) {
+    Node* s = serial_nodes[i];
+    Node* p = parallel_nodes[i];
+    ASSERT_EQ(s->kind(), p->kind());
+    EXPECT_EQ(s->output()->uniqueName(), p->output()->uniqueName());
+    ASSERT_EQ(s->inputs().size(), p->inputs().size());
+    for (size_t j = 0; j < s->inputs().size(); j++) {
+      EXPECT_EQ(s->inputs()[j]->uniqueName(), p->inputs()[j]->uniqueName());
+    }
+    if (s->kind() == kIf) {
+      auto branch = nodesOf(*p->g(kthen_branch));
+      ASSERT_EQ(2u, branch.size());
+      EXPECT_EQ(kCaptured, branch[0]->kind());
+      EXPECT_EQ(p->inputs().size(), 1u);
+    }
+  }
+  EXPECT_EQ(serial->initializer_names(), parallel->initializer_names());
+  EXPECT_EQ(4.f, parallel->getInitializer("w299")->data<float>()[3]);
+
+  // errors raised in a task reach the caller
+  GraphProtoBuilder bad;
+  for (int i = 0; i < 50; i++) {
+    ProtoWriter attr;
+    attr.bytes(1, "sparse").bytes(22, "");  // unsupported
+    bad.nodes.push_back(nodeProto("Neg", {}, {"o" + std::to_string(i)},
+                                  {i == 42 ? attr : intAttr("axis", 0)}));
+  }
+  std::string bad_model = modelProto(bad.build());
+  EXPECT_THROW(ImportModelFromBuffer(bad_model.data(), bad_model.size(),
+                                     nullptr, "", options),
+               assert_error);
+}
+
+TEST(ImporterTest, ExternalData) {
+  std::string dir = ::testing::TempDir();
+  std::string weights_path = dir + "/importer_test_weights.bin";
+  std::string model_path = dir + "/importer_test_model.onnx";
+  std::vector<float> w = {1, 2, 3, 4};
+  FILE* fp = std::fopen(weights_path.c_str(), "wb");
+  ASSERT_NE(nullptr, fp);
+  std::fwrite("pad!", 1, 4, fp);
+  std::fwrite(w.data(), sizeof(float), w.size(), fp);
+  std::fclose(fp);
+
+  ProtoWriter location, offset;
+  location.bytes(1, "location").bytes(2, "importer_test_weights.bin");
+  offset.bytes(1, "offset").bytes(2, "4");
+  ProtoWriter tensor;
+  tensor.packedVarints(1, {4}).varint(2, TensorProto_DataType_FLOAT);
+  tensor.bytes(8, "w").message(13, location).message(13, offset);
+  tensor.varint(14, 1);
+
+  GraphProtoBuilder b;
+  b.inputs.push_back(valueInfo("x", TensorProto_DataType_FLOAT, {4}));
+  b.initializers.push_back(tensor);
+  b.nodes.push_back(nodeProto("Mul", {"x", "w"}, {"y"}));
+  b.outputs.push_back(valueInfo("y", TensorProto_DataType_FLOAT, {4}));
+  std::string model = modelProto(b.build());
+  fp = std::fopen(model_path.c_str(), "wb");
+  ASSERT_NE(nullptr, fp);
+  std::fwrite(model.data(), 1, model.size(), fp);
+  std::fclose(fp);
+
+  auto g = ImportModel(model_path);
+  auto it = g->getInitializer("w");
+  ASSERT_NE(g->initializers().end(), it);
+  EXPECT_FALSE(it->buffer()->isResolved());
+  EXPECT_EQ(3.f, it->data<float>()[2]);
+  EXPECT_TRUE(it->buffer()->isResolved());
+
+  std::remove(weights_path.c_str());
+  std::remove(model_path.c_str());
+}
+
+TEST(ImporterTest, MalformedExternalData) {
+  auto import = [](const std::string& key, const std::string& value) {
+    ProtoWriter location, entry;
+    location.bytes(1, "location").bytes(2, "weights.bin");
+    entry.bytes(1, key).bytes(2, value);
+    ProtoWriter tensor;
+    tensor.packedVarints(1, {4}).varint(2, TensorProto_DataType_FLOAT);
+    tensor.bytes(8, "w").message(13, location).message(13, entry);
+    tensor.varint(14, 1);
+    GraphProtoBuilder b;
+    b.initializers.push_back(tensor);
+    auto owner = std::make_shared<std::string>(modelProto(b.build()));
+    // the data is mapped lazily, so the file need not exist
+    return ImportModelFromBuffer(owner->data(), owner->size(), owner,
+                                 ::testing::TempDir());
+  };
+  EXPECT_NE(nullptr, import("offset", "16"));
+  EXPECT_NE(nullptr, import("length", "16"));
+  for (const char* value :
+       {"", "4x", " 4", "-4", "0x10", "99999999999999999999"}) {
+    EXPECT_THROW(import("offset", value), assert_error) << value;
+    EXPECT_THROW(import("length", value), assert_error) << value;
+  }
+}
+
+TEST(ImporterTest, MalformedTensorDims) {
+  auto import = [](const std::vector<int64_t>& dims) {
+    ProtoWriter tensor;
+    tensor.packedVarints(1, dims).varint(2, TensorProto_DataType_FLOAT);
+    tensor.bytes(8, "w");
+    GraphProtoBuilder b;
+    b.initializers.push_back(tensor);
+    return importString(modelProto(b.build()));
+  };
+  // each of these has 0 elements once the count wraps around
+  EXPECT_THROW(import({-2, 0}), assert_error);
+  EXPECT_THROW(import({int64_t{1} << 32, int64_t{1} << 32}), assert_error);
+  EXPECT_THROW(import({int64_t{1} << 62, 4}), assert_error);
+}
+
+TEST(ImporterTest, Malformed) {
+  GraphProtoBuilder b;
+  b.nodes.push_back(nodeProto("Neg", {"missing"}, {"y"}));
+  EXPECT_THROW(importString(modelProto(b.build())), assert_error);
+
+  std::string truncated = modelProto(GraphProtoBuilder().build());
+  truncated.resize(truncated.size() - 3);
+  EXPECT_THROW(importString(truncated), assert_error);
+}
+
+}  // namespace
+}  // namespace my_ai_training::ir
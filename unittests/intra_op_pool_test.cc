@@ -0,0 +1,147 @@
+#include "common/intra_op_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace my_ai_training {
+namespace {
+
+IntraOpPoolOptions threads(int n) {
+  IntraOpPoolOptions options;
+  options.num_threads = n;
+  return options;
+}
+
+TEST(IntraOpPoolTest, StaticBlocks) {
+  IntraOpPool pool(threads(4));
+  EXPECT_EQ(4, pool.numThreads());
+  std::vector<int> hits(1001, 0);
+  std::atomic<int> calls{0};
+  pool.parallelFor(hits.size(), [&](size_t begin, size_t end) {
+    calls++;
+    for (size_t i = begin; i < end; i++) hits[i]++;
+  });
+  for (int hit : hits) EXPECT_EQ(1, hit);
+  EXPECT_EQ(4, calls.load());
+
+  // whole grains: 10 grains of 100 over 4 threads
+  std::vector<size_t> sizes(4, 0);
+  std::atomic<int> next{0};
+  pool.parallelFor(
+      1000,
+      [&](size_t begin, size_t end) {
+        EXPECT_EQ(0u, begin % 100);
+        sizes[next++] = end - begin;
+      },
+      IntraOpPool::Schedule::kStatic, 100);
+  size_t total = 0;
+  for (size_t size : sizes) total += size;
+  EXPECT_EQ(1000u, total);
+
+  pool.parallelFor(0, [](size_t, size_t) { FAIL(); });
+}
+
+TEST(IntraOpPoolTest, DynamicChunks) {
+  IntraOpPool pool(threads(3));
+  std::vector<std::atomic<int>> hits(997);
+  std::atomic<int> calls{0};
+  pool.parallelFor(
+      hits.size(),
+      [&](size_t begin, size_t end) {
+        calls++;
+        EXPECT_LE(end - begin, 10u);
+        for (size_t i = begin; i < end; i++) hits[i]++;
+      },
+      IntraOpPool::Schedule::kDynamic, 10);
+  for (auto& hit : hits) EXPECT_EQ(1, hit.load());
+  EXPECT_EQ(100, calls.load());
+}
+
+TEST(IntraOpPoolTest, MaxThreads) {
+  IntraOpPool pool(threads(4));
+  std::vector<int> hits(1000, 0);
+  std::atomic<int> calls{0};
+  pool.parallelFor(
+      hits.size(),
+      [&](size_t begin, size_t end) {
+        calls++;
+        for (size_t i = begin; i < end; i++) hits[i]++;
+      },
+      IntraOpPool::Schedule::kStatic, 1, 2);
+  for (int hit : hits) EXPECT_EQ(1, hit);
+  EXPECT_EQ(2, calls.load());
+
+  // one thread runs the whole range on the caller
+  std::thread::id caller = std::this_thread::get_id();
+  pool.parallelFor(
+      hits.size(),
+      [&](size_t begin, size_t end) {
+        EXPECT_EQ(caller, std::this_thread::get_id());
+        EXPECT_EQ(0u, begin);
+        EXPECT_EQ(hits.size(), end);
+      },
+      IntraOpPool::Schedule::kDynamic, 10, 1);
+}
+
+TEST(IntraOpPoolTest, NestedAndConcurrentLoopsRunInline) {
+  IntraOpPool pool(threads(2));
+  std::atomic<int> count{0};
+  pool.parallelFor(8, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      // one call with the whole range, on this thread
+      std::thread::id self = std::this_thread::get_id();
+      pool.parallelFor(8, [&](size_t b, size_t e) {
+        EXPECT_EQ(self, std::this_thread::get_id());
+        count += static_cast<int>(e - b);
+      });
+    }
+  });
+  EXPECT_EQ(64, count.load());
+
+  // many threads sharing one pool
+  std::atomic<int> total{0};
+  std::vector<std::thread> callers;
+  for (int t = 0; t < 4; t++) {
+    callers.emplace_back([&]() {
+      for (int round = 0; round < 100; round++) {
+        pool.parallelFor(16, [&](size_t b, size_t e) {
+          total += static_cast<int>(e - b);
+        });
+      }
+    });
+  }
+  for (auto& caller : callers) caller.join();
+  EXPECT_EQ(6400, total.load());
+}
+
+TEST(IntraOpPoolTest, Rethrows) {
+  IntraOpPoolOptions options = threads(2);
+  options.cpus = {0};
+  options.spin_rounds = 0;
+  IntraOpPool pool(options);
+  std::atomic<int> count{0};
+  EXPECT_THROW(pool.parallelFor(
+                   16,
+                   [&count](size_t begin, size_t) {
+                     count++;
+                     if (begin == 0) throw std::runtime_error("0");
+                   },
+                   IntraOpPool::Schedule::kDynamic, 1),
+               std::runtime_error);
+  EXPECT_EQ(16, count.load());
+  // parked workers wake for the next loop
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  count = 0;
+  pool.parallelFor(4, [&count](size_t b, size_t e) {
+    count += static_cast<int>(e - b);
+  });
+  EXPECT_EQ(4, count.load());
+}
+
+}  // namespace
+}  // namespace my_ai_training
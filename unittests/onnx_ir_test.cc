@@ -31,5 +31,135 @@ TEST(IrTest, ResourceGuard) {
 
 TEST(IrTest, ONNX_ASSERT) { ONNX_ASSERT(1 < 2); }
 
+TEST(IrTest, GraphNodes) {
+  Graph g;
+  Value* x = g.addInput();
+  x->setUniqueName("x");
+  Node* relu = g.appendNode(g.create(kNeg, {x}));
+  Node* add = g.appendNode(g.create(kAdd, {x, relu->output()}));
+  g.registerOutput(add->output());
+
+  std::vector<Node*> order(g.begin(), g.end());
+  ASSERT_EQ(2u, order.size());
+  EXPECT_EQ(relu, order[0]);
+  EXPECT_EQ(add, order[1]);
+  EXPECT_TRUE(relu->isBefore(add));
+  EXPECT_EQ(2u, x->uses().size());
+  EXPECT_EQ(add->output(), g.outputs()[0]);
+
+  // fold %relu away: add(x, x)
+  add->replaceInput(1, x);
+  EXPECT_FALSE(relu->hasUses());
+  relu->destroy();
+  order.assign(g.begin(), g.end());
+  ASSERT_EQ(1u, order.size());
+  EXPECT_EQ(2u, x->uses().size());
+}
+
+TEST(IrTest, ReplaceGraphOutputKeepsName) {
+  Graph g;
+  Value* x = g.addInput();
+  Node* a = g.appendNode(g.create(kNeg, {x}));
+  a->output()->setUniqueName("y");
+  g.registerOutput(a->output());
+  Node* b = g.appendNode(g.create(kTanh, {x}));
+  a->output()->replaceAllUsesWith(b->output());
+  EXPECT_EQ(b->output(), g.outputs()[0]);
+  EXPECT_EQ("y", b->output()->uniqueName());
+  EXPECT_NE("y", a->output()->uniqueName());
+}
+
+TEST(IrTest, Initializers) {
+  Graph g;
+  Tensor w(TensorProto_DataType_FLOAT, {2, 2});
+  float values[] = {1.f, 2.f, 3.f, 4.f};
+  w.setRawData(values, sizeof(values));
+  w.setName("w");
+  Value* v = g.addInitializerAndCreateValue(w);
+  EXPECT_EQ("w", v->uniqueName());
+  ASSERT_EQ(2u, v->sizes().size());
+  EXPECT_EQ(2, v->sizes()[1].dim());
+  EXPECT_EQ(TensorProto_DataType_FLOAT, v->elemType());
+
+  auto it = g.getInitializer("w");
+  ASSERT_NE(g.initializers().end(), it);
+  // the graph shares the payload of the tensor it was given
+  EXPECT_EQ(w.rawData(), it->rawData());
+
+  v->setUniqueName("weight");
+  EXPECT_EQ("weight", g.initializer_names()[0]);
+  EXPECT_EQ("weight", g.initializers()[0].name());
+
+  g.eraseInitializer("weight");
+  EXPECT_TRUE(g.initializers().empty());
+  EXPECT_TRUE(g.initializerValues().empty());
+}
+
+TEST(IrTest, Dimension) {
+  Dimension unknown;
+  EXPECT_TRUE(unknown.is_unknown());
+  EXPECT_EQ(-1, unknown.dim());
+
+  Dimension extent(int64_t{-3});
+  EXPECT_TRUE(extent.is_int());
+  EXPECT_EQ(-3, extent.dim());
+  EXPECT_EQ(Dimension::kMaxDim, Dimension(Dimension::kMaxDim).dim());
+  EXPECT_EQ(Dimension::kMinDim, Dimension(Dimension::kMinDim).dim());
+  EXPECT_THROW(Dimension(Dimension::kMaxDim + 1), assert_error);
+
+  // symbolic dims with the same name compare equal without string compares
+  Dimension batch(std::string("batch"));
+  EXPECT_TRUE(batch.is_param());
+  EXPECT_STREQ("batch", batch.param().toString());
+  EXPECT_EQ(batch, Dimension(Symbol("batch")));
+  EXPECT_NE(batch, Dimension(std::string("seq")));
+  EXPECT_NE(batch, unknown);
+  EXPECT_TRUE(Dimension(kperm).is_param());
+}
+
+TEST(IrTest, ValueSizesInline) {
+  Graph g;
+  Value* v = g.addInput();
+  EXPECT_FALSE(v->has_sizes());
+  std::vector<Dimension> nchw = {Dimension(std::string("N")), 3, 224, 224};
+  v->setSizes(nchw);
+  ASSERT_TRUE(v->has_sizes());
+  EXPECT_TRUE(v->sizes().equals(nchw));
+
+  std::vector<Dimension> rank8(8, Dimension(int64_t{2}));
+  v->setSizes(rank8);
+  EXPECT_TRUE(v->sizes().equals(rank8));
+  // shrinking reuses the storage, setting from our own sizes is fine
+  v->setSizes(v->sizes().slice(1, 3));
+  EXPECT_EQ(3u, v->sizes().size());
+  v->wipeSizes();
+  EXPECT_FALSE(v->has_sizes());
+  EXPECT_TRUE(v->sizes().empty());
+}
+
+TEST(IrTest, SmallVector) {
+  SmallVector<int64_t, 2> small;
+  EXPECT_TRUE(small.isSmall());
+  small.push_back(1);
+  small.push_back(2);
+  EXPECT_TRUE(small.isSmall());
+  small.push_back(small[0]);
+  EXPECT_FALSE(small.isSmall());
+  EXPECT_EQ(std::vector<int64_t>({1, 2, 1}), ArrayRef<int64_t>(small).vec());
+
+  SmallVector<int64_t, 2> copy = small;
+  EXPECT_EQ(3u, copy.size());
+  EXPECT_NE(small.data(), copy.data());
+  const int64_t* heap = small.data();
+  SmallVector<int64_t, 2> moved = std::move(small);
+  EXPECT_EQ(heap, moved.data());
+  EXPECT_TRUE(small.empty());  // NOLINT(bugprone-use-after-move)
+
+  std::vector<int64_t> one = {7};
+  SmallVector<int64_t, 2> inline_moved = SmallVector<int64_t, 2>(one);
+  EXPECT_TRUE(inline_moved.isSmall());
+  EXPECT_EQ(7, inline_moved[0]);
+}
+
 }  // namespace
 }  // namespace my_ai_training::ir
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "optimizer/pass_manager.h"
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "graph_helpers.h"
+
+namespace my_ai_training::optimization {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+// Runs a callback as a pass.
+class LambdaPass : public Pass {
+ public:
+  using Fn = std::function<PassResult(Graph&, AnalysisManager&)>;
+  LambdaPass(std::string name, Fn fn)
+      : name_(std::move(name)), fn_(std::move(fn)) {}
+
+  std::string getPassName() const override { return name_; }
+  PassResult runPass(Graph& graph, AnalysisManager& analyses) override {
+    return fn_(graph, analyses);
+  }
+
+ private:
+  std::string name_;
+  Fn fn_;
+};
+
+// x -> a -> (b, c) -> d, y -> e, output d and e
+struct Diamond {
+  Graph g;
+  Value* x;
+  Value* y;
+  Node *a, *b, *c, *d, *e;
+
+  Diamond() {
+    x = g.addInput();
+    x->setUniqueName("x");
+    x->setElemType(ir::TensorProto_DataType_FLOAT);
+    x->setSizes({ir::Dimension(int64_t{4})});
+    y = g.addInput();
+    y->setUniqueName("y");
+    a = append(g, ir::kNeg, {x});
+    b = append(g, ir::kRelu, {a->output()});
+    c = append(g, ir::kTanh, {a->output()});
+    e = append(g, ir::kSigmoid, {y});
+    d = append(g, ir::kAdd, {b->output(), c->output()});
+    g.registerOutput(d->output());
+    g.registerOutput(e->output());
+  }
+};
+
+TEST(PassManagerTest, UseDef) {
+  Diamond m;
+  AnalysisManager analyses;
+  auto& use_def = analyses.get<UseDefAnalysis>(m.g);
+  EXPECT_EQ(5u, use_def.nodes().size());
+  EXPECT_EQ(0u, use_def.position(m.x->node()));
+  EXPECT_EQ(1u, use_def.position(m.a));
+  EXPECT_EQ(6u, use_def.position(m.g.return_node()));
+  EXPECT_EQ(0u, use_def.valueId(m.x));
+  EXPECT_EQ(m.a->output(), use_def.values()[use_def.valueId(m.a->output())]);
+  EXPECT_EQ(std::vector<Node*>({m.b, m.c}), use_def.users(m.a->output()));
+  EXPECT_EQ(std::vector<Node*>({m.g.return_node()}),
+            use_def.users(m.d->output()));
+  // cached
+  EXPECT_EQ(&use_def, &analyses.get<UseDefAnalysis>(m.g));
+  EXPECT_EQ(1u, analyses.numComputed());
+}
+
+TEST(PassManagerTest, UseDefThroughSubgraphs) {
+  Graph g;
+  Value* cond = g.addInput();
+  cond->setUniqueName("cond");
+  Node* relu = append(g, ir::kRelu, {cond});
+  relu->output()->setUniqueName("r");
+  auto branch = std::make_shared<Graph>();
+  Node* captured = branch->appendNode(branch->create(ir::kCaptured, 1));
+  captured->output()->setUniqueName("r");
+  branch->registerOutput(
+      append(*branch, ir::kNeg, {captured->output()})->output());
+  Node* if_node = append(g, ir::kIf, {cond});
+  if_node->g_(ir::kthen_branch, branch);
+  if_node->g_(ir::kelse_branch, branch);
+
+  AnalysisManager analyses;
+  auto& use_def = analyses.get<UseDefAnalysis>(g);
+  EXPECT_EQ(std::vector<Node*>({if_node}), use_def.users(relu->output()));
+  EXPECT_EQ(std::vector<Node*>({relu, if_node}), use_def.users(cond));
+}
+
+TEST(PassManagerTest, Liveness) {
+  Diamond m;
+  AnalysisManager analyses;
+  auto& liveness = analyses.get<LivenessAnalysis>(m.g);
+  auto& use_def = analyses.get<UseDefAnalysis>(m.g);
+  EXPECT_EQ(2u, analyses.numComputed());
+  EXPECT_EQ(use_def.position(m.c), liveness.lastUse(m.a->output()));
+  EXPECT_EQ(use_def.endPosition(), liveness.lastUse(m.e->output()));
+  EXPECT_EQ(std::vector<Value*>({m.a->output()}), liveness.dyingAt(m.c));
+  EXPECT_EQ(std::vector<Value*>({m.b->output(), m.c->output()}),
+            liveness.dyingAt(m.d));
+  EXPECT_TRUE(liveness.liveAt(m.y, use_def.position(m.e)));
+  EXPECT_FALSE(liveness.liveAt(m.y, use_def.position(m.d)));
+  // while d runs: b, c, e
+  EXPECT_EQ(3u, liveness.maxLive());
+}
+
+TEST(PassManagerTest, Dominance) {
+  Diamond m;
+  AnalysisManager analyses;
+  auto& dominance = analyses.get<DominanceAnalysis>(m.g);
+  EXPECT_EQ(nullptr, dominance.idom(m.a));
+  EXPECT_EQ(m.a, dominance.idom(m.b));
+  EXPECT_EQ(m.a, dominance.idom(m.d));
+  EXPECT_TRUE(dominance.dominates(m.a, m.d));
+  EXPECT_FALSE(dominance.dominates(m.b, m.d));
+  EXPECT_FALSE(dominance.dominates(m.a, m.e));
+  EXPECT_TRUE(dominance.dominates(m.d, m.d));
+  // d and e meet only at the return node
+  EXPECT_EQ(nullptr, dominance.idom(m.g.return_node()));
+}
+
+TEST(PassManagerTest, AnalysesSurviveUnrelatedPasses) {
+  Diamond m;
+  size_t shape_runs = 0, use_def_runs = 0;
+  auto reader = [&](Graph& g, AnalysisManager& analyses) {
+    shape_runs += analyses.getCached<ShapeAnalysis>(g) == nullptr;
+    use_def_runs += analyses.getCached<UseDefAnalysis>(g) == nullptr;
+    analyses.get<ShapeAnalysis>(g);
+    analyses.get<UseDefAnalysis>(g);
+    return PassResult::unchanged();
+  };
+  // rewrites an attribute: shapes may change, the structure does not
+  auto set_attribute = [&](Graph&, AnalysisManager&) {
+    m.d->i_(ir::kaxis, 0);
+    return PassResult::changed(1, GraphState::kAttributes);
+  };
+  PassManager manager;
+  manager.add(std::make_shared<LambdaPass>("read", reader));
+  manager.add(std::make_shared<LambdaPass>("read_again", reader));
+  manager.add(std::make_shared<LambdaPass>("set_attribute", set_attribute));
+  manager.add(std::make_shared<LambdaPass>("read_after", reader));
+
+  AnalysisManager analyses;
+  EXPECT_EQ(1u, manager.run(m.g, analyses));
+  EXPECT_EQ(2u, shape_runs);
+  EXPECT_EQ(1u, use_def_runs);
+  EXPECT_EQ(3u, analyses.numComputed());
+  EXPECT_EQ(ir::Dimension(int64_t{4}), m.d->output()->sizes()[0]);
+
+  ASSERT_EQ(4u, manager.statistics().size());
+  EXPECT_EQ("set_attribute", manager.statistics()[2].name);
+  EXPECT_EQ(1u, manager.statistics()[2].num_changes);
+  EXPECT_EQ(1u, manager.statistics()[3].runs);
+
+  analyses.invalidate(GraphState::kStructure);
+  EXPECT_EQ(nullptr, analyses.getCached<UseDefAnalysis>(m.g));
+  EXPECT_EQ(nullptr, analyses.getCached<ShapeAnalysis>(m.g));
+}
+
+TEST(PassManagerTest, FixedPoint) {
+  Diamond m;
+  int budget = 3;
+  auto shrink = [&](Graph&, AnalysisManager&) {
+    if (budget == 0) return PassResult::unchanged();
+    budget--;
+    return PassResult::changed(1, GraphState::kStructure);
+  };
+  PassManager manager;
+  manager.add(std::make_shared<LambdaPass>("shrink", shrink));
+  EXPECT_EQ(1u, manager.run(m.g));
+  EXPECT_EQ(1u, manager.rounds());
+  manager.setMaxRounds(10);
+  EXPECT_EQ(2u, manager.run(m.g));
+  EXPECT_EQ(3u, manager.rounds());
+}
+
+TEST(PassManagerTest, Registry) {
+  auto pass = std::make_shared<LambdaPass>(
+      "pass_manager_test_nop",
+      [](Graph&, AnalysisManager&) { return PassResult::unchanged(); });
+  PassRegistry::global().registerPass(pass);
+  EXPECT_EQ(pass, PassRegistry::global().find("pass_manager_test_nop"));
+  EXPECT_EQ(nullptr, PassRegistry::global().find("no_such_pass"));
+
+  PassManager manager = CreatePipeline({"pass_manager_test_nop"});
+  ASSERT_EQ(1u, manager.passes().size());
+  EXPECT_EQ(pass, manager.passes()[0]);
+  EXPECT_THROW(CreatePipeline({"no_such_pass"}), ir::assert_error);
+}
+
+}  // namespace
+}  // namespace my_ai_training::optimization
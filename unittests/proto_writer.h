@@ -0,0 +1,169 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Minimal protobuf encoder used by the tests to build ONNX models without
+// depending on protobuf/onnx. Field numbers follow onnx.proto.
+namespace my_ai_training::test {
+
+class ProtoWriter {
+ public:
+  ProtoWriter& varint(uint32_t field, uint64_t value) {
+    key(field, 0);
+    raw_varint(value);
+    return *this;
+  }
+  ProtoWriter& fixed32(uint32_t field, float value) {
+    key(field, 5);
+    append(&value, sizeof(value));
+    return *this;
+  }
+  ProtoWriter& bytes(uint32_t field, const std::string& value) {
+    key(field, 2);
+    raw_varint(value.size());
+    buffer_ += value;
+    return *this;
+  }
+  ProtoWriter& message(uint32_t field, const ProtoWriter& value) {
+    return bytes(field, value.str());
+  }
+  ProtoWriter& packedVarints(uint32_t field,
+                             const std::vector<int64_t>& values) {
+    ProtoWriter packed;
+    for (int64_t v : values) packed.raw_varint(static_cast<uint64_t>(v));
+    return bytes(field, packed.str());
+  }
+  ProtoWriter& packedFloats(uint32_t field, const std::vector<float>& values) {
+    return bytes(field,
+                 std::string(reinterpret_cast<const char*>(values.data()),
+                             values.size() * sizeof(float)));
+  }
+
+  const std::string& str() const { return buffer_; }
+
+ private:
+  void key(uint32_t field, uint32_t wire_type) {
+    raw_varint((static_cast<uint64_t>(field) << 3) | wire_type);
+  }
+  void raw_varint(uint64_t value) {
+    while (value >= 0x80) {
+      buffer_.push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+    buffer_.push_back(static_cast<char>(value));
+  }
+  void append(const void* data, size_t size) {
+    buffer_.append(static_cast<const char*>(data), size);
+  }
+
+  std::string buffer_;
+};
+
+// TensorProto with raw_data
+inline ProtoWriter tensorProto(const std::string& name, int32_t data_type,
+                               const std::vector<int64_t>& dims,
+                               const void* data, size_t size) {
+  ProtoWriter t;
+  t.packedVarints(1, dims).varint(2, data_type).bytes(8, name);
+  t.bytes(9, std::string(static_cast<const char*>(data), size));
+  return t;
+}
+
+// TensorProto with float_data
+inline ProtoWriter floatTensorProto(const std::string& name,
+                                    const std::vector<int64_t>& dims,
+                                    const std::vector<float>& values) {
+  ProtoWriter t;
+  t.packedVarints(1, dims).varint(2, 1).packedFloats(4, values).bytes(8, name);
+  return t;
+}
+
+// ValueInfoProto of a tensor; negative dims become dim_param "N<i>"
+inline ProtoWriter valueInfo(const std::string& name, int32_t elem_type,
+                             const std::vector<int64_t>& dims) {
+  ProtoWriter shape;
+  for (size_t i = 0; i < dims.size(); i++) {
+    ProtoWriter dim;
+    if (dims[i] >= 0) {
+      dim.varint(1, static_cast<uint64_t>(dims[i]));
+    } else {
+      dim.bytes(2, "N" + std::to_string(i));
+    }
+    shape.message(1, dim);
+  }
+  ProtoWriter tensor_type;
+  tensor_type.varint(1, static_cast<uint64_t>(elem_type)).message(2, shape);
+  ProtoWriter type;
+  type.message(1, tensor_type);
+  ProtoWriter info;
+  info.bytes(1, name).message(2, type);
+  return info;
+}
+
+inline ProtoWriter intAttr(const std::string& name, int64_t value) {
+  ProtoWriter a;
+  a.bytes(1, name).varint(3, static_cast<uint64_t>(value)).varint(20, 2);
+  return a;
+}
+
+inline ProtoWriter floatAttr(const std::string& name, float value) {
+  ProtoWriter a;
+  a.bytes(1, name).fixed32(2, value).varint(20, 1);
+  return a;
+}
+
+inline ProtoWriter intsAttr(const std::string& name,
+                            const std::vector<int64_t>& values) {
+  ProtoWriter a;
+  a.bytes(1, name).packedVarints(8, values).varint(20, 7);
+  return a;
+}
+
+inline ProtoWriter graphAttr(const std::string& name,
+                             const ProtoWriter& graph) {
+  ProtoWriter a;
+  a.bytes(1, name).message(6, graph).varint(20, 5);
+  return a;
+}
+
+inline ProtoWriter nodeProto(const std::string& op_type,
+                             const std::vector<std::string>& inputs,
+                             const std::vector<std::string>& outputs,
+                             const std::vector<ProtoWriter>& attributes = {}) {
+  ProtoWriter n;
+  for (auto& input : inputs) n.bytes(1, input);
+  for (auto& output : outputs) n.bytes(2, output);
+  n.bytes(4, op_type);
+  for (auto& attribute : attributes) n.message(5, attribute);
+  return n;
+}
+
+struct GraphProtoBuilder {
+  std::string name = "graph";
+  std::vector<ProtoWriter> nodes, initializers, inputs, outputs;
+
+  ProtoWriter build() const {
+    ProtoWriter g;
+    for (auto& n : nodes) g.message(1, n);
+    g.bytes(2, name);
+    for (auto& t : initializers) g.message(5, t);
+    for (auto& i : inputs) g.message(11, i);
+    for (auto& o : outputs) g.message(12, o);
+    return g;
+  }
+};
+
+inline std::string modelProto(const ProtoWriter& graph,
+                              int64_t opset_version = 17) {
+  ProtoWriter opset;
+  opset.bytes(1, "").varint(2, static_cast<uint64_t>(opset_version));
+  ProtoWriter m;
+  m.varint(1, 8).message(7, graph).message(8, opset);
+  return m.str();
+}
+
+}  // namespace my_ai_training::test
@@ -0,0 +1,198 @@
+#include "runtime/session.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "runtime/tensor_mat.h"
+
+namespace my_ai_training::runtime {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+
+// y = (x + x) * x on x of [4]
+std::shared_ptr<const ExecutionPlan> plan() {
+  Graph g;
+  Value* x = g.addInput();
+  x->setElemType(ir::TensorProto_DataType_FLOAT);
+  std::vector<ir::Dimension> sizes{ir::Dimension(4)};
+  x->setSizes(sizes);
+  std::vector<Value*> add_inputs{x, x};
+  Node* add = g.appendNode(g.create(ir::kAdd, add_inputs, 1));
+  std::vector<Value*> mul_inputs{add->output(), x};
+  Node* mul = g.appendNode(g.create(ir::kMul, mul_inputs, 1));
+  g.registerOutput(mul->output());
+  return ExecutionPlan::Compile(g);
+}
+
+std::vector<SlotValue> inputs(float value) {
+  SlotValue x;
+  x.mat.create(4);
+  x.mat.fill(value);
+  x.sizes = {4};
+  return {x};
+}
+
+TEST(SessionTest, Blocking) {
+  Session serial(plan());
+  std::vector<SlotValue> outputs = serial.run(inputs(3)).get();
+  ASSERT_EQ(1u, outputs.size());
+  EXPECT_EQ(std::vector<int64_t>({4}), outputs[0].sizes);
+  EXPECT_EQ(18, outputs[0].mat[3]);
+
+  WorkStealingPool pool(2);
+  SessionOptions options;
+  options.inter_op_pool = &pool;
+  Session parallel(plan(), options);
+  EXPECT_EQ(8, parallel.run(inputs(2)).get()[0].mat[0]);
+  // the graph has one input
+  EXPECT_THROW(parallel.run({}).get(), ir::assert_error);
+}
+
+TEST(SessionTest, ManyRunsInFlight) {
+  WorkStealingPool pool(3);
+  SessionOptions options;
+  options.inter_op_pool = &pool;
+  Session session(plan(), options);
+  constexpr int kRuns = 500;
+  std::vector<float> results(kRuns, 0);
+  std::mutex mutex;
+  std::condition_variable cv;
+  int remaining = kRuns;
+  for (int r = 0; r < kRuns; r++) {
+    session.run(inputs(r), [&, r](std::exception_ptr error,
+                                  std::vector<SlotValue> outputs) {
+      EXPECT_FALSE(error);
+      results[r] = outputs[0].mat[0];
+      std::lock_guard<std::mutex> guard(mutex);
+      if (--remaining == 0) cv.notify_all();
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&remaining]() { return remaining == 0; });
+  }
+  for (int r = 0; r < kRuns; r++) EXPECT_EQ(2.0f * r * r, results[r]);
+
+  // invalid inputs are reported on the calling thread
+  bool called = false;
+  session.run({}, [&called](std::exception_ptr error,
+                            std::vector<SlotValue> outputs) {
+    EXPECT_TRUE(error);
+    EXPECT_TRUE(outputs.empty());
+    called = true;
+  });
+  EXPECT_TRUE(called);
+}
+
+// y = x * w + x on x of [4] with w = {1, 2, 3, 4}
+std::shared_ptr<const Model> model() {
+  auto g = std::make_unique<Graph>();
+  Value* x = g->addInput();
+  x->setElemType(ir::TensorProto_DataType_FLOAT);
+  std::vector<ir::Dimension> sizes{ir::Dimension(4)};
+  x->setSizes(sizes);
+  ir::Tensor t(ir::TensorProto_DataType_FLOAT, {4});
+  std::vector<float> values{1, 2, 3, 4};
+  t.setRawData(values.data(), values.size() * sizeof(float));
+  Value* w = g->addInitializerAndCreateValue(t);
+  std::vector<Value*> mul_inputs{x, w};
+  Node* mul = g->appendNode(g->create(ir::kMul, mul_inputs, 1));
+  std::vector<Value*> add_inputs{mul->output(), x};
+  Node* add = g->appendNode(g->create(ir::kAdd, add_inputs, 1));
+  g->registerOutput(add->output());
+  return Model::Create(std::move(g));
+}
+
+TEST(SessionTest, SessionsShareTheModel) {
+  std::shared_ptr<const Model> shared = model();
+  // frames point at the same weights
+  Frame a = shared->plan()->createFrame();
+  Frame b = shared->plan()->createFrame();
+  int constants = 0;
+  for (size_t s = 0; s < a.slots.size(); s++) {
+    if (a.slots[s].mat.empty()) continue;
+    EXPECT_EQ(a.slots[s].mat.data, b.slots[s].mat.data);
+    constants++;
+  }
+  EXPECT_EQ(1, constants);
+
+  constexpr int kThreads = 4;
+  constexpr int kRuns = 50;
+  std::vector<std::vector<float>> results(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&shared, &results, t]() {
+      Session session(shared);
+      for (int r = 0; r < kRuns; r++) {
+        results[t].push_back(session.run(inputs(t + r)).get()[0].mat[3]);
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  for (int t = 0; t < kThreads; t++) {
+    for (int r = 0; r < kRuns; r++) EXPECT_EQ(5.0f * (t + r), results[t][r]);
+  }
+}
+
+TEST(SessionTest, ArenaReusesBuffers) {
+  Session session(model());
+  ASSERT_NE(nullptr, session.allocator());
+  const void* first = session.run(inputs(1)).get()[0].mat.data;
+  // the output of the first run was released to the arena
+  EXPECT_EQ(first, session.run(inputs(2)).get()[0].mat.data);
+
+  ncnn::PoolAllocator allocator;
+  SessionOptions options;
+  options.allocator = &allocator;
+  EXPECT_EQ(&allocator, Session(model(), options).allocator());
+}
+
+#if MY_AI_TRAINING_HAS_COROUTINES
+// a coroutine nobody waits for
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+Detached square(const Session& session, float x, std::atomic<int>* done,
+                float* result) {
+  std::vector<SlotValue> outputs = co_await session.run(inputs(x));
+  *result = outputs[0].mat[0];
+  try {
+    co_await session.run({});
+  } catch (const ir::assert_error&) {
+    (*done)++;
+  }
+}
+
+TEST(SessionTest, Awaits) {
+  WorkStealingPool pool(2);
+  SessionOptions options;
+  options.inter_op_pool = &pool;
+  Session parallel(plan(), options);
+  Session serial(plan());
+  std::atomic<int> done{0};
+  std::vector<float> results(100, 0);
+  for (int r = 0; r < 100; r++) {
+    square(r % 2 ? parallel : serial, r, &done, &results[r]);
+  }
+  while (done.load() < 100) std::this_thread::yield();
+  for (int r = 0; r < 100; r++) EXPECT_EQ(2.0f * r * r, results[r]);
+}
+#endif
+
+}  // namespace
+}  // namespace my_ai_training::runtime
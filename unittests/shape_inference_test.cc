@@ -0,0 +1,321 @@
+#include "onnx_ir/shape_inference.h"
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "graph_helpers.h"
+
+namespace my_ai_training::ir {
+namespace {
+
+using Shape = std::vector<Dimension>;
+using namespace my_ai_training::test;  // NOLINT
+
+Dimension sym(const std::string& name) { return Dimension(name); }
+
+Value* addInput(Graph& g, const std::string& name, Shape shape,
+                int32_t elem_type = TensorProto_DataType_FLOAT) {
+  Value* v = g.addInput();
+  v->setUniqueName(name);
+  v->setElemType(elem_type);
+  v->setSizes(shape);
+  return v;
+}
+
+Value* addInts(Graph& g, const std::string& name,
+               const std::vector<int64_t>& values) {
+  Tensor t(TensorProto_DataType_INT64,
+           {static_cast<int64_t>(values.size())});
+  t.setRawData(values.data(), values.size() * sizeof(int64_t));
+  t.setName(name);
+  return g.addInitializerAndCreateValue(t);
+}
+
+Value* addFloats(Graph& g, const std::string& name,
+                 const std::vector<float>& values) {
+  Tensor t(TensorProto_DataType_FLOAT, {static_cast<int64_t>(values.size())});
+  t.setRawData(values.data(), values.size() * sizeof(float));
+  t.setName(name);
+  return g.addInitializerAndCreateValue(t);
+}
+
+void expectShape(const Shape& expected, const Value* v) {
+  ASSERT_TRUE(v->has_sizes());
+  ASSERT_EQ(expected.size(), v->sizes().size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(expected[i], v->sizes()[i]) << "dim " << i;
+  }
+}
+
+TEST(ShapeInferenceTest, ConvNet) {
+  Graph g;
+  Value* x = addInput(g, "x", {sym("N"), 3, 224, 224});
+  Value* w = addInput(g, "w", {64, 3, 7, 7});
+  Node* conv = append(g, kConv, {x, w});
+  conv->is_(kstrides, {2, 2})->is_(kpads, {3, 3, 3, 3});
+  Node* relu = append(g, kRelu, {conv->output()});
+  Node* pool = append(g, kMaxPool, {relu->output()});
+  pool->is_(kkernel_shape, {3, 3})->is_(kstrides, {2, 2});
+  pool->i_(kceil_mode, 1);
+  Node* gap = append(g, kGlobalAveragePool, {pool->output()});
+  Node* flatten = append(g, kFlatten, {gap->output()});
+  Value* fc = addInput(g, "fc", {1000, 64});
+  Node* gemm = append(g, kGemm, {flatten->output(), fc});
+  gemm->i_(ktransB, 1);
+  Node* same = append(g, kConv, {x, addInput(g, "w2", {8, 3, 3, 3})});
+  same->s_(kauto_pad, "SAME_UPPER")->is_(kstrides, {2, 2});
+  Node* deconv = append(g, kConvTranspose,
+                        {conv->output(), addInput(g, "wt", {64, 16, 4, 4})});
+  deconv->is_(kstrides, {2, 2})->is_(kpads, {1, 1, 1, 1});
+  InferShapes(g);
+
+  expectShape({sym("N"), 64, 112, 112}, conv->output());
+  EXPECT_EQ(TensorProto_DataType_FLOAT, relu->output()->elemType());
+  expectShape({sym("N"), 64, 56, 56}, pool->output());
+  expectShape({sym("N"), 64, 1, 1}, gap->output());
+  expectShape({sym("N"), 64}, flatten->output());
+  expectShape({sym("N"), 1000}, gemm->output());
+  expectShape({sym("N"), 8, 112, 112}, same->output());
+  expectShape({sym("N"), 16, 224, 224}, deconv->output());
+}
+
+TEST(ShapeInferenceTest, ShapeOps) {
+  // what exporters use for "to the end"
+  const int64_t kEnd = std::numeric_limits<int64_t>::max();
+  Graph g;
+  Value* x = addInput(g, "x", {sym("N"), 8, 4, 4});
+  Node* reshape = append(g, kReshape, {x, addInts(g, "shape", {0, -1})});
+  Node* transpose = append(g, kTranspose, {x});
+  transpose->is_(kperm, {0, 2, 3, 1});
+  Node* concat = append(g, kConcat, {x, addInput(g, "y", {sym("N"), 2, 4, 4})});
+  concat->i_(kaxis, 1);
+  Node* slice = append(g, kSlice,
+                       {x, addInts(g, "starts", {1, 0}),
+                        addInts(g, "ends", {-1, kEnd}),
+                        addInts(g, "axes", {1, 0})});
+  Node* resize = append(g, kResize, {x, addFloats(g, "roi", {}),
+                                     addFloats(g, "scales", {1, 1, 2, 2})});
+  Node* unsqueeze = append(g, kUnsqueeze, {x, addInts(g, "uaxes", {0, -1})});
+  Node* squeeze =
+      append(g, kSqueeze, {unsqueeze->output(), addInts(g, "saxes", {0})});
+  Node* matmul = append(g, kMatMul, {x, addInput(g, "m", {4, 5})});
+  Node* reduce = append(g, kReduceMean, {x});
+  reduce->is_(kaxes, {2, 3})->i_(kkeepdims, 0);
+  Node* shape = append(g, kShape, {x});
+  Node* split = append(g, kSplit, {x}, 2);
+  split->i_(kaxis, 1);
+  InferShapes(g);
+
+  expectShape({sym("N"), 128}, reshape->output());
+  expectShape({sym("N"), 4, 4, 8}, transpose->output());
+  expectShape({sym("N"), 10, 4, 4}, concat->output());
+  expectShape({sym("N"), 6, 4, 4}, slice->output());
+  expectShape({sym("N"), 8, 8, 8}, resize->output());
+  expectShape({1, sym("N"), 8, 4, 4, 1}, unsqueeze->output());
+  expectShape({sym("N"), 8, 4, 4, 1}, squeeze->output());
+  expectShape({sym("N"), 8, 4, 5}, matmul->output());
+  expectShape({sym("N"), 8}, reduce->output());
+  expectShape({4}, shape->output());
+  EXPECT_EQ(TensorProto_DataType_INT64, shape->output()->elemType());
+  expectShape({sym("N"), 4, 4, 4}, split->outputs()[1]);
+}
+
+TEST(ShapeInferenceTest, ReshapeZeros) {
+  Graph g;
+  Value* x = addInput(g, "x", {sym("N"), 8});
+  Value* unknown = g.addInput();
+  unknown->setUniqueName("unknown");
+  Value* shape = addInts(g, "shape", {0, -1, 0});
+  // 0 copies the input dim, unknown past its rank or without a shape
+  Node* past_rank = append(g, kReshape, {x, shape});
+  Node* no_shape = append(g, kReshape, {unknown, shape});
+  Node* allow_zero = append(g, kReshape, {x, addInts(g, "zeros", {0, 8})});
+  allow_zero->i_(kallowzero, 1);
+  InferShapes(g);
+
+  expectShape({sym("N"), Dimension(), Dimension()}, past_rank->output());
+  expectShape({Dimension(), Dimension(), Dimension()}, no_shape->output());
+  expectShape({0, 8}, allow_zero->output());
+}
+
+TEST(ShapeInferenceTest, UnevenSplit) {
+  Graph g;
+  Value* x = addInput(g, "x", {sym("N"), 7});
+  Node* three = append(g, kSplit, {x}, 3);
+  three->i_(kaxis, 1);
+  // parts of 2 before the last exceed 5, so 5 does not split into 4
+  Value* y = addInput(g, "y", {5, sym("N")});
+  Node* four = append(g, kSplit, {y}, 4);
+  InferShapes(g);
+
+  expectShape({sym("N"), 3}, three->outputs()[0]);
+  expectShape({sym("N"), 3}, three->outputs()[1]);
+  expectShape({sym("N"), 1}, three->outputs()[2]);
+  for (Value* part : four->outputs()) {
+    expectShape({Dimension(), sym("N")}, part);
+  }
+}
+
+TEST(ShapeInferenceTest, BackwardSliceOfEmptyDim) {
+  Graph g;
+  Value* x = addInput(g, "x", {2, 0});
+  Node* slice = append(g, kSlice,
+                       {x, addInts(g, "starts", {-1}),
+                        addInts(g, "ends", {-100}), addInts(g, "axes", {1}),
+                        addInts(g, "steps", {-1})});
+  InferShapes(g);
+  expectShape({2, 0}, slice->output());
+}
+
+TEST(ShapeInferenceTest, ExtremeSliceSteps) {
+  const int64_t kMax = std::numeric_limits<int64_t>::max();
+  const int64_t kMin = std::numeric_limits<int64_t>::min();
+  Graph g;
+  Value* x = addInput(g, "x", {5, 7});
+  Node* forward = append(g, kSlice,
+                         {x, addInts(g, "starts", {1, 0}),
+                          addInts(g, "ends", {kMax, kMax}),
+                          addInts(g, "axes", {0, 1}),
+                          addInts(g, "steps", {kMax, 3})});
+  Node* backward = append(g, kSlice,
+                          {x, addInts(g, "rstarts", {-1, kMax}),
+                           addInts(g, "rends", {kMin, kMin}),
+                           addInts(g, "raxes", {0, 1}),
+                           addInts(g, "rsteps", {kMin, -2})});
+  InferShapes(g);
+  expectShape({1, 3}, forward->output());
+  expectShape({1, 4}, backward->output());
+}
+
+TEST(ShapeInferenceTest, BroadcastAndTypes) {
+  Graph g;
+  Value* a = addInput(g, "a", {sym("N"), 1, 3});
+  Value* b = addInput(g, "b", {5, 1});
+  Node* add = append(g, kAdd, {a, b});
+  Node* less = append(g, kLess, {a, b});
+  Node* cast = append(g, kCast, {add->output()});
+  cast->i_(kto, TensorProto_DataType_FLOAT16);
+  InferShapes(g);
+
+  expectShape({sym("N"), 5, 3}, add->output());
+  EXPECT_EQ(TensorProto_DataType_BOOL, less->output()->elemType());
+  EXPECT_EQ(TensorProto_DataType_FLOAT16, cast->output()->elemType());
+  expectShape({sym("N"), 5, 3}, cast->output());
+}
+
+TEST(ShapeInferenceTest, IncrementalUpdate) {
+  Graph g;
+  Value* x = addInput(g, "x", {sym("N"), 16});
+  Node* relu = append(g, kRelu, {x});
+  Node* neg = append(g, kNeg, {relu->output()});
+  Node* tanh = append(g, kTanh, {neg->output()});
+  // a branch that does not depend on the rewrite
+  Node* other = append(g, kSigmoid, {addInput(g, "y", {4})});
+  g.registerOutput(tanh->output());
+  g.registerOutput(other->output());
+  InferShapes(g);
+  expectShape({sym("N"), 16}, tanh->output());
+
+  // rewrite: neg now reads a differently shaped value
+  Value* z = addInput(g, "z", {sym("N"), 32});
+  neg->replaceInput(0, z);
+  EXPECT_EQ(2u, UpdateShapes({neg}));  // neg, then tanh
+  expectShape({sym("N"), 32}, tanh->output());
+
+  // nothing changes, so the users are not visited
+  EXPECT_EQ(1u, UpdateShapes({neg}));
+}
+
+TEST(ShapeInferenceTest, IncrementalUpdateThroughSubgraphs) {
+  Graph g;
+  Value* cond = addInput(g, "cond", {}, TensorProto_DataType_BOOL);
+  Value* x = addInput(g, "x", {2, 3});
+  Node* relu = append(g, kRelu, {x});
+  relu->output()->setUniqueName("r");
+
+  auto make_branch = [](NodeKind kind) {
+    auto branch = std::make_shared<Graph>();
+    Node* captured = branch->create(kCaptured, 1);
+    branch->appendNode(captured);
+    captured->output()->setUniqueName("r");
+    Node* n = branch->create(kind, {captured->output()}, 1);
+    branch->appendNode(n);
+    branch->registerOutput(n->output());
+    return branch;
+  };
+  Node* if_node = append(g, kIf, {cond});
+  if_node->g_(kthen_branch, make_branch(kNeg));
+  if_node->g_(kelse_branch, make_branch(kIdentity));
+  Node* after = append(g, kSigmoid, {if_node->output()});
+  InferShapes(g);
+  expectShape({2, 3}, if_node->output());
+  expectShape({2, 3}, after->output());
+
+  // relu's input changes shape, the change reaches the If through its
+  // branches and then the If's users
+  relu->replaceInput(0, addInput(g, "x2", {7, 3}));
+  UpdateShapes({relu});
+  Graph& then_branch = *if_node->g(kthen_branch);
+  expectShape({7, 3}, (*then_branch.begin())->output());
+  expectShape({7, 3}, if_node->output());
+  expectShape({7, 3}, after->output());
+}
+
+TEST(ShapeInferenceTest, IncrementalUpdateFromSubgraphs) {
+  Graph g;
+  Value* cond = addInput(g, "cond", {}, TensorProto_DataType_BOOL);
+  addInput(g, "x", {2, 3});
+  addInput(g, "x2", {5, 3});
+
+  auto make_branch = [](const std::string& name) {
+    auto branch = std::make_shared<Graph>();
+    Node* captured = branch->create(kCaptured, 1);
+    branch->appendNode(captured);
+    captured->output()->setUniqueName(name);
+    Node* n = branch->create(kNeg, {captured->output()}, 1);
+    branch->appendNode(n);
+    branch->registerOutput(n->output());
+    return branch;
+  };
+  auto then_branch = make_branch("x");
+  Node* if_node = append(g, kIf, {cond});
+  if_node->g_(kthen_branch, then_branch);
+  if_node->g_(kelse_branch, then_branch);
+  Node* after = append(g, kSigmoid, {if_node->output()});
+  InferShapes(g);
+  expectShape({2, 3}, after->output());
+
+  // the Neg in the branch now reads x2
+  Node* neg = then_branch->outputs()[0]->node();
+  Node* captured = then_branch->create(kCaptured, 1);
+  captured->insertBefore(neg);
+  captured->output()->setUniqueName("x2");
+  captured->output()->setSizes({5, 3});
+  neg->replaceInput(0, captured->output());
+  EXPECT_EQ(3u, UpdateShapes({neg}, nullptr, &g));  // neg, If, Sigmoid
+  expectShape({5, 3}, if_node->output());
+  expectShape({5, 3}, after->output());
+}
+
+TEST(ShapeInferenceTest, CustomRule) {
+  NodeKind kind(Symbol("ShapeInferenceTestOp"));
+  EXPECT_FALSE(HasShapeInference(kind));
+  RegisterShapeInference(kind, [](InferenceContext& ctx) {
+    ctx.setOutputType(0, TensorProto_DataType_INT8);
+    ctx.setOutputShape(0, Shape{ctx.inputShape(0)[0], 2});
+  });
+  EXPECT_TRUE(HasShapeInference(kind));
+
+  Graph g;
+  Node* n = append(g, kind, {addInput(g, "x", {sym("B"), 9})});
+  InferShapes(g);
+  EXPECT_EQ(TensorProto_DataType_INT8, n->output()->elemType());
+  expectShape({sym("B"), 2}, n->output());
+}
+
+}  // namespace
+}  // namespace my_ai_training::ir
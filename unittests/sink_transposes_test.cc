@@ -0,0 +1,124 @@
+#include "optimizer/sink_transposes.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "graph_helpers.h"
+#include "optimizer/fold_constants.h"
+
+namespace my_ai_training::optimization {
+namespace {
+
+using ir::Graph;
+using ir::Node;
+using ir::Value;
+using namespace my_ai_training::test;  // NOLINT
+
+Node* transpose(Graph& g, Value* x, std::vector<int64_t> perm) {
+  Node* n = append(g, ir::kTranspose, {x});
+  n->is_(ir::kperm, std::move(perm));
+  return n;
+}
+
+Value* shape(Graph& g, std::vector<int64_t> values) {
+  ir::Tensor t(ir::TensorProto_DataType_INT64,
+               {static_cast<int64_t>(values.size())});
+  t.setRawData(values.data(), values.size() * sizeof(int64_t));
+  return g.addInitializerAndCreateValue(t);
+}
+
+std::vector<ir::NodeKind> kinds(const Graph& g) {
+  std::vector<ir::NodeKind> result;
+  for (const Node* n : g.nodes()) result.push_back(n->kind());
+  return result;
+}
+
+size_t sink(Graph& g) {
+  AnalysisManager analyses;
+  return SinkTransposes().runPass(g, analyses).num_changes;
+}
+
+TEST(SinkTransposesTest, CancelsThroughElementwiseOps) {
+  // NCHW -> NHWC, Relu, x + 1 and + the same layout of y, back to NCHW
+  Graph g;
+  Value* x = input(g, {1, 2, 3, 4});
+  Value* y = input(g, {1, 2, 3, 4});
+  Node* tx = transpose(g, x, {0, 2, 3, 1});
+  Node* relu = append(g, ir::kRelu, {tx->output()});
+  ir::Tensor one(ir::TensorProto_DataType_FLOAT, {1});
+  one.allocate();
+  Node* add_one = append(
+      g, ir::kAdd, {relu->output(), g.addInitializerAndCreateValue(one)});
+  Node* ty = transpose(g, y, {0, 2, 3, 1});
+  Node* add = append(g, ir::kAdd, {add_one->output(), ty->output()});
+  Node* back = transpose(g, add->output(), {0, 3, 1, 2});
+  back->output()->setUniqueName("out");
+  g.registerOutput(back->output());
+
+  EXPECT_LT(0u, sink(g));
+  EXPECT_EQ(std::vector<ir::NodeKind>({ir::kRelu, ir::kAdd, ir::kAdd}),
+            kinds(g));
+  EXPECT_EQ(x, relu->input());
+  EXPECT_EQ(y, add->input(1));
+  EXPECT_EQ(add->output(), g.outputs()[0]);
+  EXPECT_EQ("out", add->output()->uniqueName());
+}
+
+TEST(SinkTransposesTest, KeepsTransposesReadElsewhere) {
+  Graph g;
+  Value* x = input(g, {2, 3});
+  Node* t = transpose(g, x, {1, 0});
+  Node* relu = append(g, ir::kRelu, {t->output()});
+  g.registerOutput(relu->output());
+  g.registerOutput(t->output());
+  // a transpose of an input back to the same graph output name stays
+  Graph h;
+  Node* twice = transpose(h, transpose(h, h.addInput(), {1, 0})->output(),
+                          {1, 0});
+  h.registerOutput(twice->output());
+
+  EXPECT_EQ(0u, sink(g));
+  EXPECT_EQ(1u, sink(h));
+  EXPECT_EQ(std::vector<ir::NodeKind>({ir::kTranspose}), kinds(h));
+  EXPECT_EQ(std::vector<int64_t>({0, 1}), twice->is(ir::kperm));
+}
+
+TEST(SinkTransposesTest, Reshapes) {
+  Graph g;
+  Value* x = input(g, {2, 1, 3});
+  // only moves the dim of extent 1, so it becomes a Reshape to [1, 2, 3]
+  Node* t = transpose(g, x, {1, 0, 2});
+  Node* a = append(g, ir::kReshape, {t->output(), shape(g, {6})});
+  Node* b = append(g, ir::kReshape, {a->output(), shape(g, {3, 2})});
+  // already has the shape it reshapes to
+  Value* y = input(g, {3, 2});
+  Node* c = append(g, ir::kReshape, {y, shape(g, {3, 2})});
+  c->output()->setSizes({3, 2});
+  Node* add = append(g, ir::kAdd, {b->output(), c->output()});
+  g.registerOutput(add->output());
+
+  EXPECT_EQ(4u, sink(g));
+  EXPECT_EQ(std::vector<ir::NodeKind>({ir::kReshape, ir::kAdd}), kinds(g));
+  EXPECT_EQ(b, add->input(0)->node());
+  EXPECT_EQ(x, b->input(0));
+  EXPECT_EQ(y, add->input(1));
+}
+
+TEST(SinkTransposesTest, KeepsPermsOfAnotherRank) {
+  Graph g;
+  Value* x = input(g, {2, 1, 3});
+  // perms of another rank than the input's do not become Reshapes
+  Node* t = transpose(g, x, {0, 2, 1, 3});
+  Node* u = transpose(g, x, {1, 0});
+  g.registerOutput(t->output());
+  g.registerOutput(u->output());
+
+  EXPECT_EQ(0u, sink(g));
+  EXPECT_EQ(std::vector<ir::NodeKind>({ir::kTranspose, ir::kTranspose}),
+            kinds(g));
+}
+
+}  // namespace
+}  // namespace my_ai_training::optimization
@@ -0,0 +1,211 @@
+#include "onnx_ir/snapshot.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "onnx_ir/importer.h"
+#include "proto_writer.h"
+
+namespace my_ai_training::ir {
+namespace {
+
+using namespace my_ai_training::test;  // NOLINT
+
+std::vector<Node*> nodesOf(Graph& g) { return {g.begin(), g.end()}; }
+
+std::unique_ptr<Graph> loadString(const std::string& bytes) {
+  auto owner = std::make_shared<std::string>(bytes);
+  return LoadSnapshotFromBuffer(owner->data(), owner->size(), owner);
+}
+
+// If(cond) { Neg(y) } else { Identity(y) } over y = MatMul(x, w) + b, with
+// 'x' also backed by an initializer
+std::unique_ptr<Graph> buildModel() {
+  GraphProtoBuilder then_branch;
+  then_branch.name = "then";
+  then_branch.nodes.push_back(nodeProto("Neg", {"y"}, {"then_out"}));
+  then_branch.outputs.push_back(
+      valueInfo("then_out", TensorProto_DataType_FLOAT, {-1, 2}));
+  GraphProtoBuilder else_branch;
+  else_branch.name = "else";
+  else_branch.nodes.push_back(nodeProto("Identity", {"y"}, {"else_out"}));
+  else_branch.outputs.push_back(
+      valueInfo("else_out", TensorProto_DataType_FLOAT, {-1, 2}));
+
+  std::vector<float> w = {1, 2, 3, 4, 5, 6};
+  GraphProtoBuilder b;
+  b.name = "main";
+  b.inputs.push_back(valueInfo("cond", TensorProto_DataType_BOOL, {}));
+  b.inputs.push_back(valueInfo("x", TensorProto_DataType_FLOAT, {-1, 3}));
+  b.initializers.push_back(floatTensorProto("x", {1, 3}, {7, 8, 9}));
+  b.initializers.push_back(tensorProto("w", TensorProto_DataType_FLOAT,
+                                       {3, 2}, w.data(),
+                                       w.size() * sizeof(float)));
+  b.initializers.push_back(floatTensorProto("b", {2}, {0.5f, -0.5f}));
+  b.nodes.push_back(nodeProto("MatMul", {"x", "w"}, {"m"}));
+  b.nodes.push_back(nodeProto("Add", {"m", "b"}, {"y"},
+                              {intsAttr("perm", {1, 0}), intAttr("axis", -1),
+                               floatAttr("alpha", 0.25f)}));
+  b.nodes.push_back(nodeProto("If", {"cond"}, {"out"},
+                              {graphAttr("then_branch", then_branch.build()),
+                               graphAttr("else_branch", else_branch.build())}));
+  b.outputs.push_back(valueInfo("out", TensorProto_DataType_FLOAT, {-1, 2}));
+  auto model = std::make_shared<std::string>(modelProto(b.build(), 13));
+  return ImportModelFromBuffer(model->data(), model->size(), model);
+}
+
+void expectSameGraph(Graph& expected, Graph& actual) {
+  EXPECT_EQ(expected.name(), actual.name());
+  ASSERT_EQ(expected.inputs().size(), actual.inputs().size());
+  for (size_t i = 0; i < expected.inputs().size(); i++) {
+    Value* e = expected.inputs()[i];
+    Value* a = actual.inputs()[i];
+    EXPECT_EQ(e->uniqueName(), a->uniqueName());
+    EXPECT_EQ(e->elemType(), a->elemType());
+    EXPECT_TRUE(e->sizes().equals(a->sizes()));
+  }
+  EXPECT_EQ(expected.initializer_names(), actual.initializer_names());
+  for (size_t i = 0; i < expected.initializers().size(); i++) {
+    const Tensor& e = expected.initializers()[i];
+    const Tensor& a = actual.initializers()[i];
+    EXPECT_EQ(e.sizes(), a.sizes());
+    ASSERT_EQ(e.byteSize(), a.byteSize());
+    EXPECT_EQ(0, std::memcmp(e.rawData(), a.rawData(), e.byteSize()));
+  }
+  ASSERT_EQ(expected.initializerValues().size(),
+            actual.initializerValues().size());
+
+  auto e_nodes = nodesOf(expected);
+  auto a_nodes = nodesOf(actual);
+  ASSERT_EQ(e_nodes.size(), a_nodes.size());
+  for (size_t i = 0; i < e_nodes.size(); i++) {
+    Node* e = e_nodes[i];
+    Node* a = a_nodes[i];
+    EXPECT_EQ(e->kind(), a->kind());
+    EXPECT_EQ(e->attributeNames(), a->attributeNames());
+    ASSERT_EQ(e->inputs().size(), a->inputs().size());
+    for (size_t j = 0; j < e->inputs().size(); j++) {
+      EXPECT_EQ(e->inputs()[j]->uniqueName(), a->inputs()[j]->uniqueName());
+    }
+    ASSERT_EQ(e->outputs().size(), a->outputs().size());
+    for (size_t j = 0; j < e->outputs().size(); j++) {
+      EXPECT_EQ(e->outputs()[j]->uniqueName(), a->outputs()[j]->uniqueName());
+      EXPECT_EQ(e->outputs()[j]->elemType(), a->outputs()[j]->elemType());
+    }
+  }
+  ASSERT_EQ(expected.outputs().size(), actual.outputs().size());
+  for (size_t i = 0; i < expected.outputs().size(); i++) {
+    EXPECT_EQ(expected.outputs()[i]->uniqueName(),
+              actual.outputs()[i]->uniqueName());
+  }
+}
+
+TEST(SnapshotTest, RoundTrip) {
+  auto g = buildModel();
+  std::string bytes = SerializeSnapshot(*g);
+  auto loaded = loadString(bytes);
+  expectSameGraph(*g, *loaded);
+
+  ASSERT_EQ(1u, loaded->opset_versions().size());
+  EXPECT_EQ(13, loaded->opset_versions()[0].version());
+  // 'x' is a graph input, so it has no initializer value
+  ASSERT_EQ(2u, loaded->initializerValues().size());
+  EXPECT_EQ("w", loaded->initializerValues()[0]->uniqueName());
+
+  auto nodes = nodesOf(*loaded);
+  EXPECT_EQ(loaded->inputs()[1], nodes[0]->inputs()[0]);
+  EXPECT_EQ(loaded->initializerValues()[0], nodes[0]->inputs()[1]);
+  EXPECT_EQ(nodes[0]->output(), nodes[1]->inputs()[0]);
+  EXPECT_EQ(std::vector<int64_t>({1, 0}), nodes[1]->is(kperm));
+  EXPECT_EQ(-1, nodes[1]->i(kaxis));
+  EXPECT_DOUBLE_EQ(0.25, nodes[1]->f(kalpha));
+  EXPECT_EQ(nodes[2]->output(), loaded->outputs()[0]);
+
+  // subgraphs capture by name, as after import
+  auto& then_graph = nodes[2]->g(kthen_branch);
+  EXPECT_EQ("then", then_graph->name());
+  auto then_nodes = nodesOf(*then_graph);
+  ASSERT_EQ(2u, then_nodes.size());
+  EXPECT_EQ(kCaptured, then_nodes[0]->kind());
+  EXPECT_EQ(2u, nodes[1]->output()->uses().size());
+  expectSameGraph(*nodesOf(*g)[2]->g(kelse_branch),
+                  *nodes[2]->g(kelse_branch));
+
+  // serializing again gives the same bytes
+  EXPECT_EQ(bytes, SerializeSnapshot(*loaded));
+}
+
+TEST(SnapshotTest, MappedPayloadsAreAligned) {
+  auto g = buildModel();
+  std::string path = ::testing::TempDir() + "/snapshot_test.snap";
+  SaveSnapshot(*g, path);
+  auto loaded = LoadSnapshot(path);
+  std::remove(path.c_str());
+
+  for (const Tensor& t : loaded->initializers()) {
+    EXPECT_TRUE(t.isBorrowed());
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(t.rawData()) % 64);
+  }
+  // the mapping outlives the file name
+  auto w = loaded->getInitializer("w");
+  EXPECT_EQ(6.f, w->data<float>()[5]);
+  // and is never written to
+  Tensor copy = *w;
+  copy.mutableData<float>()[0] = 42.f;
+  EXPECT_EQ(1.f, w->data<float>()[0]);
+}
+
+TEST(SnapshotTest, Malformed) {
+  std::string bytes = SerializeSnapshot(*buildModel());
+
+  std::string bad_magic = bytes;
+  bad_magic[0] = 'X';
+  EXPECT_THROW(loadString(bad_magic), assert_error);
+
+  std::string bad_version = bytes;
+  bad_version[8] = static_cast<char>(kSnapshotVersion + 1);
+  EXPECT_THROW(loadString(bad_version), assert_error);
+
+  std::string truncated = bytes.substr(0, bytes.size() - 1);
+  EXPECT_THROW(loadString(truncated), assert_error);
+
+  EXPECT_THROW(loadString("MATSNAP"), assert_error);
+}
+
+// 'bytes' with the uint32 or uint64 at 'offset' in the first record of
+// section 'section' replaced, after the header layout of snapshot.cc: 24
+// bytes, then an {offset, count} pair of uint64 per section
+template <typename T>
+std::string patchRecord(std::string bytes, int section, size_t offset,
+                        T value) {
+  uint64_t table;
+  std::memcpy(&table, &bytes[24 + 16 * section], sizeof(table));
+  std::memcpy(&bytes[table + offset], &value, sizeof(value));
+  return bytes;
+}
+
+TEST(SnapshotTest, DamagedRecords) {
+  std::string bytes = SerializeSnapshot(*buildModel());
+  constexpr int kNodes = 4, kTensors = 6;
+  // the first initializer, x, holds 12 bytes
+  ASSERT_NE(nullptr,
+            loadString(patchRecord<uint64_t>(bytes, kTensors, 32, 12)));
+
+  // a node kind past the strings
+  EXPECT_THROW(loadString(patchRecord<uint32_t>(bytes, kNodes, 0, 1u << 30)),
+               assert_error);
+  // an initializer of an unknown element type, or with a payload that is
+  // not its 3 floats
+  EXPECT_THROW(loadString(patchRecord<int32_t>(bytes, kTensors, 4, 99)),
+               assert_error);
+  EXPECT_THROW(loadString(patchRecord<uint64_t>(bytes, kTensors, 32, 8)),
+               assert_error);
+}
+
+}  // namespace
+}  // namespace my_ai_training::ir
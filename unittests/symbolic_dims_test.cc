@@ -0,0 +1,162 @@
+#include "onnx_ir/symbolic_dims.h"
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "onnx_ir/shape_inference.h"
+
+namespace my_ai_training::ir {
+namespace {
+
+using Shape = std::vector<Dimension>;
+
+Dimension sym(const std::string& name) { return Dimension(name); }
+
+std::string text(const Dimension& d) {
+  if (d.is_int()) return std::to_string(d.dim());
+  return d.is_param() ? d.param().toString() : "?";
+}
+
+TEST(SymbolicDimsTest, Canonical) {
+  Dimension n = sym("N"), s = sym("S");
+  EXPECT_EQ("N*S", text(mulDims(n, s)));
+  EXPECT_EQ(mulDims(n, s), mulDims(s, n));
+  // a dim_param that is an expression means that expression
+  EXPECT_EQ(mulDims(n, s), addDims(sym("S * N"), Dimension(int64_t{0})));
+  EXPECT_EQ("S + 1", text(addDims(s, Dimension(int64_t{1}))));
+  EXPECT_EQ(s, subDims(addDims(s, Dimension(int64_t{1})),
+                       Dimension(int64_t{1})));
+  EXPECT_EQ("2*N*S + S - 1",
+            text(subDims(mulDims(addDims(mulDims(n, Dimension(int64_t{2})),
+                                         Dimension(int64_t{1})),
+                                 s),
+                         Dimension(int64_t{1}))));
+  EXPECT_EQ(Dimension(int64_t{0}), subDims(mulDims(n, s), sym("S*N")));
+  EXPECT_TRUE(addDims(n, Dimension()).is_unknown());
+
+  // exact division cancels, inexact division is floored
+  EXPECT_EQ(n, divDims(mulDims(n, s), s));
+  EXPECT_EQ("N + 1", text(divDims(sym("2*N + 3"), Dimension(int64_t{2}))));
+  Dimension half = divDims(addDims(n, Dimension(int64_t{1})),
+                           Dimension(int64_t{2}));
+  EXPECT_EQ("floor((N + 1)/2)", text(half));
+  EXPECT_EQ(half, divDims(sym("N+1"), Dimension(int64_t{2})));
+  EXPECT_EQ("N + floor((N + 1)/2)", text(divDims(sym("3*N + 1"),
+                                                  Dimension(int64_t{2}))));
+
+  // names that are not identifiers stay one symbol
+  Dimension odd = sym("batch size");
+  EXPECT_EQ(odd, mulDims(odd, Dimension(int64_t{1})));
+  EXPECT_EQ("2*[batch size]", text(mulDims(odd, Dimension(int64_t{2}))));
+  EXPECT_EQ(mulDims(odd, Dimension(int64_t{2})), sym("2*[batch size]"));
+
+  // overflow gives up instead of wrapping
+  Dimension big(Dimension::kMaxDim);
+  EXPECT_TRUE(mulDims(big, Dimension(int64_t{8})).is_unknown());
+  EXPECT_TRUE(mulDims(mulDims(big, n), Dimension(int64_t{8})).is_unknown());
+}
+
+TEST(SymbolicDimsTest, Solver) {
+  DimSolver solver;
+  // S + 1 == T + 1 renames T
+  EXPECT_TRUE(solver.unify(sym("S + 1"), sym("T+1")));
+  EXPECT_EQ(sym("S"), solver.resolve(sym("T")));
+  EXPECT_EQ("2*S", text(solver.resolve(sym("S + T"))));
+  // 2*M == 2*N*S + 4
+  EXPECT_TRUE(solver.unify(sym("2*N*S + 4"), sym("2*M")));
+  EXPECT_EQ("N*S + 2", text(solver.resolve(sym("M"))));
+  EXPECT_FALSE(solver.unify(sym("S + 1"), sym("S")));
+  EXPECT_EQ(2u, solver.numSolved());
+
+  // a bucket: bind the free symbols on a copy and evaluate
+  DimSolver bucket = solver;
+  EXPECT_TRUE(bucket.bind("N", 4));
+  EXPECT_TRUE(bucket.bind("S", 128));
+  std::vector<int64_t> sizes;
+  ASSERT_TRUE(
+      bucket.evaluate(Shape{sym("M"), sym("T"), sym("floor((S + 1)/2)")},
+                      &sizes));
+  EXPECT_EQ(std::vector<int64_t>({514, 128, 64}), sizes);
+  EXPECT_FALSE(bucket.bind("T", 127));
+  // the original is untouched
+  int64_t value;
+  EXPECT_FALSE(solver.evaluate(sym("M"), &value));
+}
+
+TEST(SymbolicDimsTest, OutlivesTheCaches) {
+  DimExpr half = (DimExpr(Symbol("N")) + DimExpr(1)).floorDiv(2);
+  // more params and floor() factors than the caches hold
+  for (int i = 0; i < 10000; i++) {
+    divDims(sym("S" + std::to_string(i) + " + 1"), Dimension(int64_t{3}));
+  }
+  EXPECT_EQ("floor((N + 1)/2)", half.toString());
+  DimExpr value = half.substitute([](Symbol s, DimExpr* e) {
+    *e = DimExpr(6);
+    return s == Symbol("N");
+  });
+  ASSERT_TRUE(value.isConstant());
+  EXPECT_EQ(3, value.constant());
+}
+
+TEST(SymbolicDimsTest, PropagatesThroughShapeOps) {
+  Graph g;
+  auto input = [&](const std::string& name, Shape shape) {
+    Value* v = g.addInput();
+    v->setUniqueName(name);
+    v->setElemType(TensorProto_DataType_FLOAT);
+    v->setSizes(shape);
+    return v;
+  };
+  auto ints = [&](const std::string& name, std::vector<int64_t> values) {
+    Tensor t(TensorProto_DataType_INT64,
+             {static_cast<int64_t>(values.size())});
+    t.setRawData(values.data(), values.size() * sizeof(int64_t));
+    t.setName(name);
+    return g.addInitializerAndCreateValue(t);
+  };
+  auto append = [&](NodeKind kind, std::vector<Value*> inputs) {
+    return g.appendNode(g.create(kind, inputs, 1));
+  };
+  const int64_t kEnd = std::numeric_limits<int64_t>::max();
+  Value* cls = input("cls", {sym("N"), 1, 64});
+  Value* x = input("x", {sym("B"), sym("S"), 64});
+  // [cls; x] along the sequence: B is N
+  Node* concat = append(kConcat, {cls, x});
+  concat->i_(kaxis, 1);
+  Node* slice = append(kSlice, {concat->output(), ints("starts", {1}),
+                                ints("ends", {kEnd}), ints("axes", {1})});
+  Node* reshape = append(kReshape, {slice->output(), ints("shape", {-1, 64})});
+  Node* flatten = append(kFlatten, {x});
+  flatten->i_(kaxis, 2);
+  Node* add = append(kAdd, {reshape->output(), flatten->output()});
+  Node* pool = append(kReshape, {concat->output(), ints("pool", {0, -1})});
+  DimSolver solver;
+  InferShapes(g, &solver);
+
+  EXPECT_EQ(Shape({sym("N"), sym("S"), 64}), x->sizes().vec());
+  EXPECT_EQ(Shape({sym("N"), sym("S + 1"), 64}),
+            concat->output()->sizes().vec());
+  EXPECT_EQ(Shape({sym("N"), sym("S"), 64}), slice->output()->sizes().vec());
+  EXPECT_EQ(Shape({sym("N*S"), 64}), reshape->output()->sizes().vec());
+  EXPECT_EQ(reshape->output()->sizes().vec(),
+            flatten->output()->sizes().vec());
+  EXPECT_EQ(Shape({sym("N*S"), 64}), add->output()->sizes().vec());
+  EXPECT_EQ(Shape({sym("N"), sym("64*S + 64")}),
+            pool->output()->sizes().vec());
+
+  // buffer sizes for one bucket
+  DimSolver bucket = solver;
+  bucket.bind("N", 2);
+  bucket.bind("S", 10);
+  std::vector<int64_t> sizes;
+  ASSERT_TRUE(bucket.evaluate(concat->output()->sizes(), &sizes));
+  EXPECT_EQ(std::vector<int64_t>({2, 11, 64}), sizes);
+  ASSERT_TRUE(bucket.evaluate(pool->output()->sizes(), &sizes));
+  EXPECT_EQ(std::vector<int64_t>({2, 704}), sizes);
+}
+
+}  // namespace
+}  // namespace my_ai_training::ir
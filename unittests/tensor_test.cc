@@ -0,0 +1,88 @@
+#include "onnx_ir/tensor.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace my_ai_training::ir {
+namespace {
+
+Tensor makeFloatTensor(const std::vector<float>& values) {
+  Tensor t(TensorProto_DataType_FLOAT, {static_cast<int64_t>(values.size())});
+  t.setRawData(values.data(), values.size() * sizeof(float));
+  return t;
+}
+
+TEST(TensorTest, ElemSize) {
+  EXPECT_EQ(4u, elemSizeOf(TensorProto_DataType_FLOAT));
+  EXPECT_EQ(8u, elemSizeOf(TensorProto_DataType_INT64));
+  EXPECT_EQ(2u, elemSizeOf(TensorProto_DataType_FLOAT16));
+  EXPECT_EQ(0u, elemSizeOf(TensorProto_DataType_STRING));
+}
+
+TEST(TensorTest, Sizes) {
+  Tensor t(TensorProto_DataType_FLOAT, {2, 3, 4});
+  EXPECT_EQ(24, t.numel());
+  EXPECT_EQ(12, t.size_from_dim(1));
+  EXPECT_EQ(4, t.size_from_dim(-1));
+  EXPECT_EQ(96u, t.expectedByteSize());
+  EXPECT_FALSE(t.hasRawData());
+}
+
+TEST(TensorTest, CopySharesPayload) {
+  Tensor a = makeFloatTensor({1.f, 2.f, 3.f});
+  Tensor b = a;
+  EXPECT_TRUE(a.isShared());
+  EXPECT_EQ(a.rawData(), b.rawData());
+}
+
+TEST(TensorTest, CopyOnWrite) {
+  Tensor a = makeFloatTensor({1.f, 2.f, 3.f});
+  const void* original = a.rawData();
+  Tensor b = a;
+  b.mutableData<float>()[0] = 42.f;
+  EXPECT_NE(original, b.rawData());
+  EXPECT_EQ(original, a.rawData());
+  EXPECT_EQ(1.f, a.data<float>()[0]);
+  EXPECT_EQ(42.f, b.data<float>()[0]);
+  EXPECT_FALSE(a.isShared());
+
+  // sole owner writes in place
+  a.mutableData<float>()[1] = 7.f;
+  EXPECT_EQ(original, a.rawData());
+}
+
+TEST(TensorTest, BorrowedPayload) {
+  auto storage = std::make_shared<std::vector<float>>(
+      std::vector<float>{4.f, 5.f, 6.f});
+  std::weak_ptr<std::vector<float>> watch = storage;
+
+  Tensor t(TensorProto_DataType_FLOAT, {3});
+  t.setBuffer(TensorBuffer::borrow(storage->data(), 3 * sizeof(float),
+                                   storage));
+  storage.reset();
+  EXPECT_FALSE(watch.expired());
+  EXPECT_TRUE(t.isBorrowed());
+  EXPECT_EQ(5.f, t.data<float>()[1]);
+
+  // first write detaches from the borrowed memory and releases it
+  t.mutableData<float>()[1] = 0.f;
+  EXPECT_FALSE(t.isBorrowed());
+  EXPECT_TRUE(watch.expired());
+  EXPECT_EQ(4.f, t.data<float>()[0]);
+  EXPECT_EQ(0.f, t.data<float>()[1]);
+}
+
+TEST(TensorTest, Alignment) {
+  Tensor t(TensorProto_DataType_FLOAT, {5});
+  void* p = t.allocate();
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(p) % TensorBuffer::kAlignment);
+}
+
+TEST(TensorTest, TypeMismatch) {
+  Tensor t = makeFloatTensor({1.f});
+  EXPECT_THROW(t.data<int64_t>(), tensor_error);
+}
+
+}  // namespace
+}  // namespace my_ai_training::ir
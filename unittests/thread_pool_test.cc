@@ -0,0 +1,56 @@
+#include "common/thread_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace my_ai_training {
+namespace {
+
+TEST(ThreadPoolTest, Schedule) {
+  std::atomic<int> count{0};
+  {
+    ThreadPool pool(3);
+    EXPECT_EQ(3, pool.numThreads());
+    for (int i = 0; i < 100; i++) pool.schedule([&count]() { count++; });
+  }
+  // the destructor drains the queue
+  EXPECT_EQ(100, count.load());
+}
+
+TEST(ThreadPoolTest, ParallelFor) {
+  ThreadPool pool(4);
+  std::vector<int> hits(1000, 0);
+  pool.parallelFor(hits.size(), [&hits](size_t i) { hits[i]++; });
+  for (int hit : hits) EXPECT_EQ(1, hit);
+
+  pool.parallelFor(0, [](size_t) { FAIL(); });
+}
+
+TEST(ThreadPoolTest, NestedParallelFor) {
+  // more nested loops than workers must not deadlock
+  ThreadPool pool(2);
+  std::atomic<int> count{0};
+  pool.parallelFor(8, [&](size_t) {
+    pool.parallelFor(8, [&](size_t) { count++; });
+  });
+  EXPECT_EQ(64, count.load());
+}
+
+TEST(ThreadPoolTest, ParallelForRethrows) {
+  ThreadPool pool(2);
+  std::atomic<int> count{0};
+  EXPECT_THROW(pool.parallelFor(16,
+                                [&count](size_t i) {
+                                  count++;
+                                  if (i == 5) throw std::runtime_error("5");
+                                }),
+               std::runtime_error);
+  // the other calls still ran
+  EXPECT_EQ(16, count.load());
+}
+
+}  // namespace
+}  // namespace my_ai_training
@@ -0,0 +1,109 @@
+#include "common/work_stealing_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace my_ai_training {
+namespace {
+
+TEST(ChaseLevDequeTest, OwnerPopsNewestThievesStealOldest) {
+  ChaseLevDeque<int> deque(2);
+  EXPECT_TRUE(deque.empty());
+  // grows past the initial capacity
+  for (int i = 0; i < 10; i++) deque.push(i);
+  int item = -1;
+  EXPECT_TRUE(deque.pop(&item));
+  EXPECT_EQ(9, item);
+  EXPECT_TRUE(deque.steal(&item));
+  EXPECT_EQ(0, item);
+  for (int i = 0; i < 8; i++) EXPECT_TRUE(deque.pop(&item));
+  EXPECT_EQ(1, item);
+  EXPECT_FALSE(deque.pop(&item));
+  EXPECT_FALSE(deque.steal(&item));
+}
+
+TEST(ChaseLevDequeTest, EveryItemIsTakenOnce) {
+  constexpr int kItems = 100000;
+  ChaseLevDeque<int> deque(4);
+  std::vector<std::atomic<int>> taken(kItems);
+  std::atomic<bool> done{false};
+  std::vector<std::thread> thieves;
+  for (int t = 0; t < 3; t++) {
+    thieves.emplace_back([&]() {
+      int item;
+      while (!done.load()) {
+        if (deque.steal(&item)) taken[item]++;
+      }
+    });
+  }
+  int item;
+  for (int i = 0; i < kItems; i++) {
+    deque.push(i);
+    // the owner takes some back, racing the thieves for the last one
+    if (i % 3 == 0 && deque.pop(&item)) taken[item]++;
+  }
+  while (deque.pop(&item)) taken[item]++;
+  done = true;
+  for (auto& thief : thieves) thief.join();
+  for (int i = 0; i < kItems; i++) EXPECT_EQ(1, taken[i].load()) << i;
+}
+
+// a binary tree of tasks, each spawning its children
+class TreeTask : public WorkStealingPool::Task {
+ public:
+  void run() override {
+    (*count)++;
+    for (size_t child : {2 * index + 1, 2 * index + 2}) {
+      if (child < tasks->size()) pool->spawn(&(*tasks)[child]);
+    }
+  }
+
+  WorkStealingPool* pool;
+  std::vector<TreeTask>* tasks;
+  size_t index;
+  std::atomic<int>* count;
+};
+
+TEST(WorkStealingPoolTest, TasksSpawnTasks) {
+  std::atomic<int> count{0};
+  std::vector<TreeTask> tasks(10000);
+  {
+    WorkStealingPool pool(3);
+    EXPECT_EQ(3, pool.numThreads());
+    EXPECT_EQ(-1, pool.currentWorker());
+    for (size_t i = 0; i < tasks.size(); i++) {
+      tasks[i].pool = &pool;
+      tasks[i].tasks = &tasks;
+      tasks[i].index = i;
+      tasks[i].count = &count;
+    }
+    pool.spawn(&tasks[0]);
+  }
+  // the destructor runs the tasks still queued
+  EXPECT_EQ(10000, count.load());
+}
+
+TEST(WorkStealingPoolTest, WakesSleepingWorkers) {
+  std::atomic<int> count{0};
+  std::vector<TreeTask> tasks(1);
+  // destroyed first, joining the workers before the task goes away
+  WorkStealingPool pool(2);
+  tasks[0].pool = &pool;
+  tasks[0].tasks = &tasks;
+  tasks[0].index = 0;
+  tasks[0].count = &count;
+  for (int round = 1; round <= 3; round++) {
+    // long enough for the workers to stop spinning
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    pool.spawn(&tasks[0]);
+    while (count.load() < round) std::this_thread::yield();
+  }
+  EXPECT_EQ(3, count.load());
+}
+
+}  // namespace
+}  // namespace my_ai_training